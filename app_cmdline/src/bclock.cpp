@@ -0,0 +1,123 @@
+/*
+ Copyright 2009 Eigenlabs Ltd.  http://www.eigenlabs.com
+
+ This file is part of EigenD.
+
+ EigenD is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ EigenD is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with EigenD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <picross/pic_config.h>
+
+#include <piagent/pia_scaffold.h>
+#include <piw/piw_client.h>
+#include <piw/piw_tsd.h>
+
+#include <string.h>
+
+/*
+ * bclock server [on|off]
+ *
+ * Print the clock timing report published by a piw::clockstats_t server,
+ * or switch timing on or off.  eigend publishes one as <clockstats>.
+ */
+
+class bclock_client_t: public piw::client_t
+{
+    public:
+        bclock_client_t(int set): piw::client_t(PLG_CLIENT_SYNC), _set(set)
+        {
+        }
+
+        void client_sync()
+        {
+            client_t::client_sync();
+
+            if(_set>=0)
+            {
+                set_data(piw::makebool(_set!=0));
+                std::cout << "timing " << (_set?"on":"off") << '\n';
+            }
+            else
+            {
+                if(get_data().is_bool() && !get_data().as_bool())
+                {
+                    std::cout << "timing off\n";
+                }
+
+                for(unsigned char name=enum_child(0); name>0; name=enum_child(name))
+                {
+                    piw::data_t d = child_data_str(&name,1);
+
+                    if(d.is_string() && d.as_stringlen()>0)
+                    {
+                        std::cout << d.as_stdstr() << '\n';
+                    }
+                }
+            }
+
+            close_client();
+        }
+
+    private:
+        int _set;
+};
+
+int main0(int ac, char **av)
+{
+    int set = -1;
+
+    if(ac==3 && !strcmp(av[2],"on"))
+    {
+        set = 1;
+    }
+    else if(ac==3 && !strcmp(av[2],"off"))
+    {
+        set = 0;
+    }
+    else if(ac!=2)
+    {
+        PIC_THROW("usage: bclock server [on|off]\n");
+        return -1;
+    }
+
+    pia::scaffold_mt_t manager("bclock",1,pic::f_string_t(),pic::f_string_t(),false,false);
+    pia::context_t entity = manager.context(pic::status_t(),pic::f_string_t());
+	piw::tsd_setcontext(entity.entity());
+
+    bclock_client_t client(set);
+    piw::tsd_client(av[1],&client,false);
+    entity.release();
+    manager.wait();
+    return 0;
+}
+
+int main(int ac, char **av)
+{
+    try
+    {
+        main0(ac,av);
+    }
+    catch(const std::exception &e)
+    {
+        std::cerr << e.what() << "\n";
+        return -1;
+    }
+    catch(...)
+    {
+        std::cerr << "unknown exception\n";
+        return -1;
+    }
+
+    return 0;
+}
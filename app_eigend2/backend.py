@@ -97,6 +97,8 @@ class Agent(agentd.Agent):
         path = [os.path.join(picross.release_root_dir(),'plugins')]
         agentd.Agent.__init__(self,1,path)
         piw.tsd_server('<eigend1>',self)
+        self.clockstats = piw.clockstats(1000)
+        piw.tsd_server('<clockstats>',self.clockstats)
 
     def stop_gc(self):
         self.backend.stop_gc()
@@ -0,0 +1,36 @@
+/*
+ Copyright 2009 Eigenlabs Ltd.  http://www.eigenlabs.com
+
+ This file is part of EigenD.
+
+ EigenD is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ EigenD is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with EigenD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "nettest.h"
+
+#include <stdlib.h>
+
+/*
+ * netbench [packets] [packets per tick] [packet size]
+ */
+
+int main(int ac, const char **av)
+{
+    unsigned packets = (ac>1) ? atoi(av[1]) : 20000;
+    unsigned batch = (ac>2) ? atoi(av[2]) : 20;
+    unsigned size = (ac>3) ? atoi(av[3]) : 64;
+
+    eigend::bench_network(packets,batch,size);
+    return 0;
+}
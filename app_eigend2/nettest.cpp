@@ -25,6 +25,13 @@
 #include <picross/pic_time.h>
 #include <picross/pic_tool.h>
 #include <picross/pic_resources.h>
+#include <picross/pic_thread.h>
+#include <pibelcanto/link.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
 
 namespace
 {
@@ -77,6 +84,133 @@ namespace
         bool received_;
         unsigned spc_;
     };
+
+    struct benchport_t
+    {
+        benchport_t(pia::udpnet_t *net, bool listen): net_(net), handle_(0), received_(0)
+        {
+            handle_=net_->network_open(BCTLINK_NAMESPACE_FAST,"<netbench>",false);
+
+            if(handle_ && listen)
+            {
+                net_->network_callback(handle_,handler,this);
+            }
+        }
+
+        ~benchport_t()
+        {
+            if(handle_)
+            {
+                net_->network_close(handle_);
+            }
+        }
+
+        void send(unsigned char *msg, unsigned len)
+        {
+            unsigned long long t = pic_microtime();
+            memcpy(msg,&t,sizeof(t));
+            net_->network_write(handle_,msg,len);
+        }
+
+        static void handler(void *ctx, const unsigned char *msg, unsigned len)
+        {
+            benchport_t *self = (benchport_t *)ctx;
+            unsigned long long t;
+
+            if(len<sizeof(t))
+            {
+                return;
+            }
+
+            memcpy(&t,msg,sizeof(t));
+
+            pic::mutex_t::guard_t g(self->lock_);
+            self->latency_.push_back(pic_microtime()-t);
+            self->received_++;
+        }
+
+        unsigned received()
+        {
+            pic::mutex_t::guard_t g(lock_);
+            return received_;
+        }
+
+        pia::udpnet_t *net_;
+        void *handle_;
+        pic::mutex_t lock_;
+        unsigned received_;
+        std::vector<unsigned long long> latency_;
+    };
+
+    void bench_run(unsigned packets, unsigned batch, unsigned size, bool hold)
+    {
+        pia::fastalloc_t alloc;
+        pia::udpnet_t txnet(&alloc,false);
+        pia::udpnet_t rxnet(&alloc,false);
+
+        benchport_t tx(&txnet,false);
+        benchport_t rx(&rxnet,true);
+
+        std::vector<unsigned char> msg(std::max(size,(unsigned)sizeof(unsigned long long)),0);
+
+        pic_microsleep(100000);
+
+        unsigned long long t0 = pic_microtime();
+
+        for(unsigned sent=0; sent<packets; )
+        {
+            if(hold) txnet.network_hold();
+
+            for(unsigned j=0; j<batch && sent<packets; j++,sent++)
+            {
+                tx.send(&msg[0],msg.size());
+            }
+
+            if(hold) txnet.network_release();
+
+            // one batch per tick
+            pic_microsleep(1000);
+        }
+
+        unsigned long long t1 = pic_microtime();
+
+        for(unsigned i=0; i<100 && rx.received()<packets; i++)
+        {
+            pic_microsleep(10000);
+        }
+
+        pic::mutex_t::guard_t g(rx.lock_);
+        std::vector<unsigned long long> &l(rx.latency_);
+        std::sort(l.begin(),l.end());
+
+        unsigned n = l.size();
+
+        printf("%-6s batch %3u size %5u  sent %7u  received %7u  %9.0f pkt/s",
+            hold?"held":"direct",batch,(unsigned)msg.size(),packets,rx.received_,(t1>t0)?1000000.0*packets/(t1-t0):0.0);
+
+        if(n)
+        {
+            printf("  latency p50 %5lluus  p99 %5lluus  max %6lluus",l[n/2],l[n*99/100],l[n-1]);
+        }
+
+        printf("\n");
+
+        if(hold)
+        {
+            printf("%s",txnet.network_stats(false).c_str());
+        }
+    }
+}
+
+/*
+ * Loopback benchmark: one udpnet sends batches of timestamped packets, one
+ * per millisecond tick, to a second udpnet in the same process, first with
+ * a write per packet and then with each tick held and released as a unit.
+ */
+void eigend::bench_network(unsigned packets, unsigned batch, unsigned size)
+{
+    bench_run(packets,batch,size,false);
+    bench_run(packets,batch,size,true);
 }
 
 bool eigend::test_network()
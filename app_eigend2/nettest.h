@@ -21,4 +21,5 @@
 namespace eigend
 {
     bool test_network();
+    void bench_network(unsigned packets, unsigned batch, unsigned size);
 }
@@ -24,6 +24,7 @@
 
 #include <picross/pic_fastalloc.h>
 #include <picross/pic_nocopy.h>
+#include <picross/pic_log.h>
 
 namespace pia
 {
@@ -32,10 +33,30 @@ namespace pia
 		public:
 			class nbimpl_t;
 			class lckimpl_t;
+
+			struct classstats_t
+			{
+				unsigned size; // block size of the class, including header
+				unsigned long long hits; // served from a thread magazine
+				unsigned long long misses; // magazine was empty
+				unsigned long long refills; // popped from the shared stack
+				unsigned long long splits; // made by fragmenting a larger block
+				unsigned long long mallocs; // fell back to a fresh system block
+				unsigned long long waste; // bytes of rounding slack handed out
+				unsigned long long direct; // allocations from threads without magazines
+			};
+
 		public:
 			fastalloc_t();
 			~fastalloc_t();
 			virtual void *allocator_xmalloc(unsigned nb, size_t size,deallocator_t *dealloc, void **dealloc_arg);
+
+			unsigned classes() const;
+			void classstats(unsigned cls, classstats_t &s) const;
+			void stats(pic::msg_t &m, bool reset) const;
+
+			static void attach();
+			static void detach();
 		private:
 			nbimpl_t *nbimpl_;
 			lckimpl_t *lckimpl_;
@@ -35,6 +35,12 @@ namespace pia
         virtual int network_write(void *handle, const void *buffer, unsigned len) = 0;
         virtual int network_time(void *handle, unsigned long long *time) = 0;
         virtual int network_callback(void *handle, void (*cb)(void *ctx, const unsigned char *, unsigned), void *ctx) = 0;
+
+        // writes made by the calling thread between hold and release may be
+        // queued and sent together on release.
+        virtual void network_hold() {}
+        virtual void network_release() {}
+        virtual std::string network_stats(bool reset) { return std::string(); }
     };
 };
 
@@ -39,6 +39,9 @@ namespace pia
 			int network_write(void *handle, const void *buffer, unsigned len);
 			int network_time(void *handle, unsigned long long *time);
             int network_callback(void *handle, void (*cb)(void *ctx, const unsigned char *, unsigned), void *ctx);
+			void network_hold();
+			void network_release();
+			std::string network_stats(bool reset);
 		private:
 			impl_t *impl_;
 	};
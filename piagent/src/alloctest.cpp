@@ -20,38 +20,162 @@
 
 #include <picross/pic_thread.h>
 #include <picross/pic_time.h>
+#include <picross/pic_log.h>
 #include <piagent/pia_fastalloc.h>
 
-#define THREADS 16
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
 
-void __tester(void *a_)
+/*
+ * Each thread keeps a window of live blocks of random size, and replaces a
+ * random one on every operation.  Operations are timed in batches, since
+ * the clock is too coarse to time a single allocation.  Everything is run
+ * once on the shared stacks alone and once with thread magazines.
+ *
+ * alloctest [threads] [operations per thread] [max size]
+ */
+
+#define WINDOW 64
+#define BATCH 32
+
+struct tester_t: pic::thread_t
 {
-    pia::fastalloc_t *a = (pia::fastalloc_t *)a_;
+    tester_t(pia::fastalloc_t *a, bool m, unsigned ops, unsigned size): allocator_(a), magazine_(m), ops_(ops), size_(size), seed_(0)
+    {
+    }
 
-    for(;;)
+    void thread_init()
     {
-        pia::fastalloc_t::deallocator_t d;
-        unsigned s=1+random()%4096;
-        void *m1=a->allocator_xmalloc(s,&d);
-        d(m1);
+        if(magazine_)
+        {
+            pia::fastalloc_t::attach();
+        }
     }
-}
 
-int main()
+    void thread_term()
+    {
+        pia::fastalloc_t::detach();
+    }
+
+    unsigned random()
+    {
+        seed_ = seed_*1103515245+12345;
+        return seed_>>8;
+    }
+
+    void thread_main()
+    {
+        void *ptr[WINDOW];
+        void *arg[WINDOW];
+        pia::fastalloc_t::deallocator_t dealloc[WINDOW];
+
+        for(unsigned i=0; i<WINDOW; ++i)
+        {
+            ptr[i] = allocator_->allocator_xmalloc(PIC_ALLOC_NB,1+random()%size_,&dealloc[i],&arg[i]);
+        }
+
+        samples_.reserve(ops_/BATCH+1);
+
+        unsigned long long t0 = pic_microtime();
+
+        for(unsigned n=0; n<ops_; n+=BATCH)
+        {
+            unsigned long long b0 = pic_microtime();
+
+            for(unsigned j=0; j<BATCH; ++j)
+            {
+                unsigned i = random()%WINDOW;
+                dealloc[i](ptr[i],arg[i]);
+                ptr[i] = allocator_->allocator_xmalloc(PIC_ALLOC_NB,1+random()%size_,&dealloc[i],&arg[i]);
+            }
+
+            samples_.push_back(pic_microtime()-b0);
+        }
+
+        elapsed_ = pic_microtime()-t0;
+
+        for(unsigned i=0; i<WINDOW; ++i)
+        {
+            dealloc[i](ptr[i],arg[i]);
+        }
+    }
+
+    pia::fastalloc_t *allocator_;
+    bool magazine_;
+    unsigned ops_;
+    unsigned size_;
+    unsigned seed_;
+    unsigned long long elapsed_;
+    std::vector<unsigned long long> samples_;
+};
+
+static void run(unsigned threads, unsigned ops, unsigned size, bool magazine)
 {
     pia::fastalloc_t a;
+    std::vector<tester_t *> testers;
+    std::vector<unsigned long long> samples;
+    unsigned long long elapsed = 0;
+
+    for(unsigned i=0; i<threads; ++i)
+    {
+        tester_t *t = new tester_t(&a,magazine,ops,size);
+        t->seed_ = i+1;
+        testers.push_back(t);
+    }
 
-    for(unsigned i=0; i<THREADS; ++i)
+    for(unsigned i=0; i<threads; ++i)
     {
-        pic_thread_t *t = new pic_thread_t;
-        pic_thread_create(t,0,__tester,&a);
-        pic_thread_run(t);
+        testers[i]->run();
     }
 
-    for(;;)
+    for(unsigned i=0; i<threads; ++i)
+    {
+        testers[i]->wait();
+        elapsed = std::max(elapsed,testers[i]->elapsed_);
+        samples.insert(samples.end(),testers[i]->samples_.begin(),testers[i]->samples_.end());
+        delete testers[i];
+    }
+
+    std::sort(samples.begin(),samples.end());
+
+    unsigned long long total = (unsigned long long)threads*ops;
+    unsigned long long ns = samples.size();
+
+    if(!ns)
     {
-        pic_microsleep(1000);
+        printf("%-9s no samples\n",magazine?"magazine":"shared");
+        return;
     }
 
+    double p50 = 1000.0*samples[ns/2]/BATCH;
+    double p99 = 1000.0*samples[ns*99/100]/BATCH;
+    double p999 = 1000.0*samples[ns*999/1000]/BATCH;
+    double pmax = 1000.0*samples[ns-1]/BATCH;
+
+    printf("%-9s %2u threads  %8.2f Mops/s  p50 %7.1fns  p99 %7.1fns  p99.9 %7.1fns  max %9.1fns\n",
+        magazine?"magazine":"shared",threads,elapsed?(double)total/elapsed:0.0,p50,p99,p999,pmax);
+
+    if(magazine)
+    {
+        pic::msg_t m;
+        a.stats(m,false);
+        printf("%s",m.str().c_str());
+    }
+}
+
+int main(int ac, char **av)
+{
+    unsigned threads = (ac>1) ? atoi(av[1]) : 4;
+    unsigned ops = (ac>2) ? atoi(av[2]) : 1000000;
+    unsigned size = (ac>3) ? atoi(av[3]) : 4096;
+
+    // operations are timed a batch at a time
+    ops = std::max(ops,(unsigned)BATCH);
+
+    run(threads,ops,size,false);
+    run(threads,ops,size,true);
+
     return 0;
 }
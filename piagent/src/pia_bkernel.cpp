@@ -116,6 +116,7 @@ struct pie_bkernel_t::impl_t
     int pie_bkernel_creategroup(const pie_bkaddr_t *name, int dev, int promisc, int create);
     void bk_route_in_group(int dev, const pie_bkaddr_t *n);
     void bk_route_in(int dev, const unsigned char *payload, unsigned paylen);
+    void bk_unpack(int dev, const unsigned char *header, const unsigned char *payload, unsigned paylen);
 
     void __BkRecalcHeadroom(void);
     void bk_route_accumulate(void);
@@ -943,6 +944,11 @@ int pie_bkernel_t::impl_t::pie_bkwrite(int h, const void *payload, unsigned payl
 
     memcpy(&header[BCTLINK_GROUP],g->name.data,BCTLINK_GROUP_SIZE);
 
+    if(g->name.length<BCTLINK_GROUP_SIZE)
+    {
+        header[BCTLINK_CAPS]=BCTLINK_CAPS_PACKED;
+    }
+
     for(i=__BkNextBit(endpoints,BK_ENDPOINT_MASK,0); i>=0; i=__BkNextBit(endpoints,BK_ENDPOINT_MASK,i+1))
     {
         if(i!=h) (__BkEndpoints[i]->ops->data_callback)(i, __BkEndpoints[i]->ctx,header,payload,paylen);
@@ -975,6 +981,7 @@ void pie_bkernel_t::impl_t::bk_route_send(void)
     header[BCTLINK_GROUP_LEN]=__BkRouteName.length;
     header[BCTLINK_NAMESPACE]=__BkRouteName.space;
     memcpy(&header[BCTLINK_GROUP],__BkRouteName.data,__BkRouteName.length);
+    header[BCTLINK_CAPS]=BCTLINK_CAPS_PACKED;
 
     BK_LOCK_READ(__BkLock,grd);
 
@@ -1132,6 +1139,38 @@ static void __debug_addr(const unsigned char *header)
     printf("\"\n");
 }
 
+/*
+ * A packed datagram carries several payloads for the header's group, each
+ * preceded by a 16 bit length.  Deliver them in order as if they had
+ * arrived separately.
+ */
+void pie_bkernel_t::impl_t::bk_unpack(int dev, const unsigned char *header, const unsigned char *payload, unsigned paylen)
+{
+    unsigned char h[BCTLINK_HEADER];
+    unsigned o = 0;
+
+    memcpy(h,header,BCTLINK_HEADER);
+    h[BCTLINK_MAGIC2] = BCTLINK_MAGIC2VAL;
+
+    while(o+2 <= paylen)
+    {
+        unsigned l = (payload[o] << 8 | payload[o+1] << 0);
+        o += 2;
+
+        if(o+l > paylen)
+        {
+            printf("malformed packet: packed payload %d overruns %d\n",l,paylen);
+            __debug_addr(header);
+            return;
+        }
+
+        h[BCTLINK_LEN_HI] = ((l+BCTLINK_HEADER) >> 8) & 0xff;
+        h[BCTLINK_LEN_LO] = ((l+BCTLINK_HEADER) >> 0) & 0xff;
+        pie_bkdata(dev,h,&payload[o],l);
+        o += l;
+    }
+}
+
 void pie_bkernel_t::impl_t::pie_bkdata(int dev, const unsigned char *header, const void *payload, unsigned paylen)
 {
     pie_bkaddr_t gn;
@@ -1143,6 +1182,12 @@ void pie_bkernel_t::impl_t::pie_bkdata(int dev, const unsigned char *header, con
     unsigned char endpoints[BK_ENDPOINT_MASK];
     //unsigned char devices[BK_DEVICE_MASK];
 
+    if(header[BCTLINK_MAGIC1] == BCTLINK_MAGIC1VAL && header[BCTLINK_MAGIC2] == BCTLINK_MAGIC2PACKED)
+    {
+        bk_unpack(dev,header,(const unsigned char *)payload,paylen);
+        return;
+    }
+
     if(header[BCTLINK_MAGIC1] != BCTLINK_MAGIC1VAL || header[BCTLINK_MAGIC2] != BCTLINK_MAGIC2VAL)
     {
         printf("malformed packet: bad magic\n");
@@ -20,15 +20,22 @@
 #include "pia_glue.h"
 #include "pia_error.h"
 
+#include <piagent/pia_fastalloc.h>
+
 #include <picross/pic_strbase.h>
 #include <picross/pic_error.h>
 #include <picross/pic_flipflop.h>
 #include <picross/pic_ilist.h>
 #include <picross/pic_stl.h>
 #include <picross/pic_mlock.h>
+#include <picross/pic_time.h>
+#include <picross/pic_log.h>
 
+#include <algorithm>
 #include <list>
+#include <map>
 #include <memory>
+#include <vector>
 
 #define SRC_INTL_SAMPLE_RATE 48000
 #define SRC_INTL_PERIOD      (PLG_CLOCK_BUFFER_SIZE_DEFAULT*1000)/SRC_INTL_SAMPLE_RATE /* millis */
@@ -46,20 +53,222 @@ typedef std::list<notifier_t *> notifierlist_t;
 
 typedef pia_clocklist_t::impl_t clockimpl_t;
 
+/*
+ * Holds the network for the life of a tick, so the fast writes the sinks
+ * make on this thread go out together as one batch when it ends.
+ */
+struct nethold_t: pic::nocopy_t
+{
+    nethold_t(pia::network_t *n): network_(n) { network_->network_hold(); }
+    ~nethold_t() { network_->network_release(); }
+
+    pia::network_t *network_;
+};
+
+/*
+ * Log-linear latency histogram in microseconds.  Values below LINEAR get
+ * a bucket each, above that each power of two is split into 2^SUBBITS
+ * buckets, so the relative error stays under 1/2^SUBBITS.
+ */
+struct histogram_t
+{
+    enum { LINEAR=16, SUBBITS=3, OCTAVES=20, BUCKETS=LINEAR+OCTAVES*(1<<SUBBITS) };
+
+    histogram_t() { clear(); }
+
+    void clear()
+    {
+        for(unsigned i=0; i<BUCKETS; ++i)
+        {
+            counts_[i]=0;
+        }
+    }
+
+    static unsigned bucket(unsigned long long v)
+    {
+        if(v<LINEAR)
+        {
+            return v;
+        }
+
+        unsigned e = 0;
+        while((v>>e)>=2*LINEAR && e<OCTAVES-1)
+        {
+            e++;
+        }
+
+        unsigned s = (v>>(e+1))&((1<<SUBBITS)-1);
+        return std::min((unsigned)(LINEAR+e*(1<<SUBBITS)+s),(unsigned)(BUCKETS-1));
+    }
+
+    static unsigned long long upper(unsigned b)
+    {
+        if(b<LINEAR)
+        {
+            return b;
+        }
+
+        b -= LINEAR;
+        unsigned e = b>>SUBBITS;
+        unsigned s = b&((1<<SUBBITS)-1);
+        return ((unsigned long long)(LINEAR+(s+1)*(LINEAR>>SUBBITS))<<e)-1;
+    }
+
+    void add(unsigned long long v) { pic_atomicinc(&counts_[bucket(v)]); }
+
+    unsigned long long percentile(unsigned long long n, unsigned permille) const
+    {
+        unsigned long long want = (n*permille+999)/1000;
+        unsigned long long c = 0;
+
+        for(unsigned i=0; i<BUCKETS; ++i)
+        {
+            c += counts_[i];
+
+            if(c>=want && c>0)
+            {
+                return upper(i);
+            }
+        }
+
+        return 0;
+    }
+
+    pic_atomic_t counts_[BUCKETS];
+};
+
+struct tickstat_t
+{
+    tickstat_t(): count_(0), total_(0), max_(0) {}
+
+    void clear() { count_=0; total_=0; max_=0; hist_.clear(); }
+
+    void add(unsigned long long us)
+    {
+        count_++;
+        total_+=us;
+        if(us>max_) max_=us;
+        hist_.add(us);
+    }
+
+    void dump(pic::msg_t &m) const
+    {
+        unsigned long long n = count_;
+        m << " ticks " << n;
+        m << " mean " << (n?total_/n:0ULL) << "us";
+        m << " max " << max_ << "us";
+        m << " p50 " << hist_.percentile(n,500);
+        m << " p99 " << hist_.percentile(n,990);
+        m << " p999 " << hist_.percentile(n,999);
+    }
+
+    volatile unsigned long long count_;
+    volatile unsigned long long total_;
+    volatile unsigned long long max_;
+    histogram_t hist_;
+};
+
 struct masterlist_t: virtual public pic::lckobject_t
 {
     masterlist_t() { list_.reserve(256); }
-    masterlist_t(const masterlist_t &m): list_(m.list_) {}
+    masterlist_t(const masterlist_t &m): list_(m.list_), npred_(m.npred_), succbase_(m.succbase_), succ_(m.succ_), roots_(m.roots_) {}
+
+    void clear() { list_.clear(); npred_.clear(); succbase_.clear(); succ_.clear(); roots_.clear(); }
 
     //pic::lcklist_t<sink_t *>::lcktype list_;
     pic::lckvector_t<sink_t *>::lcktype list_;
     typedef pic::lckvector_t<sink_t *>::lcktype::const_iterator iter_t;
+
+    /*
+     * dependency graph over list_, for the parallel tick.  npred_[i] is the
+     * number of sinks which must tick before list_[i], and the successors
+     * of list_[i] are succ_[succbase_[i]] .. succ_[succbase_[i+1]-1]
+     */
+    pic::lckvector_t<unsigned>::lcktype npred_;
+    pic::lckvector_t<unsigned>::lcktype succbase_;
+    pic::lckvector_t<unsigned>::lcktype succ_;
+    pic::lckvector_t<unsigned>::lcktype roots_;
+};
+
+struct tickpool_t;
+
+struct tickworker_t: pic::thread_t, virtual public pic::lckobject_t
+{
+    tickworker_t(tickpool_t *p): pic::thread_t(PIC_THREAD_PRIORITY_REALTIME), pool_(p), quit_(false) {}
+    ~tickworker_t() { quit(); }
+
+    void quit();
+    void thread_init();
+    void thread_term();
+    void thread_main() PIC_FASTCODE;
+
+    pic::xgate_t gate_;
+    tickpool_t *pool_;
+    volatile bool quit_;
+};
+
+/*
+ * A fastcall made by a sink on a worker thread.  Workers are not fast
+ * threads, so the call is handed to the ticking thread and the worker
+ * waits for it.  While calls are queued no sink is started, and the
+ * ticking thread only runs them once every sink still in flight is one
+ * waiting on a call, so a call never runs alongside a sink, as on a
+ * single fast thread.
+ */
+struct tickcall_t
+{
+    int (*cb_)(void *, void *, void *, void *);
+    void *a1_, *a2_, *a3_, *a4_;
+    int r_;
+    tickcall_t *next_;
+    pic::semaphore_t done_;
+};
+
+/*
+ * Runs the sinks of a masterlist on the ticking thread plus a set of
+ * worker threads.  A sink becomes ready when its predecessor count drops
+ * to zero, and ready sinks are handed out in the order they became ready.
+ * Each tick every sink is pushed exactly once, so a claimed slot is
+ * always eventually filled.
+ */
+struct tickpool_t: pic::nocopy_t, virtual public pic::lckobject_t
+{
+    tickpool_t(unsigned n, pia::network_t *network);
+    ~tickpool_t();
+
+    bool acquire() { return pic_atomiccas(&running_,0,1); }
+    void release() { running_=0; }
+    void tick(const source_t *src, const masterlist_t &m, unsigned long long f, unsigned long long t) PIC_FASTCODE;
+    void work() PIC_FASTCODE;
+    void push(unsigned i) { ready_[pic_atomicinc(&tail_)-1]=i; }
+    int call(int (*cb)(void *, void *, void *, void *), void *a1, void *a2, void *a3, void *a4);
+    void serve() PIC_FASTCODE;
+    void enter() PIC_FASTCODE;
+
+    pic::lckvector_t<tickworker_t *>::lcktype workers_;
+    pic::lckvector_t<unsigned>::lcktype pending_;
+    pic::lckvector_t<unsigned>::lcktype ready_;
+    const source_t *source_;
+    const masterlist_t *list_;
+    unsigned long long from_;
+    unsigned long long to_;
+    unsigned count_;
+    pic_atomic_t head_;
+    pic_atomic_t tail_;
+    pic_atomic_t busy_;
+    pic_atomic_t running_;
+    tickcall_t *calls_;
+    pic_atomic_t ncalls_;
+    pic_atomic_t inflight_;
+    pic_atomic_t waiting_;
+    pia::network_t *network_;
 };
 
 struct sink_t: virtual public pic::lckobject_t
 {
     sink_t(bct_clocksink_t *c, domain_t *d, const pia_ctx_t &e);
 
+    void advance(const source_t *s, unsigned long long f, unsigned long long t);
     void ticked(unsigned long long f, unsigned long long t);
     bool add_upstream(sink_t *up);
     void remove_upstream(sink_t *up);
@@ -84,6 +293,8 @@ struct sink_t: virtual public pic::lckobject_t
     static unsigned api_buffer_size(bct_clocksink_host_ops_t **hops);
     static unsigned long  api_sample_rate(bct_clocksink_host_ops_t **hops);
 
+    void timed_tick(unsigned long long f, unsigned long long t) PIC_FASTCODE;
+
     pia_job_t detach_;
     bool attached_;
     bct_clocksink_t *client_;
@@ -98,6 +309,11 @@ struct sink_t: virtual public pic::lckobject_t
     const char *name_;
     int suppressed_;
     pia_ctx_t env_;
+    tickstat_t stats_;
+    const source_t *source_;
+    unsigned long long last_;
+    const source_t *othersource_;
+    unsigned long long otherlast_;
 };
 
 struct domain_t: virtual public pic::lckobject_t
@@ -142,7 +358,10 @@ struct source_t: virtual public pic::lckobject_t
     source_t(clockimpl_t *l, const pia_data_t &n, unsigned bs, unsigned long sr, const pia_ctx_t &e, bct_clocksource_t *c);
 
     void tick(unsigned long long t);
+    void run();
     void build();
+    void graph();
+    void stats(pic::msg_t &m, bool reset);
     void set_details(unsigned bs, unsigned long sr);
 
     void detach(bool notify);
@@ -169,6 +388,7 @@ struct source_t: virtual public pic::lckobject_t
     sink_t *head_;
     unsigned long long last_tick_;
     unsigned long long this_tick_;
+    tickstat_t stats_;
 };
 
 
@@ -199,10 +419,13 @@ struct pia_clocklist_t::impl_t
     void reset_default(source_t *s);
     void build();
     void clearmarks();
+    void stats(pic::msg_t &m, bool reset);
 
     static void internal_tick_fast(void *g_);
 
     pia::manager_t::impl_t *glue_;
+    pic::flipflop_t<tickpool_t *> pool_;
+    volatile bool timing_;
     source_t internalsource_;
     source_t *defaultsource_;
     sourcelist_t sources_;
@@ -216,7 +439,7 @@ std::ostream& operator<<(std::ostream &o,sink_t *s)
     return o;
 }
 
-sink_t::sink_t(bct_clocksink_t *c, domain_t *d,const pia_ctx_t &e) : attached_(false), client_(c), ops_(&dispatch__), domain_(d), mark_(false), enabled_(false), suppressed_(0), env_(e)
+sink_t::sink_t(bct_clocksink_t *c, domain_t *d,const pia_ctx_t &e) : attached_(false), client_(c), ops_(&dispatch__), domain_(d), mark_(false), enabled_(false), suppressed_(0), env_(e), source_(0), last_(0), othersource_(0), otherlast_(0)
 {
     if(client_)
     {
@@ -226,14 +449,66 @@ sink_t::sink_t(bct_clocksink_t *c, domain_t *d,const pia_ctx_t &e) : attached_(f
     }
 }
 
+/*
+ * Each source a sink is ticked by is a timeline of its own, such as the
+ * synthetic time of an offline render.  The sink keeps the end of the
+ * last interval it was given on its current source and on the one before,
+ * so when its domain switches back after a render it carries on from
+ * where it left the live source, rather than ignoring live ticks until
+ * real time catches up with the render.  On any one source time never
+ * goes backwards: overlap with the last interval is trimmed, and
+ * intervals wholly before it are dropped.
+ */
+
+void sink_t::advance(const source_t *s, unsigned long long f, unsigned long long t)
+{
+    if(s!=source_)
+    {
+        std::swap(source_,othersource_);
+        std::swap(last_,otherlast_);
+
+        if(s!=source_)
+        {
+            source_ = s;
+            last_ = 0;
+        }
+    }
+
+    if(t<=last_)
+    {
+        return;
+    }
+
+    if(f<last_)
+    {
+        f = last_;
+    }
+
+    last_ = t;
+    ticked(f,t);
+}
+
 void sink_t::ticked(unsigned long long f, unsigned long long t)
 {
     if(attached_)
     {
+        if(domain_->clocklist_->timing_)
+        {
+            timed_tick(f,t);
+            return;
+        }
+
         bct_clocksink_plug_ticked(client_, env_->api(), f, t);
     }
 }
 
+void sink_t::timed_tick(unsigned long long f, unsigned long long t)
+{
+    unsigned long long s = pic_microtime();
+    bct_clocksink_plug_ticked(client_, env_->api(), f, t);
+    stats_.add(pic_microtime()-s);
+}
+
 bool sink_t::add_upstream(sink_t *up)
 {
     if(!attached_)
@@ -557,7 +832,35 @@ void source_t::tick(unsigned long long time)
 
     this_tick_ = time;
 
+    nethold_t h(clocklist_->glue_->network());
+
+    if(clocklist_->timing_)
+    {
+        unsigned long long s = pic_microtime();
+        run();
+        stats_.add(pic_microtime()-s);
+    }
+    else
+    {
+        run();
+    }
+
+    last_tick_ = time;
+}
+
+void source_t::run()
+{
     pic::flipflop_t<masterlist_t>::guard_t g(ticks_);
+    pic::flipflop_t<tickpool_t *>::guard_t pg(clocklist_->pool_);
+    tickpool_t *p = pg.value();
+
+    if(p && g.value().list_.size()>1 && p->acquire())
+    {
+        p->tick(this, g.value(), last_tick_, this_tick_);
+        p->release();
+        return;
+    }
+
     sink_t *s;
 
     masterlist_t::iter_t si=g.value().list_.begin();
@@ -569,11 +872,36 @@ void source_t::tick(unsigned long long time)
 
         if(!s->suppressed_)
         {
-            s->ticked(last_tick_, this_tick_);
+            s->advance(this, last_tick_, this_tick_);
         }
     }
+}
 
-    last_tick_ = time;
+void source_t::stats(pic::msg_t &m, bool reset)
+{
+    const masterlist_t &l = ticks_.current();
+
+    m << "source " << name_ << ":";
+    stats_.dump(m);
+    m << "\n";
+
+    for(masterlist_t::iter_t si=l.list_.begin(); si!=l.list_.end(); ++si)
+    {
+        sink_t *s = *si;
+        m << "  " << s << ":";
+        s->stats_.dump(m);
+        m << "\n";
+
+        if(reset)
+        {
+            s->stats_.clear();
+        }
+    }
+
+    if(reset)
+    {
+        stats_.clear();
+    }
 }
 
 void source_t::build()
@@ -583,7 +911,7 @@ void source_t::build()
         return;
     }
 
-    ticks_.alternate().list_.clear();
+    ticks_.alternate().clear();
 
     domainlist_t::iterator di=clocklist_->domains_.begin();
     domainlist_t::iterator de=clocklist_->domains_.end();
@@ -610,6 +938,7 @@ void source_t::build()
     }
 
     bottom.dfs(this);
+    graph();
 
 #if CLOCK_DEBUG
     pic::msg_t m;
@@ -625,6 +954,73 @@ void source_t::build()
     ticks_.exchange();
 }
 
+void source_t::graph()
+{
+    masterlist_t &m = ticks_.alternate();
+    unsigned n = m.list_.size();
+
+    std::map<sink_t *,unsigned> index;
+    std::map<pia::context_t::impl_t *,unsigned> lastctx;
+    std::vector<unsigned> nextctx(n,0);
+
+    for(unsigned i=0; i<n; ++i)
+    {
+        index.insert(std::make_pair(m.list_[i],i));
+    }
+
+    // sinks belonging to one agent share state, so tick them in list order
+    for(unsigned i=n; i>0; --i)
+    {
+        pia::context_t::impl_t *e = m.list_[i-1]->env_.entity();
+        std::map<pia::context_t::impl_t *,unsigned>::iterator li = lastctx.find(e);
+
+        if(li!=lastctx.end())
+        {
+            nextctx[i-1] = li->second;
+            li->second = i-1;
+        }
+        else
+        {
+            lastctx.insert(std::make_pair(e,i-1));
+        }
+    }
+
+    m.npred_.resize(n,0);
+
+    for(unsigned i=0; i<n; ++i)
+    {
+        sink_t *s = m.list_[i];
+        m.succbase_.push_back(m.succ_.size());
+
+        for(sinklist_t::iterator di=s->down_.begin(); di!=s->down_.end(); ++di)
+        {
+            std::map<sink_t *,unsigned>::iterator ii = index.find(*di);
+
+            if(ii!=index.end())
+            {
+                m.succ_.push_back(ii->second);
+                m.npred_[ii->second]++;
+            }
+        }
+
+        if(nextctx[i])
+        {
+            m.succ_.push_back(nextctx[i]);
+            m.npred_[nextctx[i]]++;
+        }
+    }
+
+    m.succbase_.push_back(m.succ_.size());
+
+    for(unsigned i=0; i<n; ++i)
+    {
+        if(!m.npred_[i])
+        {
+            m.roots_.push_back(i);
+        }
+    }
+}
+
 void source_t::set_details(unsigned bs, unsigned long sr)
 {
     buf_size_ = bs;
@@ -708,6 +1104,8 @@ void source_t::detach_callback(void *s_, const pia_data_t & _)
 
 pia_clocklist_t::impl_t::impl_t(pia::manager_t::impl_t *g):
     glue_(g),
+    pool_(0),
+    timing_(false),
     internalsource_(this, glue_->allocate_cstring("internal"), PLG_CLOCK_BUFFER_SIZE, SRC_INTL_SAMPLE_RATE, 0, 0),
     defaultsource_(&internalsource_)
 
@@ -721,6 +1119,307 @@ pia_clocklist_t::impl_t::~impl_t()
 {
     internal_timer_->disable();
     kill(0,false);
+    delete pool_.current();
+}
+
+static pic::tsd_t worker__;
+
+void tickworker_t::quit()
+{
+    quit_ = true;
+    gate_.open();
+    wait();
+}
+
+void tickworker_t::thread_init()
+{
+    worker__.set(this);
+    pic_set_fpu();
+    pia::fastalloc_t::attach();
+    pia_datapool_t::attach();
+}
+
+void tickworker_t::thread_term()
+{
+    pia_datapool_t::detach();
+    pia::fastalloc_t::detach();
+    worker__.set(0);
+}
+
+void tickworker_t::thread_main()
+{
+    while(!quit_)
+    {
+        if(!gate_.pass_and_shut_timed(1000000ULL) || quit_)
+        {
+            continue;
+        }
+
+        {
+            nethold_t h(pool_->network_);
+            pool_->work();
+        }
+
+        pic_atomicdec(&pool_->busy_);
+    }
+}
+
+tickpool_t::tickpool_t(unsigned n, pia::network_t *network): source_(0), list_(0), from_(0), to_(0), count_(0), head_(0), tail_(0), busy_(0), running_(0), calls_(0), ncalls_(0), inflight_(0), waiting_(0), network_(network)
+{
+    pending_.resize(256);
+    ready_.resize(256);
+
+    for(unsigned i=0; i<n; ++i)
+    {
+        tickworker_t *w = new tickworker_t(this);
+        workers_.push_back(w);
+        w->run();
+    }
+}
+
+tickpool_t::~tickpool_t()
+{
+    for(unsigned i=0; i<workers_.size(); ++i)
+    {
+        delete workers_[i];
+    }
+}
+
+void tickpool_t::tick(const source_t *src, const masterlist_t &m, unsigned long long f, unsigned long long t)
+{
+    unsigned n = m.list_.size();
+
+    if(pending_.size()<n)
+    {
+        pending_.resize(2*n);
+        ready_.resize(2*n);
+    }
+
+    source_ = src;
+    list_ = &m;
+    from_ = f;
+    to_ = t;
+    count_ = n;
+    head_ = 0;
+    tail_ = 0;
+
+    for(unsigned i=0; i<n; ++i)
+    {
+        pending_[i] = m.npred_[i];
+        ready_[i] = ~0U;
+    }
+
+    for(unsigned i=0; i<m.roots_.size(); ++i)
+    {
+        push(m.roots_[i]);
+    }
+
+    busy_ = workers_.size();
+
+    for(unsigned i=0; i<workers_.size(); ++i)
+    {
+        workers_[i]->gate_.open();
+    }
+
+    work();
+
+    while(busy_)
+    {
+        serve();
+        pic_thread_yield();
+    }
+
+    serve();
+}
+
+int tickpool_t::call(int (*cb)(void *, void *, void *, void *), void *a1, void *a2, void *a3, void *a4)
+{
+    tickcall_t c;
+
+    c.cb_=cb;
+    c.a1_=a1;
+    c.a2_=a2;
+    c.a3_=a3;
+    c.a4_=a4;
+    c.r_=-1;
+
+    pic_atomicinc(&waiting_);
+    pic_atomicinc(&ncalls_);
+
+    do
+    {
+        c.next_=calls_;
+    }
+    while(!pic_atomicptrcas(&calls_,c.next_,&c));
+
+    c.done_.untimeddown();
+    return c.r_;
+}
+
+// ticking thread, between sinks
+void tickpool_t::serve()
+{
+    if(!ncalls_ || worker__.get())
+    {
+        return;
+    }
+
+    // wait for the sinks still running to finish or to make calls
+    pic_atomicbarrier();
+
+    if(inflight_!=waiting_)
+    {
+        return;
+    }
+
+    tickcall_t *c;
+
+    do
+    {
+        c=calls_;
+    }
+    while(!pic_atomicptrcas(&calls_,c,0));
+
+    // oldest first
+    tickcall_t *r = 0;
+
+    while(c)
+    {
+        tickcall_t *n = c->next_;
+        c->next_ = r;
+        r = c;
+        c = n;
+    }
+
+    for(c=r; c; c=c->next_)
+    {
+        try
+        {
+            c->r_=(c->cb_)(c->a1_,c->a2_,c->a3_,c->a4_);
+        }
+        CATCHLOG()
+    }
+
+    // release the callers only once the whole batch has run
+    while(r)
+    {
+        tickcall_t *n = r->next_;
+        pic_atomicdec(&ncalls_);
+        pic_atomicdec(&waiting_);
+        r->done_.up();
+        r=n;
+    }
+}
+
+// before running a sink: don't start one while calls are waiting
+void tickpool_t::enter()
+{
+    for(;;)
+    {
+        while(ncalls_)
+        {
+            serve();
+            pic_thread_yield();
+        }
+
+        pic_atomicinc(&inflight_);
+
+        if(!ncalls_)
+        {
+            return;
+        }
+
+        pic_atomicdec(&inflight_);
+    }
+}
+
+void tickpool_t::work()
+{
+    volatile unsigned *ready = &ready_[0];
+
+    for(;;)
+    {
+        unsigned k = pic_atomicinc(&head_)-1;
+
+        if(k>=count_)
+        {
+            return;
+        }
+
+        unsigned i;
+
+        while((i=ready[k])==~0U)
+        {
+            serve();
+            pic_thread_yield();
+        }
+
+        sink_t *s = list_->list_[i];
+
+        enter();
+
+        if(!s->suppressed_)
+        {
+            s->advance(source_, from_, to_);
+        }
+
+        pic_atomicdec(&inflight_);
+
+        unsigned se = list_->succbase_[i+1];
+
+        for(unsigned j=list_->succbase_[i]; j<se; ++j)
+        {
+            unsigned d = list_->succ_[j];
+
+            if(pic_atomicdec((pic_atomic_t *)&pending_[d])==0)
+            {
+                push(d);
+            }
+        }
+    }
+}
+
+void pia_clocklist_t::set_workers(unsigned n)
+{
+    tickpool_t *o = impl_->pool_.current();
+    impl_->pool_.set(n ? new tickpool_t(n,impl_->glue_->network()) : 0);
+    delete o;
+}
+
+bool pia_clocklist_t::enable_timing(bool e)
+{
+    bool o = impl_->timing_;
+    impl_->timing_ = e;
+    return o;
+}
+
+pia_data_t pia_clocklist_t::timing(bool reset)
+{
+    pic::msg_t m;
+    impl_->stats(m,reset);
+
+    pia::fastalloc_t *a = dynamic_cast<pia::fastalloc_t *>(impl_->glue_->allocator());
+
+    if(a)
+    {
+        a->stats(m,reset);
+    }
+
+    m << impl_->glue_->network()->network_stats(reset);
+
+    return impl_->glue_->allocate_cstring(m.str().c_str());
+}
+
+bool pia_clocklist_t::isworker()
+{
+    return worker__.get()!=0;
+}
+
+int pia_clocklist_t::workercall(int (*cb)(void *, void *, void *, void *), void *a1, void *a2, void *a3, void *a4)
+{
+    tickworker_t *w = (tickworker_t *)worker__.get();
+    PIC_ASSERT(w);
+    return w->pool_->call(cb,a1,a2,a3,a4);
 }
 
 pia_clocklist_t::~pia_clocklist_t()
@@ -763,6 +1462,16 @@ void pia_clocklist_t::impl_t::reset_default(source_t *s)
     build();
 }
 
+void pia_clocklist_t::impl_t::stats(pic::msg_t &m, bool reset)
+{
+    for(sourcelist_t::iterator oi=sources_.begin(); oi!=sources_.end(); ++oi)
+    {
+        (*oi)->stats(m,reset);
+    }
+
+    pia_datapool_t::stats(m,reset);
+}
+
 void pia_clocklist_t::impl_t::clearmarks()
 {
     domainlist_t::iterator di=domains_.begin();
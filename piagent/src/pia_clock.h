@@ -43,6 +43,12 @@ struct pia_clocklist_t
         int cleardownstream(void *, void *);
         void *addnotify(bct_clocksink_t *, void (*)(void *), void *);
         void cancelnotify(void *);
+        void set_workers(unsigned);
+        bool enable_timing(bool);
+        pia_data_t timing(bool reset);
+
+        static bool isworker();
+        static int workercall(int (*)(void *, void *, void *, void *), void *, void *, void *, void *);
 
     private:
         impl_t *impl_;
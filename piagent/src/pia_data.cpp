@@ -28,10 +28,12 @@
 #include <picross/pic_error.h>
 #include <picross/pic_log.h>
 #include <picross/pic_atomic.h>
+#include <picross/pic_thread.h>
 #include <picross/pic_config.h>
 
 #include <string.h>
 #include <stdlib.h>
+#include <list>
 #include <picross/pic_stdint.h>
 
 #include "pia_data.h"
@@ -51,10 +53,14 @@
 
 #define HOST_OK 1
 #define WIRE_OK 2
+#define POOL_OK 4
 
-struct rep_t: bct_data_s // rep_t         : 52
-{                        // bct_data_s    : 48
-    unsigned long flags; // unsigned long :  4
+struct rep_t: bct_data_s              // rep_t         : 64
+{                                     // bct_data_s    : 48
+    unsigned long flags;              // unsigned long :  4
+    unsigned size;                    // unsigned      :  4 allocated length, for the buffer pool
+    pic::nballocator_t *allocator;    // pointer       :  4 allocator the buffer came from
+    rep_t *next;                      // pointer       :  4 buffer pool link
 
     // followed by
     // wire_hdr     25
@@ -70,24 +76,20 @@ struct rep_t: bct_data_s // rep_t         : 52
 #define PTRADD(p,o) (((unsigned char *)(p))+(o))
 #define PTRDEL(p,o) (((unsigned char *)(p))-(o))
 
-#define PAD16(p)           (((uintptr_t)(p)+0xf)&(~((uintptr_t)0xf)))
+// vectors are padded out to BCTLIMIT_VALIGN, so the wire vector (which is
+// also the host vector on little endian machines) and the host vector
+// both start on an aligned boundary.  data without a vector isn't padded.
 
-#ifdef ALIGN_16
-#define PTR_WIRE_HDR(p)    PTRDEL(PAD16(PTRADD(p,sizeof(rep_t)+25)),25)
-#else
-#define PTR_WIRE_HDR(p)    PTRADD(p,sizeof(rep_t))
-#endif
+#define VALIGN             ((uintptr_t)BCTLIMIT_VALIGN)
+#define VPAD(p)            (((uintptr_t)(p)+VALIGN-1)&(~(VALIGN-1)))
+#define VSLACK(vl)         ((vl)?2*(BCTLIMIT_VALIGN-1):0)
 
+#define PTR_WIRE_HDR(p)    ((p)->host_hdr.vector_len?PTRDEL(VPAD(PTRADD(p,sizeof(rep_t)+25)),25):PTRADD(p,sizeof(rep_t)))
 #define PTR_WIRE_VECTOR(p) ((float *)PTRADD(PTR_WIRE_HDR(p),25))
 #define PTR_WIRE_SCALAR(p) PTRADD(PTR_WIRE_VECTOR(p),4*((p)->host_hdr.vector_len))
 #define PTR_WIRE_ZERO(p)   PTRADD(PTR_WIRE_SCALAR(p),(p)->host_hdr.scalar_len)
 
-#ifdef ALIGN_16
-#define PTR_HOST_VECTOR(p) ((float *)(PAD16(PTRADD(PTR_WIRE_ZERO(p),1))))
-#else
-#define PTR_HOST_VECTOR(p) ((float *)(PTRADD(PTR_WIRE_ZERO(p),1)))
-#endif
-
+#define PTR_HOST_VECTOR(p) ((float *)((p)->host_hdr.vector_len?(unsigned char *)VPAD(PTRADD(PTR_WIRE_ZERO(p),1)):PTRADD(PTR_WIRE_ZERO(p),1)))
 #define PTR_HOST_SCALAR(p) PTRADD(PTR_HOST_VECTOR(p),4*((p)->host_hdr.vector_len))
 #define PTR_HOST_ZERO(p)   PTRADD(PTR_HOST_SCALAR(p),(p)->host_hdr.scalar_len)
 #define WIRELEN(p)         (25+4*((p)->host_hdr.vector_len)+((p)->host_hdr.scalar_len))
@@ -99,9 +101,236 @@ struct rep_t: bct_data_s // rep_t         : 52
 #define SYS_RIGHTENDIAN 1
 #endif
 
+/*
+ * Per thread recycling pool for vector data.
+ *
+ * Audio agents allocate a fresh buffer of the same size on every tick, and
+ * drop the previous one.  Threads which attach a pool keep those buffers on
+ * a short freelist per allocation size instead of returning them to the
+ * allocator.  A pool is only ever touched by its own thread; the counters
+ * are read racily by stats().
+ */
+
+#define POOL_SLOTS 8
+#define POOL_DEPTH 32
+
+namespace
+{
+    struct poolslot_t
+    {
+        unsigned size;
+        unsigned nb;
+        pic::nballocator_t *allocator;
+        rep_t *head;
+        unsigned depth;
+    };
+
+    struct poolcounts_t
+    {
+        poolcounts_t(): hits(0), misses(0), returns(0), drops(0) {}
+
+        void add(const poolcounts_t &o) { hits+=o.hits; misses+=o.misses; returns+=o.returns; drops+=o.drops; }
+        void sub(const poolcounts_t &o) { hits-=o.hits; misses-=o.misses; returns-=o.returns; drops-=o.drops; }
+
+        unsigned long long hits;
+        unsigned long long misses;
+        unsigned long long returns;
+        unsigned long long drops;
+    };
+
+    struct datapool_t
+    {
+        datapool_t()
+        {
+            memset(slots_,0,sizeof(slots_));
+        }
+
+        ~datapool_t()
+        {
+            for(unsigned i=0;i<POOL_SLOTS;i++)
+            {
+                drain(&slots_[i]);
+            }
+        }
+
+        void drain(poolslot_t *s)
+        {
+            while(s->head)
+            {
+                rep_t *r = s->head;
+                s->head = r->next;
+                pic::nb_free(r);
+            }
+
+            s->depth = 0;
+        }
+
+        rep_t *get(pic::nballocator_t *a, unsigned nb, unsigned size)
+        {
+            for(unsigned i=0;i<POOL_SLOTS;i++)
+            {
+                poolslot_t *s = &slots_[i];
+
+                if(s->head && s->size==size && s->nb==nb && s->allocator==a)
+                {
+                    rep_t *r = s->head;
+                    s->head = r->next;
+                    s->depth--;
+                    counts_.hits++;
+                    return r;
+                }
+            }
+
+            counts_.misses++;
+            return 0;
+        }
+
+        bool put(rep_t *r)
+        {
+            poolslot_t *e = 0;
+
+            for(unsigned i=0;i<POOL_SLOTS;i++)
+            {
+                poolslot_t *s = &slots_[i];
+
+                if(s->depth && s->size==r->size && s->nb==r->host_hdr.nb_mode && s->allocator==r->allocator)
+                {
+                    e = s;
+                    break;
+                }
+
+                if(!e && !s->depth)
+                {
+                    e = s;
+                }
+            }
+
+            if(!e || e->depth>=POOL_DEPTH)
+            {
+                counts_.drops++;
+                return false;
+            }
+
+            if(!e->depth)
+            {
+                e->size = r->size;
+                e->nb = r->host_hdr.nb_mode;
+                e->allocator = r->allocator;
+            }
+
+            r->next = e->head;
+            e->head = r;
+            e->depth++;
+            counts_.returns++;
+            return true;
+        }
+
+        poolslot_t slots_[POOL_SLOTS];
+        poolcounts_t counts_;
+        poolcounts_t base_;
+    };
+
+    struct poolregistry_t
+    {
+        pic::mutex_t lock_;
+        std::list<datapool_t *> pools_;
+        poolcounts_t retired_;
+    };
+
+    pic::tsd_t pool__;
+
+    poolregistry_t &registry()
+    {
+        static poolregistry_t r;
+        return r;
+    }
+}
+
+void pia_datapool_t::attach()
+{
+    if(pool__.get())
+    {
+        return;
+    }
+
+    datapool_t *p = new datapool_t;
+    poolregistry_t &r = registry();
+
+    {
+        pic::mutex_t::guard_t g(r.lock_);
+        r.pools_.push_back(p);
+    }
+
+    pool__.set(p);
+}
+
+void pia_datapool_t::detach()
+{
+    datapool_t *p = (datapool_t *)pool__.set(0);
+
+    if(!p)
+    {
+        return;
+    }
+
+    poolregistry_t &r = registry();
+
+    {
+        pic::mutex_t::guard_t g(r.lock_);
+        r.pools_.remove(p);
+        poolcounts_t c = p->counts_;
+        c.sub(p->base_);
+        r.retired_.add(c);
+    }
+
+    delete p;
+}
+
+void pia_datapool_t::stats(pic::msg_t &m, bool reset)
+{
+    poolregistry_t &r = registry();
+    pic::mutex_t::guard_t g(r.lock_);
+    poolcounts_t t = r.retired_;
+
+    for(std::list<datapool_t *>::iterator i=r.pools_.begin(); i!=r.pools_.end(); ++i)
+    {
+        poolcounts_t c = (*i)->counts_;
+        c.sub((*i)->base_);
+        t.add(c);
+
+        if(reset)
+        {
+            (*i)->base_ = (*i)->counts_;
+        }
+    }
+
+    if(reset)
+    {
+        r.retired_ = poolcounts_t();
+    }
+
+    unsigned long long n = t.hits+t.misses;
+
+    m << "buffer pool: threads=" << r.pools_.size();
+    m << " hits=" << t.hits << " misses=" << t.misses;
+    m << " hitrate=" << (n ? (100ULL*t.hits/n) : 0ULL) << "%";
+    m << " returns=" << t.returns << " drops=" << t.drops << "\n";
+}
+
 static void data_free(const bct_data_t o)
 {
     rep_t *r = (rep_t *)o;
+
+    if(r->flags&POOL_OK)
+    {
+        datapool_t *p = (datapool_t *)pool__.get();
+
+        if(p && p->put(r))
+        {
+            return;
+        }
+    }
+
     pic::nb_free(r);
 }
 
@@ -243,9 +472,7 @@ bct_data_t allocate_host_raw(pic::nballocator_t *a, unsigned nb, unsigned long l
         rl = sizeof(rep_t)+25+4*vl+sl+1;
         rl = rl+4*vl;
     }
-#ifdef ALIGN_16
-    rl = rl+0xf+0xf;
-#endif
+    rl = rl+VSLACK(vl);
     
     unsigned wl = 25+4*vl+sl;
 
@@ -255,11 +482,28 @@ bct_data_t allocate_host_raw(pic::nballocator_t *a, unsigned nb, unsigned long l
             pic::msg() << "max wire length " << BCTLIMIT_DATA << ", requested " << wl << pic::hurl;
     }
 
-    r = (rep_t *)pic::nb_malloc(nb,a,rl);
+    r = 0;
+
+    if(vl)
+    {
+        datapool_t *p = (datapool_t *)pool__.get();
+
+        if(p)
+        {
+            r = p->get(a,nb,rl);
+        }
+    }
+
+    if(!r)
+    {
+        r = (rep_t *)pic::nb_malloc(nb,a,rl);
+    }
 
     r->host_ops=&dispatch__;
     r->count=1;
-    r->flags=HOST_OK;
+    r->flags=HOST_OK|(vl?POOL_OK:0);
+    r->size=rl;
+    r->allocator=a;
 #ifdef DEBUG_DATA_ATOMICITY
     r->tid = pic_current_threadid();
     r->nb_usage = false;
@@ -273,6 +517,7 @@ bct_data_t allocate_host_raw(pic::nballocator_t *a, unsigned nb, unsigned long l
     r->host_hdr.lbound = l;
     r->host_hdr.rest = rst;
     r->host_hdr.nb_mode = nb;
+    r->host_hdr.intern = 0;
 
     unsigned char *wh = PTR_WIRE_HDR(r);
 
@@ -330,7 +575,8 @@ bct_data_t allocate_wire_raw(pic::nballocator_t *a, unsigned nb, unsigned wl, co
     PIC_ASSERT(wl>=25);
 
     rep_t *r;
-    unsigned short sl,vl,rl;
+    unsigned short sl,vl;
+    unsigned rl;
     unsigned t;
 
     t=wp[0];
@@ -353,15 +599,15 @@ bct_data_t allocate_wire_raw(pic::nballocator_t *a, unsigned nb, unsigned wl, co
         rl = sizeof(rep_t)+25+4*vl+sl+1;
         rl = rl+4*vl;
     }
-#ifdef ALIGN_16
-    rl = rl+0xf+0xf;
-#endif
+    rl = rl+VSLACK(vl);
 
     r = (rep_t *)nb_malloc(nb,a,rl);
 
     r->host_ops=&dispatch__;
     r->count=1;
     r->flags=WIRE_OK;
+    r->size=rl;
+    r->allocator=a;
 #ifdef DEBUG_DATA_ATOMICITY
     r->tid = pic_current_threadid();
     r->nb_usage = false;
@@ -371,6 +617,7 @@ bct_data_t allocate_wire_raw(pic::nballocator_t *a, unsigned nb, unsigned wl, co
     r->host_hdr.vector_len = vl;
     r->host_hdr.wire_len = wl;
     r->host_hdr.nb_mode = nb;
+    r->host_hdr.intern = 0;
 
     pie_getu64(&wp[5],8,(uint64_t *)&r->host_hdr.time);
     pie_getf32(&wp[13],4,&r->host_hdr.ubound);
@@ -28,6 +28,7 @@
 #include <picross/pic_nocopy.h>
 #include <picross/pic_error.h>
 #include <picross/pic_flipflop.h>
+#include <picross/pic_log.h>
 #include <piembedded/pie_iostream.h>
 #include <piembedded/pie_print.h>
 
@@ -79,6 +80,19 @@ inline void pia_data_decref_atomic(bct_data_t d) { if(d) if(pic_atomicdec(&d->co
 bct_data_t allocate_host_raw(pic::nballocator_t *a, unsigned nb, unsigned long long ts, float u, float l, float rst,unsigned t, unsigned sl, unsigned char **hp, unsigned vl, float **vp);
 bct_data_t allocate_wire_raw(pic::nballocator_t *a, unsigned nb, unsigned wl, const unsigned char *wp);
 
+/*
+ * Vector data freed on a thread with an attached pool is kept for reuse by
+ * the next allocation of the same size on that thread.
+ */
+
+class pia_datapool_t
+{
+    public:
+        static void attach();
+        static void detach();
+        static void stats(pic::msg_t &m, bool reset);
+};
+
 class pia_data_base_t
 {
 	public:
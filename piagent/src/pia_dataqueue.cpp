@@ -39,9 +39,11 @@ namespace
         void subscribe(pia_dataqueue_t::subscriber_t *s);
         void broadcast(const pia_data_nb_t &d);
         void dump(pic::msg_t &o, bool full);
+        unsigned long long search(unsigned long long t, bool after);
 
         unsigned size_;
         pic::lckvector_t<pia_data_nb_t>::nbtype queue_;
+        pic::lckvector_t<unsigned long long>::nbtype times_;
         unsigned long long write_;
         unsigned long long time_;
         pic::ilist_t<pia_dataqueue_t::subscriber_t,DATAQUEUE_SUBSCRIBER> subscribers_;
@@ -91,6 +93,7 @@ int queue_t::write(const pia_data_nb_t &d)
 
     current_ = d;
     queue_[write_%size_] = d;
+    times_[write_%size_] = t;
     ++write_;
     time_ = t;
 
@@ -145,6 +148,33 @@ int queue_t::read(pia_data_nb_t &d, unsigned long long *x, unsigned long long t)
     return 1;
 }
 
+// timestamps in the ring are strictly increasing, since write() drops
+// anything earlier than the last write and overwrites anything equal.
+// returns the first index in the ring whose time is >= t (or > t if after)
+
+unsigned long long queue_t::search(unsigned long long t, bool after)
+{
+    unsigned long long lo = (write_>=size_) ? (write_-size_) : 0ULL;
+    unsigned long long hi = write_;
+
+    while(lo<hi)
+    {
+        unsigned long long mid = lo+(hi-lo)/2;
+        unsigned long long mt = times_[mid%size_];
+
+        if(mt<t || (after && mt==t))
+        {
+            lo = mid+1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
 int queue_t::earliest(pia_data_nb_t &d, unsigned long long *i, unsigned long long t)
 {
     if(i) *i = write_;
@@ -154,18 +184,13 @@ int queue_t::earliest(pia_data_nb_t &d, unsigned long long *i, unsigned long lon
         return 0;
     }
 
-    unsigned long long x = (write_>=size_) ? (write_-size_) : 0ULL;
-    unsigned long long end = write_;
+    unsigned long long x = search(t,false);
 
-    for(; x<end; ++x)
+    if(x<write_)
     {
-        pia_data_nb_t r = queue_[x%size_];
-        if(r.time()>=t)
-        {
-            d = r;
-            if(i) *i = x;
-            return 1;
-        }
+        d = queue_[x%size_];
+        if(i) *i = x;
+        return 1;
     }
 
     return 0;
@@ -180,18 +205,14 @@ int queue_t::latest(pia_data_nb_t &d, unsigned long long *i, unsigned long long
         return 0;
     }
 
-    long long x = write_-1;
-    long long start = (write_>=size_) ? (write_-size_) : 0ULL;
+    unsigned long long start = (write_>=size_) ? (write_-size_) : 0ULL;
+    unsigned long long x = search(t,true);
 
-    for(; x>=start; --x)
+    if(x>start)
     {
-        pia_data_nb_t r = queue_[x%size_];
-        if(r.time()<=t)
-        {
-            d = r;
-            if(i) *i = x;
-            return 1;
-        }
+        d = queue_[(x-1)%size_];
+        if(i) *i = x-1;
+        return 1;
     }
 
     if(i) *i = start;
@@ -222,7 +243,7 @@ pia_dataqueue_t pia_dataqueue_t::alloc(unsigned size)
     return pia_dataqueue_t::from_given(ret);
 }
 
-queue_t::queue_t(unsigned size): size_(size), queue_(size), write_(0), time_(0), dropped_(0)
+queue_t::queue_t(unsigned size): size_(size), queue_(size), times_(size), write_(0), time_(0), dropped_(0)
 {
 }
 
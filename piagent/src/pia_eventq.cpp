@@ -19,6 +19,7 @@
 */
 
 #include "pia_eventq.h"
+#include "pia_timerwheel.h"
 
 #include <picross/pic_safeq.h>
 #include <picross/pic_ilist.h>
@@ -77,7 +78,7 @@ template <class T> struct pia_eventq_impl_t
     pic::ilist_t<idlecall_t<T> > idlecall_;
     pic::ilist_t<fastjob_t<T> > fastjob_;
     pic::ilist_t<slowjob_t<T> > slowjob_;
-    pic::ilist_t<evttimer_t<T> > timer_;
+    pia_timerwheel_t timer_;
 
     pic::nballocator_t * const allocator_;
     void (*pinger_)(void *);
@@ -144,10 +145,10 @@ namespace
         bct_data_t d_;
     };
 
-    template <class T> struct evttimer_t: public job_t<T>, virtual public pic::lckobject_t, pic::element_t<>
+    template <class T> struct evttimer_t: public job_t<T>, virtual public pic::lckobject_t, pia_wheelnode_t
     {
         evttimer_t(pia_eventq_impl_t<T> *q, const pia_cref_t &cp, void (*cb)(void *), void *ctx, unsigned long ms, long us): job_t<T>(q,cp), cb_(cb), ctx_(ctx), period_(ms*1000+us) { }
-        void insert();
+        void insert() { job_t<T>::queue_->timer_.insert(this,scheduled_); }
         bool run();
 
         void (*cb_)(void *);
@@ -248,32 +249,6 @@ template <class T> bool idlecall_t<T>::run()
     return false;
 }
 
-template <class T> void evttimer_t<T>::insert()
-{
-    evttimer_t<T> *t = job_t<T>::queue_->timer_.head();
-
-    if(!t)
-    {
-        job_t<T>::queue_->timer_.append(this);
-        return;
-    }
-
-    while(t && t->scheduled_<scheduled_)
-    {
-        t=job_t<T>::queue_->timer_.next(t);
-    }
-
-    if(t)
-    {
-        job_t<T>::queue_->timer_.insert(this,t);
-    }
-    else
-    {
-        job_t<T>::queue_->timer_.append(this);
-    }
-}
-
-
 /*
  * pia_eventq_impl_t
  */
@@ -376,13 +351,13 @@ template <class T> bool pia_eventq_impl_t<T>::run(unsigned long long now)
     idlecall_t<T> *ic;
     bool a = false;
 
+    timer_.advance(now);
     safe_.run();
 
-    while((t=timer_.head())!=0  && t->scheduled_ <= now)
+    while((t=static_cast<evttimer_t<T> *>(timer_.expire(now)))!=0)
     {
         tcurrent_=t->cb_;
         tcurrentctx_=t->ctx_;
-        t->remove();
         if(t->run())
         {
             t->scheduled_+=t->period_;
@@ -451,8 +426,7 @@ restart:
 
 template <class T> unsigned long long pia_eventq_impl_t<T>::next()
 {
-    evttimer_t<T> *t = timer_.head();
-    return t?t->scheduled_:~0ULL;
+    return timer_.next();
 }
 
 
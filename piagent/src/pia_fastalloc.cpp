@@ -28,6 +28,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <iostream>
+#include <algorithm>
+#include <new>
 
 //#include <execinfo.h>
 
@@ -36,6 +38,8 @@
 #define WATERMARK 2
 #define SLB_WATERMARK 10
 #define ALIGN(size, boundary) (((size) + ((boundary) - 1)) & ~((boundary) - 1))
+#define MAG_DEPTH 32
+#define MAG_BYTES 16384
 
 /*
  * We keep blocks on various stacks.  When a stack is exhausted, we get a block
@@ -53,6 +57,16 @@
  * this case because once a block is allocated, it remains valid forever.  Even
  * if the block is fragmented, the reference count isn't touched.  Fragmented
  * blocks are not recombined.
+ *
+ * Threads which attach() get a magazine per allocator: a short stack of free
+ * blocks per size class which only that thread touches.  A block in a
+ * magazine keeps the references it held while allocated (on the block and on
+ * the allocator) so moving blocks in and out of a magazine needs no atomic
+ * operations.  An empty magazine falls back to the shared stacks, a full one
+ * spills to them, and detach() hands everything back.
+ *
+ * The per class counters live in the magazines and are only written by the
+ * owning thread; stats() reads them racily.
  */
  
 
@@ -74,6 +88,40 @@ namespace
     };
 
     typedef blkheader_t * volatile vblkhdr_t;
+
+    struct magcounts_t
+    {
+        magcounts_t(): hits(0), misses(0), refills(0), splits(0), mallocs(0), waste(0) {}
+
+        void add(const magcounts_t &o) { hits+=o.hits; misses+=o.misses; refills+=o.refills; splits+=o.splits; mallocs+=o.mallocs; waste+=o.waste; }
+        void sub(const magcounts_t &o) { hits-=o.hits; misses-=o.misses; refills-=o.refills; splits-=o.splits; mallocs-=o.mallocs; waste-=o.waste; }
+
+        unsigned long long hits;
+        unsigned long long misses;
+        unsigned long long refills;
+        unsigned long long splits;
+        unsigned long long mallocs;
+        unsigned long long waste;
+    };
+
+    struct magazine_t
+    {
+        pia::fastalloc_t::nbimpl_t *owner;
+        magazine_t *next;
+        magazine_t *rnext;
+        blkheader_t *head[PIA_ALLOC_LIMIT];
+        unsigned depth[PIA_ALLOC_LIMIT];
+        magcounts_t counts[PIA_ALLOC_LIMIT];
+        magcounts_t base[PIA_ALLOC_LIMIT];
+    };
+
+    struct threadmags_t
+    {
+        threadmags_t(): head(0) {}
+        magazine_t *head;
+    };
+
+    pic::tsd_t magazines__;
 };
 
 struct pia::fastalloc_t::nbimpl_t: pic::thread_t
@@ -87,6 +135,12 @@ struct pia::fastalloc_t::nbimpl_t: pic::thread_t
     pic_atomic_t waste_;
     pic_atomic_t slbfree_;
     vslbhdr_t slbhead_;
+    unsigned caps_[PIA_ALLOC_LIMIT];
+    pic_atomic_t direct_[PIA_ALLOC_LIMIT];
+    pic::mutex_t maglock_;
+    magazine_t *maglist_;
+    unsigned magcount_;
+    magcounts_t retired_[PIA_ALLOC_LIMIT];
 
     void add_waste(unsigned waste)
     {
@@ -304,22 +358,25 @@ struct pia::fastalloc_t::nbimpl_t: pic::thread_t
         }
     }
 
-	blkheader_t *get0(unsigned i)
+	blkheader_t *get0(unsigned i, magcounts_t *c)
 	{
 		blkheader_t *blk;
 
         if((blk=alloc(i))!=0)
         {
+            if(c) c[i].refills++;
             return blk;
         }
 
         if(i+4>=PIA_ALLOC_LIMIT)
         {
+            if(c) c[i].mallocs++;
             blk = newblock(i);
             return blk;
         }
 
-		blk=get0(i+4);
+		blk=get0(i+4,c);
+        if(c) c[i].splits++;
         blkheader_t *blk2 = (blkheader_t *)PTRADD(blk,sizes_[i]);
 
         blk2->refc=1;
@@ -361,7 +418,28 @@ struct pia::fastalloc_t::nbimpl_t: pic::thread_t
 		{
 			if(size+sizeof(blkheader_t) <= sizes_[i])
 			{
-				ptr = get0(i);
+                magazine_t *m = magazine();
+
+                if(!m)
+                {
+                    pic_atomicinc(&direct_[i]);
+                    ptr = get0(i,0);
+                    incref();
+                    return (void *)(ptr+1);
+                }
+
+                m->counts[i].waste += sizes_[i]-sizeof(blkheader_t)-size;
+
+                if((ptr=m->head[i])!=0)
+                {
+                    m->head[i] = ptr->next;
+                    m->depth[i]--;
+                    m->counts[i].hits++;
+                    return (void *)(ptr+1);
+                }
+
+                m->counts[i].misses++;
+				ptr = get0(i,m->counts);
                 incref();
                 return (void *)(ptr+1);
 			}
@@ -375,10 +453,151 @@ struct pia::fastalloc_t::nbimpl_t: pic::thread_t
 	{
 		blkheader_t *ptr = ((blkheader_t *)mem)-1;
         nbimpl_t *a = (nbimpl_t *)da;
+        magazine_t *m = a->magazine();
+
+        if(m)
+        {
+            unsigned fl = ptr->freelist;
+
+            if(m->depth[fl] < a->caps_[fl])
+            {
+                ptr->next = m->head[fl];
+                m->head[fl] = ptr;
+                m->depth[fl]++;
+                return;
+            }
+        }
+
 		a->release(ptr);
         a->decref();
 	}
 
+    magazine_t *magazine()
+    {
+        threadmags_t *t = (threadmags_t *)magazines__.get();
+
+        if(!t)
+        {
+            return 0;
+        }
+
+        for(magazine_t *m = t->head; m; m=m->next)
+        {
+            if(m->owner == this)
+            {
+                return m;
+            }
+        }
+
+        magazine_t *m = (magazine_t *)pic_thread_lck_malloc(sizeof(magazine_t));
+
+        if(!m)
+        {
+            return 0;
+        }
+
+        new(m) magazine_t;
+        m->owner = this;
+
+        for(unsigned i=0;i<PIA_ALLOC_LIMIT;i++)
+        {
+            m->head[i] = 0;
+            m->depth[i] = 0;
+        }
+
+        // the magazine keeps us alive until its thread detaches
+        incref();
+
+        {
+            pic::mutex_t::guard_t g(maglock_);
+            m->rnext = maglist_;
+            maglist_ = m;
+            magcount_++;
+        }
+
+        m->next = t->head;
+        t->head = m;
+        return m;
+    }
+
+    void flush(magazine_t *m)
+    {
+        for(unsigned i=0;i<PIA_ALLOC_LIMIT;i++)
+        {
+            blkheader_t *blk;
+
+            while((blk=m->head[i])!=0)
+            {
+                m->head[i] = blk->next;
+                release(blk);
+                decref();
+            }
+
+            m->depth[i] = 0;
+        }
+
+        {
+            pic::mutex_t::guard_t g(maglock_);
+            magazine_t **p = &maglist_;
+
+            while(*p != m)
+            {
+                p = &(*p)->rnext;
+            }
+
+            *p = m->rnext;
+            magcount_--;
+
+            for(unsigned i=0;i<PIA_ALLOC_LIMIT;i++)
+            {
+                magcounts_t c = m->counts[i];
+                c.sub(m->base[i]);
+                retired_[i].add(c);
+            }
+        }
+
+        m->~magazine_t();
+        pic_thread_lck_free(m,sizeof(magazine_t));
+        decref();
+    }
+
+    void classstats(unsigned i, pia::fastalloc_t::classstats_t &s, bool reset)
+    {
+        magcounts_t t = retired_[i];
+
+        for(magazine_t *m = maglist_; m; m=m->rnext)
+        {
+            magcounts_t c = m->counts[i];
+            c.sub(m->base[i]);
+            t.add(c);
+
+            if(reset)
+            {
+                m->base[i] = m->counts[i];
+            }
+        }
+
+        if(reset)
+        {
+            retired_[i] = magcounts_t();
+        }
+
+        s.size = sizes_[i];
+        s.hits = t.hits;
+        s.misses = t.misses;
+        s.refills = t.refills;
+        s.splits = t.splits;
+        s.mallocs = t.mallocs;
+        s.waste = t.waste;
+        s.direct = (unsigned)direct_[i];
+
+        if(reset)
+        {
+            pic_atomic_t d = direct_[i];
+            while(!pic_atomiccas(&direct_[i],d,0)) d = direct_[i];
+        }
+    }
+
     slbheader_t *newslb()
     {
         slbheader_t *p;
@@ -411,18 +630,14 @@ struct pia::fastalloc_t::nbimpl_t: pic::thread_t
         return p;
     }
 
-	nbimpl_t(): count_(1), stop_(false), waste_(0), slbfree_(0), slbhead_(0)
+	nbimpl_t(): count_(1), stop_(false), waste_(0), slbfree_(0), slbhead_(0), maglist_(0), magcount_(0)
 	{
 		unsigned i,j;
 
 		for(i=0;i<4;i++)
         {
 			queue_[i]=0;
-#ifdef ALIGN_16
-			sizes_[i]=64+16*i; 
-#else
             sizes_[i]=32+8*i;
-#endif
             free_[i]=0;
         }
 
@@ -432,6 +647,13 @@ struct pia::fastalloc_t::nbimpl_t: pic::thread_t
 			sizes_[i]=sizes_[i-4]*2;
 		}
 
+		for(i=0;i<PIA_ALLOC_LIMIT;i++)
+		{
+            unsigned c = std::min((unsigned)MAG_DEPTH,(unsigned)(MAG_BYTES/sizes_[i]));
+            caps_[i] = (c<2) ? 0 : c;
+            direct_[i] = 0;
+		}
+
         for(j=0;j<4;j++)
         {
             for(i=0;i<WATERMARK;i++)
@@ -457,9 +679,93 @@ pia::fastalloc_t::fastalloc_t()
 
 pia::fastalloc_t::~fastalloc_t()
 {
+    threadmags_t *t = (threadmags_t *)magazines__.get();
+
+    if(t)
+    {
+        for(magazine_t **p = &t->head; *p; p=&(*p)->next)
+        {
+            if((*p)->owner == nbimpl_)
+            {
+                magazine_t *m = *p;
+                *p = m->next;
+                nbimpl_->flush(m);
+                break;
+            }
+        }
+    }
+
 	nbimpl_->decref();
 }
 
+void pia::fastalloc_t::attach()
+{
+    if(!magazines__.get())
+    {
+        magazines__.set(new threadmags_t);
+    }
+}
+
+void pia::fastalloc_t::detach()
+{
+    threadmags_t *t = (threadmags_t *)magazines__.set(0);
+
+    if(!t)
+    {
+        return;
+    }
+
+    while(t->head)
+    {
+        magazine_t *m = t->head;
+        t->head = m->next;
+        m->owner->flush(m);
+    }
+
+    delete t;
+}
+
+unsigned pia::fastalloc_t::classes() const
+{
+    return PIA_ALLOC_LIMIT;
+}
+
+void pia::fastalloc_t::classstats(unsigned cls, classstats_t &s) const
+{
+    PIC_ASSERT(cls<PIA_ALLOC_LIMIT);
+    pic::mutex_t::guard_t g(nbimpl_->maglock_);
+    nbimpl_->classstats(cls,s,false);
+}
+
+void pia::fastalloc_t::stats(pic::msg_t &m, bool reset) const
+{
+    pic::mutex_t::guard_t g(nbimpl_->maglock_);
+    classstats_t t;
+    unsigned long long fast = 0, slow = 0, waste = 0;
+
+    m << "fastalloc: threads=" << nbimpl_->magcount_ << "\n";
+
+    for(unsigned i=0;i<PIA_ALLOC_LIMIT;i++)
+    {
+        nbimpl_->classstats(i,t,reset);
+
+        if(!t.hits && !t.misses && !t.direct)
+        {
+            continue;
+        }
+
+        m << "  size=" << t.size << " hits=" << t.hits << " misses=" << t.misses << " refills=" << t.refills;
+        m << " splits=" << t.splits << " mallocs=" << t.mallocs << " direct=" << t.direct;
+        m << " waste=" << t.waste << "\n";
+
+        fast += t.hits;
+        slow += t.misses;
+        waste += t.waste;
+    }
+
+    m << "fastalloc: hitrate=" << ((fast+slow) ? (100ULL*fast/(fast+slow)) : 0ULL) << "% waste=" << waste << "\n";
+}
+
 static void demallocator(void *ptr, void *)
 {
     free(ptr);
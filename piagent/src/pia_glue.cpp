@@ -30,7 +30,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 
-struct pia_timer_t: pic::element_t<>, virtual pic::lckobject_t
+struct pia_timer_t: pia_wheelnode_t, virtual pic::lckobject_t
 {
     void (*cb_)(void *);
     void *ctx_;
@@ -64,12 +64,18 @@ static void synccaller(void *ctx)
 
 int pia::manager_t::impl_t::fastcall(int (*cb)(void *, void *, void *, void *), void *a1, void *a2, void *a3, void *a4)
 {
-    if(handle_->service_isfast())
+    if(isfast())
     {
         return (cb)(a1,a2,a3,a4);
     }
     else
     {
+        // the fast thread is waiting for this worker, so it runs the call
+        if(pia_clocklist_t::isworker())
+        {
+            return pia_clocklist_t::workercall(cb,a1,a2,a3,a4);
+        }
+
         if(!fastactive_)
         {
             pic::mutex_t::guard_t g(fast_lock_);
@@ -92,6 +98,157 @@ int pia::manager_t::impl_t::fastcall(int (*cb)(void *, void *, void *, void *),
     return s.r;
 }
 
+// as fastcall, but returns as soon as the call is queued.  calls are run
+// in the order they were queued, along with ordinary fastcalls.
+
+int pia::manager_t::impl_t::fastcall_async(void (*cb)(void *), void *ctx)
+{
+    if(isfast())
+    {
+        (cb)(ctx);
+        return 0;
+    }
+    else
+    {
+        if(!fastactive_)
+        {
+            pic::mutex_t::guard_t g(fast_lock_);
+            (cb)(ctx);
+            return 0;
+        }
+    }
+
+    fastq_.idlecall(async_cpoint_,cb,ctx);
+
+    return 0;
+}
+
+/*
+ * An entity call queued by api_fastcall_async.  Records come from the
+ * non blocking allocator and are pushed onto async_in_ without a lock.
+ * The first push onto an empty list queues a visit to the fast thread,
+ * which takes the whole list and runs it oldest first.  The records then
+ * go onto async_out_ for the main thread, which frees them.
+ *
+ * While a call is queued, the entity's async count keeps it from going:
+ * if its last strong reference is dropped meanwhile, the gone callback is
+ * held back until the main thread has retired the last such call.
+ */
+
+struct pia_asynccall_t
+{
+    bct_entity_t e_;
+    pia::context_t::impl_t *entity_;
+    int (*cb_)(bct_entity_t, void *, void *);
+    void *a1_;
+    void *a2_;
+    pia_asynccall_t *next_;
+};
+
+static void push_async(pia_asynccall_t **list, pia_asynccall_t *head, pia_asynccall_t *tail, bool *first)
+{
+    do
+    {
+        tail->next_ = *list;
+    }
+    while(!pic_atomicptrcas(list,tail->next_,head));
+
+    *first = (tail->next_==0);
+}
+
+static pia_asynccall_t *take_async(pia_asynccall_t **list)
+{
+    pia_asynccall_t *c;
+
+    do
+    {
+        c = *list;
+    }
+    while(!pic_atomicptrcas(list,c,0));
+
+    return c;
+}
+
+// main thread
+void pia::manager_t::impl_t::async_retire(void *g_)
+{
+    pia::manager_t::impl_t *g = (pia::manager_t::impl_t *)g_;
+    pia_asynccall_t *c = take_async(&g->async_out_);
+
+    while(c)
+    {
+        pia_asynccall_t *n = c->next_;
+        c->entity_->async_dec();
+        pic::nb_free(c);
+        c = n;
+    }
+}
+
+// fast thread
+void pia::manager_t::impl_t::async_run(void *g_)
+{
+    pia::manager_t::impl_t *g = (pia::manager_t::impl_t *)g_;
+    pia_asynccall_t *c = take_async(&g->async_in_);
+
+    if(!c)
+    {
+        return;
+    }
+
+    // pushed newest first
+    pia_asynccall_t *r = 0;
+    pia_asynccall_t *t = c;
+
+    while(c)
+    {
+        pia_asynccall_t *n = c->next_;
+        c->next_ = r;
+        r = c;
+        c = n;
+    }
+
+    for(c=r; c; c=c->next_)
+    {
+        try
+        {
+            (c->cb_)(c->e_,c->a1_,c->a2_);
+        }
+        CATCHLOG()
+    }
+
+    bool first;
+    push_async(&g->async_out_,r,t,&first);
+
+    if(first)
+    {
+        g->mainq()->idlecall(g->async_cpoint_,async_retire,g);
+    }
+}
+
+void pia::manager_t::impl_t::asynccall(pia_asynccall_t *c)
+{
+    bool first;
+    push_async(&async_in_,c,c,&first);
+
+    if(first)
+    {
+        fastcall_async(async_run,this);
+    }
+}
+
+void pia::context_t::impl_t::async_dec()
+{
+    if(pic_atomicdec(&async_)!=0)
+    {
+        return;
+    }
+
+    for(; asyncgone_>0; asyncgone_--)
+    {
+        glue_->auxq()->idle(cpoint_,idle_callback,this,pia_data_t());
+    }
+}
+
 void pia::manager_t::impl_t::context_add(pia::context_t::impl_t *ctx)
 {
     contexts_.append(ctx);
@@ -361,6 +518,36 @@ static int api_fastcall(bct_entity_t e_, int (*cb)(bct_entity_t, void *, void *)
     return -1;
 }
 
+// never waits for the main thread, so it is safe on the fast thread
+static int api_fastcall_async(bct_entity_t e_, int (*cb)(bct_entity_t, void *, void *), void *a1, void *a2)
+{
+    pia::context_t::impl_t *e = pia::context_t::impl_t::from_entity(e_);
+    try
+    {
+        pia_logguard_t guard(e->glue());
+
+        if(e->glue()->isfast())
+        {
+            (cb)(e_,a1,a2);
+            return 0;
+        }
+
+        pia_asynccall_t *c = (pia_asynccall_t *)pic::nb_malloc(PIC_ALLOC_NB,e->glue()->allocator(),sizeof(pia_asynccall_t));
+
+        c->e_=e_;
+        c->entity_=e;
+        c->cb_=cb;
+        c->a1_=a1;
+        c->a2_=a2;
+
+        e->async_inc();
+        e->glue()->asynccall(c);
+        return 0;
+    }
+    PIA_CATCHLOG_EREF(e)
+    return -1;
+}
+
 void pia::manager_t::impl_t::winch(const char *msg)
 {
     auxq()->idle(cpoint_,winch_callback, (void *)this, allocate_cstring(msg));
@@ -497,7 +684,7 @@ static bool api_is_fast(bct_entity_t e_)
     try
     {
         pia_mainguard_t guard(e->glue());
-        return e->glue()->handle()->service_isfast();
+        return e->glue()->isfast();
     }
     PIA_CATCHLOG_EREF(e)
     return false;
@@ -515,6 +702,32 @@ static void api_dump(bct_entity_t e_)
     PIA_CATCHLOG_EREF(e)
 }
 
+static int api_clockstats_enable(bct_entity_t e_, int f)
+{
+    pia::context_t::impl_t *e = pia::context_t::impl_t::from_entity(e_);
+
+    try
+    {
+        pia_mainguard_t guard(e->glue());
+        return e->glue()->enable_clock_timing(f!=0) ? 1 : 0;
+    }
+    PIA_CATCHLOG_EREF(e)
+    return -1;
+}
+
+static bct_data_t api_clockstats(bct_entity_t e_, int reset)
+{
+    pia::context_t::impl_t *e = pia::context_t::impl_t::from_entity(e_);
+
+    try
+    {
+        pia_mainguard_t guard(e->glue());
+        return e->glue()->clock_timing(reset!=0).give();
+    }
+    PIA_CATCHLOG_EREF(e)
+    return 0;
+}
+
 static void *api_winctx(bct_entity_t e_)
 {
     pia::context_t::impl_t *e = pia::context_t::impl_t::from_entity(e_);
@@ -636,7 +849,10 @@ bct_entity_ops_t pia::context_t::impl_t::dispatch__ =
     api_dump,
 	api_winctx,
     api_winch,
-    api_is_fast
+    api_is_fast,
+    api_clockstats_enable,
+    api_clockstats,
+    api_fastcall_async
 };
 
 void pia::context_t::impl_t::idle_callback(void *e_, const pia_data_t & d)
@@ -665,11 +881,15 @@ void pia::manager_t::impl_t::process_main(unsigned long long now, unsigned long
 {
     pia_mainguard_t guard(this);
 
+    network_->network_hold();
+
     if(mainq()->run(now))
     {
         *activity = true;
     }
 
+    network_->network_release();
+
     if(mainq()->next() < *timer)
     {
         *timer=mainq()->next();
@@ -990,6 +1210,12 @@ void pia::manager_t::fast_resume()
     impl_->fast_resume();
 }
 
+void pia::manager_t::set_clock_workers(unsigned n)
+{
+    pia_mainguard_t guard(impl_);
+    impl_->set_clock_workers(n);
+}
+
 unsigned pia::manager_t::window_count()
 {
     return impl_->window_count();
@@ -1017,7 +1243,7 @@ static void fast_pinger(void *g_) { ((pia::manager_t::impl_t *)g_)->service_fast
 static void aux_pinger(void *g_) { ((pia::manager_t::impl_t *)g_)->service_aux(); }
 static void ctx_pinger(void *c_) { ((pia::context_t::impl_t *)c_)->service_ctx(); }
 
-pia::context_t::impl_t::impl_t(pia::manager_t::impl_t *g, int grp, const pic::status_t &gone, const pic::f_string_t &log, const char *t, bool strong): gone_(gone), log_(log), glue_(g), appq_(g->allocator(),ctx_pinger,this), queued_(0), killed_(false), exited_(false), group_(grp)
+pia::context_t::impl_t::impl_t(pia::manager_t::impl_t *g, int grp, const pic::status_t &gone, const pic::f_string_t &log, const char *t, bool strong): gone_(gone), log_(log), glue_(g), appq_(g->allocator(),ctx_pinger,this), queued_(0), async_(0), asyncgone_(0), killed_(false), exited_(false), group_(grp)
 {
     ops_=&dispatch__;
     strong_=strong?1:0;
@@ -1034,11 +1260,14 @@ pia::context_t::impl_t::~impl_t()
 }
 
 pia::manager_t::impl_t::impl_t(const char *user, pia::controller_t *h, pic::nballocator_t *a, network_t *n, const pic::f_string_t &log, const pic::f_string_t &winch,void *winctx): handle_(h), seed_(pic_microtime()), network_(n), allocator_(a), auxq_(a,aux_pinger,this), fastq_(a,fast_pinger,this), mainq_(a,main_pinger,this),
-    index_(this), clock_(this), rpc_(this), log_(log), auxflag_(0), auxbusy_(false), winctx_(winctx), winch_(winch), fast_lock_(true), fastactive_(1)
+    index_(this), clock_(this), rpc_(this), log_(log), auxflag_(0), auxbusy_(false), timers_(0), winctx_(winctx), winch_(winch), fast_lock_(true), fastactive_(1)
 {
     unsigned char *p = (unsigned char *)&chuff_;
     cpoint_=pia_make_cpoint();
     timer_cpoint_=pia_make_cpoint();
+    async_cpoint_=pia_make_cpoint();
+    async_in_=0;
+    async_out_=0;
 
     srand(pic_microtime());
 
@@ -1050,6 +1279,7 @@ pia::manager_t::impl_t::impl_t(const char *user, pia::controller_t *h, pic::nbal
     chuff_ |= 0x800000000000ULL;
     user_ = allocate_cstring(user);
     timer_count_=0;
+    timer_current_=0;
 
     mainq_.timer(timer_cpoint_,timer_callback,this,1000);
 }
@@ -1058,37 +1288,55 @@ pia::manager_t::impl_t::~impl_t()
 {
     cpoint_->disable();
     timer_cpoint_->disable();
+    async_cpoint_->disable();
+
+    pia_asynccall_t *lists[2] = { async_in_, async_out_ };
+
+    for(unsigned i=0; i<2; i++)
+    {
+        while(lists[i])
+        {
+            pia_asynccall_t *c = lists[i];
+            lists[i] = c->next_;
+            pic::nb_free(c);
+        }
+    }
 }
 
+// timers_ is a wheel keyed on timer_count_, so each tick is one second.
+
 void pia::manager_t::impl_t::timer_callback(void *impl_)
 {
     impl_t *impl = (impl_t *)impl_;
 
-    pia_timer_t *t = impl->timers_.head();
-    pia_timer_t *t2;
-    unsigned tc = impl->timer_count_++;
+    unsigned long long tc = impl->timer_count_++;
+    pia_wheelnode_t *n;
 
-    while(t)
+    while((n=impl->timers_.expire(tc))!=0)
     {
-        t2=impl->timers_.next(t);
+        pia_timer_t *t = static_cast<pia_timer_t *>(n);
 
-        if(!t->period_)
+        // a zero period timer is deleted without ever firing
+        if(t->period_)
         {
-            delete t;
-            t=t2;
-            continue;
-        }
+            impl->timer_current_ = t;
 
-        if((t->bias_+tc)%(t->period_)==0)
-        {
             try
             {
                 t->cb_(t->ctx_);
             }
             CATCHLOG()
+
+            impl->timer_current_ = 0;
+        }
+
+        if(!t->period_)
+        {
+            delete t;
+            continue;
         }
 
-        t=t2;
+        impl->timers_.insert(t,tc+t->period_);
     }
 }
 
@@ -1099,13 +1347,26 @@ void *pia::manager_t::impl_t::add_timer(void (*cb)(void *), void *ctx,unsigned p
     t->ctx_=ctx;
     t->period_=period;
     t->bias_=((((unsigned long long)t)>>9)&0xff);
-    timers_.append(t);
+
+    // first due when (bias+count)%period==0, as the timers always have been
+    unsigned r = period?(unsigned)((t->bias_+timer_count_)%period):0;
+    timers_.insert(t,timer_count_+(r?period-r:0));
+
     return (void *)t;
 }
 
 void pia::manager_t::impl_t::del_timer(void *hnd)
 {
-    ((pia_timer_t *)hnd)->period_=0;;
+    pia_timer_t *t = (pia_timer_t *)hnd;
+
+    // a timer cancelled from its own callback is deleted once it returns
+    if(t==timer_current_)
+    {
+        t->period_=0;
+        return;
+    }
+
+    delete t;
 }
 
 pia::context_t::context_t(): impl_(0)
@@ -41,11 +41,13 @@
 #include "pia_rpc.h"
 #include "pia_error.h"
 #include "pia_eventq.h"
+#include "pia_timerwheel.h"
 #include "pia_dataqueue.h"
 #include "pia_window.h"
 
 struct pia_ctx_t;
 struct pia_timer_t;
+struct pia_asynccall_t;
 
 class pia::manager_t::impl_t: pic::nocopy_t, public pic::logger_t, virtual public pic::lckobject_t
 {
@@ -105,9 +107,15 @@ class pia::manager_t::impl_t: pic::nocopy_t, public pic::logger_t, virtual publi
         void cancelclocknotify(void *n) { clock_.cancelnotify(n); }
         int setdownstreamclock(void *u, void *d) { return clock_.setdownstream(u,d); }
         int cleardownstreamclock(void *u, void *d) { return clock_.cleardownstream(u,d); }
+        void set_clock_workers(unsigned n) { clock_.set_workers(n); }
+        bool enable_clock_timing(bool e) { return clock_.enable_timing(e); }
+        pia_data_t clock_timing(bool reset) { return clock_.timing(reset); }
+        bool isfast() { return handle_->service_isfast(); }
         void context_add(pia::context_t::impl_t *);
         void context_del(pia::context_t::impl_t *);
         int fastcall(int (*cb)(void *, void *,void *, void *), void *, void *,void *, void *);
+        int fastcall_async(void (*cb)(void *), void *);
+        void asynccall(pia_asynccall_t *);
         pia::controller_t *handle() { return handle_; }
         void main_lock() { lock_.lock(); }
         void main_unlock() { lock_.unlock(); }
@@ -140,6 +148,8 @@ class pia::manager_t::impl_t: pic::nocopy_t, public pic::logger_t, virtual publi
 
         static void idle_callback(void *g_, const pia_data_t &d);
         static void timer_callback(void *);
+        static void async_run(void *);
+        static void async_retire(void *);
         static void log_callback(void *e_, const pia_data_t &d);
         static void winch_callback(void *e_, const pia_data_t &d);
 
@@ -172,9 +182,13 @@ class pia::manager_t::impl_t: pic::nocopy_t, public pic::logger_t, virtual publi
         pia_cref_t cpoint_;
         pia_data_t user_;
 
-        pic::ilist_t<pia_timer_t> timers_;
+        pia_timerwheel_t timers_;
+        pia_timer_t *timer_current_;
         pia_cref_t timer_cpoint_;
-        unsigned timer_count_;
+        unsigned long long timer_count_;
+        pia_cref_t async_cpoint_;
+        pia_asynccall_t *async_in_;
+        pia_asynccall_t *async_out_;
 		void *winctx_;
         pic::f_string_t winch_;
         pic::rwmutex_t global_lock_;
@@ -252,7 +266,9 @@ class pia::context_t::impl_t: pic::nocopy_t, public pic::element_t<>, virtual pu
         void strong_inc() { strong_++; weak_inc(); }
         bool inuse() { return strong_!=0; }
         void log(const pia_data_t &msg);
-        void strong_dec() { if(--strong_==0) { glue_->auxq()->idle(cpoint_,idle_callback,this,pia_data_t()); return; } weak_dec(); }
+        void strong_dec() { if(--strong_==0) { if(async_) { asyncgone_++; return; } glue_->auxq()->idle(cpoint_,idle_callback,this,pia_data_t()); return; } weak_dec(); }
+        void async_inc() { pic_atomicinc(&async_); }
+        void async_dec();
         void weak_dec() { if(--weak_==0) { glue_->context_del(this); delete this; } }
         void cancel() { log_.clear(); gone_.clear(); }
         pia_eventq_t *appq() { return &appq_; }
@@ -289,6 +305,8 @@ class pia::context_t::impl_t: pic::nocopy_t, public pic::element_t<>, virtual pu
         static bct_entity_ops_t dispatch__;
 
         pic_atomic_t queued_;
+        pic_atomic_t async_;
+        unsigned asyncgone_;
         bool killed_;
         bool exited_;
         int group_;
@@ -308,6 +326,7 @@ class pia_ctx_t
         pia_ctx_t &operator=(pia::context_t::impl_t *e) { release(); entity_=e; if(entity_) entity_->strong_inc(); return *this; }
         void release() { if(entity_) entity_->strong_dec(); entity_=0; }
         bool valid() { return entity_!=0; }
+        pia::context_t::impl_t *entity() const { return entity_; }
 
         pia::context_t::impl_t *operator->() const { PIC_ASSERT(entity_); return entity_; }
 
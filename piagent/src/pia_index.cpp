@@ -36,13 +36,52 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <deque>
 
 #define ISERVER_TICK_INTERVAL 5000
 #define ISERVER_TICKS_DEATH   10
+#define ISERVER_LOG_SIZE      256
+#define ISERVER_HDR_SIZE      17
+
+/*
+ * Each index server numbers its local changes with a generation, and keeps
+ * the last ISERVER_LOG_SIZE of them.  Changes are broadcast as deltas from
+ * one generation to the next, and the tick only carries the current
+ * generation.  A peer that sees a gap asks for the changes since the last
+ * generation it applied, and is sent a snapshot instead if the log no
+ * longer reaches back that far.
+ *
+ * Packets start with a versioned header (see pie_setindexhdr) that the old
+ * whole-set format can't be mistaken for, in either direction.
+ */
 
 struct inode_t;
 struct irecord_t;
 struct iserver_t;
+struct ipeer_t;
+
+struct ilog_t
+{
+    ilog_t(uint32_t g, unsigned o, const pia_data_t &n, unsigned short c): gen_(g), op_(o), name_(n), cookie_(c) {}
+
+    uint32_t gen_;
+    unsigned op_;
+    pia_data_t name_;
+    unsigned short cookie_;
+};
+
+struct ipeer_t: pic::element_t<>
+{
+    ipeer_t(uint32_t s): source_(s), gen_(0), death_(0), asked_(false), insnap_(false), part_(0), snapgen_(0) {}
+
+    uint32_t source_;
+    uint32_t gen_;
+    int death_;
+    bool asked_;
+    bool insnap_;
+    uint32_t part_;
+    uint32_t snapgen_;
+};
 
 struct pia_indexlist_t::impl_t
 {
@@ -62,16 +101,31 @@ struct iserver_t: pic::element_t<>
     void kill(const pia_ctx_t &e);
     void dump(const pia_ctx_t &e);
     void receive(const unsigned char *msg, unsigned len);
-    void refresh(const pia_data_t &a, unsigned short cookie);
+    void receive_records(ipeer_t *p, const unsigned char *msg, unsigned len);
+    bool apply(ipeer_t *p, unsigned op, const pia_data_t &a, unsigned short cookie);
     void add(const pia_ctx_t &e, bct_index_t *i);
     void killadvertise(void *id);
+    void remove_local(irecord_t *r);
+    bool advertised(const pia_data_t &a, long hash, unsigned short cookie);
+    irecord_t *lookup(ipeer_t *p, const pia_data_t &a, long hash, unsigned short cookie);
+    irecord_t *member(int c);
+    ipeer_t *peer(uint32_t source);
+    void drop(ipeer_t *p);
+    void log(unsigned op, const pia_data_t &a, unsigned short cookie);
+    void request(ipeer_t *p);
+    void reply(uint32_t since);
     void close();
     void changed();
     int tick();
-    void transmit();
+    void transmit(uint32_t since);
+    void transmit_delta(uint32_t since);
+    void transmit_snapshot();
+    void transmit_header(unsigned type, uint32_t source, uint32_t gen0, uint32_t gen1);
     void timer();
 
     static void job_network(void *s_, const pia_data_t &);
+    static void job_delta(void *s_);
+    static void job_reply(void *s_);
 
     pia_data_t name_;
     pia_ctx_t entity_;
@@ -79,9 +133,22 @@ struct iserver_t: pic::element_t<>
 
     pia_sockref_t socket_;
     pia_job_t job_timer_;
+    pia_job_t job_delta_;
+    pia_job_t job_reply_;
 
     pic::ilist_t<inode_t> nodes_;
     pic::ilist_t<irecord_t> records_;
+    pic::ilist_t<ipeer_t> peers_;
+
+    uint32_t source_;
+    uint32_t gen_;
+    uint32_t sent_;
+    uint32_t since_;
+    bool replying_;
+    std::deque<ilog_t> log_;
+
+    irecord_t *cursor_;
+    int cursorpos_;
 };
 
 struct inode_t: pic::element_t<>
@@ -122,12 +189,13 @@ struct inode_t: pic::element_t<>
 
 struct irecord_t: pic::element_t<>
 {
-    irecord_t(const pia_data_t &n, void *i, unsigned short c);
+    irecord_t(const pia_data_t &n, void *i, unsigned short c, ipeer_t *p);
 
     pia_data_t name_;
     void *id_;
     unsigned short cookie_;
-    int death_;
+    ipeer_t *peer_;
+    bool stale_;
     long hash_;
 };
 
@@ -143,8 +211,7 @@ void iserver_t::killadvertise(void *id)
 
         if(r->id_==id)
         {
-            r->remove();
-            delete r;
+            remove_local(r);
         }
 
         r=n;
@@ -153,6 +220,163 @@ void iserver_t::killadvertise(void *id)
     changed();
 }
 
+void iserver_t::remove_local(irecord_t *r)
+{
+    pia_data_t name = r->name_;
+    unsigned short cookie = r->cookie_;
+    long hash = r->hash_;
+
+    delete r;
+
+    if(!advertised(name,hash,cookie))
+    {
+        log(BCTINDEX_DEL,name,cookie);
+    }
+}
+
+bool iserver_t::advertised(const pia_data_t &a, long hash, unsigned short cookie)
+{
+    for(irecord_t *r=records_.head(); r!=0; r=records_.next(r))
+    {
+        if(r->id_ && r->hash_==hash && r->cookie_==cookie && r->name_==a)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+irecord_t *iserver_t::lookup(ipeer_t *p, const pia_data_t &a, long hash, unsigned short cookie)
+{
+    for(irecord_t *r=records_.head(); r!=0; r=records_.next(r))
+    {
+        if(r->peer_==p && !r->id_ && r->hash_==hash && r->cookie_==cookie && r->name_==a)
+        {
+            return r;
+        }
+    }
+
+    return 0;
+}
+
+// listeners walk the members in order after every change, so keep our place
+
+irecord_t *iserver_t::member(int c)
+{
+    if(!cursor_ || c<cursorpos_)
+    {
+        cursor_=records_.head();
+        cursorpos_=0;
+    }
+
+    while(cursor_ && cursorpos_<c)
+    {
+        cursor_=records_.next(cursor_);
+        cursorpos_++;
+    }
+
+    return cursor_;
+}
+
+ipeer_t *iserver_t::peer(uint32_t source)
+{
+    ipeer_t *p;
+
+    for(p=peers_.head(); p!=0; p=peers_.next(p))
+    {
+        if(p->source_==source)
+        {
+            return p;
+        }
+    }
+
+    p = new ipeer_t(source);
+    peers_.append(p);
+    return p;
+}
+
+void iserver_t::drop(ipeer_t *p)
+{
+    irecord_t *r,*n;
+    bool chg=false;
+
+    r=records_.head();
+
+    while(r)
+    {
+        n=records_.next(r);
+
+        if(r->peer_==p)
+        {
+            delete r;
+            chg=true;
+        }
+
+        r=n;
+    }
+
+    delete p;
+
+    if(chg)
+    {
+        changed();
+    }
+}
+
+void iserver_t::log(unsigned op, const pia_data_t &a, unsigned short cookie)
+{
+    log_.push_back(ilog_t(++gen_,op,a,cookie));
+
+    if(log_.size()>ISERVER_LOG_SIZE)
+    {
+        log_.pop_front();
+    }
+
+    job_delta_.idlecall(entity_->glue()->mainq(),job_delta,this);
+}
+
+void iserver_t::job_delta(void *s_)
+{
+    iserver_t *s = (iserver_t *)s_;
+
+    if(s->sent_!=s->gen_)
+    {
+        s->transmit(s->sent_);
+        s->sent_=s->gen_;
+    }
+}
+
+void iserver_t::request(ipeer_t *p)
+{
+    if(!p->asked_)
+    {
+        p->asked_=true;
+        transmit_header(BCTMTYPE_INDEX_REQ,p->source_,p->gen_,0);
+    }
+}
+
+// requests are broadcast, so answer them all at once from the oldest
+
+void iserver_t::reply(uint32_t since)
+{
+    if(!replying_ || since<since_)
+    {
+        since_=since;
+    }
+
+    replying_=true;
+    job_reply_.idlecall(entity_->glue()->mainq(),job_reply,this);
+}
+
+void iserver_t::job_reply(void *s_)
+{
+    iserver_t *s = (iserver_t *)s_;
+
+    s->replying_=false;
+    s->transmit(s->since_);
+}
+
 void inode_job_closed(void *h_, const pia_data_t &d)
 {
     inode_t *h = (inode_t *)h_;
@@ -192,12 +416,21 @@ void iserver_t::close()
         h->detach(true);
     }
 
+    ipeer_t *p;
+
     while((r=records_.head())!=0)
     {
         delete r;
     }
 
+    while((p=peers_.head())!=0)
+    {
+        delete p;
+    }
+
     job_timer_.cancel();
+    job_delta_.cancel();
+    job_reply_.cancel();
     socket_.close();
 
     delete this;
@@ -213,6 +446,8 @@ void iserver_t::changed()
 {
     inode_t *h;
 
+    cursor_=0;
+
     for(h=nodes_.head(); h!=0; h=nodes_.next(h))
     {
         h->job_changed_.idle(h->entity_->appq(),inode_job_changed,h,pia_data_t());
@@ -222,38 +457,32 @@ void iserver_t::changed()
 
 int iserver_t::tick()
 {
-    int chg=0, busy=0;
-    irecord_t *r, *n;
+    int busy=0;
+    irecord_t *r;
+    ipeer_t *p, *n;
 
     for(r=records_.head(); r!=0; r=records_.next(r))
     {
         if(r->id_)
         {
             busy=1;
-        }
-        else
-        {
-            r->death_++;
+            break;
         }
     }
 
-    r=records_.head();
-    while(r)
+    p=peers_.head();
+    while(p)
     {
-        n=records_.next(r);
+        n=peers_.next(p);
+
+        p->asked_=false;
 
-        if(!r->id_ && r->death_ > ISERVER_TICKS_DEATH)
+        if(++p->death_ > ISERVER_TICKS_DEATH)
         {
-            delete r;
-            chg=1;
+            drop(p);
         }
 
-        r=n;
-    }
-
-    if(chg)
-    {
-        changed();
+        p=n;
     }
 
     if(nodes_.head())
@@ -264,17 +493,74 @@ int iserver_t::tick()
     return busy;
 }
 
-void iserver_t::transmit()
+void iserver_t::transmit_header(unsigned type, uint32_t source, uint32_t gen0, uint32_t gen1)
+{
+    unsigned char msg[ISERVER_HDR_SIZE];
+    pie_setindexhdr(msg,sizeof(msg),type,source,gen0,gen1);
+    socket_.write(msg,sizeof(msg));
+}
+
+void iserver_t::transmit(uint32_t since)
+{
+    uint32_t base = gen_-log_.size();
+
+    if(since==gen_)
+    {
+        transmit_header(BCTMTYPE_INDEX_BEAT,source_,0,gen_);
+        return;
+    }
+
+    if(since<base || since>gen_)
+    {
+        transmit_snapshot();
+        return;
+    }
+
+    transmit_delta(since);
+}
+
+void iserver_t::transmit_delta(uint32_t since)
 {
-    int len;
     unsigned char msg[BCTLINK_SMALLPAYLOAD];
-    unsigned char *buf;
+    unsigned i = since-(gen_-log_.size());
+
+    while(i<log_.size())
+    {
+        uint32_t from = log_[i].gen_-1;
+        unsigned used = ISERVER_HDR_SIZE;
+        int x;
 
-    int used;
+        while(i<log_.size())
+        {
+            const ilog_t &l(log_[i]);
 
-    used=0;
-    len=sizeof(msg);
-    buf=msg;
+            if((x=pie_setindexop(msg+used,sizeof(msg)-used,l.op_,l.cookie_,l.name_.wirelen(),l.name_.wiredata()))<0)
+            {
+                break;
+            }
+
+            used+=x;
+            i++;
+        }
+
+        if(used==ISERVER_HDR_SIZE)
+        {
+            pic::logmsg() << "index entry too big: " << log_[i].name_;
+            transmit_snapshot();
+            return;
+        }
+
+        pie_setindexhdr(msg,ISERVER_HDR_SIZE,BCTMTYPE_INDEX_DELTA,source_,from,log_[i-1].gen_);
+        socket_.write(msg,used);
+    }
+}
+
+void iserver_t::transmit_snapshot()
+{
+    unsigned char msg[BCTLINK_SMALLPAYLOAD];
+    unsigned used = ISERVER_HDR_SIZE;
+    uint32_t part = 0;
+    int x;
 
     for(irecord_t *r=records_.head(); r!=0; r=records_.next(r))
     {
@@ -283,30 +569,25 @@ void iserver_t::transmit()
 
         if(r->id_)
         {
-            int x;
-
-            if((x=pie_setindex(buf,len,r->cookie_,r->name_.wirelen(),r->name_.wiredata()))<0)
+            if((x=pie_setindexop(msg+used,sizeof(msg)-used,BCTINDEX_ADD,r->cookie_,r->name_.wirelen(),r->name_.wiredata()))<0)
             {
+                if(used==ISERVER_HDR_SIZE)
+                {
+                    continue;
+                }
+
+                pie_setindexhdr(msg,ISERVER_HDR_SIZE,BCTMTYPE_INDEX_SNAP,source_,part++,gen_);
                 socket_.write(msg,used);
-                used=0;
-                len=sizeof(msg);
-                buf=msg;
+                used=ISERVER_HDR_SIZE;
                 goto restart;
             }
 
-            buf+=x; len-=x; used+=x;
+            used+=x;
         }
     }
 
-    if(used>0)
-    {
-        socket_.write(msg,used);
-    }
-
-    if(records_.head())
-    {
-        records_.append(records_.head());
-    }
+    pie_setindexhdr(msg,ISERVER_HDR_SIZE,BCTMTYPE_INDEX_LAST,source_,part,gen_);
+    socket_.write(msg,used);
 }
 
 void iserver_job_timer(void *e)
@@ -319,7 +600,12 @@ void iserver_t::timer()
 {
     if(tick())
     {
-        transmit();
+        if(sent_!=gen_)
+        {
+            job_delta(this);
+        }
+
+        transmit_header(BCTMTYPE_INDEX_BEAT,source_,0,gen_);
     }
     else
     {
@@ -398,6 +684,20 @@ void inode_t::member_died(const pia_data_t & name, unsigned short cookie)
         {
             if(r->cookie_==cookie && r->name_==name)
             {
+                if(r->id_)
+                {
+                    server_->remove_local(r);
+                    break;
+                }
+
+                // have the owner's changes replayed, in case it is still there
+
+                if(r->peer_)
+                {
+                    r->peer_->gen_=0;
+                    r->peer_->asked_=false;
+                }
+
                 delete r;
                 break;
             }
@@ -424,17 +724,9 @@ unsigned short inode_t::member_cookie(int c)
 {
     irecord_t *r;
 
-    if(server_)
+    if(server_ && c>=0 && (r=server_->member(c))!=0)
     {
-        for(r=server_->records_.head(); r!=0; r=server_->records_.next(r))
-        {
-            if(c==0)
-            {
-                return r->cookie_;
-            }
-
-            c--;
-        }
+        return r->cookie_;
     }
 
     return 0;
@@ -459,17 +751,9 @@ pia_data_t inode_t::member_name(int c)
 {
     irecord_t *r;
 
-    if(server_)
+    if(server_ && c>=0 && (r=server_->member(c))!=0)
     {
-        for(r=server_->records_.head(); r!=0; r=server_->records_.next(r))
-        {
-            if(c==0)
-            {
-                return r->name_;
-            }
-
-            c--;
-        }
+        return r->name_;
     }
 
     return pia_data_t();
@@ -547,45 +831,187 @@ inode_t::~inode_t()
 
 void iserver_t::add(const pia_ctx_t &e, bct_index_t *i)
 {
+    // the first listener catches up with everyone already out there
+
+    if(!nodes_.head())
+    {
+        transmit_header(BCTMTYPE_INDEX_REQ,0,0,0);
+    }
+
     new inode_t(this,e,i);
 }
 
-void iserver_t::refresh(const pia_data_t &a, unsigned short cookie)
+bool iserver_t::apply(ipeer_t *p, unsigned op, const pia_data_t &a, unsigned short cookie)
 {
-    long hash = a.hash();
+    irecord_t *r = lookup(p,a,a.hash(),cookie);
 
-    irecord_t *r;
-
-    for(r=records_.head(); r!=0; r=records_.next(r))
+    if(op==BCTINDEX_ADD)
     {
-        if(r->hash_==hash && r->name_==a && r->cookie_==cookie)
+        if(r)
         {
-            r->death_=0;
-            return;
+            r->stale_=false;
+            return false;
         }
+
+        records_.append(new irecord_t(a,0,cookie,p));
+        return true;
     }
 
-    r = new irecord_t(a,0,cookie);
-    records_.append(r);
-    changed();
+    if(r)
+    {
+        delete r;
+        return true;
+    }
+
+    return false;
 }
 
-void iserver_t::receive(const unsigned char *msg, unsigned len)
+void iserver_t::receive_records(ipeer_t *p, const unsigned char *msg, unsigned len)
 {
     int x;
+    unsigned op;
     unsigned short cookie;
     const unsigned char *dp;
     unsigned short dl;
+    bool chg=false;
 
     while(len>0)
     {
-        if((x=pie_getindex(msg,len,&cookie,&dl,&dp))<0)
+        if((x=pie_getindexop(msg,len,&op,&cookie,&dl,&dp))<0)
         {
             break;
         }
 
         msg+=x; len-=x;
-        refresh(entity_->glue()->allocate_wire(PIC_ALLOC_NORMAL,dl,dp),cookie);
+
+        if(apply(p,op,entity_->glue()->allocate_wire(PIC_ALLOC_NORMAL,dl,dp),cookie))
+        {
+            chg=true;
+        }
+    }
+
+    if(chg)
+    {
+        changed();
+    }
+}
+
+void iserver_t::receive(const unsigned char *msg, unsigned len)
+{
+    int x;
+    unsigned type;
+    uint32_t source,gen0,gen1;
+    ipeer_t *p;
+
+    if((x=pie_getindexhdr(msg,len,&type,&source,&gen0,&gen1))<0)
+    {
+        return;
+    }
+
+    msg+=x; len-=x;
+
+    if(type==BCTMTYPE_INDEX_REQ)
+    {
+        if(source==0 || source==source_)
+        {
+            reply(gen0);
+        }
+
+        return;
+    }
+
+    if(source==source_)
+    {
+        return;
+    }
+
+    p=peer(source);
+    p->death_=0;
+
+    switch(type)
+    {
+        case BCTMTYPE_INDEX_BEAT:
+            if(p->gen_!=gen1 && !p->insnap_)
+            {
+                request(p);
+            }
+            break;
+
+        case BCTMTYPE_INDEX_DELTA:
+            if(p->gen_==gen0)
+            {
+                receive_records(p,msg,len);
+                p->gen_=gen1;
+                p->asked_=false;
+            }
+            else if(p->gen_<gen1)
+            {
+                request(p);
+            }
+            break;
+
+        case BCTMTYPE_INDEX_SNAP:
+        case BCTMTYPE_INDEX_LAST:
+            if(gen0==0)
+            {
+                if(p->gen_==gen1)
+                {
+                    break;
+                }
+
+                for(irecord_t *r=records_.head(); r!=0; r=records_.next(r))
+                {
+                    if(r->peer_==p)
+                    {
+                        r->stale_=true;
+                    }
+                }
+
+                p->insnap_=true;
+                p->part_=0;
+                p->snapgen_=gen1;
+            }
+
+            if(!p->insnap_ || p->part_!=gen0 || p->snapgen_!=gen1)
+            {
+                p->insnap_=false;
+                request(p);
+                break;
+            }
+
+            p->part_++;
+            receive_records(p,msg,len);
+
+            if(type==BCTMTYPE_INDEX_LAST)
+            {
+                irecord_t *r,*n;
+                bool chg=false;
+
+                r=records_.head();
+
+                while(r)
+                {
+                    n=records_.next(r);
+
+                    if(r->peer_==p && r->stale_)
+                    {
+                        delete r;
+                        chg=true;
+                    }
+
+                    r=n;
+                }
+
+                p->insnap_=false;
+                p->gen_=gen1;
+                p->asked_=false;
+
+                if(chg)
+                {
+                    changed();
+                }
+            }
+            break;
     }
 }
 
@@ -631,7 +1057,7 @@ void iserver_t::job_network(void *s_, const pia_data_t &d)
     s->receive(d.hostdata(),d.hostlen());
 }
 
-irecord_t::irecord_t(const pia_data_t &n, void *i, unsigned short c): name_(n), id_(i), cookie_(c), death_(0)
+irecord_t::irecord_t(const pia_data_t &n, void *i, unsigned short c, ipeer_t *p): name_(n), id_(i), cookie_(c), peer_(p), stale_(false)
 {
     hash_ = n.hash();
 }
@@ -645,16 +1071,27 @@ void iserver_t::advertise(void *id, const pia_data_t &a, unsigned short cookie)
     {
         if(r->id_==id && r->hash_==hash && r->name_==a)
         {
-            r->cookie_=cookie;
-            timer();
-            changed();
+            if(r->cookie_!=cookie)
+            {
+                unsigned short old = r->cookie_;
+                r->cookie_=cookie;
+
+                if(!advertised(a,hash,old))
+                {
+                    log(BCTINDEX_DEL,r->name_,old);
+                }
+
+                log(BCTINDEX_ADD,r->name_,cookie);
+                changed();
+            }
+
             return;
         }
     }
 
-    r = new irecord_t(a.copy(entity_->glue()->allocator(), PIC_ALLOC_NORMAL),id,cookie);
+    r = new irecord_t(a.copy(entity_->glue()->allocator(), PIC_ALLOC_NORMAL),id,cookie,0);
     records_.append(r);
-    timer();
+    log(BCTINDEX_ADD,r->name_,cookie);
     changed();
 }
 
@@ -671,7 +1108,7 @@ void iserver_t::unadvertise(void *id, const pia_data_t &a)
 
         if(r->id_==id && r->hash_==hash && r->name_==a)
         {
-            delete r;
+            remove_local(r);
         }
 
         r=n;
@@ -684,10 +1121,17 @@ iserver_t::~iserver_t()
 {
 }
 
-iserver_t::iserver_t(pia_indexlist_t::impl_t *l, const pia_data_t &n): name_(n), list_(l), socket_(list_->glue_->allocator())
+iserver_t::iserver_t(pia_indexlist_t::impl_t *l, const pia_data_t &n): name_(n), list_(l), socket_(list_->glue_->allocator()), gen_(0), sent_(0), since_(0), replying_(false), cursor_(0), cursorpos_(0)
 {
     entity_ = pia_ctx_t(list_->glue_,0,pic::status_t(),pic::f_string_t(), "index server");
 
+    source_ = (list_->glue_->random()<<16) ^ list_->glue_->random() ^ (uint32_t)pic_microtime();
+
+    if(!source_)
+    {
+        source_=1;
+    }
+
     socket_.open(entity_->glue()->network(), BCTLINK_NAMESPACE_INDEX, entity_->glue()->expand_address(name_));
     socket_.callback(entity_->glue()->mainq(),job_network,this);
     job_timer_.timer(entity_->glue()->mainq(),iserver_job_timer,this,ISERVER_TICK_INTERVAL);
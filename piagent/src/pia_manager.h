@@ -64,6 +64,7 @@ namespace pia
             void global_unlock();
             void fast_pause();
             void fast_resume();
+            void set_clock_workers(unsigned);
 
 			context_t context(int grp, const pic::status_t &gone, const pic::f_string_t &log, const char *tag = ""); 
 
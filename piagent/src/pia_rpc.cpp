@@ -40,11 +40,24 @@
 #include <stdlib.h>
 #include <map>
 #include <set>
+#include <vector>
 
-#define ACK_TIMER 1
-#define RSP_TIMER 5
-#define ACK_FAIL  10
-#define RSP_FAIL  10
+/*
+ * Timeouts are in ticks of the network's deadline timer, which runs once
+ * a second while any call on that network has a deadline.
+ *
+ * KEEP_TIMER holds a completed response for GETs from a client that
+ * missed it, DONE_TIMER absorbs retransmitted requests after a DUN.
+ */
+
+#define ACK_TIMER  1
+#define RSP_TIMER  5
+#define ACK_FAIL   10
+#define RSP_FAIL   10
+#define KEEP_TIMER 60
+#define DONE_TIMER 2
+
+#define MARKER_SIZE 14
 
 namespace
 {
@@ -77,9 +90,48 @@ namespace
     struct snode_t;
     struct cnode_t;
 
+    // a proxy with a deadline in its network's heap
+    struct pending_t
+    {
+        pending_t(): deadline_(0), slot_(~0U) {}
+        virtual ~pending_t() {}
+        virtual void expired() = 0;
+
+        unsigned long long deadline_;
+        unsigned slot_;
+    };
+
+    /*
+     * All the calls to one rpc address share a network_t.  Messages sent
+     * in the same pass of the main loop are packed into one datagram,
+     * which is flushed when the main queue is next idle, so a burst of
+     * calls and their acks, responses and duns each cost one packet
+     * rather than one per call.
+     *
+     * Agents that predate batching only read the first message in a
+     * datagram, so every datagram also carries a BCTMTYPE_RPC_BAT marker.
+     * Until an address has heard the marker from a peer, and as long as it
+     * has heard no peer without it, each message goes out alone with the
+     * marker after it, where old agents ignore it.  A batch starts with
+     * the marker, so an old agent that does meet one drops all of it
+     * rather than acting on its first message only.  What an address has
+     * heard outlives its network_t, which goes when its calls do.
+     *
+     * Call timeouts are kept in a binary min-heap on the deadline, with
+     * one timer for the network rather than one per call.
+     */
+
+    struct batching_t
+    {
+        batching_t(): batchers_(false), oldpeers_(false) {}
+
+        bool batchers_;
+        bool oldpeers_;
+    };
+
     struct network_t: virtual pic::counted_t, virtual pic::tracked_t
     {
-        network_t(pia::manager_t::impl_t *glue, const pia_data_t &addr);
+        network_t(pia::manager_t::impl_t *glue, const pia_data_t &addr, batching_t *batching);
         ~network_t();
 
         void decode_req(const pia_data_t &key, const pia_data_t &n, const pia_data_t &dp);
@@ -92,8 +144,18 @@ namespace
         void send_ack(const pia_data_t &key);
         void send_request(const pia_data_t &key, const pia_data_t &name, const pia_data_t &val);
         void send_response(const pia_data_t &key, int st, const pia_data_t &val);
+        void send(unsigned bt, const pia_data_t &key, const pia_data_t &name, int st, const pia_data_t &val);
+        static int marker(unsigned char *b, unsigned l);
+        void flush();
+        static void flush__(void *ctx);
         void decode(const unsigned char *b, unsigned bl);
         static void network__(void *ctx,const pia_data_t &data);
+        void schedule(pending_t *p, unsigned ticks);
+        void unschedule(pending_t *p);
+        void heap_set(unsigned i, pending_t *p);
+        void heap_up(unsigned i);
+        void heap_down(unsigned i);
+        static void tick__(void *ctx);
         void counted_deallocate();
         bool set_server(snode_t *server);
         void clear_server(snode_t *server);
@@ -108,17 +170,25 @@ namespace
         std::map<pia_data_t,cproxy_t *> cproxies_;
         std::map<pia_data_t,sproxy_t *> sproxies_;
         pia_sockref_t socket_;
+        unsigned char buffer_[BCTLINK_MAXPAYLOAD];
+        unsigned buflen_;
+        bool flushing_;
+        batching_t *batching_;
+        pia_cref_t flush_cpoint_;
+        std::vector<pending_t *> heap_;
+        unsigned long long ticks_;
+        pia_timerhnd_t job_tick_;
     };
 
     typedef pic::ref_t<network_t> netref_t;
     typedef pic::weak_t<network_t> netwref_t;
 
     // client side of a remote rpc
-    struct cproxy_t
+    struct cproxy_t: pending_t
     {
         cproxy_t(const netref_t &n, invocation_t *i);
         ~cproxy_t();
-        static void timer__(void *ctx);
+        void expired();
         void net_ack();
         void net_response(int st, const pia_data_t &dp);
         static void cancel__(void *ctx, invocation_t *i);
@@ -127,25 +197,22 @@ namespace
         invocation_t *invocation_;
         bool acked_;
         unsigned count_;
-        pia_timerhnd_t job_timer_;
     };
 
     // server side of a remote rpc
-    struct sproxy_t: invocation_t
+    struct sproxy_t: invocation_t, pending_t
     {
         sproxy_t(snode_t *server, const netref_t &n, const pia_data_t &path, const pia_data_t &name, const pia_data_t &v);
         ~sproxy_t();
         void handle_get();
         void handle_dun();
         void handle_req();
-        static void timer__(void *ctx);
+        void expired();
         void completed();
 
         netref_t network_;
         pia_data_t id_;
         bool completed_;
-        pia_timerhnd_t job_timer_;
-        bool timing_;
     };
 
     struct blob_t
@@ -209,7 +276,7 @@ struct pia_rpclist_t::impl_t
     void kill(const pia_ctx_t &e);
 
     pia::manager_t::impl_t *glue_;
-    std::map<pia_data_t,netwref_t,pia_notime_less> networks_;
+    std::map<pia_data_t,std::pair<netwref_t,batching_t>,pia_notime_less> networks_;
     pic::ilist_t<snode_t,0> servers_;
     pic::ilist_t<cnode_t,0> clients_;
 };
@@ -259,7 +326,7 @@ void invocation_t::complete(int s,const pia_data_t &v)
     }
 }
 
-sproxy_t::sproxy_t(snode_t *server, const netref_t &n, const pia_data_t &path, const pia_data_t &name, const pia_data_t &v): invocation_t(path,name,v), network_(n), completed_(false), job_timer_(n->glue_)
+sproxy_t::sproxy_t(snode_t *server, const netref_t &n, const pia_data_t &path, const pia_data_t &name, const pia_data_t &v): invocation_t(path,name,v), network_(n), completed_(false)
 {
     network_->add_sproxy(key(),this);
     server->invoke(this);
@@ -369,23 +436,21 @@ void network_t::decode_rsp(const pia_data_t &key, int st, const pia_data_t &dp)
 netref_t pia_rpclist_t::impl_t::get_network(const pia_data_t &addr)
 {
     pia_data_t eaddr = glue_->expand_address(addr);
-    std::map<pia_data_t,netwref_t,pia_notime_less>::iterator i;
+    std::map<pia_data_t,std::pair<netwref_t,batching_t>,pia_notime_less>::iterator i;
 
     if((i=networks_.find(eaddr))==networks_.end())
     {
-        network_t *n = new network_t(glue_,eaddr);
-        networks_.insert(std::make_pair(eaddr,n));
-        return netref_t::from_given(n);
+        i = networks_.insert(std::make_pair(eaddr,std::make_pair(netwref_t(),batching_t()))).first;
     }
 
-    if(!i->second.isvalid())
+    if(!i->second.first.isvalid())
     {
-        network_t *n = new network_t(glue_,eaddr);
-        i->second.assign(n);
+        network_t *n = new network_t(glue_,eaddr,&i->second.second);
+        i->second.first.assign(n);
         return netref_t::from_given(n);
     }
 
-    return netref_t::from_lent(i->second.ptr());
+    return netref_t::from_lent(i->second.first.ptr());
 }
 
 void pia_rpclist_t::impl_t::dump(const pia_ctx_t &e)
@@ -492,62 +557,99 @@ void pia_rpclist_t::kill(const pia_ctx_t &e)
 
 void network_t::send_get(const pia_data_t &key)
 {
-    uint64_t cookie = key.time();
-    unsigned char buffer[BCTLINK_MAXPAYLOAD];
-    int l;
-
-    if((l=pie_setrpc(buffer,sizeof(buffer),key.aspath(),key.aspathlen(),BCTMTYPE_RPC_GET,&cookie,0,0,0,0,0))>0)
-    {
-        socket_.write(buffer,l);
-    }
+    send(BCTMTYPE_RPC_GET,key,pia_data_t(),0,pia_data_t());
 }
 
 void network_t::send_dun(const pia_data_t &key)
 {
-    uint64_t cookie = key.time();
-    unsigned char buffer[BCTLINK_MAXPAYLOAD];
-    int l;
-
-    if((l=pie_setrpc(buffer,sizeof(buffer),key.aspath(),key.aspathlen(),BCTMTYPE_RPC_DUN,&cookie,0,0,0,0,0))>0)
-    {
-        socket_.write(buffer,l);
-    }
+    send(BCTMTYPE_RPC_DUN,key,pia_data_t(),0,pia_data_t());
 }
 
 void network_t::send_ack(const pia_data_t &key)
 {
-    uint64_t cookie = key.time();
-    unsigned char buffer[BCTLINK_MAXPAYLOAD];
-    int l;
-
-    if((l=pie_setrpc(buffer,sizeof(buffer),key.aspath(),key.aspathlen(),BCTMTYPE_RPC_ACK,&cookie,0,0,0,0,0))>0)
-    {
-        socket_.write(buffer,l);
-    }
+    send(BCTMTYPE_RPC_ACK,key,pia_data_t(),0,pia_data_t());
 }
 
 void network_t::send_request(const pia_data_t &key, const pia_data_t &name, const pia_data_t &val)
+{
+    send(BCTMTYPE_RPC_REQ,key,name,0,val);
+}
+
+void network_t::send_response(const pia_data_t &key, int st, const pia_data_t &val)
+{
+    send(BCTMTYPE_RPC_RSP,key,pia_data_t(),st,val);
+}
+
+int network_t::marker(unsigned char *b, unsigned l)
+{
+    uint64_t cookie = 0;
+    return pie_setrpc(b,l,0,0,BCTMTYPE_RPC_BAT,&cookie,0,0,0,0,0);
+}
+
+void network_t::send(unsigned bt, const pia_data_t &key, const pia_data_t &name, int st, const pia_data_t &val)
 {
     uint64_t cookie = key.time();
-    unsigned char buffer[BCTLINK_MAXPAYLOAD];
     int l;
 
-    if((l=pie_setrpc(buffer,sizeof(buffer),key.aspath(),key.aspathlen(),BCTMTYPE_RPC_REQ,&cookie,name.hostlen(),name.hostdata(),0,val.wirelen(),val.wiredata()))>0)
+    if(!batching_->batchers_ || batching_->oldpeers_)
     {
+        unsigned char buffer[BCTLINK_MAXPAYLOAD];
+
+        flush();
+
+        if((l=pie_setrpc(buffer,sizeof(buffer)-MARKER_SIZE,key.aspath(),key.aspathlen(),bt,&cookie,name.hostlen(),name.hostdata(),st,val.wirelen(),val.wiredata()))<0)
+        {
+            pic::logmsg() << "rpc message too large";
+            return;
+        }
+
+        l += marker(buffer+l,MARKER_SIZE);
         socket_.write(buffer,l);
+        return;
+    }
+
+    if(!buflen_)
+    {
+        buflen_ = marker(buffer_,sizeof(buffer_));
+    }
+
+    if((l=pie_setrpc(buffer_+buflen_,sizeof(buffer_)-buflen_,key.aspath(),key.aspathlen(),bt,&cookie,name.hostlen(),name.hostdata(),st,val.wirelen(),val.wiredata()))<0)
+    {
+        flush();
+        buflen_ = marker(buffer_,sizeof(buffer_));
+
+        if((l=pie_setrpc(buffer_+buflen_,sizeof(buffer_)-buflen_,key.aspath(),key.aspathlen(),bt,&cookie,name.hostlen(),name.hostdata(),st,val.wirelen(),val.wiredata()))<0)
+        {
+            buflen_=0;
+            pic::logmsg() << "rpc message too large";
+            return;
+        }
+    }
+
+    if(!flushing_)
+    {
+        flushing_=true;
+        glue_->mainq()->idlecall(flush_cpoint_,flush__,this);
     }
+
+    buflen_ += l;
 }
 
-void network_t::send_response(const pia_data_t &key, int st, const pia_data_t &val)
+void network_t::flush()
 {
-    uint64_t cookie = key.time();
-    unsigned char buffer[BCTLINK_MAXPAYLOAD];
-    int l;
-
-    if((l=pie_setrpc(buffer,sizeof(buffer),key.aspath(),key.aspathlen(),BCTMTYPE_RPC_RSP,&cookie,0,0,st,val.wirelen(),val.wiredata()))>0)
+    if(buflen_>MARKER_SIZE)
     {
-        socket_.write(buffer,l);
+        socket_.write(buffer_,buflen_);
     }
+
+    buflen_=0;
+}
+
+void network_t::flush__(void *ctx)
+{
+    network_t *n = (network_t *)ctx;
+    n->flushing_=false;
+    n->flush();
 }
 
 void network_t::decode(const unsigned char *b, unsigned bl)
@@ -556,10 +658,26 @@ void network_t::decode(const unsigned char *b, unsigned bl)
     unsigned pl,bt,nl;
     unsigned short dl;
     uint64_t cookie;
-    int st;
+    int st,l;
+    bool marked = false;
 
-    if(pie_getrpc(b,bl,&p,&pl,&bt,&cookie,&nl,&np,&st,&dl,&dp)>0)
+    while(bl>0)
     {
+        if((l=pie_getrpc(b,bl,&p,&pl,&bt,&cookie,&nl,&np,&st,&dl,&dp))<=0)
+        {
+            pic::logmsg() << "garbled rpc packet";
+            return;
+        }
+
+        b += l;
+        bl -= l;
+
+        if(bt==BCTMTYPE_RPC_BAT)
+        {
+            marked = true;
+            continue;
+        }
+
         pia_data_t xp = glue_->allocate_path(pl,p,cookie);
         pia_data_t xn = glue_->allocate_string((const char *)np,nl);
         pia_data_t xd = glue_->allocate_wire(PIC_ALLOC_NORMAL,dl,dp);
@@ -574,15 +692,22 @@ void network_t::decode(const unsigned char *b, unsigned bl)
             case BCTMTYPE_RPC_DUN: decode_dun(xp); break;
         }
     }
+
+    if(marked)
+    {
+        batching_->batchers_ = true;
+    }
     else
     {
-        pic::logmsg() << "garbled rpc packet";
+        batching_->oldpeers_ = true;
     }
 }
 
 void network_t::network__(void *ctx,const pia_data_t &data)
 {
-    network_t *n = (network_t *)ctx;
+    // a response can release the last reference to the network, so hold
+    // one until the whole datagram has been decoded.
+    netref_t n = netref_t::from_lent((network_t *)ctx);
     n->decode(data.hostdata(),data.hostlen());
 }
 
@@ -630,8 +755,9 @@ void network_t::remove_sproxy(const pia_data_t &key)
     sproxies_.erase(key);
 }
 
-network_t::network_t(pia::manager_t::impl_t *glue, const pia_data_t &addr): glue_(glue), server_(0), socket_(glue->allocator())
+network_t::network_t(pia::manager_t::impl_t *glue, const pia_data_t &addr, batching_t *batching): glue_(glue), server_(0), socket_(glue->allocator()), buflen_(0), flushing_(false), batching_(batching), ticks_(0), job_tick_(glue)
 {
+    flush_cpoint_=pia_make_cpoint();
     socket_.open(glue->network(),BCTLINK_NAMESPACE_RPC,addr);
     socket_.callback(glue->mainq(),network__,this);
 }
@@ -639,57 +765,191 @@ network_t::network_t(pia::manager_t::impl_t *glue, const pia_data_t &addr): glue
 network_t::~network_t()
 {
     tracked_invalidate();
+    job_tick_.cancel();
+    flush_cpoint_->disable();
+    flush();
     socket_.close();
 }
 
-cproxy_t::cproxy_t(const netref_t &n, invocation_t *i): network_(n), invocation_(i), acked_(false), count_(0), job_timer_(n->glue_)
+void network_t::heap_set(unsigned i, pending_t *p)
+{
+    heap_[i]=p;
+    p->slot_=i;
+}
+
+void network_t::heap_up(unsigned i)
+{
+    pending_t *p = heap_[i];
+
+    while(i>0)
+    {
+        unsigned u = (i-1)/2;
+
+        if(heap_[u]->deadline_<=p->deadline_)
+        {
+            break;
+        }
+
+        heap_set(i,heap_[u]);
+        i=u;
+    }
+
+    heap_set(i,p);
+}
+
+void network_t::heap_down(unsigned i)
+{
+    pending_t *p = heap_[i];
+    unsigned n = heap_.size();
+
+    for(;;)
+    {
+        unsigned c = 2*i+1;
+
+        if(c>=n)
+        {
+            break;
+        }
+
+        if(c+1<n && heap_[c+1]->deadline_<heap_[c]->deadline_)
+        {
+            c++;
+        }
+
+        if(p->deadline_<=heap_[c]->deadline_)
+        {
+            break;
+        }
+
+        heap_set(i,heap_[c]);
+        i=c;
+    }
+
+    heap_set(i,p);
+}
+
+void network_t::schedule(pending_t *p, unsigned ticks)
+{
+    unsigned long long old = p->deadline_;
+
+    // the next tick can be almost due already, so count from the one after
+    // it, otherwise a timer could fire up to a whole tick early
+    p->deadline_ = ticks_+ticks+1;
+
+    if(p->slot_==~0U)
+    {
+        heap_.push_back(p);
+        heap_up(heap_.size()-1);
+
+        if(!job_tick_.hnd_)
+        {
+            job_tick_.start(tick__,this,1);
+        }
+
+        return;
+    }
+
+    if(p->deadline_<old)
+    {
+        heap_up(p->slot_);
+    }
+    else
+    {
+        heap_down(p->slot_);
+    }
+}
+
+void network_t::unschedule(pending_t *p)
+{
+    unsigned i = p->slot_;
+
+    if(i==~0U)
+    {
+        return;
+    }
+
+    p->slot_=~0U;
+    pending_t *last = heap_.back();
+    heap_.pop_back();
+
+    if(last==p)
+    {
+        return;
+    }
+
+    heap_set(i,last);
+    heap_up(i);
+    heap_down(last->slot_);
+}
+
+void network_t::tick__(void *ctx)
+{
+    // an expiring call can release the last reference to the network
+    netref_t n = netref_t::from_lent((network_t *)ctx);
+
+    n->ticks_++;
+
+    while(!n->heap_.empty() && n->heap_.front()->deadline_<=n->ticks_)
+    {
+        pending_t *p = n->heap_.front();
+        n->unschedule(p);
+        p->expired();
+    }
+
+    if(n->heap_.empty())
+    {
+        n->job_tick_.cancel();
+    }
+}
+
+cproxy_t::cproxy_t(const netref_t &n, invocation_t *i): network_(n), invocation_(i), acked_(false), count_(0)
 {
     network_->add_cproxy(i->key(),this);
     invocation_->set_cancel(cancel__,this);
     network_->send_request(i->key(),i->name(),i->request());
-    job_timer_.start(timer__, this,ACK_TIMER);
+    network_->schedule(this,ACK_TIMER);
 }
 
 cproxy_t::~cproxy_t()
 {
-    job_timer_.cancel();
+    network_->unschedule(this);
     network_->remove_cproxy(invocation_->key());
 }
 
-void cproxy_t::timer__(void *ctx)
+void cproxy_t::expired()
 {
-    cproxy_t *c = (cproxy_t *)ctx;
-
-    if(c->acked_)
+    if(acked_)
     {
-        if(++c->count_ > RSP_FAIL)
+        if(++count_ > RSP_FAIL)
         {
             pic::logmsg() << "rpc timeout for rsp";
-            c->net_response(0,pia_data_t());
+            net_response(0,pia_data_t());
             return;
         }
 
-        pic::logmsg() << "retransmit get " << c->invocation_->name() << c->invocation_->request() << " count=" << c->count_ << ' ' << (void *)c;
-        c->network_->send_get(c->invocation_->key());
+        pic::logmsg() << "retransmit get " << invocation_->name() << invocation_->request() << " count=" << count_ << ' ' << (void *)this;
+        network_->send_get(invocation_->key());
+        network_->schedule(this,RSP_TIMER);
         return;
     }
 
-    if(++c->count_ > ACK_FAIL)
+    if(++count_ > ACK_FAIL)
     {
         pic::logmsg() << "rpc timeout for ack";
-        c->net_response(0,pia_data_t());
+        net_response(0,pia_data_t());
         return;
     }
 
     pic::logmsg() << "retransmit ack";
-    c->network_->send_request(c->invocation_->key(),c->invocation_->name(),c->invocation_->request());
+    network_->send_request(invocation_->key(),invocation_->name(),invocation_->request());
+    network_->schedule(this,ACK_TIMER);
 }
 
 void cproxy_t::net_ack()
 {
     if(!acked_)
     {
-        job_timer_.start(timer__, this,RSP_TIMER);
+        network_->schedule(this,RSP_TIMER);
         acked_=true;
     }
 
@@ -713,8 +973,7 @@ void sproxy_t::handle_get()
 {
     if(completed_)
     {
-        timing_=false;
-        job_timer_.start(timer__, this,60);
+        network_->schedule(this,KEEP_TIMER);
         network_->send_response(key(),status(),response());
     }
     else
@@ -725,7 +984,7 @@ void sproxy_t::handle_get()
 
 void sproxy_t::handle_dun()
 {
-    job_timer_.start(timer__, this,1);
+    network_->schedule(this,DONE_TIMER);
 }
 
 void sproxy_t::handle_req()
@@ -736,28 +995,19 @@ void sproxy_t::handle_req()
     }
     else
     {
-        timing_=false;
-        job_timer_.start(timer__, this,60);
+        network_->schedule(this,KEEP_TIMER);
         network_->send_response(key(),status(),response());
     }
 }
 
-void sproxy_t::timer__(void *ctx)
+void sproxy_t::expired()
 {
-    sproxy_t *s = (sproxy_t *)ctx;
-
-    if(!s->timing_)
-    {
-        s->timing_=true;
-        return;
-    }
-
-    delete s;
+    delete this;
 }
 
 sproxy_t::~sproxy_t()
 {
-    job_timer_.cancel();
+    network_->unschedule(this);
     cancel();
     network_->remove_sproxy(key());
 }
@@ -765,9 +1015,8 @@ sproxy_t::~sproxy_t()
 void sproxy_t::completed()
 {
     completed_=true;
-    timing_=false;
     network_->send_response(key(),status(),response());
-    job_timer_.start(timer__, this,60);
+    network_->schedule(this,KEEP_TIMER);
 }
 
 snode_t::~snode_t()
@@ -0,0 +1,274 @@
+/*
+ Copyright 2009 Eigenlabs Ltd.  http://www.eigenlabs.com
+
+ This file is part of EigenD.
+
+ EigenD is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ EigenD is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with EigenD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <picross/pic_time.h>
+#include <piagent/pia_fastalloc.h>
+
+#include "pia_glue.h"
+#include "pia_data.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/*
+ * Times rpc calls between two agents over an in-process loopback network.
+ * The client keeps up to a window of calls in flight to a server that
+ * answers each call as soon as it is invoked.  Datagrams written in one
+ * pass of the loop are delivered in the next, so the number of passes is
+ * the number of network hops the calls took.
+ *
+ * pia_rpcbench [calls] [window]
+ */
+
+struct datagram_t
+{
+    void *from;
+    std::string data;
+};
+
+struct socket_t
+{
+    unsigned space;
+    std::string name;
+    void (*cb)(void *, const unsigned char *, unsigned);
+    void *ctx;
+};
+
+struct loopnet_t: pia::network_t
+{
+    loopnet_t(): packets(0), bytes(0) {}
+
+    void *network_open(unsigned space, const char *name, bool)
+    {
+        socket_t *s = new socket_t;
+        s->space=space; s->name=name; s->cb=0; s->ctx=0;
+        sockets.push_back(s);
+        return s;
+    }
+
+    void network_close(void *h)
+    {
+        for(unsigned i=0; i<sockets.size(); ++i)
+        {
+            if(sockets[i]==h)
+            {
+                sockets.erase(sockets.begin()+i);
+                break;
+            }
+        }
+
+        delete (socket_t *)h;
+    }
+
+    int network_write(void *h, const void *b, unsigned l)
+    {
+        datagram_t d;
+        d.from=h;
+        d.data.assign((const char *)b,l);
+        pending.push_back(d);
+        packets++;
+        bytes+=l;
+        return 0;
+    }
+
+    int network_time(void *, unsigned long long *) { return -1; }
+
+    int network_callback(void *h, void (*cb)(void *, const unsigned char *, unsigned), void *ctx)
+    {
+        ((socket_t *)h)->cb=cb;
+        ((socket_t *)h)->ctx=ctx;
+        return 0;
+    }
+
+    void deliver()
+    {
+        std::vector<datagram_t> q;
+        q.swap(pending);
+
+        for(unsigned i=0; i<q.size(); ++i)
+        {
+            socket_t *f = (socket_t *)q[i].from;
+
+            for(unsigned j=0; j<sockets.size(); ++j)
+            {
+                socket_t *s = sockets[j];
+
+                if(s!=f && s->cb && s->space==f->space && s->name==f->name)
+                {
+                    s->cb(s->ctx,(const unsigned char *)q[i].data.data(),q[i].data.size());
+                }
+            }
+        }
+    }
+
+    std::vector<socket_t *> sockets;
+    std::vector<datagram_t> pending;
+    unsigned long packets,bytes;
+};
+
+struct benchctl_t: pia::controller_t
+{
+    void service_fast() {}
+    void service_main() {}
+    void service_ctx(int) {}
+    void service_gone() {}
+    bool service_isfast() { return false; }
+};
+
+struct call_t: bct_rpcclient_t
+{
+    bool done;
+    int status;
+};
+
+static unsigned completed__ = 0;
+
+static void server_attached(bct_rpcserver_t *) {}
+static void server_closed(bct_rpcserver_t *, bct_entity_t) {}
+
+static void server_invoke(bct_rpcserver_t *s, bct_entity_t e, void *c, bct_data_t p, bct_data_t n, bct_data_t v)
+{
+    bct_rpcserver_host_complete(s,c,1,v);
+}
+
+static void client_attached(bct_rpcclient_t *) {}
+
+static void client_complete(bct_rpcclient_t *c, bct_entity_t, int s, bct_data_t)
+{
+    call_t *call = (call_t *)c;
+    call->done=true;
+    call->status=s;
+    completed__++;
+}
+
+static bct_rpcserver_plug_ops_t server_ops__ = { server_attached, server_invoke, server_closed };
+static bct_rpcclient_plug_ops_t client_ops__ = { client_attached, client_complete };
+
+int main(int ac, char **av)
+{
+    unsigned n = (ac>1) ? atoi(av[1]) : 20000;
+    unsigned w = (ac>2) ? atoi(av[2]) : 16;
+
+    if(w<1) w=1;
+
+    pia::fastalloc_t allocator;
+    benchctl_t ctl;
+    loopnet_t net;
+    pia::manager_t server("bench",&ctl,&allocator,&net,pic::f_string_t(),pic::f_string_t());
+    pia::manager_t client("bench",&ctl,&allocator,&net,pic::f_string_t(),pic::f_string_t());
+    pia_ctx_t sctx(server.impl(),0,pic::status_t(),pic::f_string_t(),"server");
+    pia_ctx_t cctx(client.impl(),0,pic::status_t(),pic::f_string_t(),"client");
+
+    bct_rpcserver_t rpcserver;
+    rpcserver.host_ops=0;
+    rpcserver.plug_ops=&server_ops__;
+    rpcserver.plg_state=0;
+
+    if(bct_entity_rpcserver(sctx->api(),&rpcserver,"<rpcbench>")<0)
+    {
+        fprintf(stderr,"can't create rpc server\n");
+        return 1;
+    }
+
+    pia_data_t path,name,value;
+
+    {
+        pia_mainguard_t guard(client.impl());
+        unsigned char p[] = { 1, 2, 3 };
+        path = client.impl()->allocate_path(sizeof(p),p);
+        name = client.impl()->allocate_cstring("finfo");
+        value = client.impl()->allocate_cstring("an argument of typical size");
+    }
+
+    std::vector<call_t *> flight;
+    unsigned long long now = pic_microtime();
+    unsigned long long timer;
+    unsigned long long t0,t1;
+    unsigned started=0, failed=0, passes=0;
+    bool activity;
+
+    t0 = pic_microtime();
+
+    while(completed__<n)
+    {
+        while(started<n && flight.size()<w)
+        {
+            call_t *c = new call_t;
+            c->host_ops=0;
+            c->plug_ops=&client_ops__;
+            c->done=false;
+            c->status=0;
+
+            if(bct_entity_rpcclient(cctx->api(),c,"<rpcbench>",path.lend(),name.lend(),value.lend(),10000)<0)
+            {
+                fprintf(stderr,"can't create rpc client\n");
+                return 1;
+            }
+
+            flight.push_back(c);
+            started++;
+        }
+
+        // the second main pass writes what the contexts sent, as a running
+        // agent's main loop would as soon as they return.
+
+        now += 100;
+        client.process_main(now,&timer,&activity);
+        client.process_ctx(0,now,&activity);
+        client.process_main(now,&timer,&activity);
+        server.process_main(now,&timer,&activity);
+        server.process_ctx(0,now,&activity);
+        server.process_main(now,&timer,&activity);
+        net.deliver();
+        passes++;
+
+        for(unsigned i=0; i<flight.size();)
+        {
+            call_t *c = flight[i];
+
+            if(!c->done)
+            {
+                ++i;
+                continue;
+            }
+
+            if(c->status<=0)
+            {
+                failed++;
+            }
+
+            bct_rpcclient_host_close(c);
+            delete c;
+            flight[i]=flight.back();
+            flight.pop_back();
+        }
+    }
+
+    t1 = pic_microtime();
+
+    printf("%u calls, window %u: %llu ms, %.0f calls/s\n",n,w,(t1-t0)/1000,1000000.0*(double)n/(double)(t1-t0));
+    printf("%.2f datagrams/call, %.1f bytes/call, %.3f hops/call, %u failed\n",(double)net.packets/(double)n,(double)net.bytes/(double)n,(double)passes/(double)n,failed);
+
+    bct_rpcserver_host_close(&rpcserver);
+
+    return 0;
+}
@@ -122,6 +122,7 @@ namespace
         void service();
         void shutdown(bool w);
         void thread_init();
+        void thread_term();
         void thread_main();
 
         pia::manager_t *manager_;
@@ -138,6 +139,7 @@ namespace
         void service();
         void shutdown(bool w);
         void thread_init();
+        void thread_term();
         void thread_main();
 
         pia::manager_t *manager_;
@@ -268,6 +270,11 @@ bool pia::scaffold_mt_t::global_lock()
     return impl_->scaffold_->manager_.global_lock();
 }
 
+void pia::scaffold_mt_t::set_clock_workers(unsigned n)
+{
+    impl_->scaffold_->manager_.set_clock_workers(n);
+}
+
 pia::context_t pia::scaffold_mt_t::context(const pic::status_t &gone, const pic::f_string_t &log, const char *tag)
 {
     return impl_->scaffold_->context(gone,log,tag);
@@ -315,6 +322,11 @@ void pia::scaffold_gui_t::fast_resume()
     impl_->scaffold_->manager_.fast_resume();
 }
 
+void pia::scaffold_gui_t::set_clock_workers(unsigned n)
+{
+    impl_->scaffold_->manager_.set_clock_workers(n);
+}
+
 void pia::scaffold_gui_t::set_window_state(unsigned w,bool o)
 {
     impl_->scaffold_->manager_.set_window_state(w,o);
@@ -380,10 +392,14 @@ void fastthread_t::thread_init()
 {
     marker_.set(this);
     pic_set_fpu();
+    pia::fastalloc_t::attach();
+    pia_datapool_t::attach();
 }
 
 void fastthread_t::thread_term()
 {
+    pia_datapool_t::detach();
+    pia::fastalloc_t::detach();
     marker_.set(0);
 }
 
@@ -467,7 +483,12 @@ void ctxthread_t::shutdown(bool w)
 
 void ctxthread_t::thread_init()
 {
+    pia::fastalloc_t::attach();
+}
 
+void ctxthread_t::thread_term()
+{
+    pia::fastalloc_t::detach();
 }
 
 void ctxthread_t::thread_main()
@@ -515,6 +536,12 @@ void mainthread_t::shutdown(bool w)
 
 void mainthread_t::thread_init()
 {
+    pia::fastalloc_t::attach();
+}
+
+void mainthread_t::thread_term()
+{
+    pia::fastalloc_t::detach();
 }
 
 void mainthread_t::thread_main()
@@ -30,6 +30,12 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <vector>
+
+#define PATHINDEX_MIN 64
+#define PATHHASH_SEED 2166136261UL
+#define CNODE_LOOKUPS 8
+#define CNODE_LOOKUPLEN 16
 
 struct cnode_t;
 struct pia_serverlocal_t;
@@ -38,17 +44,48 @@ struct pia_serverglobal_t;
 typedef pic::ref_t<pia_serverlocal_t> lref_t;
 typedef pic::ref_t<pia_serverglobal_t> gref_t;
 
+static inline unsigned long path_hash(unsigned long h, unsigned char c)
+{
+    return ((h^c)*16777619UL)&0xffffffffUL;
+}
+
+/*
+ * Every node below the root is entered in index_, an open addressed
+ * table keyed on a hash of its full path, so a lookup costs one hash
+ * over the relative path instead of a map lookup per path element.  gen_ moves whenever a
+ * node is closed or changes visibility, and guards anything cached
+ * against the shape of the tree.  Main thread only.
+ */
+
 struct pia_serverglobal_t: pic::counted_t
 {
+    struct pathentry_t
+    {
+        pathentry_t(): hash_(0), depth_(0), node_(0) {}
+        pathentry_t(pia_server_t *s): hash_(s->hash_), depth_(s->depth_), node_(s) {}
+
+        unsigned long hash_;
+        unsigned depth_;
+        pia_server_t *node_;
+    };
+
     pia_serverglobal_t(const pia_data_t &a, const pia_ctx_t &e);
 
     pia::manager_t::impl_t *glue() { return entity_->glue(); }
 
+    void index_add(pia_server_t *);
+    void index_insert(const pathentry_t &);
+    void index_remove(pia_server_t *);
+    pia_server_t *index_find(pia_server_t *, const unsigned char *, unsigned);
+
     pia_data_t addr_;
     pia_ctx_t entity_;
     pic::ilist_t<cnode_t,CNODE_ROOTS> roots_;
     unsigned short cookie_;
     bool insync_;
+    std::vector<pathentry_t> index_;
+    unsigned indexcount_;
+    unsigned long gen_;
 };
 
 struct pia_serverlocal_t: pic::counted_t
@@ -110,6 +147,17 @@ struct cnode_t: pic::element_t<CNODE_CHILDREN>, pic::element_t<CNODE_RECEIVE>, p
     void close();
 
     void dirty();
+    pia_server_t *lookup(const unsigned char *, unsigned);
+
+    struct lookup_t
+    {
+        lookup_t(): gen_(0), len_(0), node_(0) {}
+
+        unsigned long gen_;
+        unsigned len_;
+        pia_server_t *node_;
+        unsigned char path_[CNODE_LOOKUPLEN];
+    };
 
     static bct_client_host_ops_t dispatch__;
     bct_client_host_ops_t *client_ops_;
@@ -135,10 +183,118 @@ struct cnode_t: pic::element_t<CNODE_CHILDREN>, pic::element_t<CNODE_RECEIVE>, p
     pia_job_t job_close_;
     pia_job_t job_clock_;
     pia_job_t job_rsync_;
+
+    lookup_t lookups_[CNODE_LOOKUPS];
 };
 
-pia_serverglobal_t::pia_serverglobal_t(const pia_data_t &addr, const pia_ctx_t &e): addr_(addr), entity_(e), cookie_(0), insync_(true)
+pia_serverglobal_t::pia_serverglobal_t(const pia_data_t &addr, const pia_ctx_t &e): addr_(addr), entity_(e), cookie_(0), insync_(true), index_(PATHINDEX_MIN), indexcount_(0), gen_(1)
+{
+}
+
+void pia_serverglobal_t::index_add(pia_server_t *s)
+{
+    if(2*(indexcount_+1)>index_.size())
+    {
+        std::vector<pathentry_t> index(2*index_.size());
+        index_.swap(index);
+
+        for(unsigned i=0; i<index.size(); i++)
+        {
+            if(index[i].node_)
+            {
+                index_insert(index[i]);
+            }
+        }
+    }
+
+    index_insert(pathentry_t(s));
+    indexcount_++;
+}
+
+void pia_serverglobal_t::index_insert(const pathentry_t &e)
 {
+    unsigned mask = index_.size()-1;
+    unsigned i = e.hash_&mask;
+
+    while(index_[i].node_)
+    {
+        i=(i+1)&mask;
+    }
+
+    index_[i]=e;
+}
+
+void pia_serverglobal_t::index_remove(pia_server_t *s)
+{
+    unsigned mask = index_.size()-1;
+    unsigned i = s->hash_&mask;
+
+    while(index_[i].node_!=s)
+    {
+        if(!index_[i].node_)
+        {
+            return;
+        }
+
+        i=(i+1)&mask;
+    }
+
+    indexcount_--;
+
+    // close the gap, so that probes never need to skip deleted slots
+
+    for(unsigned j=i;;)
+    {
+        j=(j+1)&mask;
+
+        if(!index_[j].node_)
+        {
+            index_[i]=pathentry_t();
+            return;
+        }
+
+        unsigned k = index_[j].hash_&mask;
+
+        if((i<=j) ? (i<k && k<=j) : (i<k || k<=j))
+        {
+            continue;
+        }
+
+        index_[i]=index_[j];
+        i=j;
+    }
+}
+
+pia_server_t *pia_serverglobal_t::index_find(pia_server_t *base, const unsigned char *path, unsigned len)
+{
+    unsigned long h = base->hash_;
+    unsigned depth = base->depth_+len;
+
+    for(unsigned i=0; i<len; i++)
+    {
+        h=path_hash(h,path[i]);
+    }
+
+    unsigned mask = index_.size()-1;
+
+    for(unsigned i=h&mask; index_[i].node_; i=(i+1)&mask)
+    {
+        const pathentry_t &e(index_[i]);
+
+        if(e.hash_!=h || e.depth_!=depth)
+        {
+            continue;
+        }
+
+        const unsigned char *np = e.node_->pathdata_;
+
+        if(!memcmp(np+base->depth_,path,len) && !memcmp(np,base->pathdata_,base->depth_))
+        {
+            return e.node_;
+        }
+    }
+
+    return 0;
 }
 
 pia_serverlocal_t::pia_serverlocal_t(const pia_data_t &addr, const pia_ctx_t &e): last_(0), global_(pic::ref(new pia_serverglobal_t(addr,e))), clock_(0)
@@ -361,7 +517,14 @@ int cnode_t::api_change(bct_client_host_ops_t **co, bct_data_t d)
 
 pia_server_t *pia_server_t::find(const unsigned char *path, unsigned len, pia_server_t **good)
 {
-    pia_server_t *n = this;
+    pia_server_t *n;
+
+    if(len>0 && (n=local_->global_->index_find(this,path,len))!=0)
+    {
+        return n;
+    }
+
+    n = this;
 
 restart:
 
@@ -387,30 +550,62 @@ restart:
 
 pia_server_t *pia_server_t::findvisible(const unsigned char *path, unsigned len)
 {
-    pia_server_t *n = this;
+    if(len==0)
+    {
+        return this;
+    }
 
-restart:
+    pia_server_t *n = local_->global_->index_find(this,path,len);
 
-    while(len>0)
+    if(n && n->hidden_depth()<=depth_)
     {
-        const children_t &cc(n->children_.current());
-        children_t::const_iterator iter(cc.find(*path));
+        return n;
+    }
 
-        if(iter!=cc.end())
-        {
-            if(iter->second->isvisible())
-            {
-                n=iter->second;
-                len--;
-                path++;
-                goto restart;
-            }
-        }
+    return 0;
+}
 
-        return 0;
+// depth of the deepest invisible node between the root and here
+
+unsigned pia_server_t::hidden_depth()
+{
+    unsigned long gen = local_->global_->gen_;
+
+    if(vgen_!=gen)
+    {
+        vdepth_ = parent_ ? (visible_ ? parent_->hidden_depth() : depth_) : 0;
+        vgen_ = gen;
     }
 
-    return n;
+    return vdepth_;
+}
+
+pia_server_t *cnode_t::lookup(const unsigned char *path, unsigned len)
+{
+    if(len==0 || len>CNODE_LOOKUPLEN)
+    {
+        return server_->findvisible(path,len);
+    }
+
+    lookup_t &l(lookups_[(len+7*path[0]+13*path[len-1])&(CNODE_LOOKUPS-1)]);
+    unsigned long gen = local_->global_->gen_;
+
+    if(l.gen_==gen && l.len_==len && !memcmp(l.path_,path,len))
+    {
+        return l.node_;
+    }
+
+    pia_server_t *t = server_->findvisible(path,len);
+
+    if(t)
+    {
+        l.gen_=gen;
+        l.len_=len;
+        l.node_=t;
+        memcpy(l.path_,path,len);
+    }
+
+    return t;
 }
 
 int cnode_t::api_child_change(bct_client_host_ops_t **co, const unsigned char *path, unsigned pathlen, bct_data_t d)
@@ -424,7 +619,7 @@ int cnode_t::api_child_change(bct_client_host_ops_t **co, const unsigned char *p
 
         if(s)
         {
-            if((t=s->findvisible(path,pathlen))!= 0)
+            if((t=c->lookup(path,pathlen))!= 0)
             {
                 if((t->flags_&PLG_SERVER_RO)==0)
                 {
@@ -450,7 +645,7 @@ int cnode_t::api_child_exists(bct_client_host_ops_t **co, const unsigned char *p
 
         if(s)
         {
-            if((t=s->findvisible(path,pathlen)) != 0)
+            if((t=c->lookup(path,pathlen)) != 0)
             {
                 return 1;
             }
@@ -474,7 +669,7 @@ bct_data_t cnode_t::api_child_data(bct_client_host_ops_t **co, const unsigned ch
 
         if(s)
         {
-            if((t=s->findvisible(path,pathlen)) != 0)
+            if((t=c->lookup(path,pathlen)) != 0)
             {
                 if(flags) *flags=t->flags();
                 return t->current_slow_.give();
@@ -615,7 +810,7 @@ int cnode_t::api_child_add(bct_client_host_ops_t  **co, const unsigned char *o,
 
         if(s)
         {
-            if((t=s->findvisible(o,l))!=0)
+            if((t=c->lookup(o,l))!=0)
             {
                 new cnode_t(t,c->entity_,c,ch);
                 return 1;
@@ -641,7 +836,7 @@ int cnode_t::api_child_remove(bct_client_host_ops_t  **co, const unsigned char *
         pia_server_t *s = c->server_, *t = 0;
         cnode_t *c2;
 
-        if(!s || (t=s->findvisible(o,l))==0)
+        if(!s || (t=c->lookup(o,l))==0)
         {
             return -1;
         }
@@ -703,7 +898,7 @@ unsigned char cnode_t::api_child_enum(bct_client_host_ops_t **co, const unsigned
 
         if(s)
         {
-            if((t=s->findvisible(o,l))!=0)
+            if((t=c->lookup(o,l))!=0)
             {
                 return t->enum_visible(ch);
             }
@@ -724,7 +919,7 @@ bct_client_t *cnode_t::api_child_get(bct_client_host_ops_t **co, const unsigned
         pia_server_t *s = c->server_, *t = 0;
         cnode_t *c2;
 
-        if(!s || (t=s->findvisible(o,l))==0)
+        if(!s || (t=c->lookup(o,l))==0)
         {
             return 0;
         }
@@ -787,7 +982,7 @@ long cnode_t::api_child_ncrc(bct_client_host_ops_t **co, const unsigned char *pa
 
         if(s)
         {
-            if((t=s->findvisible(path,pathlen)) != 0)
+            if((t=c->lookup(path,pathlen)) != 0)
             {
                 return t->nseq_;
             }
@@ -809,7 +1004,7 @@ long cnode_t::api_child_tcrc(bct_client_host_ops_t **co, const unsigned char *pa
 
         if(s)
         {
-            if((t=s->findvisible(path,pathlen)) != 0)
+            if((t=c->lookup(path,pathlen)) != 0)
             {
                 return t->tseq_;
             }
@@ -831,7 +1026,7 @@ long cnode_t::api_child_dcrc(bct_client_host_ops_t **co, const unsigned char *pa
 
         if(s)
         {
-            if((t=s->findvisible(path,pathlen)) != 0)
+            if((t=c->lookup(path,pathlen)) != 0)
             {
                 return t->dseq_;
             }
@@ -1124,11 +1319,13 @@ void pia_server_t::close0(bool calladj)
 
     local_->fast_.clear();
     open_.set(false);
+    local_->global_->gen_++;
 
     if(parent_)
     {
         parent_->children_.alternate().erase(local_->last_);
         parent_->children_.exchange();
+        local_->global_->index_remove(this);
     }
 
     if(local_->clock_)
@@ -1357,6 +1554,7 @@ void pia_server_t::setvisible(bool visible)
     }
 
     visible_=visible;
+    local_->global_->gen_++;
 
     if(visible)
     {
@@ -1490,6 +1688,11 @@ pia_server_t::pia_server_t(const pia_data_t &addr, const pia_ctx_t &e, const pia
     root_ = this;
     parent_ = 0;
     fast_= 0;
+    pathdata_ = local_->path_.aspath();
+    hash_ = PATHHASH_SEED;
+    depth_ = 0;
+    vgen_ = 0;
+    vdepth_ = 0;
 
     init(data,dseq);
 }
@@ -1500,12 +1703,18 @@ pia_server_t::pia_server_t(pia_server_t *parent, unsigned char last, const pia_d
     parent_ = parent;
     root_ = parent->root_;
     fast_= 0;
+    pathdata_ = local_->path_.aspath();
+    hash_ = path_hash(parent->hash_,last);
+    depth_ = parent->depth_+1;
+    vgen_ = 0;
+    vdepth_ = 0;
 
     children_t &cc(parent->children_.alternate());
 
     PIC_ASSERT(cc.find(last)==cc.end());
     cc.insert(std::make_pair(last,this));
     parent->children_.exchange();
+    local_->global_->index_add(this);
 
     init(data,dseq);
 
@@ -96,7 +96,7 @@ class pia_server_t
         const pia_data_t &current() { return current_slow_; }
         const pia_data_t &path();
         const pia_data_t &addr();
-        const unsigned char *pathdata();
+        const unsigned char *pathdata() { return pathdata_; }
         void setcookie(unsigned short);
         unsigned short getcookie();
         void setclock(bct_clocksink_t *);
@@ -112,6 +112,7 @@ class pia_server_t
 
     private:
         friend struct cnode_t;
+        friend struct pia_serverglobal_t;
 
         void childadded(pia_server_t *);
         void childgone(pia_server_t *);
@@ -122,6 +123,7 @@ class pia_server_t
         static void clockgone(void *);
         void schedule_setclock();
         void dirty();
+        unsigned hidden_depth();
 
         pia_fastdata_t *fast_;
         pic::flipflop_t<bool> open_;
@@ -136,6 +138,13 @@ class pia_server_t
         unsigned visible_children_;
         unsigned flags_;
         bool visible_;
+
+        // path index (main thread only, see pia_serverglobal_t)
+        const unsigned char *pathdata_;
+        unsigned long hash_;
+        unsigned depth_;
+        unsigned long vgen_;
+        unsigned vdepth_;
 };
 
 
@@ -0,0 +1,238 @@
+/*
+ Copyright 2009 Eigenlabs Ltd.  http://www.eigenlabs.com
+
+ This file is part of EigenD.
+
+ EigenD is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ EigenD is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with EigenD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <picross/pic_time.h>
+#include <piagent/pia_fastalloc.h>
+
+#include "pia_server.h"
+#include "pia_glue.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+/*
+ * Builds a server tree shaped like a large setup (10 agents of 10 atoms
+ * of 10 sub-atoms, and so on down to depth 5, about 51k nodes) and times
+ * path resolution from the root: find(), findvisible(), and the client
+ * child_exists and child_data calls, both on random paths and on a small
+ * working set as a browser would poll.
+ *
+ * pia_serverbench [lookups]
+ */
+
+static const unsigned fanout__[] = { 10, 10, 10, 10, 4 };
+#define DEPTH (sizeof(fanout__)/sizeof(fanout__[0]))
+#define HOT 6
+
+struct benchnode_t: pia_server_t
+{
+    benchnode_t(const pia_data_t &a, const pia_ctx_t &e): pia_server_t(a,e,pia_data_t(),0) {}
+    benchnode_t(benchnode_t *p, unsigned char l, const pia_data_t &d): pia_server_t(p,l,d,0) { setvisible(true); }
+
+    pic::ref_t<fast_receiver_t> server_fast() { return pic::ref_t<fast_receiver_t>(); }
+    unsigned server_fastflags() { return 0; }
+};
+
+struct benchctl_t: pia::controller_t
+{
+    void service_fast() {}
+    void service_main() {}
+    void service_ctx(int) {}
+    void service_gone() {}
+    bool service_isfast() { return false; }
+};
+
+struct benchnet_t: pia::network_t
+{
+    void *network_open(unsigned, const char *, bool) { return 0; }
+    void network_close(void *) {}
+    int network_write(void *, const void *, unsigned) { return 0; }
+    int network_time(void *, unsigned long long *) { return -1; }
+    int network_callback(void *, void (*)(void *, const unsigned char *, unsigned), void *) { return 0; }
+};
+
+static void client_attached(bct_client_t *, bct_data_t d) { pia_data_t::from_given(d); }
+static void client_data(bct_client_t *, bct_entity_t, bct_data_t) {}
+static void client_event(bct_client_t *, bct_entity_t) {}
+
+static bct_client_plug_ops_t client_ops__ =
+{
+    client_attached, client_data, client_event, client_event, client_event, client_event, client_event, client_event
+};
+
+static unsigned build(benchnode_t *n, unsigned level, std::vector<benchnode_t *> &nodes, const pia_data_t &d)
+{
+    if(level==DEPTH)
+    {
+        return 0;
+    }
+
+    unsigned count = 0;
+
+    for(unsigned i=0; i<fanout__[level]; ++i)
+    {
+        benchnode_t *c = new benchnode_t(n,i+1,d);
+        nodes.push_back(c);
+        count += 1+build(c,level+1,nodes,d);
+    }
+
+    return count;
+}
+
+static void report(const char *what, unsigned n, unsigned long long t, unsigned found)
+{
+    printf("%-24s %8.1f ns/lookup (%u/%u found)\n",what,1000.0*(double)t/(double)n,found,n);
+}
+
+int main(int ac, char **av)
+{
+    unsigned n = (ac>1) ? atoi(av[1]) : 1000000;
+
+    pia::fastalloc_t allocator;
+    benchctl_t ctl;
+    benchnet_t net;
+    pia::manager_t manager("bench",&ctl,&allocator,&net,pic::f_string_t(),pic::f_string_t());
+    pia::manager_t::impl_t *glue = manager.impl();
+    pia_ctx_t ctx(glue,0,pic::status_t(),pic::f_string_t(),"bench");
+
+    std::vector<benchnode_t *> nodes;
+    std::vector<unsigned char> paths;
+    std::vector<unsigned> lengths;
+    benchnode_t *root;
+    unsigned long long t0,t1;
+
+    {
+        pia_mainguard_t guard(glue);
+
+        root = new benchnode_t(glue->allocate_cstring("bench"),ctx);
+        root->setvisible(true);
+
+        t0 = pic_microtime();
+        unsigned count = build(root,0,nodes,glue->allocate_cstring("value"));
+        t1 = pic_microtime();
+
+        printf("built %u nodes in %llu ms\n",count,(t1-t0)/1000);
+    }
+
+    for(unsigned i=0; i<nodes.size(); ++i)
+    {
+        const pia_data_t &p(nodes[i]->path());
+        paths.insert(paths.end(),p.aspath(),p.aspath()+p.aspathlen());
+        paths.resize((i+1)*DEPTH);
+        lengths.push_back(p.aspathlen());
+    }
+
+    std::vector<unsigned> order(n);
+
+    for(unsigned i=0; i<n; ++i)
+    {
+        order[i] = rand()%lengths.size();
+    }
+
+    unsigned found;
+
+    {
+        pia_mainguard_t guard(glue);
+
+        found=0;
+        t0 = pic_microtime();
+        for(unsigned i=0; i<n; ++i)
+        {
+            unsigned j = order[i];
+            if(root->find(&paths[j*DEPTH],lengths[j],0)) found++;
+        }
+        t1 = pic_microtime();
+        report("find",n,t1-t0,found);
+
+        found=0;
+        t0 = pic_microtime();
+        for(unsigned i=0; i<n; ++i)
+        {
+            unsigned j = order[i];
+            if(root->findvisible(&paths[j*DEPTH],lengths[j])) found++;
+        }
+        t1 = pic_microtime();
+        report("findvisible",n,t1-t0,found);
+    }
+
+    bct_client_t client;
+    client.host_ops = 0;
+    client.plug_ops = &client_ops__;
+    client.plug_flags = 0;
+    client.host_flags = 0;
+    client.plg_state = 0;
+
+    {
+        pia_mainguard_t guard(glue);
+        root->add(ctx,&client);
+    }
+
+    bct_client_host_ops_t **co = client.host_ops;
+
+    found=0;
+    t0 = pic_microtime();
+    for(unsigned i=0; i<n; ++i)
+    {
+        unsigned j = order[i];
+        if((*co)->client_host_child_exists(co,&paths[j*DEPTH],lengths[j])>0) found++;
+    }
+    t1 = pic_microtime();
+    report("child_exists random",n,t1-t0,found);
+
+    found=0;
+    t0 = pic_microtime();
+    for(unsigned i=0; i<n; ++i)
+    {
+        unsigned j = order[i%HOT];
+        if((*co)->client_host_child_exists(co,&paths[j*DEPTH],lengths[j])>0) found++;
+    }
+    t1 = pic_microtime();
+    report("child_exists hot",n,t1-t0,found);
+
+    found=0;
+    t0 = pic_microtime();
+    for(unsigned i=0; i<n; ++i)
+    {
+        unsigned j = order[i%HOT];
+        bct_data_t d = (*co)->client_host_child_data(co,&paths[j*DEPTH],lengths[j],0);
+        if(d) { found++; pia_data_t::from_given(d); }
+    }
+    t1 = pic_microtime();
+    report("child_data hot",n,t1-t0,found);
+
+    bct_client_host_close(&client);
+
+    {
+        pia_mainguard_t guard(glue);
+
+        t0 = pic_microtime();
+        root->close();
+        delete root;
+        for(unsigned i=0; i<nodes.size(); ++i)
+        {
+            delete nodes[i];
+        }
+        t1 = pic_microtime();
+
+        printf("tore down in %llu ms\n",(t1-t0)/1000);
+    }
+
+    return 0;
+}
@@ -0,0 +1,790 @@
+/*
+ Copyright 2009 Eigenlabs Ltd.  http://www.eigenlabs.com
+
+ This file is part of EigenD.
+
+ EigenD is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ EigenD is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with EigenD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pia_shmlink.h"
+
+#include <picross/pic_atomic.h>
+#include <picross/pic_error.h>
+#include <picross/pic_time.h>
+
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define SHM_VERSION 3
+#define SHM_RINGSIZE (128*1024)
+#define SHM_WRAP 0xffffffffU
+#define SHM_SETTLE 10000 // us for writes already under way to land
+#define SHM_ALIGN(n) (((n)+7)&~7U)
+#define SHM_GROUPWORDS ((PIA_SHMLINK_GROUPS+31)/32)
+#define SHM_SPACES 6
+#define SHM_BUCKETS 20
+#define SHM_CLAIMING 0xffffffffU
+#define SHM_PORTWORDS ((PIA_SHMLINK_PORTS+1)/2)
+
+/*
+ * Ring positions run freely and are reduced modulo the ring size.  Records
+ * are a 32 bit length followed by the bkernel header and payload, padded to
+ * 8 bytes.  A record never wraps: if it doesn't fit before the end of the
+ * ring the writer leaves a SHM_WRAP marker and starts again at the front.
+ * A full ring drops the packet, as a socket buffer would.
+ *
+ * Any thread of the writing process may write, without a lock.  A writer
+ * reserves space by moving head on with a compare and swap, fills it in,
+ * and publishes the record by storing its length last.  The reader takes
+ * records until it finds a length of 0, and zeroes what it has taken
+ * before moving tail on, so free space always reads as 0.
+ *
+ * A writer that dies can leave a record reserved but never published.  The
+ * next owner of its slot asks each reader to step over anything it finds
+ * unpublished before skipto, by moving skipto to head and counting skipgen
+ * on.
+ *
+ * A slot is owned by the process whose pid and start time are recorded in
+ * it, so a recycled pid isn't taken for the previous owner.  While a slot
+ * is being claimed its pid reads SHM_CLAIMING.
+ */
+
+namespace
+{
+    struct peer_t
+    {
+        pic_atomic_t pid;
+        pic_atomic_t start;
+        pic_atomic_t wake;
+        pic_atomic_t sleeping;
+        pic_atomic_t groups[SHM_GROUPWORDS];
+        pic_atomic_t ports[SHM_PORTWORDS];
+        unsigned char pad[64-(4+SHM_GROUPWORDS+SHM_PORTWORDS)*sizeof(pic_atomic_t)];
+    };
+
+    struct ring_t
+    {
+        pic_atomic_t head;
+        pic_atomic_t skipto;
+        pic_atomic_t skipgen;
+        unsigned char pad0[52];
+        pic_atomic_t tail;
+        unsigned char pad1[60];
+        unsigned char data[SHM_RINGSIZE];
+    };
+
+    inline void barrier()
+    {
+        __sync_synchronize();
+    }
+
+    int futex(pic_atomic_t *addr, int op, uint32_t val, const struct timespec *timeout)
+    {
+        return syscall(SYS_futex,(uint32_t *)addr,op,val,timeout,0,0);
+    }
+
+    // start time of a process in clock ticks since boot (low 32 bits), or 0
+    // if it can't be read
+    uint32_t start_time(pid_t pid)
+    {
+        char name[64];
+        char buffer[1024];
+        FILE *f;
+        size_t n;
+
+        sprintf(name,"/proc/%u/stat",(unsigned)pid);
+
+        if((f=fopen(name,"r"))==0)
+        {
+            return 0;
+        }
+
+        n = fread(buffer,1,sizeof(buffer)-1,f);
+        fclose(f);
+        buffer[n] = 0;
+
+        // field 22; the command name in field 2 can contain anything, so
+        // count from the bracket that closes it
+        const char *p = strrchr(buffer,')');
+
+        for(unsigned i=0; p && i<20; i++)
+        {
+            p = strchr(p+1,' ');
+        }
+
+        return p ? (uint32_t)strtoull(p+1,0,10) : 0;
+    }
+
+    inline uint32_t *ring_word(ring_t *r, uint32_t pos)
+    {
+        return (uint32_t *)&r->data[pos&(SHM_RINGSIZE-1)];
+    }
+
+    // any thread of the writing process
+    bool ring_write(ring_t *r, const unsigned char *header, const void *payload, unsigned paylen)
+    {
+        unsigned len = BCTLINK_HEADER+paylen;
+        unsigned need = SHM_ALIGN(4+len);
+        uint32_t head;
+        unsigned off,total;
+
+        for(;;)
+        {
+            head = r->head;
+            uint32_t tail = r->tail;
+            off = head&(SHM_RINGSIZE-1);
+            unsigned contig = SHM_RINGSIZE-off;
+            total = (need>contig) ? contig+need : need;
+
+            if(SHM_RINGSIZE-(head-tail) < total)
+            {
+                return false;
+            }
+
+            if(pic_atomiccas(&r->head,head,head+total))
+            {
+                break;
+            }
+        }
+
+        if(total>need)
+        {
+            *(volatile uint32_t *)&r->data[off] = SHM_WRAP;
+            off = 0;
+        }
+
+        memcpy(&r->data[off+4],header,BCTLINK_HEADER);
+        memcpy(&r->data[off+4+BCTLINK_HEADER],payload,paylen);
+
+        barrier();
+        *(volatile uint32_t *)&r->data[off] = len;
+        return true;
+    }
+
+    // the reader, giving n bytes from pos back as free space
+    void ring_clear(ring_t *r, uint32_t pos, unsigned n)
+    {
+        unsigned off = pos&(SHM_RINGSIZE-1);
+        unsigned contig = std::min(n,SHM_RINGSIZE-off);
+
+        memset(&r->data[off],0,contig);
+        memset(&r->data[0],0,n-contig);
+    }
+}
+
+struct pia_shmlink_t::segment_t
+{
+    pic_atomic_t version;
+    unsigned char pad[60];
+    peer_t peers[PIA_SHMLINK_PEERS];
+    ring_t rings[PIA_SHMLINK_PEERS][PIA_SHMLINK_PEERS];
+
+    ring_t *ring(unsigned producer, unsigned consumer) { return &rings[producer][consumer]; }
+};
+
+pia_shmlink_t::pia_shmlink_t(pie_bkernel_t *kernel): pic::thread_t(0), kernel_(kernel), segment_(0), self_(PIA_SHMLINK_PEERS), device_(-1), stop_(false), sent_(0), received_(0), dropped_(0), wakes_(0)
+{
+    char name[64];
+    struct stat st;
+    int fd;
+
+    memset(refs_,0,sizeof(refs_));
+    sprintf(name,"/pia-shmlink-%u",(unsigned)getuid());
+
+    if((fd=shm_open(name,O_RDWR|O_CREAT,0600))<0)
+    {
+        pic::msg() << "can't open shared memory rendezvous " << name << pic::hurl;
+    }
+
+    if(fstat(fd,&st)<0 || (st.st_size<(off_t)sizeof(segment_t) && ftruncate(fd,sizeof(segment_t))<0))
+    {
+        close(fd);
+        pic::msg() << "can't size shared memory rendezvous " << name << pic::hurl;
+    }
+
+    void *m = mmap(0,sizeof(segment_t),PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+    close(fd);
+
+    if(m==MAP_FAILED)
+    {
+        pic::msg() << "can't map shared memory rendezvous " << name << pic::hurl;
+    }
+
+    segment_ = (segment_t *)m;
+
+    if(!pic_atomiccas(&segment_->version,0,SHM_VERSION) && segment_->version!=SHM_VERSION)
+    {
+        munmap(segment_,sizeof(segment_t));
+        pic::msg() << "incompatible shared memory rendezvous " << name << pic::hurl;
+    }
+
+    claim();
+
+    if(self_==PIA_SHMLINK_PEERS)
+    {
+        munmap(segment_,sizeof(segment_t));
+        pic::msg() << "no free slot in shared memory rendezvous " << name << pic::hurl;
+    }
+
+    if((device_ = kernel_->pie_bkadddevice(this,0,0,this)) < 0)
+    {
+        segment_->peers[self_].pid = 0;
+        munmap(segment_,sizeof(segment_t));
+        pic::msg() << "Can't add shared memory bkernel" << pic::hurl;
+    }
+
+    run();
+}
+
+pia_shmlink_t::~pia_shmlink_t()
+{
+    peer_t *me = &segment_->peers[self_];
+
+    stop_ = true;
+    pic_atomicinc(&me->wake);
+    futex(&me->wake,FUTEX_WAKE,1,0);
+    wait();
+
+    kernel_->pie_bkremovedevice(device_,false);
+
+    for(unsigned i=0; i<SHM_GROUPWORDS; i++)
+    {
+        me->groups[i] = 0;
+    }
+
+    for(unsigned i=0; i<SHM_PORTWORDS; i++)
+    {
+        me->ports[i] = 0;
+    }
+
+    barrier();
+    me->pid = 0;
+    munmap(segment_,sizeof(segment_t));
+
+    for(unsigned i=0; i<holds_.size(); i++)
+    {
+        delete holds_[i];
+    }
+}
+
+bool pia_shmlink_t::alive(unsigned slot)
+{
+    peer_t *p = &segment_->peers[slot];
+    pic_atomic_t o = p->pid;
+
+    if(o==0)
+    {
+        return false;
+    }
+
+    if(o==SHM_CLAIMING)
+    {
+        return true;
+    }
+
+    if(kill(o,0)<0 && errno==ESRCH)
+    {
+        return false;
+    }
+
+    uint32_t s = p->start;
+    barrier();
+
+    // if the slot changed hands while we looked, assume it's in use
+    if(p->pid!=o)
+    {
+        return true;
+    }
+
+    uint32_t t = start_time(o);
+
+    return t==0 || t==s;
+}
+
+void pia_shmlink_t::claim()
+{
+    pic_atomic_t pid = getpid();
+
+    for(unsigned i=0; i<PIA_SHMLINK_PEERS; i++)
+    {
+        peer_t *p = &segment_->peers[i];
+        pic_atomic_t o = p->pid;
+
+        if(alive(i))
+        {
+            continue;
+        }
+
+        if(!pic_atomiccas(&p->pid,o,SHM_CLAIMING))
+        {
+            continue;
+        }
+
+        p->start = start_time(pid);
+
+        // anything left from a previous owner of the slot is stale
+        for(unsigned j=0; j<SHM_GROUPWORDS; j++)
+        {
+            p->groups[j] = 0;
+        }
+
+        for(unsigned j=0; j<SHM_PORTWORDS; j++)
+        {
+            p->ports[j] = 0;
+        }
+
+        p->sleeping = 0;
+
+        // writers that looked at the slot before we took it may still be
+        // copying into it
+        barrier();
+        pic_microsleep(SHM_SETTLE);
+
+        // we are now the only reader of the rings into this slot, so skip
+        // whatever is in them.
+        for(unsigned j=0; j<PIA_SHMLINK_PEERS; j++)
+        {
+            ring_t *in = segment_->ring(j,i);
+            memset(in->data,0,SHM_RINGSIZE);
+            skipped_[j] = in->skipgen;
+            barrier();
+            in->tail = in->head;
+        }
+
+        // the rings out of it are left alone: their readers are live and
+        // own the tails, and will drain what the previous owner left, as
+        // they would had it not gone away, up to any record it died
+        // writing, which they are asked to step over.
+        for(unsigned j=0; j<PIA_SHMLINK_PEERS; j++)
+        {
+            ring_t *out = segment_->ring(i,j);
+            out->skipto = out->head;
+            barrier();
+            pic_atomicinc(&out->skipgen);
+            wake(j);
+        }
+
+        barrier();
+        p->pid = pid;
+        self_ = i;
+        return;
+    }
+}
+
+void pia_shmlink_t::set_ports(const unsigned short *ports)
+{
+    peer_t *me = &segment_->peers[self_];
+
+    for(unsigned i=0; i<SHM_PORTWORDS; i++)
+    {
+        uint32_t lo = ports[2*i];
+        uint32_t hi = (2*i+1<PIA_SHMLINK_PORTS) ? ports[2*i+1] : 0;
+        me->ports[i] = lo|(hi<<16);
+    }
+
+    barrier();
+}
+
+bool pia_shmlink_t::peer_port(unsigned short port)
+{
+    for(unsigned i=0; i<PIA_SHMLINK_PEERS; i++)
+    {
+        peer_t *p = &segment_->peers[i];
+
+        pic_atomic_t pid = p->pid;
+
+        if(i==self_ || pid==0 || pid==SHM_CLAIMING)
+        {
+            continue;
+        }
+
+        for(unsigned j=0; j<SHM_PORTWORDS; j++)
+        {
+            uint32_t w = p->ports[j];
+
+            if((w&0xffff)==port || (w>>16)==port)
+            {
+                return port!=0;
+            }
+        }
+    }
+
+    return false;
+}
+
+void pia_shmlink_t::reap()
+{
+    for(unsigned i=0; i<PIA_SHMLINK_PEERS; i++)
+    {
+        peer_t *p = &segment_->peers[i];
+
+        if(i==self_ || alive(i))
+        {
+            continue;
+        }
+
+        // stop writers copying into a dead process's rings
+        for(unsigned j=0; j<SHM_GROUPWORDS; j++)
+        {
+            p->groups[j] = 0;
+        }
+    }
+}
+
+unsigned pia_shmlink_t::bucket(const pie_bkaddr_t *grp)
+{
+    unsigned char h[1];
+    unsigned space = grp->space;
+
+    if(space>=SHM_SPACES)
+    {
+        space = SHM_SPACES-1;
+    }
+
+    pie_bkernel_t::pie_bkaddrhash(grp,&h,1);
+    return space*SHM_BUCKETS+(h[0]%SHM_BUCKETS);
+}
+
+void pia_shmlink_t::addgroup_callback(void *ctx, const pie_bkaddr_t *grp)
+{
+    unsigned b = bucket(grp);
+    pic::mutex_t::guard_t g(grouplock_);
+
+    if(refs_[b]++ > 0)
+    {
+        return;
+    }
+
+    pic_atomic_t *w = &segment_->peers[self_].groups[b/32];
+
+    for(;;)
+    {
+        pic_atomic_t o = *w;
+
+        if(pic_atomiccas(w,o,o|(1U<<(b%32))))
+        {
+            break;
+        }
+    }
+}
+
+void pia_shmlink_t::delgroup_callback(void *ctx, const pie_bkaddr_t *grp)
+{
+    unsigned b = bucket(grp);
+    pic::mutex_t::guard_t g(grouplock_);
+
+    if(refs_[b]==0)
+    {
+        pic::msg() << "invalid shared memory unsubscription" << pic::log;
+        return;
+    }
+
+    if(--refs_[b] > 0)
+    {
+        return;
+    }
+
+    pic_atomic_t *w = &segment_->peers[self_].groups[b/32];
+
+    for(;;)
+    {
+        pic_atomic_t o = *w;
+
+        if(pic_atomiccas(w,o,o&~(1U<<(b%32))))
+        {
+            break;
+        }
+    }
+}
+
+// any thread, without a lock.  the futex wake for a sleeping reader is
+// left to release while the calling thread holds the link.
+void pia_shmlink_t::write_callback(void *ctx, const pie_bkaddr_t *grp, const unsigned char *header, const void *payload, unsigned paylen)
+{
+    if(BCTLINK_HEADER+paylen+4 > SHM_RINGSIZE/2)
+    {
+        pic_atomicinc(&dropped_);
+        return;
+    }
+
+    unsigned b = bucket(grp);
+    hold_t *h = (hold_t *)hold_.get();
+
+    for(unsigned i=0; i<PIA_SHMLINK_PEERS; i++)
+    {
+        peer_t *p = &segment_->peers[i];
+
+        pic_atomic_t pid = p->pid;
+
+        if(i==self_ || pid==0 || pid==SHM_CLAIMING || (p->groups[b/32]&(1U<<(b%32)))==0)
+        {
+            continue;
+        }
+
+        if(!ring_write(segment_->ring(self_,i),header,payload,paylen))
+        {
+            pic_atomicinc(&dropped_);
+            continue;
+        }
+
+        pic_atomicinc(&sent_);
+
+        if(h && h->depth)
+        {
+            h->pending |= (1U<<i);
+            continue;
+        }
+
+        wake(i);
+    }
+}
+
+void pia_shmlink_t::wake(unsigned i)
+{
+    peer_t *p = &segment_->peers[i];
+
+    barrier();
+
+    if(p->sleeping)
+    {
+        pic_atomicinc(&p->wake);
+        futex(&p->wake,FUTEX_WAKE,1,0);
+        pic_atomicinc(&wakes_);
+    }
+}
+
+void pia_shmlink_t::hold()
+{
+    hold_t *h = (hold_t *)hold_.get();
+
+    if(!h)
+    {
+        h = new hold_t;
+        h->depth = 0;
+        h->pending = 0;
+        hold_.set(h);
+
+        pic::mutex_t::guard_t g(holdlock_);
+        holds_.push_back(h);
+    }
+
+    h->depth++;
+}
+
+void pia_shmlink_t::release()
+{
+    hold_t *h = (hold_t *)hold_.get();
+
+    if(!h || h->depth==0)
+    {
+        return;
+    }
+
+    if(--h->depth>0)
+    {
+        return;
+    }
+
+    for(unsigned i=0; h->pending; i++)
+    {
+        if(h->pending&(1U<<i))
+        {
+            h->pending &= ~(1U<<i);
+            wake(i);
+        }
+    }
+}
+
+bool pia_shmlink_t::pending()
+{
+    for(unsigned i=0; i<PIA_SHMLINK_PEERS; i++)
+    {
+        ring_t *r = segment_->ring(i,self_);
+        uint32_t tail = r->tail;
+
+        if(*(volatile uint32_t *)ring_word(r,tail)!=0)
+        {
+            return true;
+        }
+
+        if(r->skipgen!=skipped_[i])
+        {
+            barrier();
+
+            if((int32_t)(r->skipto-tail)>0)
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+// true if the reader should step over an unpublished record at tail,
+// left by a writer that died
+bool pia_shmlink_t::skip(unsigned i, uint32_t tail, uint32_t *to)
+{
+    ring_t *r = segment_->ring(i,self_);
+    uint32_t gen = r->skipgen;
+
+    if(gen==skipped_[i])
+    {
+        return false;
+    }
+
+    barrier();
+    *to = r->skipto;
+
+    if((int32_t)(*to-tail)<=0)
+    {
+        skipped_[i] = gen;
+        return false;
+    }
+
+    return true;
+}
+
+bool pia_shmlink_t::drain()
+{
+    bool activity = false;
+
+    for(unsigned i=0; i<PIA_SHMLINK_PEERS; i++)
+    {
+        if(i==self_)
+        {
+            continue;
+        }
+
+        ring_t *r = segment_->ring(i,self_);
+        uint32_t head = r->head;
+        uint32_t tail = r->tail;
+        uint32_t start = tail;
+
+        while(tail!=head)
+        {
+            unsigned off = tail&(SHM_RINGSIZE-1);
+            uint32_t len = *(volatile uint32_t *)&r->data[off];
+
+            // not published yet
+            if(len==0)
+            {
+                uint32_t to;
+
+                if(!skip(i,tail,&to))
+                {
+                    break;
+                }
+
+                ring_clear(r,tail,to-tail);
+                tail = to;
+                continue;
+            }
+
+            barrier();
+
+            if(len==SHM_WRAP)
+            {
+                ring_clear(r,tail,SHM_RINGSIZE-off);
+                tail += SHM_RINGSIZE-off;
+                continue;
+            }
+
+            if(len>BCTLINK_HEADER)
+            {
+                const unsigned char *h = &r->data[off+4];
+                kernel_->pie_bkdata(device_,h,h+BCTLINK_HEADER,len-BCTLINK_HEADER);
+                received_++;
+            }
+
+            ring_clear(r,tail,SHM_ALIGN(4+len));
+            tail += SHM_ALIGN(4+len);
+        }
+
+        // a request to skip that's been overtaken is done with
+        uint32_t to;
+        skip(i,tail,&to);
+
+        if(tail==start)
+        {
+            continue;
+        }
+
+        barrier();
+        r->tail = tail;
+        activity = true;
+    }
+
+    return activity;
+}
+
+void pia_shmlink_t::thread_main()
+{
+    peer_t *me = &segment_->peers[self_];
+    struct timespec ts;
+
+    ts.tv_sec = 0;
+    ts.tv_nsec = 250000000;
+
+    while(!stop_)
+    {
+        try
+        {
+            if(drain())
+            {
+                continue;
+            }
+        }
+        CATCHLOG()
+
+        pic_atomic_t w = me->wake;
+        me->sleeping = 1;
+        barrier();
+
+        if(!pending() && !stop_)
+        {
+            if(futex(&me->wake,FUTEX_WAIT,w,&ts)<0 && errno==ETIMEDOUT)
+            {
+                reap();
+            }
+        }
+
+        me->sleeping = 0;
+    }
+}
+
+void pia_shmlink_t::stats(pic::msg_t &m, bool reset)
+{
+    m << "shmlink: slot=" << self_ << " sent=" << sent_ << " received=" << received_;
+    m << " dropped=" << dropped_ << " wakes=" << wakes_ << "\n";
+
+    if(reset)
+    {
+        sent_ = 0;
+        received_ = 0;
+        dropped_ = 0;
+        wakes_ = 0;
+    }
+}
@@ -0,0 +1,112 @@
+/*
+ Copyright 2009 Eigenlabs Ltd.  http://www.eigenlabs.com
+
+ This file is part of EigenD.
+
+ EigenD is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ EigenD is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with EigenD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __PIA_SRC_SHMLINK__
+#define __PIA_SRC_SHMLINK__
+
+#include <picross/pic_thread.h>
+#include <picross/pic_log.h>
+#include <picross/pic_nocopy.h>
+#include <picross/pic_atomic.h>
+
+#include <vector>
+
+#include "pia_bkernel.h"
+
+#define PIA_SHMLINK_PEERS 16
+#define PIA_SHMLINK_GROUPS 120
+#define PIA_SHMLINK_PORTS 6
+
+/*
+ * Shared memory link between the agents on one host.  A bkernel device,
+ * like a network interface, but carrying packets through a segment shared
+ * by every agent process of the user rather than loopback multicast.
+ *
+ * The segment holds a slot per process and a ring for every ordered pair
+ * of slots, written by any thread of one process and read by the other's
+ * link thread.  Each process publishes the multicast buckets it has
+ * joined, so writers only copy into the rings of peers who want the group,
+ * and readers sleep on a futex in their slot.
+ *
+ * Each process also publishes the ports it sends loopback multicast from,
+ * so that when loopback is in use as well, for an agent on the host which
+ * isn't on the link, copies of link traffic arriving that way can be
+ * recognised and dropped.
+ */
+
+class pia_shmlink_t: public pie_bkdeviceops_t, public pic::thread_t, public pic::nocopy_t
+{
+    public:
+        struct segment_t;
+
+    public:
+        pia_shmlink_t(pie_bkernel_t *kernel);
+        ~pia_shmlink_t();
+
+        int bk() { return device_; }
+        void stats(pic::msg_t &m, bool reset);
+
+        void set_ports(const unsigned short *ports);
+        bool peer_port(unsigned short port);
+
+        // while the calling thread holds the link, readers are woken once on release
+        void hold();
+        void release();
+
+        void write_callback(void *ctx, const pie_bkaddr_t *grp, const unsigned char *header, const void *payload, unsigned paylen);
+        void addgroup_callback(void *ctx, const pie_bkaddr_t *grp);
+        void delgroup_callback(void *ctx, const pie_bkaddr_t *grp);
+
+    protected:
+        void thread_main();
+
+    private:
+        bool drain();
+        bool pending();
+        void claim();
+        bool alive(unsigned slot);
+        void reap();
+        void wake(unsigned peer);
+        bool skip(unsigned ring, uint32_t tail, uint32_t *to);
+        static unsigned bucket(const pie_bkaddr_t *grp);
+
+        struct hold_t
+        {
+            unsigned depth;
+            unsigned pending;
+        };
+
+        pie_bkernel_t *kernel_;
+        segment_t *segment_;
+        unsigned self_;
+        int device_;
+        volatile bool stop_;
+        pic::tsd_t hold_;
+        pic::mutex_t holdlock_;
+        std::vector<hold_t *> holds_;
+        pic::mutex_t grouplock_;
+        unsigned refs_[PIA_SHMLINK_GROUPS];
+        uint32_t skipped_[PIA_SHMLINK_PEERS];
+        pic_atomic_t sent_;
+        unsigned long long received_;
+        pic_atomic_t dropped_;
+        pic_atomic_t wakes_;
+};
+
+#endif
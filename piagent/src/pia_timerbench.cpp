@@ -0,0 +1,162 @@
+/*
+ Copyright 2009 Eigenlabs Ltd.  http://www.eigenlabs.com
+
+ This file is part of EigenD.
+
+ EigenD is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ EigenD is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with EigenD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <picross/pic_config.h>
+#include <picross/pic_ilist.h>
+#include <picross/pic_time.h>
+
+#include "pia_timerwheel.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+/*
+ * Runs a population of periodic timers against the sorted list the event
+ * queues used to keep, and against the timer wheel.  Time is simulated in
+ * 1ms steps, with periods between 1ms and 10s.
+ *
+ * pia_timerbench [timers] [seconds]
+ */
+
+struct listtimer_t: pic::element_t<>
+{
+    unsigned long long scheduled_;
+    unsigned long long period_;
+};
+
+struct wheeltimer_t: pia_wheelnode_t
+{
+    unsigned long long scheduled_;
+    unsigned long long period_;
+};
+
+static void list_insert(pic::ilist_t<listtimer_t> &l, listtimer_t *t)
+{
+    listtimer_t *i = l.head();
+
+    while(i && i->scheduled_<t->scheduled_)
+    {
+        i=l.next(i);
+    }
+
+    if(i)
+    {
+        l.insert(t,i);
+    }
+    else
+    {
+        l.append(t);
+    }
+}
+
+int main(int ac, char **av)
+{
+    unsigned n = (ac>1) ? atoi(av[1]) : 10000;
+    unsigned secs = (ac>2) ? atoi(av[2]) : 60;
+    unsigned long long end = secs*1000000ULL;
+
+    std::vector<unsigned long long> periods(n);
+
+    for(unsigned i=0; i<n; ++i)
+    {
+        periods[i] = 1000ULL*(1+rand()%10000);
+    }
+
+    unsigned long long t0,t1,t2,t3,t4,t5;
+    unsigned long long lfired=0, wfired=0;
+
+    {
+        std::vector<listtimer_t> timers(n);
+        pic::ilist_t<listtimer_t> list;
+
+        t0 = pic_microtime();
+
+        for(unsigned i=0; i<n; ++i)
+        {
+            timers[i].period_ = periods[i];
+            timers[i].scheduled_ = periods[i];
+            list_insert(list,&timers[i]);
+        }
+
+        t1 = pic_microtime();
+
+        for(unsigned long long now=0; now<end; now+=1000)
+        {
+            listtimer_t *t;
+
+            while((t=list.head())!=0 && t->scheduled_<=now)
+            {
+                t->remove();
+                t->scheduled_ += t->period_;
+                list_insert(list,t);
+                lfired++;
+            }
+        }
+
+        t2 = pic_microtime();
+
+        while(list.head())
+        {
+            list.head()->remove();
+        }
+    }
+
+    wheeltimer_t *timers = new wheeltimer_t[n];
+
+    {
+        pia_timerwheel_t wheel;
+
+        t3 = pic_microtime();
+
+        for(unsigned i=0; i<n; ++i)
+        {
+            timers[i].period_ = periods[i];
+            timers[i].scheduled_ = periods[i];
+            wheel.insert(&timers[i],timers[i].scheduled_);
+        }
+
+        t4 = pic_microtime();
+
+        for(unsigned long long now=0; now<end; now+=1000)
+        {
+            pia_wheelnode_t *w;
+
+            while((w=wheel.expire(now))!=0)
+            {
+                wheeltimer_t *t = static_cast<wheeltimer_t *>(w);
+                t->scheduled_ += t->period_;
+                wheel.insert(t,t->scheduled_);
+                wfired++;
+            }
+
+            wheel.next();
+        }
+
+        t5 = pic_microtime();
+    }
+
+    delete[] timers;
+
+    printf("%u timers, %u simulated seconds\n",n,secs);
+    printf("list   insert %8.1fms  run %8.1fms  fired %llu  %7.1fns/fire\n",(t1-t0)/1000.0,(t2-t1)/1000.0,lfired,lfired?1000.0*(t2-t1)/lfired:0.0);
+    printf("wheel  insert %8.1fms  run %8.1fms  fired %llu  %7.1fns/fire\n",(t4-t3)/1000.0,(t5-t4)/1000.0,wfired,wfired?1000.0*(t5-t4)/wfired:0.0);
+
+    return 0;
+}
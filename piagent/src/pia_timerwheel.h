@@ -0,0 +1,396 @@
+/*
+ Copyright 2009 Eigenlabs Ltd.  http://www.eigenlabs.com
+
+ This file is part of EigenD.
+
+ EigenD is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ EigenD is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with EigenD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __PIA_SRC_TIMERWHEEL__
+#define __PIA_SRC_TIMERWHEEL__
+
+#include <picross/pic_nocopy.h>
+#include <picross/pic_stdint.h>
+
+/*
+ * Hierarchical timing wheel.
+ *
+ * Entries are intrusive and keyed on a 64 bit time.  Times are grouped
+ * into ticks of 2^shift units.  The first wheel has a slot per tick for
+ * the next 256 ticks, and each coarser wheel has 64 slots covering 64
+ * turns of the wheel below.  Insert and remove are O(1).  As time
+ * advances, a slot of a coarser wheel is emptied into the finer wheels
+ * each time the wheel below it wraps.
+ *
+ * Entries due in the current tick are compared against the exact time,
+ * so expiry is no less precise than a sorted list.
+ */
+
+#define PIA_WHEEL_BITS0 8
+#define PIA_WHEEL_BITSN 6
+#define PIA_WHEEL_LEVELS 4
+#define PIA_WHEEL_SIZE0 (1<<PIA_WHEEL_BITS0)
+#define PIA_WHEEL_SIZEN (1<<PIA_WHEEL_BITSN)
+
+class pia_timerwheel_t;
+
+class pia_wheelnode_t
+{
+    private:
+        friend class pia_timerwheel_t;
+
+    public:
+        pia_wheelnode_t(): when_(0), next_(0), prev_(0), wheel_(0), level_(0), slot_(0) {}
+        ~pia_wheelnode_t() { remove(); }
+
+        bool queued() const { return wheel_!=0; }
+        unsigned long long when() const { return when_; }
+        inline void remove();
+
+    private:
+        pia_wheelnode_t(const pia_wheelnode_t &);
+        pia_wheelnode_t &operator=(const pia_wheelnode_t &);
+
+        unsigned long long when_;
+        pia_wheelnode_t *next_;
+        pia_wheelnode_t *prev_;
+        pia_timerwheel_t *wheel_;
+        unsigned level_;
+        unsigned slot_;
+};
+
+class pia_timerwheel_t: public pic::nocopy_t
+{
+    private:
+        friend class pia_wheelnode_t;
+
+        struct slot_t
+        {
+            slot_t() { head_.next_=&head_; head_.prev_=&head_; }
+            bool empty() const { return head_.next_==&head_; }
+            pia_wheelnode_t head_;
+        };
+
+    public:
+        pia_timerwheel_t(unsigned shift=10): shift_(shift), current_(0), count_(0)
+        {
+            for(unsigned l=0; l<PIA_WHEEL_LEVELS; ++l)
+            {
+                bits_[l][0]=bits_[l][1]=bits_[l][2]=bits_[l][3]=0;
+            }
+        }
+
+        ~pia_timerwheel_t()
+        {
+            for(unsigned l=0; l<PIA_WHEEL_LEVELS; ++l)
+            {
+                for(unsigned s=0; s<slots(l); ++s)
+                {
+                    slot_t &h(slot(l,s));
+
+                    while(!h.empty())
+                    {
+                        unlink(h.head_.next_);
+                    }
+                }
+            }
+        }
+
+        unsigned size() const { return count_; }
+
+        void insert(pia_wheelnode_t *n, unsigned long long when)
+        {
+            n->remove();
+            n->when_=when;
+            place(n);
+            count_++;
+        }
+
+        void remove(pia_wheelnode_t *n)
+        {
+            if(n->wheel_==this)
+            {
+                unlink(n);
+            }
+        }
+
+        /*
+         * Bring an empty wheel up to now, so that entries inserted next are
+         * placed relative to the present, rather than to the last expire()
+         * (or time 0, for a new wheel) which expire() would then have to
+         * step through.
+         */
+
+        void advance(unsigned long long now)
+        {
+            unsigned long long tick = now>>shift_;
+
+            if(!count_ && tick>current_)
+            {
+                current_=tick;
+            }
+        }
+
+        /*
+         * Remove and return one entry due at or before now, or 0 if there
+         * are none.  Call repeatedly to drain everything that is due.
+         */
+
+        pia_wheelnode_t *expire(unsigned long long now)
+        {
+            unsigned long long tick = now>>shift_;
+
+            if(!count_)
+            {
+                if(tick>current_) current_=tick;
+                return 0;
+            }
+
+            while(current_<tick)
+            {
+                unsigned i = (unsigned)(current_&(PIA_WHEEL_SIZE0-1));
+                slot_t &h(slot(0,i));
+
+                if(!h.empty())
+                {
+                    pia_wheelnode_t *n = h.head_.next_;
+                    unlink(n);
+                    return n;
+                }
+
+                // skip empty slots, but stop at the end of the turn to
+                // bring down the next slot of the coarser wheels.
+
+                unsigned long long turn = (current_|(PIA_WHEEL_SIZE0-1))+1;
+                unsigned long long limit = (tick<turn)?tick:turn;
+                current_ += 1+findset(0,i+1,(unsigned)(limit-current_-1));
+
+                if((current_&(PIA_WHEEL_SIZE0-1))==0)
+                {
+                    cascade();
+                }
+            }
+
+            slot_t &h(slot(0,(unsigned)(current_&(PIA_WHEEL_SIZE0-1))));
+
+            for(pia_wheelnode_t *n=h.head_.next_; n!=&h.head_; n=n->next_)
+            {
+                if(n->when_<=now)
+                {
+                    unlink(n);
+                    return n;
+                }
+            }
+
+            return 0;
+        }
+
+        /*
+         * Earliest time at which expire() might return something.  This is
+         * exact for entries in the first wheel, and the time of the next
+         * cascade for entries further out.
+         */
+
+        unsigned long long next() const
+        {
+            if(!count_)
+            {
+                return ~0ULL;
+            }
+
+            unsigned long long best = ~0ULL;
+            unsigned i = (unsigned)(current_&(PIA_WHEEL_SIZE0-1));
+            unsigned d = findset(0,i,PIA_WHEEL_SIZE0);
+
+            if(d<PIA_WHEEL_SIZE0)
+            {
+                const slot_t &h(slot(0,(i+d)&(PIA_WHEEL_SIZE0-1)));
+
+                for(const pia_wheelnode_t *n=h.head_.next_; n!=&h.head_; n=n->next_)
+                {
+                    if(n->when_<best) best=n->when_;
+                }
+            }
+
+            for(unsigned l=1; l<PIA_WHEEL_LEVELS; ++l)
+            {
+                unsigned s = levelshift(l);
+                unsigned long long w = current_>>s;
+                unsigned j = (unsigned)(w&(PIA_WHEEL_SIZEN-1));
+                unsigned e = findset(l,j+1,PIA_WHEEL_SIZEN);
+
+                if(e<PIA_WHEEL_SIZEN)
+                {
+                    unsigned long long t = ((w+e+1)<<s)<<shift_;
+                    if(t<best) best=t;
+                }
+            }
+
+            return best;
+        }
+
+    private:
+        static unsigned slots(unsigned l) { return l?PIA_WHEEL_SIZEN:PIA_WHEEL_SIZE0; }
+        static unsigned levelshift(unsigned l) { return l?(PIA_WHEEL_BITS0+(l-1)*PIA_WHEEL_BITSN):0; }
+
+        slot_t &slot(unsigned l, unsigned s) { return l?wheeln_[l-1][s]:wheel0_[s]; }
+        const slot_t &slot(unsigned l, unsigned s) const { return l?wheeln_[l-1][s]:wheel0_[s]; }
+
+        static unsigned lowbit(uint64_t x)
+        {
+#ifdef __GNUC__
+            return __builtin_ctzll(x);
+#else
+            unsigned n=0;
+            while(!(x&1)) { x>>=1; ++n; }
+            return n;
+#endif
+        }
+
+        // offset from slot i of the first occupied slot of wheel l,
+        // searching at most n slots around the wheel.  returns n if none.
+
+        unsigned findset(unsigned l, unsigned i, unsigned n) const
+        {
+            unsigned size = slots(l);
+            unsigned d = 0;
+
+            while(d<n)
+            {
+                unsigned p = (i+d)&(size-1);
+                uint64_t w = bits_[l][p>>6]>>(p&63);
+
+                if(w)
+                {
+                    d += lowbit(w);
+                    return (d<n)?d:n;
+                }
+
+                d += 64-(p&63);
+            }
+
+            return n;
+        }
+
+        void place(pia_wheelnode_t *n)
+        {
+            unsigned long long t = n->when_>>shift_;
+
+            if(t<current_)
+            {
+                t=current_;
+            }
+
+            unsigned long long d = t-current_;
+            unsigned l;
+
+            if(d<(1ULL<<levelshift(1)))
+            {
+                l=0;
+            }
+            else if(d<(1ULL<<levelshift(2)))
+            {
+                l=1;
+            }
+            else if(d<(1ULL<<levelshift(3)))
+            {
+                l=2;
+            }
+            else
+            {
+                // anything beyond the last wheel waits in its furthest
+                // slot and is placed again when that slot comes round.
+                unsigned long long m = (1ULL<<(levelshift(3)+PIA_WHEEL_BITSN))-1;
+                if(d>m) t=current_+m;
+                l=3;
+            }
+
+            unsigned s = (unsigned)((t>>levelshift(l))&(slots(l)-1));
+            slot_t &h(slot(l,s));
+
+            n->wheel_=this;
+            n->level_=l;
+            n->slot_=s;
+            n->next_=&h.head_;
+            n->prev_=h.head_.prev_;
+            h.head_.prev_->next_=n;
+            h.head_.prev_=n;
+
+            bits_[l][s>>6] |= (1ULL<<(s&63));
+        }
+
+        void unlink(pia_wheelnode_t *n)
+        {
+            n->prev_->next_=n->next_;
+            n->next_->prev_=n->prev_;
+            n->next_=0;
+            n->prev_=0;
+            n->wheel_=0;
+            count_--;
+
+            if(slot(n->level_,n->slot_).empty())
+            {
+                bits_[n->level_][n->slot_>>6] &= ~(1ULL<<(n->slot_&63));
+            }
+        }
+
+        // called as the first wheel wraps: empty the current slot of each
+        // coarser wheel whose own wheel below has wrapped.
+
+        void cascade()
+        {
+            for(unsigned l=1; l<PIA_WHEEL_LEVELS; ++l)
+            {
+                unsigned s = (unsigned)((current_>>levelshift(l))&(PIA_WHEEL_SIZEN-1));
+                slot_t &h(slot(l,s));
+
+                if(!h.empty())
+                {
+                    pia_wheelnode_t *n = h.head_.next_;
+                    h.head_.next_=&h.head_;
+                    h.head_.prev_=&h.head_;
+                    bits_[l][s>>6] &= ~(1ULL<<(s&63));
+
+                    while(n!=&h.head_)
+                    {
+                        pia_wheelnode_t *x = n->next_;
+                        place(n);
+                        n=x;
+                    }
+                }
+
+                if(s!=0)
+                {
+                    break;
+                }
+            }
+        }
+
+        unsigned shift_;
+        unsigned long long current_;
+        unsigned count_;
+        uint64_t bits_[PIA_WHEEL_LEVELS][4];
+        slot_t wheel0_[PIA_WHEEL_SIZE0];
+        slot_t wheeln_[PIA_WHEEL_LEVELS-1][PIA_WHEEL_SIZEN];
+};
+
+inline void pia_wheelnode_t::remove()
+{
+    if(wheel_)
+    {
+        wheel_->unlink(this);
+    }
+}
+
+#endif
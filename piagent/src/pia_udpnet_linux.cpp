@@ -29,9 +29,11 @@
 #include <stdlib.h>
 
 #include <map>
+#include <vector>
 
 #include "pia_bkernel.h"
 #include "pia_bclock.h"
+#include "pia_shmlink.h"
 
 #define PIA_WORKER_PRIORITY 0
 #define PIA_TIMER_PRIORITY 0
@@ -40,6 +42,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
+#include <sys/epoll.h>
 #include <net/if.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
@@ -58,12 +61,19 @@
 #define PORTBASE_ETHER 56555
 #define PORTBASE(loop) ((loop)?PORTBASE_LOCAL:PORTBASE_ETHER)
 
+#define RECV_BATCH 16
+#define EPOLL_BATCH 16
+#define SENDQ_PACKETS 64
+#define SENDQ_BYTES (256*1024)
+#define PACK_LIMIT (BCTLINK_HEADER+BCTLINK_SMALLPAYLOAD)
+
 namespace
 {
     struct checker_t
     {
         virtual ~checker_t() {}
         virtual bool check(unsigned spc,unsigned long, unsigned short,int *d) = 0;
+        virtual void heard(const unsigned char *header) = 0;
     };
 
     struct socket_t : pic::nocopy_t
@@ -136,14 +146,18 @@ namespace
         {
         }
 
+        void address(unsigned long addr, struct sockaddr_in *group)
+        {
+             memset(group,0,sizeof(*group));
+             group->sin_family = AF_INET;
+             group->sin_addr.s_addr = addr;
+             group->sin_port = htons(PORTBASE(loop_)+spc_);
+        }
+
         void send(unsigned long addr, const unsigned char *data, unsigned len)
         {
              struct sockaddr_in group;
-
-             memset(&group,0,sizeof(group));
-             group.sin_family = AF_INET;
-             group.sin_addr.s_addr = addr;
-             group.sin_port = htons(PORTBASE(loop_)+spc_);
+             address(addr,&group);
 
              ssize_t s = sendto(socket_.fd, (char *)data, len, 0, (struct sockaddr*)&group, sizeof(group));
              if(s != (int)len)
@@ -153,6 +167,28 @@ namespace
 
         }
 
+        void sendv(struct mmsghdr *msgs, unsigned n)
+        {
+            while(n>0)
+            {
+                int s = sendmmsg(socket_.fd, msgs, n, 0);
+
+                if(s <= 0)
+                {
+                    if(s<0 && errno==EINTR)
+                    {
+                        continue;
+                    }
+
+                    pic::msg() << "Can't send multicast data on " << socket_.fd << ':' << (void *)this << ": " << sys_errlist[errno] << pic::log;
+                    return;
+                }
+
+                msgs += s;
+                n -= s;
+            }
+        }
+
         unsigned short port() { return port_; }
 
         socket_t socket_;
@@ -162,9 +198,357 @@ namespace
         bool loop_;
     };
 
+    /*
+     * Packets written while a thread holds the network are copied into
+     * that thread's own batch, and go out with one sendmmsg per socket when
+     * its outermost hold is released (or when the batch fills).  Other
+     * threads keep sending directly.  A thread never waits behind another
+     * thread's sendmmsg: the lock on a batch is only otherwise taken by
+     * purge and stats, which don't send.
+     *
+     * Fast namespace packets for the same group are packed together, up to
+     * PACK_LIMIT, into one BCTLINK_MAGIC2PACKED datagram which the bkernel
+     * unpacks on receipt.  A packet is only ever added to the latest entry
+     * for its group, so ordering within the group is kept.  Packing is only
+     * done once every host heard from has said it can unpack.
+     */
+    struct sendbatch_t: pic::nocopy_t
+    {
+        struct entry_t
+        {
+            send_socket_t *socket;
+            struct sockaddr_in group;
+            struct iovec iov;
+            unsigned char *base;
+            unsigned packets;
+            bool packable;
+            bool done;
+        };
+
+        sendbatch_t(): depth_(0), count_(0), used_(0), fastpackets_(0), fastdatagrams_(0), fastsaved_(0)
+        {
+        }
+
+        void queue(send_socket_t *socket, unsigned long addr, const unsigned char *hdr, const void *data, unsigned len, bool fast, bool packing)
+        {
+            pic::mutex_t::guard_t g(lock_);
+
+            bool packable = fast && packing && BCTLINK_HEADER+2+len <= PACK_LIMIT;
+            unsigned reserve = packable ? PACK_LIMIT : BCTLINK_HEADER+len;
+
+            if(fast)
+            {
+                fastpackets_++;
+            }
+
+            if(packable)
+            {
+                entry_t *e = latest(socket,hdr);
+
+                if(e && e->packable && pack(e,(const unsigned char *)data,len))
+                {
+                    fastsaved_++;
+                    return;
+                }
+            }
+
+            if(count_==SENDQ_PACKETS || used_+reserve > SENDQ_BYTES)
+            {
+                flush_locked();
+            }
+
+            entry_t *e = &entry_[count_++];
+            unsigned char *b = &buffer_[used_];
+
+            memcpy(b,hdr,BCTLINK_HEADER);
+            memcpy(&b[BCTLINK_HEADER],data,len);
+            used_ += reserve;
+
+            e->socket = socket;
+            e->iov.iov_base = b;
+            e->iov.iov_len = BCTLINK_HEADER+len;
+            e->base = b;
+            e->packets = 1;
+            e->packable = packable;
+            e->done = false;
+            socket->address(addr,&e->group);
+
+            if(fast)
+            {
+                fastdatagrams_++;
+            }
+        }
+
+        entry_t *latest(send_socket_t *socket, const unsigned char *hdr)
+        {
+            for(unsigned i=count_; i>0; i--)
+            {
+                entry_t *e = &entry_[i-1];
+
+                if(e->socket==socket && !memcmp(&e->base[BCTLINK_NAMESPACE],&hdr[BCTLINK_NAMESPACE],BCTLINK_HEADER-BCTLINK_NAMESPACE))
+                {
+                    return e;
+                }
+            }
+
+            return 0;
+        }
+
+        bool pack(entry_t *e, const unsigned char *data, unsigned len)
+        {
+            unsigned char *b = e->base;
+            unsigned used = e->iov.iov_len;
+
+            if(used+((e->packets==1)?2:0)+2+len > PACK_LIMIT)
+            {
+                return false;
+            }
+
+            if(e->packets==1)
+            {
+                unsigned l = used-BCTLINK_HEADER;
+                memmove(&b[BCTLINK_HEADER+2],&b[BCTLINK_HEADER],l);
+                b[BCTLINK_HEADER+0] = (l>>8)&0xff;
+                b[BCTLINK_HEADER+1] = (l>>0)&0xff;
+                b[BCTLINK_MAGIC2] = BCTLINK_MAGIC2PACKED;
+                used += 2;
+            }
+
+            b[used+0] = (len>>8)&0xff;
+            b[used+1] = (len>>0)&0xff;
+            memcpy(&b[used+2],data,len);
+            used += 2+len;
+
+            b[BCTLINK_LEN_HI] = (used>>8)&0xff;
+            b[BCTLINK_LEN_LO] = (used>>0)&0xff;
+
+            e->iov.iov_len = used;
+            e->packets++;
+            return true;
+        }
+
+        // drop anything queued for a socket that's going away
+        void purge(send_socket_t *socket)
+        {
+            pic::mutex_t::guard_t g(lock_);
+
+            for(unsigned i=0; i<count_; i++)
+            {
+                if(entry_[i].socket==socket)
+                {
+                    entry_[i].done = true;
+                }
+            }
+        }
+
+        void stats(unsigned long long *counts, bool reset)
+        {
+            pic::mutex_t::guard_t g(lock_);
+
+            counts[0] += fastpackets_;
+            counts[1] += fastdatagrams_;
+            counts[2] += fastsaved_;
+
+            if(reset)
+            {
+                fastpackets_ = 0;
+                fastdatagrams_ = 0;
+                fastsaved_ = 0;
+            }
+        }
+
+        void flush()
+        {
+            pic::mutex_t::guard_t g(lock_);
+            flush_locked();
+        }
+
+        void flush_locked()
+        {
+            for(unsigned i=0; i<count_; i++)
+            {
+                if(entry_[i].done)
+                {
+                    continue;
+                }
+
+                send_socket_t *socket = entry_[i].socket;
+                unsigned n = 0;
+
+                for(unsigned j=i; j<count_; j++)
+                {
+                    entry_t *e = &entry_[j];
+
+                    if(e->done || e->socket!=socket)
+                    {
+                        continue;
+                    }
+
+                    memset(&msgs_[n],0,sizeof(msgs_[n]));
+                    msgs_[n].msg_hdr.msg_name = &e->group;
+                    msgs_[n].msg_hdr.msg_namelen = sizeof(e->group);
+                    msgs_[n].msg_hdr.msg_iov = &e->iov;
+                    msgs_[n].msg_hdr.msg_iovlen = 1;
+                    e->done = true;
+                    n++;
+                }
+
+                socket->sendv(msgs_,n);
+            }
+
+            count_ = 0;
+            used_ = 0;
+        }
+
+        unsigned depth_;
+        pic::mutex_t lock_;
+        unsigned count_;
+        unsigned used_;
+        unsigned long long fastpackets_;
+        unsigned long long fastdatagrams_;
+        unsigned long long fastsaved_;
+        entry_t entry_[SENDQ_PACKETS];
+        struct mmsghdr msgs_[SENDQ_PACKETS];
+        unsigned char buffer_[SENDQ_BYTES];
+    };
+
+    /*
+     * The batches of every thread that has held the network.  A thread's
+     * batch is made the first time it holds, and kept until the network
+     * goes.
+     */
+    struct sendq_t: pic::nocopy_t
+    {
+        sendq_t(): packing_(false)
+        {
+        }
+
+        ~sendq_t()
+        {
+            for(unsigned i=0; i<batches_.size(); i++)
+            {
+                delete batches_[i];
+            }
+        }
+
+        void packing(bool p)
+        {
+            packing_ = p;
+        }
+
+        bool held()
+        {
+            sendbatch_t *b = (sendbatch_t *)batch_.get();
+            return b && b->depth_!=0;
+        }
+
+        void hold()
+        {
+            sendbatch_t *b = (sendbatch_t *)batch_.get();
+
+            if(!b)
+            {
+                b = new sendbatch_t;
+                batch_.set(b);
+
+                pic::mutex_t::guard_t g(lock_);
+                batches_.push_back(b);
+            }
+
+            b->depth_++;
+        }
+
+        void release()
+        {
+            sendbatch_t *b = (sendbatch_t *)batch_.get();
+
+            if(!b || b->depth_==0)
+            {
+                return;
+            }
+
+            if(--b->depth_==0)
+            {
+                b->flush();
+            }
+        }
+
+        // only while this thread holds the network
+        void queue(send_socket_t *socket, unsigned long addr, const unsigned char *hdr, const void *data, unsigned len, bool fast)
+        {
+            ((sendbatch_t *)batch_.get())->queue(socket,addr,hdr,data,len,fast,packing_);
+        }
+
+        void purge(send_socket_t *socket)
+        {
+            pic::mutex_t::guard_t g(lock_);
+
+            for(unsigned i=0; i<batches_.size(); i++)
+            {
+                batches_[i]->purge(socket);
+            }
+        }
+
+        void stats(pic::msg_t &m, bool reset)
+        {
+            unsigned long long counts[3] = { 0, 0, 0 };
+
+            {
+                pic::mutex_t::guard_t g(lock_);
+
+                for(unsigned i=0; i<batches_.size(); i++)
+                {
+                    batches_[i]->stats(counts,reset);
+                }
+            }
+
+            m << "udpnet: fast packets=" << counts[0] << " datagrams=" << counts[1] << " saved=" << counts[2];
+            m << " header bytes saved=" << counts[2]*(BCTLINK_HEADER-2) << "\n";
+        }
+
+        pic::tsd_t batch_;
+        pic::mutex_t lock_;
+        std::vector<sendbatch_t *> batches_;
+        volatile bool packing_;
+    };
+
+    /*
+     * Receive buffers shared by all the sockets serviced by the network
+     * thread, so that one recvmmsg can drain a socket.
+     */
+    struct recvbatch_t: pic::nocopy_t
+    {
+        recvbatch_t()
+        {
+            for(unsigned i=0; i<RECV_BATCH; i++)
+            {
+                iov_[i].iov_base = buffer_[i];
+                iov_[i].iov_len = BCTLINK_MAXPACKET;
+            }
+        }
+
+        void prepare()
+        {
+            memset(msgs_,0,sizeof(msgs_));
+
+            for(unsigned i=0; i<RECV_BATCH; i++)
+            {
+                msgs_[i].msg_hdr.msg_name = &names_[i];
+                msgs_[i].msg_hdr.msg_namelen = sizeof(names_[i]);
+                msgs_[i].msg_hdr.msg_iov = &iov_[i];
+                msgs_[i].msg_hdr.msg_iovlen = 1;
+            }
+        }
+
+        struct mmsghdr msgs_[RECV_BATCH];
+        struct iovec iov_[RECV_BATCH];
+        struct sockaddr_in names_[RECV_BATCH];
+        unsigned char buffer_[RECV_BATCH][BCTLINK_MAXPACKET];
+    };
+
     struct recv_socket_t
     {
-        recv_socket_t(unsigned spc, unsigned long local, bool loop): socket_(AF_INET,SOCK_DGRAM,0), spc_(spc), local_(local)
+        recv_socket_t(unsigned spc, unsigned long local, bool loop): socket_(AF_INET,SOCK_DGRAM,0), spc_(spc), local_(local), kernel_(0), device_(-1)
         {
             int reuse=1;
             struct sockaddr_in addr;
@@ -255,17 +639,31 @@ namespace
             }
         }
 
-        int recv(unsigned long *addr, unsigned short *port, unsigned char *data, unsigned len)
+        void watch(int epfd, pie_bkernel_t *kernel, int device)
+        {
+            struct epoll_event ev;
+            memset(&ev,0,sizeof(ev));
+            ev.events = EPOLLIN;
+            ev.data.ptr = this;
+
+            kernel_ = kernel;
+            device_ = device;
+
+            if(epoll_ctl(epfd, EPOLL_CTL_ADD, socket_.fd, &ev) < 0)
+            {
+                pic::msg() << "Can't watch mcast socket: " << sys_errlist[errno] << pic::hurl;
+            }
+        }
+
+        int recv(recvbatch_t *b)
         {
-            int l;
-            struct sockaddr_in a;
-            memset(&a,0,sizeof(a));
-            a.sin_family=AF_INET;
-            socklen_t al = sizeof(a);
+            int n;
+
+            b->prepare();
 
-            if((l=recvfrom(socket_.fd, (char *)data, len, MSG_WAITALL|MSG_DONTWAIT, (struct sockaddr *)&a, &al)) < 0)
+            if((n=recvmmsg(socket_.fd, b->msgs_, RECV_BATCH, MSG_DONTWAIT, 0)) < 0)
             {
-                if(errno==EAGAIN)
+                if(errno==EAGAIN || errno==EINTR)
                 {
                     return 0;
                 }
@@ -273,18 +671,29 @@ namespace
                 pic::msg() << "error receiving multicast data" << pic::hurl;
             }
 
-            *addr = a.sin_addr.s_addr;
-            *port = a.sin_port;
-            return l;
+            return n;
         }
 
-        void network(pie_bkernel_t *kernel,checker_t *checker, int device)
+        void network(checker_t *checker, recvbatch_t *b)
         {
-            unsigned char buffer[BCTLINK_MAXPACKET];
-            int len;
-            unsigned long a; unsigned short p;
-            
-            while((len=recv(&a,&p,buffer,sizeof(buffer)))>0)
+            int n;
+
+            do
+            {
+                n = recv(b);
+
+                for(int i=0; i<n; i++)
+                {
+                    process(checker,b->names_[i].sin_addr.s_addr,b->names_[i].sin_port,b->buffer_[i],b->msgs_[i].msg_len);
+                }
+            }
+            while(n==RECV_BATCH);
+        }
+
+        void process(checker_t *checker, unsigned long a, unsigned short p, unsigned char *buffer, int len)
+        {
+            int device = device_;
+
             {
                 if(!checker->check(spc_,a,p,&device))
                 {
@@ -294,13 +703,14 @@ namespace
                     //    (unsigned)x[1] << "." <<
                     //    (unsigned)x[2] << "." <<
                     //    (unsigned)x[3] << ":" << p;
-                    continue;
+                    return;
                 }
 
                 if(len>BCTLINK_HEADER)
                 {
+                    checker->heard(buffer);
                     len-=BCTLINK_HEADER;
-                    kernel->pie_bkdata(device,buffer,&buffer[BCTLINK_HEADER],len);
+                    kernel_->pie_bkdata(device,buffer,&buffer[BCTLINK_HEADER],len);
                 }
             }
         }
@@ -309,11 +719,13 @@ namespace
         unsigned spc_;
         unsigned long local_;
         pic::lckmap_t<unsigned long,unsigned>::type subscriptions_;
+        pie_bkernel_t *kernel_;
+        int device_;
     };
 
     struct interface_t: pie_bkdeviceops_t
     {
-        interface_t(pie_bkernel_t *kernel,unsigned long ifaddr, bool loop): local_(ifaddr), device_(-1), loop_(loop),
+        interface_t(pie_bkernel_t *kernel,unsigned long ifaddr, bool loop): local_(ifaddr), device_(-1), loop_(loop), sending_(true), sendq_(0),
              rsocket0_(0,ifaddr,loop), rsocket1_(1,ifaddr,loop), rsocket2_(2,ifaddr,loop), rsocket3_(3,ifaddr,loop), rsocket4_(4,ifaddr,loop), rsocket5_(5,ifaddr,loop), 
              ssocket0_(0,ifaddr,loop), ssocket1_(1,ifaddr,loop), ssocket2_(2,ifaddr,loop), ssocket3_(3,ifaddr,loop), ssocket4_(4,ifaddr,loop), ssocket5_(5,ifaddr,loop),
              kernel_(kernel)
@@ -357,20 +769,24 @@ namespace
         {
             interface_t *intf = (interface_t *)ctx;
             unsigned long addr = hash(grp);
+            send_socket_t *socket = intf->ssocket(grp->space);
+
+            if(!intf->sending_)
+            {
+                return;
+            }
+
+            if(intf->sendq_ && intf->sendq_->held())
+            {
+                intf->sendq_->queue(socket,addr,hdr,data,len,grp->space==BCTLINK_NAMESPACE_FAST);
+                return;
+            }
 
             unsigned char buffer[BCTLINK_MAXPACKET];
             memcpy(buffer,hdr,BCTLINK_HEADER);
             memcpy(&buffer[BCTLINK_HEADER],data,len);
 
-            switch(grp->space)
-            {
-                case 0: intf->ssocket0_.send(addr,buffer,BCTLINK_HEADER+len); break;
-                case 1: intf->ssocket1_.send(addr,buffer,BCTLINK_HEADER+len); break;
-                case 2: intf->ssocket2_.send(addr,buffer,BCTLINK_HEADER+len); break;
-                case 3: intf->ssocket3_.send(addr,buffer,BCTLINK_HEADER+len); break;
-                case 4: intf->ssocket4_.send(addr,buffer,BCTLINK_HEADER+len); break;
-                default: intf->ssocket5_.send(addr,buffer,BCTLINK_HEADER+len); break;
-            }
+            socket->send(addr,buffer,BCTLINK_HEADER+len);
         }
 
         void addgroup_callback(void *ctx, const pie_bkaddr_t *grp)
@@ -405,37 +821,33 @@ namespace
             }
         }
 
-        unsigned short sp(unsigned spc)
+        send_socket_t *ssocket(unsigned spc)
         {
             switch(spc)
             {
-                case 0:  return ssocket0_.port();
-                case 1:  return ssocket1_.port();
-                case 2:  return ssocket2_.port();
-                case 3:  return ssocket3_.port();
-                case 4:  return ssocket4_.port();
-                default: return ssocket5_.port();
+                case 0:  return &ssocket0_;
+                case 1:  return &ssocket1_;
+                case 2:  return &ssocket2_;
+                case 3:  return &ssocket3_;
+                case 4:  return &ssocket4_;
+                default: return &ssocket5_;
             }
         }
 
-        void populate_fd(fd_set *r)
+        unsigned short sp(unsigned spc)
         {
-            FD_SET(rsocket0_.fd(),r);
-            FD_SET(rsocket1_.fd(),r);
-            FD_SET(rsocket2_.fd(),r);
-            FD_SET(rsocket3_.fd(),r);
-            FD_SET(rsocket4_.fd(),r);
-            FD_SET(rsocket5_.fd(),r);
+            return ssocket(spc)->port();
         }
 
-        void process_fd(fd_set *r, checker_t *checker)
+        void watch(int epfd, sendq_t *sendq)
         {
-            if(FD_ISSET(rsocket0_.fd(),r)) rsocket0_.network(kernel_,checker,device_);
-            if(FD_ISSET(rsocket1_.fd(),r)) rsocket1_.network(kernel_,checker,device_);
-            if(FD_ISSET(rsocket2_.fd(),r)) rsocket2_.network(kernel_,checker,device_);
-            if(FD_ISSET(rsocket3_.fd(),r)) rsocket3_.network(kernel_,checker,device_);
-            if(FD_ISSET(rsocket4_.fd(),r)) rsocket4_.network(kernel_,checker,device_);
-            if(FD_ISSET(rsocket5_.fd(),r)) rsocket5_.network(kernel_,checker,device_);
+            rsocket0_.watch(epfd,kernel_,device_);
+            rsocket1_.watch(epfd,kernel_,device_);
+            rsocket2_.watch(epfd,kernel_,device_);
+            rsocket3_.watch(epfd,kernel_,device_);
+            rsocket4_.watch(epfd,kernel_,device_);
+            rsocket5_.watch(epfd,kernel_,device_);
+            sendq_ = sendq;
         }
 
         unsigned short sp0() { return ssocket0_.port(); }
@@ -449,6 +861,8 @@ namespace
         unsigned long local_;
         int device_;
         bool loop_;
+        volatile bool sending_;
+        sendq_t *sendq_;
 
         recv_socket_t rsocket0_;
         recv_socket_t rsocket1_;
@@ -591,19 +1005,71 @@ namespace
 
     };
 
+    struct poller_t : pic::nocopy_t
+    {
+        poller_t()
+        {
+            if((fd=epoll_create(16))<0)
+            {
+                pic::msg() << "can't create epoll instance" << pic::hurl;
+            }
+        }
+
+        ~poller_t()
+        {
+            close(fd);
+        }
+
+        int fd;
+    };
+
     struct netbase_t: pic::thread_t, checker_t
     {
-        netbase_t(pic::nballocator_t *a, bool clock): pic::thread_t(0), allocator_(a), shutdown_(false), bkernel_(allocator_,clock), local_(false), loopback_(&bkernel_,inet_addr("127.0.0.1"),true)
+        netbase_t(pic::nballocator_t *a, bool clock): pic::thread_t(0), allocator_(a), shutdown_(false), bkernel_(allocator_,clock), local_(false), packers_(false), oldpeers_(false), shmlink_(0), loopback_(0)
         {
             if(getenv("PI_FULLNET")==0)
             {
                 pic::logmsg() << "warning: networking disabled";
                 local_ = true;
             }
+
+            loopback_ = new interface_t(&bkernel_,inet_addr("127.0.0.1"),true);
+            loopback_->watch(poller_.fd,&sendq_);
+            loopback_->sending_ = false;
+
+            // agents on this host talk through shared memory where they can.
+            // loopback multicast is still received, and is sent as well once
+            // an agent turns up which isn't on the shared memory link.
+            if(getenv("PI_NOSHMLINK")==0)
+            {
+                try
+                {
+                    shmlink_ = new pia_shmlink_t(&bkernel_);
+                }
+                CATCHLOG()
+            }
+
+            if(shmlink_)
+            {
+                unsigned short ports[PIA_SHMLINK_PORTS];
+
+                for(unsigned i=0; i<PIA_SHMLINK_PORTS; i++)
+                {
+                    ports[i] = loopback_->sp(i);
+                }
+
+                shmlink_->set_ports(ports);
+            }
+            else
+            {
+                loopback_->sending_ = true;
+            }
         }
 
         ~netbase_t()
         {
+            delete shmlink_;
+            delete loopback_;
         }
 
         bool check(unsigned spc, unsigned long a, unsigned short p, int *d)
@@ -612,7 +1078,7 @@ namespace
 
             bool remotehost = true;
 
-            if(a==loopback_.local_)
+            if(a==loopback_->local_)
                 remotehost = false;
 
             for(i=interfaces_.begin(); i!=interfaces_.end(); i++)
@@ -624,7 +1090,7 @@ namespace
 
             bool remoteproc = true;
 
-            if(p==loopback_.sp(spc))
+            if(p==loopback_->sp(spc))
                 remoteproc = false;
 
             for(i=interfaces_.begin(); i!=interfaces_.end(); i++)
@@ -633,13 +1099,46 @@ namespace
 
             if(remoteproc)
             {
-                *d = loopback_.bk();
+                if(shmlink_ && a==loopback_->local_)
+                {
+                    // a link peer's copy of what it also sent us directly
+                    if(shmlink_->peer_port(p))
+                        return false;
+
+                    if(!loopback_->sending_)
+                    {
+                        pic::logmsg() << "agent without shared memory link on this host, sending loopback multicast";
+                        loopback_->sending_ = true;
+                    }
+                }
+
+                *d = loopback_->bk();
                 return true;
             }
 
             return false;
         }
 
+        // a host that can unpack says so after any group shorter than the
+        // header has room for.  one that doesn't stops packing for good.
+        void heard(const unsigned char *header)
+        {
+            if(header[BCTLINK_GROUP_LEN]>=BCTLINK_GROUP_SIZE)
+                return;
+
+            if(header[BCTLINK_CAPS]==BCTLINK_CAPS_PACKED)
+            {
+                packers_ = true;
+            }
+            else if(!oldpeers_)
+            {
+                pic::logmsg() << "host without packed datagrams on the network, not packing";
+                oldpeers_ = true;
+            }
+
+            sendq_.packing(packers_ && !oldpeers_);
+        }
+
         void shutdown()
         {
             //pic::logmsg() << "shutting down network";
@@ -648,80 +1147,107 @@ namespace
             //pic::logmsg() << "shut down network";
         }
 
-        virtual void populate_monitor(fd_set *r)
+        virtual int monitor_fd()
         {
+            return -1;
         }
 
-        virtual bool process_monitor(fd_set *r)
+        virtual void process_monitor()
         {
-            return false;
         }
 
-        void thread_init()
+        void hold()
         {
-            if(!local_)
-                scan();
+            sendq_.hold();
+
+            if(shmlink_)
+            {
+                shmlink_->hold();
+            }
         }
 
-        void thread_main()
+        void release()
         {
-            fd_set r;
-            struct timeval tv;
-            int rv;
+            sendq_.release();
 
-            while(!shutdown_)
+            if(shmlink_)
             {
-                tv.tv_sec=0;
-                tv.tv_usec=250000;
-
-                FD_ZERO(&r);
+                shmlink_->release();
+            }
+        }
 
-                populate_fd(&r);
-                if(!local_)
-                    populate_monitor(&r);
+        void thread_init()
+        {
+            if(!local_)
+            {
+                int fd = monitor_fd();
 
-                if((rv=::select(FD_SETSIZE,&r,0,0,&tv))<0)
+                if(fd>=0)
                 {
-                    pic::msg() << "error in select: " << rv << ',' << sys_errlist[errno] << pic::hurl;
+                    struct epoll_event ev;
+                    memset(&ev,0,sizeof(ev));
+                    ev.events = EPOLLIN;
+                    ev.data.ptr = 0;
+
+                    if(epoll_ctl(poller_.fd, EPOLL_CTL_ADD, fd, &ev) < 0)
+                    {
+                        pic::msg() << "can't watch kernel events: " << sys_errlist[errno] << pic::hurl;
+                    }
                 }
 
-                if(local_ || !process_monitor(&r))
-                {
-                    process_fd(&r);
-                }
+                scan();
             }
         }
 
-        void populate_fd(fd_set *r)
+        void thread_main()
         {
-            std::map<std::string,std::pair<unsigned long,interface_t *> >::iterator i;
+            struct epoll_event ev[EPOLL_BATCH];
+            int n;
 
-            for(i=interfaces_.begin(); i!=interfaces_.end(); i++)
+            while(!shutdown_)
             {
-                i->second.second->populate_fd(r);
-            }
+                if((n=epoll_wait(poller_.fd,ev,EPOLL_BATCH,250))<0)
+                {
+                    if(errno==EINTR)
+                    {
+                        continue;
+                    }
 
-            loopback_.populate_fd(r);
-        }
+                    pic::msg() << "error in epoll_wait: " << n << ',' << sys_errlist[errno] << pic::hurl;
+                }
 
-        void process_fd(fd_set *r)
-        {
-            std::map<std::string,std::pair<unsigned long,interface_t *> >::iterator i;
+                bool monitor = false;
 
-            for(i=interfaces_.begin(); i!=interfaces_.end(); i++)
-            {
-                i->second.second->process_fd(r, this);
-            }
+                for(int i=0; i<n; i++)
+                {
+                    if(!ev[i].data.ptr)
+                    {
+                        monitor = true;
+                    }
+                }
 
-            loopback_.process_fd(r, this);
-        }
+                // the interface set may change under the other events, and
+                // anything still readable will be reported again.
+                if(monitor)
+                {
+                    process_monitor();
+                    continue;
+                }
 
+                for(int i=0; i<n; i++)
+                {
+                    ((recv_socket_t *)ev[i].data.ptr)->network(this,&recvbatch_);
+                }
+            }
+        }
 
         interface_t *create_intf(unsigned long addr)
         {
             try
             {
-                return new interface_t(&bkernel_,addr,false);
+                interface_t *intf = new interface_t(&bkernel_,addr,false);
+                intf->watch(poller_.fd,&sendq_);
+                return intf;
             }
             catch(...)
             {
@@ -731,6 +1257,14 @@ namespace
 
         void destroy_intf(interface_t *intf)
         {
+            if(intf)
+            {
+                for(unsigned i=0; i<6; i++)
+                {
+                    sendq_.purge(intf->ssocket(i));
+                }
+            }
+
             delete intf;
         }
 
@@ -813,7 +1347,13 @@ namespace
         bool shutdown_;
         bkernel_t bkernel_;
         bool local_;
-        interface_t loopback_;
+        bool packers_;
+        bool oldpeers_;
+        poller_t poller_;
+        sendq_t sendq_;
+        recvbatch_t recvbatch_;
+        pia_shmlink_t *shmlink_;
+        interface_t *loopback_;
         std::map<std::string,std::pair<unsigned long, interface_t *> > interfaces_;
     };
 };
@@ -847,22 +1387,16 @@ struct pia::udpnet_t::impl_t: netbase_t
 
     }
 
-    virtual void populate_monitor(fd_set *r)
+    virtual int monitor_fd()
     {
-        FD_SET(kevsock_.fd,r);
+        return kevsock_.fd;
     }
 
-    virtual bool process_monitor(fd_set *r)
+    virtual void process_monitor()
     {
-        if(FD_ISSET(kevsock_.fd,r))
-        {
-            unsigned char buffer[4096];
-            recv(kevsock_.fd,buffer,sizeof(buffer),0);
-            scan();
-            return true;
-        }
-
-        return false;
+        unsigned char buffer[4096];
+        recv(kevsock_.fd,buffer,sizeof(buffer),0);
+        scan();
     }
 
     virtual unsigned long interface_filter(const char *name)
@@ -977,3 +1511,27 @@ int pia::udpnet_t::network_time(void *handle_, unsigned long long *time)
     *time = pic_microtime();
     return 1;
 }
+
+void pia::udpnet_t::network_hold()
+{
+    impl_->hold();
+}
+
+void pia::udpnet_t::network_release()
+{
+    pia_logguard_t guard(0,impl_->allocator_);
+    impl_->release();
+}
+
+std::string pia::udpnet_t::network_stats(bool reset)
+{
+    pic::msg_t m;
+    impl_->sendq_.stats(m,reset);
+
+    if(impl_->shmlink_)
+    {
+        impl_->shmlink_->stats(m,reset);
+    }
+
+    return std::string(m.str().c_str());
+}
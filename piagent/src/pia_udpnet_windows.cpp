@@ -935,3 +935,16 @@ int pia::udpnet_t::network_time(void *handle_, unsigned long long *time)
     *time = pic_microtime();
     return 1;
 }
+
+void pia::udpnet_t::network_hold()
+{
+}
+
+void pia::udpnet_t::network_release()
+{
+}
+
+std::string pia::udpnet_t::network_stats(bool reset)
+{
+    return std::string();
+}
@@ -34,6 +34,7 @@ extern "C" {
 
 #define BCTLINK_MAGIC1VAL       0xbe
 #define BCTLINK_MAGIC2VAL       0xca
+#define BCTLINK_MAGIC2PACKED    0xcb /**< payload is a run of 16 bit length prefixed payloads for one group */
 
 #define BCTLINK_MAGIC1          0
 #define BCTLINK_MAGIC2          1
@@ -43,6 +44,9 @@ extern "C" {
 #define BCTLINK_GROUP_LEN       5
 #define BCTLINK_GROUP           6
 #define BCTLINK_HEADER          (BCTLINK_GROUP+BCTLINK_GROUP_SIZE)
+#define BCTLINK_CAPS            (BCTLINK_HEADER-1) /**< capabilities, if the group is shorter than BCTLINK_GROUP_SIZE */
+
+#define BCTLINK_CAPS_PACKED     0xcb /**< sender can receive BCTLINK_MAGIC2PACKED */
 
 #define BCTLINK_MAXPACKET       49152 /**< maximum packet length */
 #define BCTLINK_MAXPAYLOAD      (BCTLINK_MAXPACKET-BCTLINK_HEADER) /**< absolute maximum payload length */
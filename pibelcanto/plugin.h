@@ -152,6 +152,7 @@ struct bct_datahdr_s
     float lbound;
     float rest;
     unsigned nb_mode;
+    unsigned intern; /* 0, the process local id of an interned path, or ~0 if it can't be interned */
 };
 
 
@@ -263,6 +264,9 @@ struct bct_entity_ops_s
 	void *(*entity_winctx)(bct_entity_t);
 	void (*entity_winch)(bct_entity_t, const char *);
 	bool (*entity_is_fast)(bct_entity_t);
+    int (*entity_clockstats_enable)(bct_entity_t, int); /* returns previous state */
+    bct_data_t (*entity_clockstats)(bct_entity_t, int reset);
+    int (*entity_fastcall_async)(bct_entity_t, int (*function)(bct_entity_t, void *, void *), void *arg1, void *arg2); /* any thread, doesn't wait */
 };
 
 #define bct_entity_server(bc,n,s)               ((*(bc))->entity_server((bc),(n),(s)))
@@ -294,6 +298,9 @@ struct bct_entity_ops_s
 #define bct_entity_winctx(bc)                   ((*(bc))->entity_winctx((bc)))
 #define bct_entity_winch(bc,m)                  ((*(bc))->entity_winch((bc),(m)))
 #define bct_entity_is_fast(bc)                  ((*(bc))->entity_is_fast((bc)))
+#define bct_entity_clockstats_enable(bc,f)      ((*(bc))->entity_clockstats_enable((bc),(f)))
+#define bct_entity_clockstats(bc,r)             ((*(bc))->entity_clockstats((bc),(r)))
+#define bct_entity_fastcall_async(bc,f,a1,a2)   ((*(bc))->entity_fastcall_async((bc),(f),(a1),(a2)))
 
 /**
  * Host side RPC client operations
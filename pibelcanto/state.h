@@ -48,6 +48,19 @@ extern "C" {
 #define BCTMTYPE_RPC_ACK    0x0b
 #define BCTMTYPE_RPC_GET    0x0c
 #define BCTMTYPE_RPC_DUN    0x0d
+#define BCTMTYPE_RPC_BAT    0x0e /**< marker: sender understands batched datagrams */
+
+#define BCTMTYPE_INDEX_DELTA 0x01 /**< changes from gen0 to gen1 */
+#define BCTMTYPE_INDEX_SNAP  0x02 /**< snapshot at gen1, part gen0, more to come */
+#define BCTMTYPE_INDEX_LAST  0x03 /**< last part of a snapshot */
+#define BCTMTYPE_INDEX_BEAT  0x04 /**< current generation gen1, no records */
+#define BCTMTYPE_INDEX_REQ   0x05 /**< request changes since gen0 (source 0: everyone) */
+
+#define BCTINDEX_ADD        0x00
+#define BCTINDEX_DEL        0x01
+
+#define BCTINDEX_MAGIC      0xb1 /**< first byte of an index header */
+#define BCTINDEX_VERSION    0x01 /**< second byte of an index header */
 
 /**
  * @}
@@ -83,6 +96,9 @@ extern "C" {
 #define BCTLIMIT_PATHMAX    255 /**< largest path component */
 #define BCTLIMIT_PATHLEN    64 /**< length of path */
 #define BCTLIMIT_DATA       (BCTLINK_MAXPAYLOAD-100) /**< largest data (wire rep) */
+#ifndef BCTLIMIT_VALIGN
+#define BCTLIMIT_VALIGN     32 /**< alignment of data vectors (power of 2) */
+#endif
 
 #define BCTUNIT_RATIO       0x00 /** ratiometric -1:0:1 */
 #define BCTUNIT_GLOBAL      0x10 /** generally matching unit */
@@ -26,6 +26,9 @@
 /*
  * pic_atomic increment/decrement operations
  * work on unsigned 32 bit, return new value.
+ *
+ * pic_atomicbarrier is a full memory barrier: no load or store is moved
+ * across it, by the compiler or the processor.
  */
 
 #ifdef __cplusplus
@@ -97,6 +100,11 @@ inline static int pic_atomicptrcas(void *p_, void *oval, void *nval)
     return r == oval;
 }
 
+inline static void pic_atomicbarrier(void)
+{
+    __asm__ __volatile__("lock; addl $0,0(%%esp)" ::: "cc", "memory");
+}
+
 #endif
 
 #if defined(PI_LINUX_8664)
@@ -158,6 +166,11 @@ inline static int pic_atomicptrcas(void *p_, void *oval, void *nval)
     return r == oval;
 }
 
+inline static void pic_atomicbarrier(void)
+{
+    __asm__ __volatile__("mfence" ::: "memory");
+}
+
 #endif
 
 #if defined(PI_LINUX_PPC32)
@@ -233,6 +246,11 @@ inline static int pic_atomicptrcas(void *p_, void *oval, void *nval)
     return r == 0;
 }
 
+inline static void pic_atomicbarrier(void)
+{
+    __asm__ __volatile__("sync" ::: "memory");
+}
+
 #endif
 
 #if defined(PI_LINUX_PPC64)
@@ -308,6 +326,11 @@ inline static int pic_atomicptrcas(void *p_, void *oval, void *nval)
     return r == 0;
 }
 
+inline static void pic_atomicbarrier(void)
+{
+    __asm__ __volatile__("sync" ::: "memory");
+}
+
 #endif
 #endif
 
@@ -368,6 +391,11 @@ inline static int pic_atomicptrcas(void *p, void *oval, void *nval)
 
 #endif
 
+inline static void pic_atomicbarrier(void)
+{
+    OSMemoryBarrier();
+}
+
 #endif
 
 #ifdef PI_WINDOWS
@@ -394,6 +422,11 @@ inline static int pic_atomicptrcas(void *p, void *oval, void *nval)
 	return (InterlockedCompareExchangePointer((PVOID *)p,nval,oval)==oval);
 }
 
+inline static void pic_atomicbarrier(void)
+{
+    MemoryBarrier();
+}
+
 #endif
 
 
@@ -24,6 +24,11 @@
 #include <cmath>
 #include <picross/pic_stdint.h>
 #include <picross/pic_config.h>
+#include <picross/pic_exports.h>
+
+#if defined(PI_LINUX_86) || defined(PI_LINUX_8664)
+#define PIC_VECTOR_SIMD 1
+#endif
 
 #ifdef PI_MACOSX
 #include <Accelerate/Accelerate.h>
@@ -54,12 +59,34 @@ namespace pic
 
     namespace vector
     {
+#ifdef PIC_VECTOR_SIMD
+        /*
+         * Unit stride kernels in pic_simd.cpp.  The SSE2 or AVX/FMA
+         * implementation is chosen from cpuid on first use; runs shorter
+         * than SIMD_MIN stay on the inline scalar loops.
+         */
+        enum { SIMD_MIN=8 };
+
+        PIC_DECLSPEC_FUNC(float) simd_dotprod(const float *a, const float *b, unsigned n);
+        PIC_DECLSPEC_FUNC(void) simd_vectadd(const float *a, const float *b, float *c, unsigned n);
+        PIC_DECLSPEC_FUNC(void) simd_vectmul(const float *a, const float *b, float *c, unsigned n);
+        PIC_DECLSPEC_FUNC(void) simd_vectdiv(const float *a, const float *b, float *c, unsigned n);
+        PIC_DECLSPEC_FUNC(void) simd_vectasm(const float *a, const float *b, float c, float *d, unsigned n);
+        PIC_DECLSPEC_FUNC(const char) *simd_backend();
+#endif
+
         inline float dotprod(const float *a, unsigned sa, const float *b, unsigned sb, unsigned n)
         {
             float ret = 0;
 #ifdef PI_MACOSX
             vDSP_dotpr(a,sa,b,sb,&ret,n);
 #else
+#ifdef PIC_VECTOR_SIMD
+            if(sa==1 && sb==1 && n>=SIMD_MIN)
+            {
+                return simd_dotprod(a,b,n);
+            }
+#endif
             while(n>0)
             {
                 ret += ((*a)*(*b));
@@ -75,6 +102,13 @@ namespace pic
 #ifdef PI_MACOSX
         vDSP_vadd(a,sa,b,sb,c,sc,n);
 #else
+#ifdef PIC_VECTOR_SIMD
+            if(sa==1 && sb==1 && sc==1 && n>=SIMD_MIN)
+            {
+                simd_vectadd(a,b,c,n);
+                return;
+            }
+#endif
             while(n>0)
             {
                 *c = (*a)+(*b);
@@ -91,6 +125,13 @@ namespace pic
 #ifdef PI_MACOSX
             vDSP_vmul((a),(sa),(b),(sb),(c),(sc),(n));
 #else
+#ifdef PIC_VECTOR_SIMD
+            if(sa==1 && sb==1 && sc==1 && n>=SIMD_MIN)
+            {
+                simd_vectmul(a,b,c,n);
+                return;
+            }
+#endif
             while(n>0)
             {
                 *c = (*a)*(*b);
@@ -107,6 +148,13 @@ namespace pic
 #ifdef PI_MACOSX
             vDSP_vdiv((a),(sa),(b),(sb),(c),(sc),(n));
 #else
+#ifdef PIC_VECTOR_SIMD
+            if(sa==1 && sb==1 && sc==1 && n>=SIMD_MIN)
+            {
+                simd_vectdiv(a,b,c,n);
+                return;
+            }
+#endif
             while(n>0)
             {
                 *c = (*b)/(*a);
@@ -123,6 +171,13 @@ namespace pic
 #ifdef PI_MACOSX
             vDSP_vasm((float *)(a),(sa),(float *)(b),(sb),(float *)(c),(d),(sd),(n));
 #else
+#ifdef PIC_VECTOR_SIMD
+            if(sa==1 && sb==1 && sd==1 && n>=SIMD_MIN)
+            {
+                simd_vectasm(a,b,*c,d,n);
+                return;
+            }
+#endif
             float c_ = *c;
             while(n>0)
             {
@@ -0,0 +1,346 @@
+/*
+ Copyright 2009 Eigenlabs Ltd.  http://www.eigenlabs.com
+
+ This file is part of EigenD.
+
+ EigenD is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ EigenD is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with EigenD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __PIC_RING__
+#define __PIC_RING__
+
+#include <picross/pic_config.h>
+#include <picross/pic_atomic.h>
+#include <picross/pic_nocopy.h>
+
+/*
+ * Bounded lock free rings.
+ *
+ * spscring_t has one producer and one consumer thread.  mpscring_t takes
+ * any number of producers and one consumer.  SIZE must be a power of two,
+ * and elements are copied in and out by assignment, so T should be
+ * something small and plain: a pointer, a handle, a struct of them.
+ *
+ * Indices run freely and wrap at 2^32; a slot is index&(SIZE-1).  Each
+ * side's index is on its own cache line so that the producer and consumer
+ * don't share a line they both write.  An index is published by a store
+ * after a barrier and observed by a load before one, so the element written
+ * before an index moves is visible to whoever sees the move.
+ *
+ * push_n and pop_n move as many elements as will fit or are there, up to
+ * n, and return how many, publishing the lot with a single index update.
+ */
+
+#define PIC_RING_LINE 64
+
+namespace pic
+{
+    namespace ring
+    {
+        inline uint32_t load_acquire(const pic_atomic_t *p) { uint32_t v = *p; pic_atomicbarrier(); return v; }
+        inline void store_release(pic_atomic_t *p, uint32_t v) { pic_atomicbarrier(); *p = v; }
+
+        // the smallest power of two holding N elements, for callers with a
+        // size that isn't one.
+
+        template <unsigned N> struct pow2_t { enum { value = 2*pow2_t<(N+1)/2>::value }; };
+        template <> struct pow2_t<1> { enum { value = 1 }; };
+        template <> struct pow2_t<0> { enum { value = 1 }; };
+
+        // sizeof this with false fails to compile
+        template <bool B> struct check_t;
+        template <> struct check_t<true> {};
+
+        struct index_t
+        {
+            index_t(): value(0) {}
+            pic_atomic_t value;
+            char pad[PIC_RING_LINE-sizeof(pic_atomic_t)];
+        };
+    }
+
+    template <class T, unsigned SIZE> class spscring_t: public nocopy_t
+    {
+        public:
+            enum { capacity = SIZE };
+
+            spscring_t(): tail_(0), head_cache_(0), head_(0), tail_cache_(0) {}
+
+            // producer
+
+            bool push(const T &v)
+            {
+                uint32_t t = tail_;
+
+                if(t-head_cache_>=SIZE)
+                {
+                    head_cache_ = ring::load_acquire(&head_);
+
+                    if(t-head_cache_>=SIZE)
+                    {
+                        return false;
+                    }
+                }
+
+                buffer_[t&(SIZE-1)] = v;
+                ring::store_release(&tail_,t+1);
+                return true;
+            }
+
+            unsigned push_n(const T *v, unsigned n)
+            {
+                uint32_t t = tail_;
+                unsigned room = SIZE-(t-head_cache_);
+
+                if(room<n)
+                {
+                    head_cache_ = ring::load_acquire(&head_);
+                    room = SIZE-(t-head_cache_);
+                }
+
+                if(n>room)
+                {
+                    n = room;
+                }
+
+                for(unsigned i=0; i<n; ++i)
+                {
+                    buffer_[(t+i)&(SIZE-1)] = v[i];
+                }
+
+                if(n)
+                {
+                    ring::store_release(&tail_,t+n);
+                }
+
+                return n;
+            }
+
+            // consumer
+
+            bool pop(T &v)
+            {
+                uint32_t h = head_;
+
+                if(h==tail_cache_)
+                {
+                    tail_cache_ = ring::load_acquire(&tail_);
+
+                    if(h==tail_cache_)
+                    {
+                        return false;
+                    }
+                }
+
+                v = buffer_[h&(SIZE-1)];
+                ring::store_release(&head_,h+1);
+                return true;
+            }
+
+            unsigned pop_n(T *v, unsigned n)
+            {
+                uint32_t h = head_;
+                unsigned avail = tail_cache_-h;
+
+                if(avail<n)
+                {
+                    tail_cache_ = ring::load_acquire(&tail_);
+                    avail = tail_cache_-h;
+                }
+
+                if(n>avail)
+                {
+                    n = avail;
+                }
+
+                for(unsigned i=0; i<n; ++i)
+                {
+                    v[i] = buffer_[(h+i)&(SIZE-1)];
+                }
+
+                if(n)
+                {
+                    ring::store_release(&head_,h+n);
+                }
+
+                return n;
+            }
+
+            // the next element to pop, or 0 if there isn't one.  consumer.
+            T *front()
+            {
+                uint32_t h = head_;
+
+                if(h==tail_cache_)
+                {
+                    tail_cache_ = ring::load_acquire(&tail_);
+
+                    if(h==tail_cache_)
+                    {
+                        return 0;
+                    }
+                }
+
+                return &buffer_[h&(SIZE-1)];
+            }
+
+            // exact from either side when the other is idle.  neither touches
+            // the cached indices, which belong to one side each.
+            unsigned size() const { return ring::load_acquire(&tail_)-ring::load_acquire(&head_); }
+            unsigned space() const { return SIZE-size(); }
+
+        private:
+            enum { size_is_pow2_ = sizeof(ring::check_t<(SIZE&(SIZE-1))==0 && SIZE!=0>) };
+
+            // each side writes only its own line
+
+            pic_atomic_t tail_;
+            uint32_t head_cache_;
+            char pad0_[PIC_RING_LINE-2*sizeof(uint32_t)];
+
+            pic_atomic_t head_;
+            uint32_t tail_cache_;
+            char pad1_[PIC_RING_LINE-2*sizeof(uint32_t)];
+
+            T buffer_[SIZE];
+    };
+
+    /*
+     * Each slot carries a sequence number saying whose turn it is.  A slot
+     * at index i is free for the producer claiming i when its sequence is
+     * i, and full for the consumer when it is i+1.  Producers claim slots
+     * by moving tail_ with a compare and swap and then publish each slot
+     * by moving its sequence on; the consumer frees a slot by setting its
+     * sequence to i+SIZE, ready for the producer one lap later.
+     *
+     * The consumer takes slots strictly in order, so a slot being free
+     * means every slot before it in the same lap is free too.  push_n uses
+     * this to claim a run of slots by checking only the last.
+     */
+
+    template <class T, unsigned SIZE> class mpscring_t: public nocopy_t
+    {
+        public:
+            enum { capacity = SIZE };
+
+            mpscring_t()
+            {
+                for(unsigned i=0; i<SIZE; ++i)
+                {
+                    slots_[i].seq = i;
+                }
+            }
+
+            // producers
+
+            bool push(const T &v)
+            {
+                return push_n(&v,1)==1;
+            }
+
+            unsigned push_n(const T *v, unsigned n)
+            {
+                if(n>SIZE)
+                {
+                    n = SIZE;
+                }
+
+                uint32_t t;
+
+                for(;;)
+                {
+                    if(!n)
+                    {
+                        return 0;
+                    }
+
+                    t = tail_.value;
+
+                    int32_t d = (int32_t)(ring::load_acquire(&slots_[(t+n-1)&(SIZE-1)].seq)-(t+n-1));
+
+                    if(d==0)
+                    {
+                        if(pic_atomiccas(&tail_.value,t,t+n))
+                        {
+                            break;
+                        }
+                    }
+                    else if(d<0)
+                    {
+                        // not that much room.  try for less, down to nothing
+                        n--;
+                    }
+                }
+
+                for(unsigned i=0; i<n; ++i)
+                {
+                    slot_t &s(slots_[(t+i)&(SIZE-1)]);
+                    s.value = v[i];
+                    ring::store_release(&s.seq,t+i+1);
+                }
+
+                return n;
+            }
+
+            // consumer
+
+            bool pop(T &v)
+            {
+                return pop_n(&v,1)==1;
+            }
+
+            unsigned pop_n(T *v, unsigned n)
+            {
+                uint32_t h = head_.value;
+                unsigned i;
+
+                for(i=0; i<n; ++i)
+                {
+                    slot_t &s(slots_[(h+i)&(SIZE-1)]);
+
+                    if(ring::load_acquire(&s.seq)!=h+i+1)
+                    {
+                        break;
+                    }
+
+                    v[i] = s.value;
+                    ring::store_release(&s.seq,h+i+SIZE);
+                }
+
+                head_.value = h+i;
+                return i;
+            }
+
+            bool empty() const
+            {
+                uint32_t h = head_.value;
+                return ring::load_acquire(&slots_[h&(SIZE-1)].seq)!=h+1;
+            }
+
+        private:
+            struct slot_t
+            {
+                pic_atomic_t seq;
+                T value;
+            };
+
+            enum { size_is_pow2_ = sizeof(ring::check_t<(SIZE&(SIZE-1))==0 && SIZE!=0>) };
+
+            ring::index_t tail_;        // claimed by producers
+            ring::index_t head_;        // consumer only
+            slot_t slots_[SIZE];
+    };
+}
+
+#endif
@@ -29,6 +29,9 @@
 #include <picross/pic_thread.h>
 #include <picross/pic_log.h>
 #include <picross/pic_mlock.h>
+#include <picross/pic_ring.h>
+
+#define PIC_SAFE_RING 256
 
 namespace pic
 {
@@ -39,7 +42,7 @@ namespace pic
         public:
             safeq_t();
             bool add(void (*cb)(void *, void *, void *, void *), void *ctx1, void *ctx2, void *ctx3, void *ctx4) PIC_FASTCODE;
-            void run() PIC_FASTCODE;
+            unsigned run() PIC_FASTCODE;
 
         private:
             safe_t * volatile head_;
@@ -51,6 +54,13 @@ namespace pic
             void *lasta4_;
     };
 
+    /*
+     * Runs jobs on its own thread.  Jobs are queued on a ring, so adding
+     * one doesn't allocate.  If the ring is full they go on a safeq_t
+     * instead, and the ring isn't used again until those have run, so jobs
+     * still run in the order they were added.
+     */
+
     class PIC_DECLSPEC_CLASS safe_worker_t: public nocopy_t, public thread_t
     {
         public:
@@ -63,8 +73,17 @@ namespace pic
             virtual bool ping() { return false; }
 
         private:
+            struct job_t
+            {
+                void (*cb)(void *,void *,void *,void *);
+                void *a,*b,*c,*d;
+            };
+
             static void __quit(void *a, void *b, void *c, void *d);
+            void runjobs();
 
+            mpscring_t<job_t,PIC_SAFE_RING> ring_;
+            pic_atomic_t overflow_;
             safeq_t safeq_;
             xgate_t gate_;
             bool quit_;
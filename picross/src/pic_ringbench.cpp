@@ -0,0 +1,236 @@
+/*
+ Copyright 2009 Eigenlabs Ltd.  http://www.eigenlabs.com
+
+ This file is part of EigenD.
+
+ EigenD is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ EigenD is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with EigenD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <picross/pic_ring.h>
+#include <picross/pic_safeq.h>
+#include <picross/pic_thread.h>
+#include <picross/pic_time.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+/*
+ * Cross thread throughput of the rings and of the queues they replace.
+ * Producer threads each send a run of numbers to one consumer, singly or
+ * in batches, and the consumer checks every producer's numbers arrive in
+ * order.  safeq_t and safe_worker_t are timed carrying the same numbers
+ * as jobs.
+ *
+ * ringbench [items per producer]
+ */
+
+#define RING 1024
+#define BATCH 32
+#define MAXP 4
+
+typedef pic::spscring_t<uint32_t,RING> spsc_t;
+typedef pic::mpscring_t<uint32_t,RING> mpsc_t;
+
+// items carry the producer in the top bits and a sequence in the rest
+#define ITEM(p,i) (((uint32_t)(p)<<28)|(i))
+
+struct check_t
+{
+    check_t() { for(unsigned p=0; p<MAXP; ++p) next[p]=0; errors=0; }
+
+    void item(uint32_t v)
+    {
+        unsigned p = v>>28;
+        if((v&0x0fffffff)!=next[p]) errors++;
+        next[p] = (v&0x0fffffff)+1;
+    }
+
+    unsigned next[MAXP];
+    unsigned errors;
+};
+
+template <class RING_T> struct producer_t: pic::thread_t
+{
+    producer_t(RING_T *r, unsigned p, unsigned n, unsigned b): ring(r), id(p), count(n), batch(b) {}
+
+    void thread_main()
+    {
+        uint32_t buf[BATCH];
+        unsigned i = 0;
+
+        while(i<count)
+        {
+            unsigned n = std::min(batch,count-i);
+
+            for(unsigned j=0; j<n; ++j)
+            {
+                buf[j] = ITEM(id,i+j);
+            }
+
+            unsigned s = 0;
+
+            while(s<n)
+            {
+                unsigned k = (batch==1) ? (ring->push(buf[s])?1:0) : ring->push_n(buf+s,n-s);
+                if(!k) pic_thread_yield();
+                s += k;
+            }
+
+            i += n;
+        }
+    }
+
+    RING_T *ring;
+    unsigned id,count,batch;
+};
+
+template <class RING_T> static void ringtest(const char *name, unsigned producers, unsigned n, unsigned batch)
+{
+    RING_T *ring = new RING_T;
+    producer_t<RING_T> *p[MAXP];
+    check_t check;
+    uint32_t buf[BATCH];
+    unsigned total = producers*n, got = 0;
+
+    unsigned long long t0 = pic_microtime();
+
+    for(unsigned i=0; i<producers; ++i)
+    {
+        p[i] = new producer_t<RING_T>(ring,i,n,batch);
+        p[i]->run();
+    }
+
+    while(got<total)
+    {
+        unsigned k = (batch==1) ? (ring->pop(buf[0])?1:0) : ring->pop_n(buf,BATCH);
+
+        if(!k)
+        {
+            pic_thread_yield();
+            continue;
+        }
+
+        for(unsigned j=0; j<k; ++j)
+        {
+            check.item(buf[j]);
+        }
+
+        got += k;
+    }
+
+    unsigned long long t1 = pic_microtime();
+
+    for(unsigned i=0; i<producers; ++i)
+    {
+        p[i]->wait();
+        delete p[i];
+    }
+
+    printf("%-8s %u producer%s batch %2u: %7.1f Mitems/s  %u errors\n",name,producers,producers>1?"s":" ",batch,(double)total/(double)(t1-t0),check.errors);
+    delete ring;
+}
+
+static check_t qcheck__;
+static volatile unsigned qgot__ = 0;
+
+static void qitem(void *v, void *, void *, void *)
+{
+    qcheck__.item((uint32_t)(uintptr_t)v);
+    qgot__++;
+}
+
+struct qproducer_t: pic::thread_t
+{
+    qproducer_t(pic::safeq_t *q, pic::safe_worker_t *w, unsigned p, unsigned n): queue(q), worker(w), id(p), count(n) {}
+
+    void thread_main()
+    {
+        for(unsigned i=0; i<count; ++i)
+        {
+            void *v = (void *)(uintptr_t)ITEM(id,i);
+            if(worker) worker->add(qitem,v,0,0,0);
+            else queue->add(qitem,v,0,0,0);
+        }
+    }
+
+    pic::safeq_t *queue;
+    pic::safe_worker_t *worker;
+    unsigned id,count;
+};
+
+static void queuetest(unsigned producers, unsigned n, bool worker)
+{
+    pic::safeq_t *q = new pic::safeq_t;
+    pic::safe_worker_t *w = worker ? new pic::safe_worker_t(0,PIC_THREAD_PRIORITY_NORMAL) : 0;
+    qproducer_t *p[MAXP];
+    unsigned total = producers*n;
+
+    qcheck__ = check_t();
+    qgot__ = 0;
+
+    if(w)
+    {
+        w->run();
+    }
+
+    unsigned long long t0 = pic_microtime();
+
+    for(unsigned i=0; i<producers; ++i)
+    {
+        p[i] = new qproducer_t(q,w,i,n);
+        p[i]->run();
+    }
+
+    while(qgot__<total)
+    {
+        if(w) pic_thread_yield();
+        else q->run();
+    }
+
+    unsigned long long t1 = pic_microtime();
+
+    for(unsigned i=0; i<producers; ++i)
+    {
+        p[i]->wait();
+        delete p[i];
+    }
+
+    if(w)
+    {
+        w->quit();
+        delete w;
+    }
+
+    printf("%-8s %u producer%s         : %7.1f Mitems/s  %u errors\n",worker?"worker":"safeq",producers,producers>1?"s":" ",(double)total/(double)(t1-t0),qcheck__.errors);
+    delete q;
+}
+
+int main(int ac, char **av)
+{
+    unsigned n = (ac>1) ? atoi(av[1]) : 2000000;
+
+    ringtest<spsc_t>("spsc",1,n,1);
+    ringtest<spsc_t>("spsc",1,n,BATCH);
+
+    for(unsigned p=1; p<=MAXP; p*=2)
+    {
+        ringtest<mpsc_t>("mpsc",p,n/p,1);
+        ringtest<mpsc_t>("mpsc",p,n/p,BATCH);
+        queuetest(p,n/p,false);
+        queuetest(p,n/p,true);
+    }
+
+    return 0;
+}
@@ -62,7 +62,7 @@ bool pic::safeq_t::add(void (*cb)(void *, void *, void *, void *), void *ctx1, v
     return first;
 }
 
-void pic::safeq_t::run()
+unsigned pic::safeq_t::run()
 {
     safe_t *tmp,*flip;
     safe_t * volatile head;
@@ -79,9 +79,10 @@ void pic::safeq_t::run()
 
     if(!head)
     {
-        return;
+        return 0;
     }
 
+    unsigned count=0;
     flip=0;
 
     while((tmp=(safe_t *)head)!=0)
@@ -108,10 +109,13 @@ void pic::safeq_t::run()
         CATCHLOG()
 
         delete tmp;
+        count++;
     }
+
+    return count;
 }
 
-pic::safe_worker_t::safe_worker_t(unsigned ping,unsigned priority): thread_t(priority), quit_(false), ping_(ping), pinged_(false)
+pic::safe_worker_t::safe_worker_t(unsigned ping,unsigned priority): thread_t(priority), overflow_(0), quit_(false), ping_(ping), pinged_(false)
 {
 }
 
@@ -123,10 +127,46 @@ void pic::safe_worker_t::quit()
 
 void pic::safe_worker_t::add(void (*cb)(void *,void *,void *,void *),void *a,void *b,void *c,void *d)
 {
-    safeq_.add(cb,a,b,c,d);
+    job_t job;
+    job.cb=cb; job.a=a; job.b=b; job.c=c; job.d=d;
+
+    if(overflow_ || !ring_.push(job))
+    {
+        pic_atomicinc(&overflow_);
+        safeq_.add(cb,a,b,c,d);
+    }
+
     gate_.open();
 }
 
+void pic::safe_worker_t::runjobs()
+{
+    job_t jobs[16];
+    unsigned n;
+
+    while((n=ring_.pop_n(jobs,16))>0)
+    {
+        for(unsigned i=0; i<n; ++i)
+        {
+            try
+            {
+                jobs[i].cb(jobs[i].a,jobs[i].b,jobs[i].c,jobs[i].d);
+            }
+            CATCHLOG()
+        }
+    }
+
+    // anything that overflowed was added after what was on the ring
+
+    if(overflow_)
+    {
+        for(unsigned k=safeq_.run(); k>0; --k)
+        {
+            pic_atomicdec(&overflow_);
+        }
+    }
+}
+
 void pic::safe_worker_t::thread_main()
 {
 #ifdef DEBUG_DATA_ATOMICITY
@@ -149,7 +189,7 @@ void pic::safe_worker_t::thread_main()
             pinged_ = false;
         }
 
-        safeq_.run();
+        runjobs();
     }
 }
 
@@ -0,0 +1,307 @@
+/*
+ Copyright 2009 Eigenlabs Ltd.  http://www.eigenlabs.com
+
+ This file is part of EigenD.
+
+ EigenD is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ EigenD is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with EigenD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <picross/pic_float.h>
+
+#ifdef PIC_VECTOR_SIMD
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+#define PIC_SSE2 __attribute__((target("sse2")))
+#define PIC_AVX __attribute__((target("avx,fma")))
+
+namespace
+{
+    /*
+     * scalar versions, for CPUs without SSE2 and for the tails
+     */
+
+    float scalar_dotprod(const float *a, const float *b, unsigned n)
+    {
+        float r = 0.f;
+        for(unsigned i=0; i<n; ++i) r += a[i]*b[i];
+        return r;
+    }
+
+    void scalar_vectadd(const float *a, const float *b, float *c, unsigned n)
+    {
+        for(unsigned i=0; i<n; ++i) c[i] = a[i]+b[i];
+    }
+
+    void scalar_vectmul(const float *a, const float *b, float *c, unsigned n)
+    {
+        for(unsigned i=0; i<n; ++i) c[i] = a[i]*b[i];
+    }
+
+    void scalar_vectdiv(const float *a, const float *b, float *c, unsigned n)
+    {
+        for(unsigned i=0; i<n; ++i) c[i] = b[i]/a[i];
+    }
+
+    void scalar_vectasm(const float *a, const float *b, float c, float *d, unsigned n)
+    {
+        for(unsigned i=0; i<n; ++i) d[i] = (a[i]+b[i])*c;
+    }
+
+    /*
+     * SSE2, 4 floats per op.  Buffers are not assumed to be aligned.
+     */
+
+    PIC_SSE2 float sse_dotprod(const float *a, const float *b, unsigned n)
+    {
+        __m128 s0 = _mm_setzero_ps();
+        __m128 s1 = _mm_setzero_ps();
+        unsigned i = 0;
+
+        for(; i+8<=n; i+=8)
+        {
+            s0 = _mm_add_ps(s0,_mm_mul_ps(_mm_loadu_ps(a+i),_mm_loadu_ps(b+i)));
+            s1 = _mm_add_ps(s1,_mm_mul_ps(_mm_loadu_ps(a+i+4),_mm_loadu_ps(b+i+4)));
+        }
+
+        for(; i+4<=n; i+=4)
+        {
+            s0 = _mm_add_ps(s0,_mm_mul_ps(_mm_loadu_ps(a+i),_mm_loadu_ps(b+i)));
+        }
+
+        float t[4];
+        _mm_storeu_ps(t,_mm_add_ps(s0,s1));
+        return t[0]+t[1]+t[2]+t[3]+scalar_dotprod(a+i,b+i,n-i);
+    }
+
+    PIC_SSE2 void sse_vectadd(const float *a, const float *b, float *c, unsigned n)
+    {
+        unsigned i = 0;
+        for(; i+4<=n; i+=4) _mm_storeu_ps(c+i,_mm_add_ps(_mm_loadu_ps(a+i),_mm_loadu_ps(b+i)));
+        scalar_vectadd(a+i,b+i,c+i,n-i);
+    }
+
+    PIC_SSE2 void sse_vectmul(const float *a, const float *b, float *c, unsigned n)
+    {
+        unsigned i = 0;
+        for(; i+4<=n; i+=4) _mm_storeu_ps(c+i,_mm_mul_ps(_mm_loadu_ps(a+i),_mm_loadu_ps(b+i)));
+        scalar_vectmul(a+i,b+i,c+i,n-i);
+    }
+
+    PIC_SSE2 void sse_vectdiv(const float *a, const float *b, float *c, unsigned n)
+    {
+        unsigned i = 0;
+        for(; i+4<=n; i+=4) _mm_storeu_ps(c+i,_mm_div_ps(_mm_loadu_ps(b+i),_mm_loadu_ps(a+i)));
+        scalar_vectdiv(a+i,b+i,c+i,n-i);
+    }
+
+    PIC_SSE2 void sse_vectasm(const float *a, const float *b, float c, float *d, unsigned n)
+    {
+        __m128 k = _mm_set1_ps(c);
+        unsigned i = 0;
+        for(; i+4<=n; i+=4) _mm_storeu_ps(d+i,_mm_mul_ps(_mm_add_ps(_mm_loadu_ps(a+i),_mm_loadu_ps(b+i)),k));
+        scalar_vectasm(a+i,b+i,c,d+i,n-i);
+    }
+
+    /*
+     * AVX with FMA, 8 floats per op
+     */
+
+    PIC_AVX float avx_dotprod(const float *a, const float *b, unsigned n)
+    {
+        __m256 s0 = _mm256_setzero_ps();
+        __m256 s1 = _mm256_setzero_ps();
+        unsigned i = 0;
+
+        for(; i+16<=n; i+=16)
+        {
+            s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a+i),_mm256_loadu_ps(b+i),s0);
+            s1 = _mm256_fmadd_ps(_mm256_loadu_ps(a+i+8),_mm256_loadu_ps(b+i+8),s1);
+        }
+
+        for(; i+8<=n; i+=8)
+        {
+            s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a+i),_mm256_loadu_ps(b+i),s0);
+        }
+
+        s0 = _mm256_add_ps(s0,s1);
+        __m128 h = _mm_add_ps(_mm256_castps256_ps128(s0),_mm256_extractf128_ps(s0,1));
+        float t[4];
+        _mm_storeu_ps(t,h);
+        return t[0]+t[1]+t[2]+t[3]+scalar_dotprod(a+i,b+i,n-i);
+    }
+
+    PIC_AVX void avx_vectadd(const float *a, const float *b, float *c, unsigned n)
+    {
+        unsigned i = 0;
+        for(; i+8<=n; i+=8) _mm256_storeu_ps(c+i,_mm256_add_ps(_mm256_loadu_ps(a+i),_mm256_loadu_ps(b+i)));
+        scalar_vectadd(a+i,b+i,c+i,n-i);
+    }
+
+    PIC_AVX void avx_vectmul(const float *a, const float *b, float *c, unsigned n)
+    {
+        unsigned i = 0;
+        for(; i+8<=n; i+=8) _mm256_storeu_ps(c+i,_mm256_mul_ps(_mm256_loadu_ps(a+i),_mm256_loadu_ps(b+i)));
+        scalar_vectmul(a+i,b+i,c+i,n-i);
+    }
+
+    PIC_AVX void avx_vectdiv(const float *a, const float *b, float *c, unsigned n)
+    {
+        unsigned i = 0;
+        for(; i+8<=n; i+=8) _mm256_storeu_ps(c+i,_mm256_div_ps(_mm256_loadu_ps(b+i),_mm256_loadu_ps(a+i)));
+        scalar_vectdiv(a+i,b+i,c+i,n-i);
+    }
+
+    PIC_AVX void avx_vectasm(const float *a, const float *b, float c, float *d, unsigned n)
+    {
+        __m256 k = _mm256_set1_ps(c);
+        unsigned i = 0;
+        for(; i+8<=n; i+=8) _mm256_storeu_ps(d+i,_mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps(a+i),_mm256_loadu_ps(b+i)),k));
+        scalar_vectasm(a+i,b+i,c,d+i,n-i);
+    }
+
+    /*
+     * dispatch table.  Every entry starts out pointing at a resolver,
+     * which fills in the whole table from cpuid and then forwards the
+     * call, so calls from other static constructors work whatever the
+     * order.  init__ resolves the table at load anyway, so that the first
+     * call from a realtime thread doesn't pay for cpuid.
+     */
+
+    float resolve_dotprod(const float *, const float *, unsigned);
+    void resolve_vectadd(const float *, const float *, float *, unsigned);
+    void resolve_vectmul(const float *, const float *, float *, unsigned);
+    void resolve_vectdiv(const float *, const float *, float *, unsigned);
+    void resolve_vectasm(const float *, const float *, float, float *, unsigned);
+
+    struct kernels_t
+    {
+        float (*dotprod)(const float *, const float *, unsigned);
+        void (*vectadd)(const float *, const float *, float *, unsigned);
+        void (*vectmul)(const float *, const float *, float *, unsigned);
+        void (*vectdiv)(const float *, const float *, float *, unsigned);
+        void (*vectasm)(const float *, const float *, float, float *, unsigned);
+        const char *name;
+    };
+
+    kernels_t kernels__ = { resolve_dotprod, resolve_vectadd, resolve_vectmul, resolve_vectdiv, resolve_vectasm, 0 };
+
+    bool has_avx_fma()
+    {
+        unsigned a,b,c,d;
+
+        if(!__get_cpuid(1,&a,&b,&c,&d))
+        {
+            return false;
+        }
+
+        if(!(c&bit_OSXSAVE) || !(c&bit_AVX) || !(c&bit_FMA))
+        {
+            return false;
+        }
+
+        unsigned xl,xh;
+        __asm__ __volatile__("xgetbv" : "=a" (xl), "=d" (xh) : "c" (0));
+
+        // OS saves both xmm and ymm state
+        return (xl&6)==6;
+    }
+
+    bool has_sse2()
+    {
+        unsigned a,b,c,d;
+
+        if(!__get_cpuid(1,&a,&b,&c,&d))
+        {
+            return false;
+        }
+
+        return (d&bit_SSE2)!=0;
+    }
+
+    void resolve()
+    {
+        kernels_t k;
+
+        if(has_avx_fma())
+        {
+            k.dotprod = avx_dotprod; k.vectadd = avx_vectadd; k.vectmul = avx_vectmul; k.vectdiv = avx_vectdiv; k.vectasm = avx_vectasm;
+            k.name = "avx";
+        }
+        else if(has_sse2())
+        {
+            k.dotprod = sse_dotprod; k.vectadd = sse_vectadd; k.vectmul = sse_vectmul; k.vectdiv = sse_vectdiv; k.vectasm = sse_vectasm;
+            k.name = "sse2";
+        }
+        else
+        {
+            k.dotprod = scalar_dotprod; k.vectadd = scalar_vectadd; k.vectmul = scalar_vectmul; k.vectdiv = scalar_vectdiv; k.vectasm = scalar_vectasm;
+            k.name = "scalar";
+        }
+
+        // racing resolvers all store the same values
+        kernels__ = k;
+    }
+
+    float resolve_dotprod(const float *a, const float *b, unsigned n) { resolve(); return kernels__.dotprod(a,b,n); }
+    void resolve_vectadd(const float *a, const float *b, float *c, unsigned n) { resolve(); kernels__.vectadd(a,b,c,n); }
+    void resolve_vectmul(const float *a, const float *b, float *c, unsigned n) { resolve(); kernels__.vectmul(a,b,c,n); }
+    void resolve_vectdiv(const float *a, const float *b, float *c, unsigned n) { resolve(); kernels__.vectdiv(a,b,c,n); }
+    void resolve_vectasm(const float *a, const float *b, float c, float *d, unsigned n) { resolve(); kernels__.vectasm(a,b,c,d,n); }
+
+    struct init_t
+    {
+        init_t() { resolve(); }
+    };
+
+    init_t init__;
+}
+
+float pic::vector::simd_dotprod(const float *a, const float *b, unsigned n)
+{
+    return kernels__.dotprod(a,b,n);
+}
+
+void pic::vector::simd_vectadd(const float *a, const float *b, float *c, unsigned n)
+{
+    kernels__.vectadd(a,b,c,n);
+}
+
+void pic::vector::simd_vectmul(const float *a, const float *b, float *c, unsigned n)
+{
+    kernels__.vectmul(a,b,c,n);
+}
+
+void pic::vector::simd_vectdiv(const float *a, const float *b, float *c, unsigned n)
+{
+    kernels__.vectdiv(a,b,c,n);
+}
+
+void pic::vector::simd_vectasm(const float *a, const float *b, float c, float *d, unsigned n)
+{
+    kernels__.vectasm(a,b,c,d,n);
+}
+
+const char *pic::vector::simd_backend()
+{
+    if(!kernels__.name)
+    {
+        resolve();
+    }
+
+    return kernels__.name;
+}
+
+#endif
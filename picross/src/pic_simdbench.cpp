@@ -0,0 +1,150 @@
+/*
+ Copyright 2009 Eigenlabs Ltd.  http://www.eigenlabs.com
+
+ This file is part of EigenD.
+
+ EigenD is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ EigenD is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with EigenD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <picross/pic_config.h>
+#include <picross/pic_float.h>
+#include <picross/pic_time.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+
+/*
+ * Compares the pic::vector kernels against plain scalar loops over the
+ * buffer sizes the audio code sees.
+ *
+ * simdbench [iterations]
+ */
+
+#define MAXN 512
+
+static float a_[MAXN+1], b_[MAXN+1], c_[MAXN+1], d_[MAXN+1];
+
+static float __attribute__((noinline)) ref_dotprod(const float *a, const float *b, unsigned n)
+{
+    float r = 0.f;
+    for(unsigned i=0; i<n; ++i) r += a[i]*b[i];
+    return r;
+}
+
+static void __attribute__((noinline)) ref_vectadd(const float *a, const float *b, float *c, unsigned n)
+{
+    for(unsigned i=0; i<n; ++i) c[i] = a[i]+b[i];
+}
+
+static void __attribute__((noinline)) ref_vectmul(const float *a, const float *b, float *c, unsigned n)
+{
+    for(unsigned i=0; i<n; ++i) c[i] = a[i]*b[i];
+}
+
+static void __attribute__((noinline)) ref_vectdiv(const float *a, const float *b, float *c, unsigned n)
+{
+    for(unsigned i=0; i<n; ++i) c[i] = b[i]/a[i];
+}
+
+static void __attribute__((noinline)) ref_vectasm(const float *a, const float *b, float k, float *d, unsigned n)
+{
+    for(unsigned i=0; i<n; ++i) d[i] = (a[i]+b[i])*k;
+}
+
+static float maxerr(const float *x, const float *y, unsigned n)
+{
+    float e = 0.f;
+    for(unsigned i=0; i<n; ++i) e = std::max(e,std::fabs(x[i]-y[i]));
+    return e;
+}
+
+static volatile float sink__;
+
+// stops the compiler hoisting a call on unchanged inputs out of the loop
+#define CLOBBER() __asm__ __volatile__("" ::: "memory")
+
+static void report(const char *op, unsigned n, unsigned long long ref, unsigned long long vec, unsigned iter, float err)
+{
+    printf("%-8s %4u  scalar %8.1fns  vector %8.1fns  speedup %5.2fx  err %g\n",
+        op, n, 1000.0*ref/iter, 1000.0*vec/iter, vec?(double)ref/vec:0.0, err);
+}
+
+int main(int ac, char **av)
+{
+    unsigned iter = (ac==2) ? atoi(av[1]) : 200000;
+    static const unsigned sizes[] = { 32, 64, 128, 256, 512 };
+    float k = 0.5f;
+
+    for(unsigned i=0; i<=MAXN; ++i)
+    {
+        a_[i] = 1.f+(float)rand()/RAND_MAX;
+        b_[i] = (float)rand()/RAND_MAX;
+    }
+
+#ifdef PIC_VECTOR_SIMD
+    printf("backend %s\n", pic::vector::simd_backend());
+#else
+    printf("backend native\n");
+#endif
+
+    for(unsigned s=0; s<sizeof(sizes)/sizeof(sizes[0]); ++s)
+    {
+        unsigned n = sizes[s];
+        unsigned long long t0,t1,t2;
+        float r1=0,r2=0;
+
+        // offset by one float so the unaligned paths are exercised as well
+        const float *a = a_+(s&1);
+
+        t0 = pic_microtime();
+        for(unsigned i=0; i<iter; ++i) { r1 += ref_dotprod(a,b_,n); CLOBBER(); }
+        t1 = pic_microtime();
+        for(unsigned i=0; i<iter; ++i) { r2 += pic::vector::dotprod(a,1,b_,1,n); CLOBBER(); }
+        t2 = pic_microtime();
+        sink__ = r1+r2;
+        report("dotprod",n,t1-t0,t2-t1,iter,std::fabs(ref_dotprod(a,b_,n)-pic::vector::dotprod(a,1,b_,1,n)));
+
+        t0 = pic_microtime();
+        for(unsigned i=0; i<iter; ++i) { ref_vectadd(a,b_,c_,n); CLOBBER(); }
+        t1 = pic_microtime();
+        for(unsigned i=0; i<iter; ++i) { pic::vector::vectadd(a,1,b_,1,d_,1,n); CLOBBER(); }
+        t2 = pic_microtime();
+        report("vectadd",n,t1-t0,t2-t1,iter,maxerr(c_,d_,n));
+
+        t0 = pic_microtime();
+        for(unsigned i=0; i<iter; ++i) { ref_vectmul(a,b_,c_,n); CLOBBER(); }
+        t1 = pic_microtime();
+        for(unsigned i=0; i<iter; ++i) { pic::vector::vectmul(a,1,b_,1,d_,1,n); CLOBBER(); }
+        t2 = pic_microtime();
+        report("vectmul",n,t1-t0,t2-t1,iter,maxerr(c_,d_,n));
+
+        t0 = pic_microtime();
+        for(unsigned i=0; i<iter; ++i) { ref_vectdiv(a,b_,c_,n); CLOBBER(); }
+        t1 = pic_microtime();
+        for(unsigned i=0; i<iter; ++i) { pic::vector::vectdiv((float *)a,1,b_,1,d_,1,n); CLOBBER(); }
+        t2 = pic_microtime();
+        report("vectdiv",n,t1-t0,t2-t1,iter,maxerr(c_,d_,n));
+
+        t0 = pic_microtime();
+        for(unsigned i=0; i<iter; ++i) { ref_vectasm(a,b_,k,c_,n); CLOBBER(); }
+        t1 = pic_microtime();
+        for(unsigned i=0; i<iter; ++i) { pic::vector::vectasm(a,1,b_,1,&k,d_,1,n); CLOBBER(); }
+        t2 = pic_microtime();
+        report("vectasm",n,t1-t0,t2-t1,iter,maxerr(c_,d_,n));
+    }
+
+    return 0;
+}
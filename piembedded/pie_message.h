@@ -67,6 +67,10 @@ PIE_DECLSPEC_FUNC(int) pie_skipstanza(const unsigned char *b, unsigned l, unsign
 
 PIE_DECLSPEC_FUNC(int) pie_setindex(unsigned char *, unsigned, uint16_t, uint16_t dl, const unsigned char *dp);
 PIE_DECLSPEC_FUNC(int) pie_getindex(const unsigned char *, unsigned, uint16_t *, uint16_t *dl, const unsigned char **dp);
+PIE_DECLSPEC_FUNC(int) pie_setindexhdr(unsigned char *, unsigned, unsigned type, uint32_t source, uint32_t gen0, uint32_t gen1);
+PIE_DECLSPEC_FUNC(int) pie_getindexhdr(const unsigned char *, unsigned, unsigned *type, uint32_t *source, uint32_t *gen0, uint32_t *gen1);
+PIE_DECLSPEC_FUNC(int) pie_setindexop(unsigned char *, unsigned, unsigned op, uint16_t, uint16_t dl, const unsigned char *dp);
+PIE_DECLSPEC_FUNC(int) pie_getindexop(const unsigned char *, unsigned, unsigned *op, uint16_t *, uint16_t *dl, const unsigned char **dp);
 
 PIE_DECLSPEC_FUNC(int) pie_setrpc(unsigned char *b, unsigned l, const unsigned char *p, unsigned pl, unsigned bt, const uint64_t *cookie, unsigned nl, const unsigned char *np, int st, uint16_t dl, const void *dp);
 PIE_DECLSPEC_FUNC(int) pie_getrpc(const unsigned char *b, unsigned l, const unsigned char **p, unsigned *pl, unsigned *bt, uint64_t *cookie, unsigned *nl, const unsigned char **np, int *st, uint16_t *dl, const unsigned char **dp);
@@ -461,6 +461,78 @@ int pie_getindex(const unsigned char *b, unsigned l, uint16_t *cookie, uint16_t
     return 4+*dl;
 }
 
+/*
+ * The index header starts with a magic byte and a version, then 0xffff
+ * where the old format had the length of its first record.  Agents that
+ * only know the old format see a record longer than the packet and drop
+ * it, and old packets never match the magic and version.
+ */
+
+int pie_setindexhdr(unsigned char *b, unsigned l, unsigned type, uint32_t source, uint32_t gen0, uint32_t gen1)
+{
+    if(l<17)
+    {
+        return -1;
+    }
+
+    b[0]=BCTINDEX_MAGIC;
+    b[1]=BCTINDEX_VERSION;
+    b[2]=0xff;
+    b[3]=0xff;
+    b[4]=type;
+    pie_setu32(&b[5],4,source);
+    pie_setu32(&b[9],4,gen0);
+    pie_setu32(&b[13],4,gen1);
+
+    return 17;
+}
+
+int pie_getindexhdr(const unsigned char *b, unsigned l, unsigned *type, uint32_t *source, uint32_t *gen0, uint32_t *gen1)
+{
+    if(l<17)
+    {
+        return -1;
+    }
+
+    if(b[0]!=BCTINDEX_MAGIC || b[1]!=BCTINDEX_VERSION || b[2]!=0xff || b[3]!=0xff)
+    {
+        return -1;
+    }
+
+    *type=b[4];
+    pie_getu32(&b[5],4,source);
+    pie_getu32(&b[9],4,gen0);
+    pie_getu32(&b[13],4,gen1);
+
+    return 17;
+}
+
+int pie_setindexop(unsigned char *b, unsigned l, unsigned op, uint16_t cookie, uint16_t dl, const unsigned char *dp)
+{
+    int x;
+
+    if(l<1 || (x=pie_setindex(b+1,l-1,cookie,dl,dp))<0)
+    {
+        return -1;
+    }
+
+    b[0]=op;
+    return 1+x;
+}
+
+int pie_getindexop(const unsigned char *b, unsigned l, unsigned *op, uint16_t *cookie, uint16_t *dl, const unsigned char **dp)
+{
+    int x;
+
+    if(l<1 || (x=pie_getindex(b+1,l-1,cookie,dl,dp))<0)
+    {
+        return -1;
+    }
+
+    *op=b[0];
+    return 1+x;
+}
+
 int pie_getrpc(const unsigned char *b, unsigned l, const unsigned char **p, unsigned *pl, unsigned *bt, uint64_t *cookie, unsigned *nl, const unsigned char **np, int *st, uint16_t *dl, const unsigned char **dp)
 {
     if(l<14)
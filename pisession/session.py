@@ -49,7 +49,7 @@ class Logger:
 def get_username():
     return resource.user_name()
 
-def run_session(session,user=None,mt=1,name='ctx',logger=None,clock=True,rt=True):
+def run_session(session,user=None,mt=1,name='ctx',logger=None,clock=True,rt=True,workers=0):
     u = user or get_username()
 
     def logfunc(msg):
@@ -64,6 +64,7 @@ def run_session(session,user=None,mt=1,name='ctx',logger=None,clock=True,rt=True
         context.release()
 
     scaffold = piagent.scaffold_mt(u,mt,utils.stringify(logfunc),utils.stringify(None),clock,rt)
+    scaffold.set_clock_workers(workers)
     context = scaffold.context(utils.statusify(ctxdun),utils.stringify(logfunc),name)
     stdio = (sys.stdout,sys.stderr)
     x = None
@@ -88,6 +88,7 @@ namespace piw
             void merge(const xevent_data_buffer_t &,unsigned long long);
             void set_signal(unsigned s,const dataqueue_t &q) { event_->signals_[s-1]=q; }
             bool isvalid(unsigned s) const { return signal(s).isvalid(); }
+            void clear(); // fast, empty all signals
 
             typedef pic::ref_t<evtiterator_t> iter_t;
             inline iter_t iterator() const { return pic::ref(new evtiterator_t(event_)); }
@@ -71,6 +71,18 @@ namespace piw
         }
     };
 
+    /*
+     * One running voice, as handed to cfilterctl_t::cfilterctl_process().
+     * running is true on entry.  The filter sets it false for a voice which
+     * has finished, as a false return from cfilterfunc_process() would.
+     */
+    struct PIW_DECLSPEC_CLASS cfiltervoice_t
+    {
+        cfilterfunc_t *func;
+        cfilterenv_t *env;
+        bool running;
+    };
+
     struct PIW_DECLSPEC_CLASS cfilterctl_t
     {
         virtual cfilterfunc_t *cfilterctl_create(const piw::data_t &path) = 0;
@@ -81,6 +93,14 @@ namespace piw
         virtual unsigned long long cfilterctl_thru() { return 0; }
         virtual unsigned long long cfilterctl_inputs() { return ~0ULL; }
         virtual unsigned long long cfilterctl_outputs() { return ~0ULL; }
+
+        // batched processing: if cfilterctl_batch() is true, each tick all
+        // the running voices are handed to cfilterctl_process() at once,
+        // in place of a cfilterfunc_process() call on each, so that several
+        // voices can be processed together.  cfilterfunc_process() is still
+        // used for a voice's final buffer when its event ends.
+        virtual bool cfilterctl_batch() { return false; }
+        virtual void cfilterctl_process(cfiltervoice_t *voices, unsigned count, unsigned long long f, unsigned long long t, unsigned long sr, unsigned bs) {}
     };
 
     class PIW_DECLSPEC_CLASS cfilter_t
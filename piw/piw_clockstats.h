@@ -0,0 +1,51 @@
+/*
+ Copyright 2009 Eigenlabs Ltd.  http://www.eigenlabs.com
+
+ This file is part of EigenD.
+
+ EigenD is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ EigenD is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with EigenD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __PIW_CLOCKSTATS__
+#define __PIW_CLOCKSTATS__
+
+#include "piw_exports.h"
+#include "piw_server.h"
+
+namespace piw
+{
+    /*
+     * Publishes the clock subsystem's per sink tick timings.  Writing
+     * true or false to the root enables or disables timing, and each
+     * child holds one line of the report, refreshed every period ms.
+     */
+    class PIW_DECLSPEC_CLASS clockstats_t: public server_t
+    {
+        public:
+            class impl_t;
+        public:
+            clockstats_t(unsigned period);
+            ~clockstats_t();
+
+        protected:
+            void server_opened();
+            void server_closed();
+            void server_change(const piw::data_t &);
+
+        private:
+            impl_t *impl_;
+    };
+};
+
+#endif
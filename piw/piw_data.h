@@ -162,6 +162,11 @@ namespace piw
             int compare_path_beginning(const data_base_t &d) const;
             int compare_path_lexicographic(const data_base_t &d) const;
 
+            // interned id of a path, equal for equal paths, or 0 if this
+            // isn't a path or the path can't be interned.  any thread.
+            unsigned as_pathid() const;
+            bool same_path(const data_base_t &d) const;
+
             bool operator<(const data_base_t &d) const { return compare(d)<0; }
             bool operator<=(const data_base_t &d) const { return compare(d)<=0; }
             bool operator>(const data_base_t &d) const { return compare(d)>0; }
@@ -195,6 +200,10 @@ namespace piw
             float as_array_rest() const { return bct_data_rest(_rep); }
             float as_array_member(unsigned i) const { PIC_ASSERT(i<as_arraylen()); return as_array()[i]; }
 
+            // vectors are always allocated on a BCTLIMIT_VALIGN boundary
+            static unsigned array_alignment() { return BCTLIMIT_VALIGN; }
+            bool is_aligned(unsigned a=BCTLIMIT_VALIGN) const { return (((uintptr_t)as_array())&(a-1))==0; }
+
             float as_norm() const { unsigned l = as_arraylen(); return (l>0)?(*(as_array()+l-1)):0.0; }
             float as_denorm() const { if(is_double()) return as_double(); if(is_float()) return as_float(); return as_renorm(as_array_lbound(),as_array_ubound(),as_array_rest()); }
 
@@ -403,6 +412,7 @@ namespace piw
     PIW_DECLSPEC_FUNC(data_t) makedouble_bounded_units_ex(unsigned nb, unsigned u, float ubound, float lbound, float rest, double f, unsigned long long t);
     PIW_DECLSPEC_FUNC(data_t) makelong_bounded_units_ex(unsigned nb, unsigned u, float ubound, float lbound, float rest, long f, unsigned long long t);
     PIW_DECLSPEC_FUNC(data_t) makewire_ex(unsigned nb, unsigned dl, const unsigned char *dp);
+    PIW_DECLSPEC_FUNC(unsigned) intern_path(const unsigned char *p, unsigned l);
     PIW_DECLSPEC_FUNC(data_t) pathnull_ex(unsigned nb, unsigned long long t);
     PIW_DECLSPEC_FUNC(data_t) pathone_ex(unsigned nb, unsigned v, unsigned long long t);
     PIW_DECLSPEC_FUNC(data_t) pathprepend_ex(unsigned nb, const data_t &d, unsigned p);
@@ -479,6 +489,7 @@ namespace piw
     PIW_DECLSPEC_FUNC(data_nb_t) pathnull_nb_ex(unsigned nb, unsigned long long t);
     PIW_DECLSPEC_FUNC(data_nb_t) pathone_nb_ex(unsigned nb, unsigned v, unsigned long long t);
     PIW_DECLSPEC_FUNC(data_nb_t) pathprepend_nb_ex(unsigned nb, const data_nb_t &d, unsigned p);
+    PIW_DECLSPEC_FUNC(data_nb_t) pathprepend_nb_ex(unsigned nb, const data_nb_t &d, const unsigned char *p, unsigned l);
     PIW_DECLSPEC_FUNC(data_nb_t) pathtwo_nb_ex(unsigned nb, unsigned v1, unsigned v2, unsigned long long t);
     PIW_DECLSPEC_FUNC(data_nb_t) pathprepend_grist_nb_ex(unsigned nb, const data_nb_t &d, unsigned p);
     PIW_DECLSPEC_FUNC(data_nb_t) pathappend_chaff_nb_ex(unsigned nb, const data_nb_t &d, unsigned p);
@@ -507,6 +518,7 @@ namespace piw
     inline data_nb_t pathnull_nb(unsigned long long t) { return pathnull_nb_ex(PIC_ALLOC_NB,t); }
     inline data_nb_t pathone_nb(unsigned v, unsigned long long t) { return pathone_nb_ex(PIC_ALLOC_NB,v,t); }
     inline data_nb_t pathprepend_nb(const data_nb_t &d, unsigned p) { return pathprepend_nb_ex(PIC_ALLOC_NB,d,p); }
+    inline data_nb_t pathprepend_nb(const data_nb_t &d, const unsigned char *p, unsigned l) { return pathprepend_nb_ex(PIC_ALLOC_NB,d,p,l); }
     inline data_nb_t pathtwo_nb(unsigned v1, unsigned v2, unsigned long long t) { return pathtwo_nb_ex(PIC_ALLOC_NB,v1,v2,t); }
     inline data_nb_t pathprepend_grist_nb(const data_nb_t &d, unsigned p) { return pathprepend_grist_nb_ex(PIC_ALLOC_NB,d,p); }
     inline data_nb_t pathappend_chaff_nb(const data_nb_t &d, unsigned p) { return pathappend_chaff_nb_ex(PIC_ALLOC_NB,d,p); }
@@ -635,6 +647,22 @@ namespace piw
         bool operator()(const data_base_t &a, const data_base_t &b) const { return a.compare_path(b)<0; }
     };
 
+    /*
+     * Orders paths as path_less does, but settles equal paths by interned
+     * id.  The order is always compare_path's, since a path's id can still
+     * be 0 while another thread is interning it.
+     */
+
+    struct pathid_less
+    {
+        bool operator()(const data_base_t &a, const data_base_t &b) const
+        {
+            unsigned ia = a.as_pathid();
+            if(ia && ia==b.as_pathid()) return false;
+            return a.compare_path(b)<0;
+        }
+    };
+
     struct path_less_lexicographic
     {
         bool operator()(const data_base_t &a, const data_base_t &b) const { return a.compare_path_lexicographic(b)<0; }
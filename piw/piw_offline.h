@@ -0,0 +1,57 @@
+
+/*
+ Copyright 2009 Eigenlabs Ltd.  http://www.eigenlabs.com
+
+ This file is part of EigenD.
+
+ EigenD is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ EigenD is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with EigenD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __PIW_OFFLINE__
+#define __PIW_OFFLINE__
+#include "piw_exports.h"
+#include <piw/piw_bundle.h>
+
+namespace piw
+{
+    class clockdomain_ctl_t;
+
+    /*
+     * Offline renderer.  While rendering, the clock domain is driven by a
+     * clock source that ticks back to back with synthetic timestamps, as
+     * fast as the fast thread can run, and the audio connected to cookie()
+     * is written to a wav file.  Timestamps advance by exactly one buffer
+     * per tick, so the same setup and input render the same output.
+     *
+     * done is called on completion with the realtime factor achieved.
+     */
+
+    class PIW_DECLSPEC_CLASS offline_t : public pic::nocopy_t
+    {
+        public:
+            offline_t(clockdomain_ctl_t *, const std::string &name);
+            ~offline_t();
+            void setfile(const char *filename);
+            cookie_t cookie();
+            void render(unsigned bs, unsigned long sr, float seconds, const change_t &done);
+            void stop();
+            bool rendering();
+            float realtime_factor();
+
+            class impl_t;
+        private:
+            impl_t *impl_;
+    };
+}
+#endif
@@ -29,6 +29,8 @@
 #define TICK_SUPPRESS (0) // suppress but wake up on new data
 #define TICK_ENABLE (1)   // keep on ticking
 
+#define PIW_FILTER_MAXPREFIX 3
+
 namespace piw
 {
     struct PIW_DECLSPEC_CLASS converter_t: virtual public pic::counted_t, virtual public pic::lckobject_t
@@ -64,6 +66,12 @@ namespace piw
     PIW_DECLSPEC_FUNC(d2d_nb_t) last_gt_filter(unsigned);
     PIW_DECLSPEC_FUNC(d2d_nb_t) last_filter();
     PIW_DECLSPEC_FUNC(d2d_nb_t) grist_filter();
+
+    // null_filter, aggregation_filter and aggregation_filter3 only put
+    // fixed components on the front of a path.  for those, copies the
+    // components (up to PIW_FILTER_MAXPREFIX) to p and returns how many;
+    // -1 for any other filter.
+    PIW_DECLSPEC_FUNC(int) prefix_filter(const d2d_nb_t &f, unsigned char *p);
 }
 
 #endif
@@ -22,65 +22,47 @@
 #define __PIW_RING__
 
 #include <piw/piw_data.h>
+#include <picross/pic_ring.h>
 
 namespace piw
 {
+    /*
+     * Passes data from one thread to another.  Holds at least SIZE-1
+     * items, as it did when it was a plain array with one slot left empty.
+     */
+
     template <unsigned SIZE> class ringbuffer_t
     {
         public:
-            ringbuffer_t(): in_(0), out_(0)
-            {
-                for(unsigned i=0;i<SIZE;i++)
-                {
-                    buffer_[i]=0;
-                }
-            }
+            ringbuffer_t() {}
 
             ~ringbuffer_t()
             {
-                for(unsigned i=0;i<SIZE;i++)
+                bct_data_t d;
+
+                while(ring_.pop(d))
                 {
-                    if(buffer_[i])
-                    {
-                        piw_data_decref_atomic(buffer_[i]);
-                    }
+                    piw_data_decref_atomic(d);
                 }
             }
 
             unsigned used()
             {
-                int x = in_-out_;
-                if(x>=0)
-                {
-                    return x;
-                }
-                return SIZE+x;
+                return ring_.size();
             }
 
             unsigned space()
             {
-                return SIZE-used()-1;
-            }
-
-            unsigned advance_in()
-            {
-                in_=(in_+1)%SIZE;
-                return in_;
-            }
-
-            unsigned advance_out()
-            {
-                out_=(out_+1)%SIZE;
-                return out_;
+                return ring_.space();
             }
 
             bool send(const piw::data_nb_t &d)
             {
                 PIC_ASSERT(!d.is_null());
-                if(space() > 0)
+
+                if(ring_.space() > 0)
                 {
-                    buffer_[in_]=d.give_copy();
-                    advance_in();
+                    ring_.push(d.give_copy());
                     return true;
                 }
 
@@ -97,46 +79,50 @@ namespace piw
 
             piw::data_nb_t read_all()
             {
+                bct_data_t batch[16];
                 piw::data_nb_t d;
-                while(true)
+                unsigned n;
+
+                while((n=ring_.pop_n(batch,16))>0)
                 {
-                    piw::data_nb_t n(read());
-                    if(n.is_null())
+                    for(unsigned i=0;i<n-1;i++)
                     {
-                        return d;
+                        piw::data_nb_t::from_given(batch[i]);
                     }
-                    d = n;
+
+                    d = piw::data_nb_t::from_given(batch[n-1]);
                 }
+
+                return d;
             }
 
             piw::data_nb_t read()
             {
-                if(used()==0)
+                bct_data_t data;
+
+                if(!ring_.pop(data))
                 {
                     return null_;
                 }
 
-                bct_data_t data = buffer_[out_];
-                buffer_[out_]=0;
-                piw::data_nb_t d = piw::data_nb_t::from_given(data);
-                advance_out();
-                return d;
+                return piw::data_nb_t::from_given(data);
             }
 
             piw::data_nb_t peek()
             {
-                if(used()==0)
+                bct_data_t *data = ring_.front();
+
+                if(!data)
                 {
                     return null_;
                 }
 
-                return piw::data_nb_t::from_lent(buffer_[out_]);
+                return piw::data_nb_t::from_lent(*data);
             }
 
         private:
             piw::data_nb_t null_;
-            volatile bct_data_t buffer_[SIZE];
-            volatile unsigned in_,out_;
+            pic::spscring_t<bct_data_t,pic::ring::pow2_t<SIZE-1>::value> ring_;
     };
 }
 
@@ -35,6 +35,12 @@ namespace piw
             ~samplearray_t();
 
             impl_t *impl() { return impl_; }
+
+            // reads that finished after their buffer was due to be played,
+            // and reads dropped because nothing wanted the buffer any more.
+            unsigned long late_reads();
+            unsigned long cancelled_reads();
+
         private:
             impl_t *impl_;
     };
@@ -43,6 +49,14 @@ namespace piw
 
     inline samplearrayref_t create_samplearray(const char *f,unsigned p,unsigned l) { return pic::ref(new samplearray_t(f,p,l)); }
 
+    // sample arrays up to this size are mapped rather than read; applies to
+    // arrays created afterwards.
+    PIW_DECLSPEC_FUNC(void) set_sample_mmap_limit(unsigned megabytes);
+
+    // how many threads read for sample arrays, shared by all of them.
+    // applies when they are next started, after all arrays have gone.
+    PIW_DECLSPEC_FUNC(void) set_sample_readers(unsigned n);
+
     struct PIW_DECLSPEC_CLASS sample_t: pic::atomic_counted_t, virtual public pic::lckobject_t
     {
         public:
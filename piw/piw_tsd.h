@@ -64,12 +64,80 @@ namespace piw
     PIW_DECLSPEC_FUNC(int) tsd_fastcall3(int (*cb)(void *arg1, void *arg2, void *arg3), void *arg1, void *arg2, void *arg3);
     PIW_DECLSPEC_FUNC(int) tsd_fastcall4(int (*cb)(void *arg1, void *arg2, void *arg3, void *arg4), void *arg1, void *arg2, void *arg3, void *arg4);
     PIW_DECLSPEC_FUNC(void) tsd_log(const char *);
+
+    /*
+     * Completion token for a call queued to the fast thread with
+     * tsd_fastcall_async() or a fastbatch_t.
+     */
+
+    class PIW_DECLSPEC_CLASS fastfuture_t
+    {
+        public:
+            class impl_t;
+
+            fastfuture_t(): impl_(0) {}
+            explicit fastfuture_t(impl_t *i);
+            fastfuture_t(const fastfuture_t &f);
+            fastfuture_t &operator=(const fastfuture_t &f);
+            ~fastfuture_t();
+
+            bool valid() const { return impl_!=0; }
+            bool done() const;
+            int wait();
+
+        private:
+            impl_t *impl_;
+    };
+
+    /*
+     * Queue a call to the fast thread without waiting for it.  Calls run
+     * in the order queued, after any earlier fastcalls.  Pointer arguments
+     * must stay valid until the call has run; the _copy variants take a
+     * copy of arg2 and pass the fast thread a pointer to that.
+     */
+
+    PIW_DECLSPEC_FUNC(fastfuture_t) tsd_fastcall_async(int (*cb)(void *arg1, void *arg2), void *arg1, void *arg2);
+    PIW_DECLSPEC_FUNC(fastfuture_t) tsd_fastcall_async_copy(int (*cb)(void *arg1, void *arg2), void *arg1, const void *arg2, unsigned len);
+    template <class A> inline fastfuture_t tsd_fastcall_async_copy(int (*cb)(void *arg1, void *arg2), void *arg1, const A &arg2) { return tsd_fastcall_async_copy(cb,arg1,&arg2,sizeof(A)); }
+
+    /*
+     * Collects calls for the fast thread and queues them with a single
+     * fastcall, so they all run back to back in one visit, in the order
+     * added.  post() returns a future for the last call, which is done
+     * once the whole batch has run; calls still pending when the batch
+     * is destroyed are posted then.
+     */
+
+    class PIW_DECLSPEC_CLASS fastbatch_t: public pic::nocopy_t
+    {
+        public:
+            fastbatch_t(): head_(0), tail_(0), size_(0) {}
+            ~fastbatch_t();
+
+            fastfuture_t add(int (*cb)(void *arg1, void *arg2), void *arg1, void *arg2);
+            fastfuture_t add_copy(int (*cb)(void *arg1, void *arg2), void *arg1, const void *arg2, unsigned len);
+            template <class A> fastfuture_t add_copy(int (*cb)(void *arg1, void *arg2), void *arg1, const A &arg2) { return add_copy(cb,arg1,&arg2,sizeof(A)); }
+
+            unsigned size() const { return size_; }
+            fastfuture_t post();
+            int run() { return post().wait(); }
+
+        private:
+            fastfuture_t append(fastfuture_t::impl_t *call);
+
+            fastfuture_t::impl_t *head_;
+            fastfuture_t::impl_t *tail_;
+            unsigned size_;
+    };
+
     PIW_DECLSPEC_FUNC(bool) tsd_killed();
     PIW_DECLSPEC_FUNC(void) tsd_exit();
     PIW_DECLSPEC_FUNC(dataqueue_t) tsd_dataqueue(unsigned size);
     PIW_DECLSPEC_FUNC(void) tsd_dump();
     PIW_DECLSPEC_FUNC(void) *tsd_winctx();
     PIW_DECLSPEC_FUNC(void) tsd_alert(const char *,const char *,const char *);
+    PIW_DECLSPEC_FUNC(bool) tsd_clockstats_enable(bool);
+    PIW_DECLSPEC_FUNC(std::string) tsd_clockstats(bool reset);
 
     PIW_DECLSPEC_FUNC(std::string) tsd_user();
 
@@ -316,6 +316,22 @@ void piw::xevent_data_buffer_t::merge(const piw::xevent_data_buffer_t &b,unsigne
     }
 }
 
+void piw::xevent_data_buffer_t::clear()
+{
+    // the event data is only reused if no copy or iterator still holds it
+
+    if(event_->count()!=1)
+    {
+        event_=pic::ref(new event_data_t);
+        return;
+    }
+
+    for(unsigned i=0; i<MAX_SIGNALS; ++i)
+    {
+        event_->signals_[i].clear();
+    }
+}
+
 void piw::xevent_data_buffer_t::dump(bool full) const
 {
     pic::logmsg() << "--- event data dump";
@@ -432,7 +448,7 @@ void piw::evtsource_data_t::event_start(unsigned seq, const piw::data_nb_t &id,c
 
     PIC_ASSERT(id.is_path());
     PIC_WARN(id.time()!=0ULL);
-    if(event_.get().is_path() && id.compare_path(event_.get())!=0)
+    if(event_.get().is_path() && !id.same_path(event_.get()))
     {
         pic::logmsg() << "bad evt:" << event_ << " id:" << id;
         return;
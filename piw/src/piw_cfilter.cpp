@@ -74,6 +74,7 @@ namespace
         bool cfilterenv_latest(unsigned signal, piw::data_nb_t &value, unsigned long long max);
         void cfilterenv_reset(unsigned signal, unsigned long long max);
         void ticked(unsigned long long f, unsigned long long t,unsigned long sr, unsigned bs);
+        void stopped(unsigned long long t);
         piw::data_t cfilterenv_path() { return name_; }
         void cfilterenv_dump(bool f) {  input_.dump(f); }
 
@@ -111,6 +112,7 @@ struct piw::cfilter_t::impl_t: piw::root_t, piw::root_ctl_t, piw::clocksink_t, v
     piw::wire_t *root_wire(const piw::event_data_source_t &es);
 
     void clocksink_ticked(unsigned long long f, unsigned long long t);
+    void ticked_batch(unsigned long long f, unsigned long long t, unsigned long sr, unsigned bs);
     void dochanged(void *);
     void changed(void *);
     void invalidate();
@@ -121,6 +123,8 @@ struct piw::cfilter_t::impl_t: piw::root_t, piw::root_ctl_t, piw::clocksink_t, v
     piw::clockdomain_ctl_t *domain_;
     bct_clocksink_t *up_;
     pic::ilist_t<filter_wire_t> clockers_;
+    pic::lckvector_t<piw::cfiltervoice_t>::nbtype batch_;
+    pic::lckvector_t<filter_wire_t *>::nbtype batch_wires_;
     unsigned tick_count_;
     bool linger_restart_;
 };
@@ -290,12 +294,20 @@ void piw::cfilter_t::impl_t::clocksink_ticked(unsigned long long f, unsigned lon
     unsigned long sr = get_sample_rate();
     unsigned bs = get_buffer_size();
 
-    while(w)
+    if(ctl_->cfilterctl_batch())
     {
-        count++;
-        filter_wire_t *n = clockers_.next(w);
-        w->ticked(f,t,sr,bs);
-        w = n;
+        ticked_batch(f,t,sr,bs);
+        count = batch_.size();
+    }
+    else
+    {
+        while(w)
+        {
+            count++;
+            filter_wire_t *n = clockers_.next(w);
+            w->ticked(f,t,sr,bs);
+            w = n;
+        }
     }
 
     if(++tick_count_==6000)
@@ -311,6 +323,37 @@ void piw::cfilter_t::impl_t::clocksink_ticked(unsigned long long f, unsigned lon
     }
 }
 
+void piw::cfilter_t::impl_t::ticked_batch(unsigned long long f, unsigned long long t, unsigned long sr, unsigned bs)
+{
+    batch_.clear();
+    batch_wires_.clear();
+
+    for(filter_wire_t *w = clockers_.head(); w; w = clockers_.next(w))
+    {
+        piw::cfiltervoice_t v;
+        v.func = w->holder_.function_;
+        v.env = w;
+        v.running = true;
+        batch_.push_back(v);
+        batch_wires_.push_back(w);
+    }
+
+    if(batch_.empty())
+    {
+        return;
+    }
+
+    ctl_->cfilterctl_process(&batch_[0],batch_.size(),f,t,sr,bs);
+
+    for(unsigned i=0; i<batch_.size(); ++i)
+    {
+        if(!batch_[i].running)
+        {
+            batch_wires_[i]->stopped(t);
+        }
+    }
+}
+
 void piw::cfilter_t::impl_t::changed(void *a)
 {
     pic::flipflop_t<std::map<piw::data_t,filter_wire_t *> >::guard_t g(children_);
@@ -369,14 +412,19 @@ void filter_wire_t::ticked(unsigned long long f, unsigned long long t,unsigned l
 {
     if(!holder_->cfilterfunc_process(this,f,t,sr,bs))
     {
-        //pic::logmsg() << "cfilter stopped due to inactivity " << f << "->" << t;
-        state_=STATE_STOPPED;
-        remove();
-        downstopped_ = source_end(t);
-        if(downstopped_)
-        {
-            event_ended(seq_);
-        }
+        stopped(t);
+    }
+}
+
+void filter_wire_t::stopped(unsigned long long t)
+{
+    //pic::logmsg() << "cfilter stopped due to inactivity " << t;
+    state_=STATE_STOPPED;
+    remove();
+    downstopped_ = source_end(t);
+    if(downstopped_)
+    {
+        event_ended(seq_);
     }
 }
 
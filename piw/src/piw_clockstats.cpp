@@ -0,0 +1,146 @@
+/*
+ Copyright 2009 Eigenlabs Ltd.  http://www.eigenlabs.com
+
+ This file is part of EigenD.
+
+ EigenD is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ EigenD is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with EigenD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <piw/piw_clockstats.h>
+#include <piw/piw_thing.h>
+#include <piw/piw_tsd.h>
+#include <picross/pic_log.h>
+
+#include <string>
+#include <vector>
+
+struct piw::clockstats_t::impl_t: piw::thing_t, virtual public pic::lckobject_t
+{
+    impl_t(clockstats_t *s, unsigned p): stats_(s), period_(p)
+    {
+    }
+
+    ~impl_t()
+    {
+        tracked_invalidate();
+        close_thing();
+
+        for(unsigned i=0; i<lines_.size(); ++i)
+        {
+            delete lines_[i];
+        }
+    }
+
+    void open()
+    {
+        if(!thing_t::open())
+        {
+            piw::tsd_thing(this);
+        }
+
+        update();
+        timer_slow(period_);
+    }
+
+    void thing_timer_slow()
+    {
+        update();
+    }
+
+    void update()
+    {
+        if(!stats_->open())
+        {
+            return;
+        }
+
+        std::string report = piw::tsd_clockstats(false);
+        unsigned n = 0;
+        std::string::size_type b = 0;
+
+        while(b<report.size() && n<BCTLIMIT_PATHMAX)
+        {
+            std::string::size_type e = report.find('\n',b);
+
+            if(e==std::string::npos)
+            {
+                e = report.size();
+            }
+
+            line(n++)->set_data(piw::makestring(report.substr(b,e-b)));
+            b = e+1;
+        }
+
+        for(; n<lines_.size(); ++n)
+        {
+            lines_[n]->set_data(piw::makestring(""));
+        }
+    }
+
+    piw::server_t *line(unsigned i)
+    {
+        while(lines_.size()<=i)
+        {
+            piw::server_t *s = new piw::server_t(PLG_SERVER_RO);
+            lines_.push_back(s);
+            stats_->child_add(lines_.size(),s);
+        }
+
+        return lines_[i];
+    }
+
+    clockstats_t *stats_;
+    unsigned period_;
+    std::vector<piw::server_t *> lines_;
+};
+
+piw::clockstats_t::clockstats_t(unsigned period): server_t(0), impl_(new impl_t(this,period))
+{
+    set_data(piw::makebool(false));
+}
+
+piw::clockstats_t::~clockstats_t()
+{
+    close_server();
+    delete impl_;
+}
+
+void piw::clockstats_t::server_opened()
+{
+    impl_->open();
+}
+
+void piw::clockstats_t::server_closed()
+{
+    if(impl_->thing_t::open())
+    {
+        impl_->cancel_timer_slow();
+    }
+}
+
+void piw::clockstats_t::server_change(const piw::data_t &d)
+{
+    if(!d.is_bool())
+    {
+        return;
+    }
+
+    if(d.as_bool())
+    {
+        piw::tsd_clockstats(true);
+    }
+
+    piw::tsd_clockstats_enable(d.as_bool());
+    set_data(piw::makebool(d.as_bool()));
+}
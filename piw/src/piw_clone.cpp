@@ -48,11 +48,14 @@ namespace {
         void event_start(unsigned seq,const piw::data_nb_t &id, const piw::xevent_data_buffer_t &b);
         void source_ended(unsigned seq);
         void activate(bool b, unsigned long long t);
+        piw::data_nb_t filter(const piw::data_nb_t &id);
 
         unsigned output_;
         piw::clone_t::impl_t *parent_;
         bool active_;
         pic::flipflop_functor_t<piw::d2d_nb_t> filter_;
+        int prefixlen_;
+        unsigned char prefix_[PIW_FILTER_MAXPREFIX];
         unsigned seq_;
         piw::dataholder_nb_t id_;
     };
@@ -146,9 +149,37 @@ void clone_wire_t::activate(bool b, unsigned o, unsigned long long t)
 
 clone_wire_ctl_t::clone_wire_ctl_t(unsigned o, piw::clone_t::impl_t *impl, const piw::d2d_nb_t &filter, const piw::event_data_source_t &es): piw::event_data_source_real_t(es.path()), output_(o), parent_(impl), active_(false), filter_(filter)
 {
+    prefixlen_ = piw::prefix_filter(filter,prefix_);
     subscribe_and_ping(es);
 }
 
+/*
+ * Most outputs have no filter, or one that only prefixes the id.  Those are
+ * done here without calling through the functor: no filter passes on the
+ * very id every other output gets, and a prefix takes one allocation
+ * however many components it has.
+ */
+
+piw::data_nb_t clone_wire_ctl_t::filter(const piw::data_nb_t &id)
+{
+    if(prefixlen_==0)
+    {
+        return id;
+    }
+
+    if(prefixlen_>0)
+    {
+        if(!id.is_path())
+        {
+            return id;
+        }
+
+        return piw::pathprepend_nb(id,prefix_,prefixlen_);
+    }
+
+    return filter_(id);
+}
+
 void clone_wire_ctl_t::event_start(unsigned seq,const piw::data_nb_t &id, const piw::xevent_data_buffer_t &b)
 {
     seq_ = seq;
@@ -158,7 +189,7 @@ void clone_wire_ctl_t::event_start(unsigned seq,const piw::data_nb_t &id, const
         return;
     }
 
-    piw::data_nb_t nid = filter_(id);
+    piw::data_nb_t nid = filter(id);
 
     if(nid.is_path())
     {
@@ -182,7 +213,7 @@ void clone_wire_ctl_t::activate(bool b, unsigned long long t)
     {
         if(parent_->policy_)
         {
-            piw::data_nb_t nid = filter_(current_id());
+            piw::data_nb_t nid = filter(current_id());
 
             if(nid.is_path())
             {
@@ -394,7 +425,11 @@ int clone_wire_t::gc_clear()
     for(oi=clones_.alternate().begin(); oi!=clones_.alternate().end(); oi++)
     {
         clone_wire_ctl_t *w = *oi;
-        if(w) w->filter_.gc_clear();
+        if(w)
+        {
+            w->filter_.gc_clear();
+            w->prefixlen_ = -1;
+        }
     }
 
     clones_.exchange();
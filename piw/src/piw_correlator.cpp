@@ -35,6 +35,7 @@
 #define CHECKTIME(x)  t1=tsd_time(); if((t1-t0)>1000ULL) pic::logmsg() << "******** correlator " << (x) << " time " << (t1-t0); t0 = t1;
 
 #define MAX_VOICES 500
+#define VOICE_BUFFERS 2
 
 namespace
 {
@@ -69,7 +70,8 @@ namespace
         static int __plumb(void *input_, void *) { correlator_source_t *input = (correlator_source_t *)input_; input->startup_fast(); return 0; }
         static int __unplumb(void *input_, void *) { correlator_source_t *input = (correlator_source_t *)input_; input->shutdown_fast(); return 0; }
 
-        void plumb() { piw::tsd_fastcall(__plumb,this,0); }
+        // unplumb waits, so a plumb still queued runs before the source goes away
+        void plumb() { piw::tsd_fastcall_async(__plumb,this,0); }
         void unplumb() { piw::tsd_fastcall(__unplumb,this,0); }
 
         void activate_input();
@@ -93,7 +95,9 @@ namespace
 
     struct correlator_buffer_t: pic::element_t<0>, pic::element_t<1>, pic::element_t<2>, virtual pic::lckobject_t
     {
-        correlator_buffer_t(correlator_voice_t *voice, unsigned long long t);
+        correlator_buffer_t(impl_t *root);
+
+        void reset(correlator_voice_t *voice, unsigned long long t);
 
         void detach_source(correlator_source_t *,unsigned long long);
         void set_signal(unsigned s, unsigned long long t, const piw::dataqueue_t &q,bool linger);
@@ -168,6 +172,148 @@ namespace
         piw::converter_ref_t converter_;
     };
 
+    /*
+     * Voices keyed on an event id path, hashed by its bytes and compared
+     * by its interned id where it has one.  This is an open addressed table with linear
+     * probing, sized when the correlator is made for as many voices as it
+     * can ever have, so the fast thread never grows it.  Removal moves
+     * later entries of a run back rather than leaving tombstones.
+     */
+
+    class voicetable_t: public pic::nocopy_t
+    {
+        public:
+            voicetable_t(unsigned voices): mask_(3)
+            {
+                while(mask_+1<2*voices)
+                {
+                    mask_=2*mask_+1;
+                }
+
+                slots_.resize(mask_+1);
+            }
+
+            correlator_voice_t *find(const piw::data_nb_t &id) const
+            {
+                int i = lookup(id);
+                return (i<0) ? 0 : slots_[i].voice_;
+            }
+
+            void insert(const piw::data_nb_t &id, correlator_voice_t *v)
+            {
+                unsigned h = hash(id);
+                unsigned i = h&mask_;
+
+                while(slots_[i].voice_)
+                {
+                    i = (i+1)&mask_;
+                }
+
+                slots_[i].hash_ = h;
+                slots_[i].id_ = id;
+                slots_[i].voice_ = v;
+            }
+
+            void erase(const piw::data_nb_t &id)
+            {
+                int f = lookup(id);
+
+                if(f<0)
+                {
+                    return;
+                }
+
+                unsigned i = f;
+                unsigned j = f;
+
+                for(;;)
+                {
+                    slots_[i].voice_ = 0;
+                    slots_[i].id_.clear();
+
+                    for(;;)
+                    {
+                        j = (j+1)&mask_;
+
+                        if(!slots_[j].voice_)
+                        {
+                            return;
+                        }
+
+                        // an entry may move back to i unless its home
+                        // slot lies after i in the run up to j.
+
+                        unsigned k = slots_[j].hash_&mask_;
+
+                        if(i<=j ? (k<=i || k>j) : (k<=i && k>j))
+                        {
+                            break;
+                        }
+                    }
+
+                    slots_[i] = slots_[j];
+                    i = j;
+                }
+            }
+
+            unsigned capacity() const { return slots_.size(); }
+            correlator_voice_t *voice(unsigned i) const { return slots_[i].voice_; }
+
+        private:
+            struct slot_t
+            {
+                slot_t(): hash_(0), voice_(0) {}
+
+                unsigned hash_;
+                piw::data_nb_t id_;
+                correlator_voice_t *voice_;
+            };
+
+            // always from the bytes: the same path can be without an id
+            // one time and with one the next, while it's being interned.
+
+            static unsigned hash(const piw::data_nb_t &id)
+            {
+                unsigned h = 2166136261U;
+
+                if(id.is_path())
+                {
+                    const unsigned char *p = id.as_path();
+                    unsigned l = id.as_pathlen();
+
+                    for(unsigned i=0; i<l; ++i)
+                    {
+                        h = (h^p[i])*16777619U;
+                    }
+                }
+
+                return h;
+            }
+
+            int lookup(const piw::data_nb_t &id) const
+            {
+                if(!id.is_path())
+                {
+                    return -1;
+                }
+
+                unsigned h = hash(id);
+
+                for(unsigned i=h&mask_; slots_[i].voice_; i=(i+1)&mask_)
+                {
+                    if(slots_[i].hash_==h && slots_[i].id_.same_path(id))
+                    {
+                        return i;
+                    }
+                }
+
+                return -1;
+            }
+
+            pic::lckvector_t<slot_t>::lcktype slots_;
+            unsigned mask_;
+    };
+
     piw::data_t voice_id(unsigned id)
     {
         return piw::pathtwo(1+id/255,1+id%255,0);
@@ -178,6 +324,8 @@ struct piw::correlator_t::impl_t: piw::clocksink_t, piw::thing_t, virtual public
 {
     void default_ready(correlator_default_t *d, const piw::data_nb_t &id);
     correlator_buffer_t *allocate_voice(unsigned long long t,const piw::data_nb_t &id, correlator_input_t *input);
+    correlator_buffer_t *allocate_buffer(correlator_voice_t *v, unsigned long long t);
+    void free_buffer(correlator_buffer_t *b);
     void clocksink_ticked(unsigned long long f, unsigned long long t);
     correlator_default_t *best_default(unsigned,const piw::data_nb_t &);
 
@@ -198,6 +346,7 @@ struct piw::correlator_t::impl_t: piw::clocksink_t, piw::thing_t, virtual public
     void clock_plumbed(unsigned signal, bool status);
     int lookup(unsigned name);
     static int __adder(void *self_, void *voice_);
+    static int __addbuffers(void *self_, void *list_);
     void set_latency(unsigned signal, unsigned iid, unsigned latency);
     void remove_latency(unsigned signal, unsigned iid);
     int gc_traverse(void *v, void *a) const;
@@ -208,8 +357,8 @@ struct piw::correlator_t::impl_t: piw::clocksink_t, piw::thing_t, virtual public
 
     bool killed_;
     std::vector<correlator_voice_t *> voices_;
-    pic::lckmap_t<piw::data_nb_t,correlator_voice_t *,piw::path_less>::nbtype voicemap_; // fast
-    pic::lckmap_t<piw::data_nb_t,correlator_voice_t *,piw::path_less>::nbtype voiceout_; // fast
+    voicetable_t voicemap_; // fast
+    voicetable_t voiceout_; // fast
     std::vector<std::map<iid_t,correlator_input_t *> > inputs_; // slow
     pic::lckvector_t<pic::lckmap_t<iid_t,correlator_default_t *>::nbtype >::nbtype defaults_; // fast
     pic::lckvector_t<pic::lckmultimap_t<piw::data_nb_t,correlator_default_t *,piw::path_less>::nbtype >::nbtype defaults_byid_; // fast
@@ -220,6 +369,7 @@ struct piw::correlator_t::impl_t: piw::clocksink_t, piw::thing_t, virtual public
     pic::ilist_t<correlator_source_t,0> active_inputs_; // fast
     pic::ilist_t<correlator_voice_t,1> queue_;
     pic::ilist_t<correlator_voice_t,0> freelist_;
+    pic::ilist_t<correlator_buffer_t,0,true> buffers_; // fast, free buffers
 
     piw::d2d_nb_t mapper_;
     bool enabled_;
@@ -259,9 +409,19 @@ void correlator_source_t::deactivate_input()
     root_->deactivate_input(this);
 }
 
-correlator_buffer_t::correlator_buffer_t(correlator_voice_t *voice, unsigned long long t): voice_(voice), inputs_(voice_->root_->inputs_.size()), refcount_(1), refcount_input_(1), state_(BUFFER_STARTING)
+correlator_buffer_t::correlator_buffer_t(impl_t *root): voice_(0), inputs_(root->inputs_.size()), refcount_(0), refcount_input_(0), state_(BUFFER_DONE), start_time_(0), end_time_(0)
+{
+}
+
+void correlator_buffer_t::reset(correlator_voice_t *voice, unsigned long long t)
 {
+    voice_=voice;
+    refcount_=1;
+    refcount_input_=1;
+    state_=BUFFER_STARTING;
     start_time_=t;
+    end_time_=0;
+    event_.clear();
 
     for(unsigned i=0;i<inputs_.size();i++)
     {
@@ -269,6 +429,25 @@ correlator_buffer_t::correlator_buffer_t(correlator_voice_t *voice, unsigned lon
     }
 }
 
+correlator_buffer_t *piw::correlator_t::impl_t::allocate_buffer(correlator_voice_t *v, unsigned long long t)
+{
+    correlator_buffer_t *b = buffers_.pop_front();
+
+    if(!b)
+    {
+        b = new correlator_buffer_t(this);
+    }
+
+    b->reset(v,t);
+    return b;
+}
+
+void piw::correlator_t::impl_t::free_buffer(correlator_buffer_t *b)
+{
+    b->pic::element_t<1>::remove();
+    buffers_.append(b);
+}
+
 void piw::correlator_t::impl_t::check_time(correlator_source_t *s, unsigned long long t)
 {
     long long et = (long long)t;
@@ -331,17 +510,14 @@ void piw::correlator_t::impl_t::clocksink_ticked(unsigned long long f, unsigned
 
 correlator_buffer_t *piw::correlator_t::impl_t::allocate_voice(unsigned long long t,const piw::data_nb_t &id, correlator_input_t *input)
 {
-    pic::lckmap_t<piw::data_nb_t,correlator_voice_t *,piw::path_less>::nbtype::iterator i = voicemap_.find(id);
-
     correlator_buffer_t *b;
-    correlator_voice_t *v;
+    correlator_voice_t *v = voicemap_.find(id);
     piw::data_nb_t idout;
 
     unsigned s = input->signal_;
 
-    if(i!=voicemap_.end())
+    if(v)
     {
-        v = i->second;
         b = v->buflist_.head();
 
         if(b)
@@ -398,7 +574,7 @@ correlator_buffer_t *piw::correlator_t::impl_t::allocate_voice(unsigned long lon
             return 0;
         }
 
-        if((i=voiceout_.find(idout))!=voiceout_.end())
+        if(voiceout_.find(idout))
         {
             //pic::logmsg() << "mapper skipped (2) id=" << id;
             return 0;
@@ -421,11 +597,11 @@ correlator_buffer_t *piw::correlator_t::impl_t::allocate_voice(unsigned long lon
 
         v->current_id_.set_nb(id);
         v->output_id_.set_nb(idout);
-        voicemap_.insert(std::make_pair(id,v));
-        voiceout_.insert(std::make_pair(idout,v));
+        voicemap_.insert(id,v);
+        voiceout_.insert(idout,v);
     }
 
-    b = new correlator_buffer_t(v,t);
+    b = allocate_buffer(v,t);
     v->buflist_.prepend(b);
     b->inputs_[s]=input;
     queue_.append(v);
@@ -448,7 +624,7 @@ correlator_default_t *piw::correlator_t::impl_t::best_default(unsigned s, const
     if(m.size()==1)
     {
         pic::lckmultimap_t<piw::data_nb_t,correlator_default_t *,piw::path_less>::nbtype::const_iterator iter = m.begin();
-        if(iter->first.compare_path(id_)==0)
+        if(iter->first.same_path(id_))
         {
             return iter->second;
         }
@@ -511,11 +687,15 @@ void piw::correlator_t::impl_t::default_ready(correlator_default_t *d, const piw
     //pic::logmsg() << "default ready " << id << " " << d->signame_;
     //dump_defaults();
 
-    pic::lckmap_t<piw::data_nb_t,correlator_voice_t *,piw::path_less>::nbtype::iterator i;
-
-    for(i=voicemap_.begin(); i!=voicemap_.end(); i++)
+    for(unsigned i=0; i<voicemap_.capacity(); i++)
     {
-        correlator_voice_t *v = i->second;
+        correlator_voice_t *v = voicemap_.voice(i);
+
+        if(!v)
+        {
+            continue;
+        }
+
         correlator_buffer_t *b = v->buflist_.head();
 
         //pic::logmsg() << "checking " << v->current_id_;
@@ -592,14 +772,10 @@ restart:
 
     if(!buflist_.head())
     {
-        pic::lckmap_t<piw::data_nb_t,correlator_voice_t *,piw::path_less>::nbtype::iterator i;
-
         //pic::logmsg() << "freeing voice for " << current_id_ << " voice " << (void *)this;
 
-        i=root_->voicemap_.find(current_id_);
-        root_->voicemap_.erase(i);
-        i=root_->voiceout_.find(output_id_);
-        root_->voiceout_.erase(i);
+        root_->voicemap_.erase(current_id_.get());
+        root_->voiceout_.erase(output_id_.get());
 
         root_->freelist_.append(this);
         root_->freecount_++;
@@ -618,8 +794,8 @@ restart:
             //b->buffer_ticked();
 
             b->detach_sources();
-            //pic::logmsg() << "delete buffer " << (void *)b;
-            delete b;
+            //pic::logmsg() << "free buffer " << (void *)b;
+            root_->free_buffer(b);
             goto restart;
 
         case BUFFER_LINGERING2:
@@ -1199,7 +1375,7 @@ int piw::correlator_t::gc_clear()
     return impl_->gc_clear();
 }
 
-piw::correlator_t::impl_t::impl_t(piw::clockdomain_ctl_t *d, const std::string &sigmap, const piw::d2d_nb_t &evtmap, const piw::cookie_t &c,unsigned thr,unsigned poly): killed_(false), inputs_(sigmap.size()), defaults_(sigmap.size()), defaults_byid_(sigmap.size()), sigmap_(sigmap.size()), mapper_(evtmap), enabled_(false), freecount_(0), poly_(poly)
+piw::correlator_t::impl_t::impl_t(piw::clockdomain_ctl_t *d, const std::string &sigmap, const piw::d2d_nb_t &evtmap, const piw::cookie_t &c,unsigned thr,unsigned poly): killed_(false), voicemap_(poly?std::min(poly,(unsigned)MAX_VOICES):MAX_VOICES), voiceout_(poly?std::min(poly,(unsigned)MAX_VOICES):MAX_VOICES), inputs_(sigmap.size()), defaults_(sigmap.size()), defaults_byid_(sigmap.size()), sigmap_(sigmap.size()), mapper_(evtmap), enabled_(false), freecount_(0), poly_(poly)
 {
     piw::tsd_thing(this);
 
@@ -1228,6 +1404,20 @@ int piw::correlator_t::impl_t::__adder(void *self_, void *voice_)
     return 0;
 }
 
+int piw::correlator_t::impl_t::__addbuffers(void *self_, void *list_)
+{
+    impl_t *self = (impl_t *)self_;
+    pic::ilist_t<correlator_buffer_t,0> *list = (pic::ilist_t<correlator_buffer_t,0> *)list_;
+    correlator_buffer_t *b;
+
+    while((b=list->pop_front())!=0)
+    {
+        self->buffers_.append(b);
+    }
+
+    return 0;
+}
+
 void piw::correlator_t::impl_t::trash_inputs()
 {
     for(unsigned s=0;s<sigmap_.size();s++)
@@ -1310,6 +1500,18 @@ bool piw::correlator_t::impl_t::add_voice()
     voices_.resize(id+1);
     voices_[id]=v;
     piw::tsd_fastcall(__adder,this,v);
+
+    // each voice brings the buffers it will need, so a note on takes them
+    // from the pool rather than allocating.
+
+    pic::ilist_t<correlator_buffer_t,0> spare;
+
+    for(unsigned i=0;i<VOICE_BUFFERS;i++)
+    {
+        spare.append(new correlator_buffer_t(this));
+    }
+
+    piw::tsd_fastcall(__addbuffers,this,&spare);
     return true;
 }
 
@@ -176,7 +176,7 @@ struct piw::cycler_t::impl_t: piw::decode_ctl_t, virtual pic::lckobject_t, piw::
     pic::ilist_t<voice_t,1> busy_queue_;
 
     std::vector<pic::ref_t<voice_t> > voices_;
-    pic::lckmap_t<piw::data_nb_t,voice_t *,piw::path_less>::nbtype dst2voice_;
+    pic::lckmap_t<piw::data_nb_t,voice_t *,piw::pathid_less>::nbtype dst2voice_;
 
     feedback_ctl_t feedback_;
     piw::decoder_t main_decoder_;
@@ -290,7 +290,7 @@ piw::data_nb_t piw::cycler_t::impl_t::nextid(const piw::data_nb_t &d_)
 
 void feedback_wire_t::event_start(unsigned seq,const piw::data_nb_t &id, const piw::xevent_data_buffer_t &b)
 {
-    pic::lckmap_t<piw::data_nb_t,voice_t *,piw::path_less>::nbtype::iterator i;
+    pic::lckmap_t<piw::data_nb_t,voice_t *,piw::pathid_less>::nbtype::iterator i;
 
     //pic::logmsg() << "feedback: " << id << " started " << (void *)voice_;
 
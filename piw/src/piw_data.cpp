@@ -150,7 +150,7 @@ static T __makewire(unsigned nb,unsigned dl, const unsigned char *dp)
 }
 
 template <class T>
-static T __pathprepend_chaff(unsigned nb,const T &o, unsigned p)
+static T __pathprepend_chaff(unsigned nb,const T &o, const unsigned char *p, unsigned pl)
 {
     unsigned char *dp;
     const unsigned char *op;
@@ -164,11 +164,11 @@ static T __pathprepend_chaff(unsigned nb,const T &o, unsigned p)
     op=(const unsigned char *)o.host_data();
     oc=*op;
 
-    d=T::from_given(__allocate_host(nb,o.time(),1,0,0,BCTVTYPE_PATH,1+ol,&dp,1,&vv));
+    d=T::from_given(__allocate_host(nb,o.time(),1,0,0,BCTVTYPE_PATH,pl+ol,&dp,1,&vv));
 
-    dp[0]=oc+1;
-    dp[1]=p;
-    memcpy(dp+2,op+1,ol-1);
+    dp[0]=oc+pl;
+    memcpy(dp+1,p,pl);
+    memcpy(dp+1+pl,op+1,ol-1);
 
     *vv=0;
 
@@ -744,7 +744,7 @@ piw::data_t piw::makelong_bounded_units_ex(unsigned nb,unsigned u,float ubound,
 piw::data_t piw::makewire_ex(unsigned nb,unsigned dl, const unsigned char *dp) { return (__makewire<data_t>(nb,dl,dp)); }
 piw::data_t piw::pathnull_ex(unsigned nb,unsigned long long t) { return (__makepath<data_t>(nb,t,0,0,0)); }
 piw::data_t piw::pathone_ex(unsigned nb,unsigned v,unsigned long long t) { unsigned char vv=v; return (__makepath<data_t>(nb,t,&vv,1,0)); }
-piw::data_t piw::pathprepend_ex(unsigned nb,const data_t &d, unsigned p) { return (__pathprepend_chaff<data_t>(nb,d,p)); }
+piw::data_t piw::pathprepend_ex(unsigned nb,const data_t &d, unsigned p) { unsigned char pp=p; return (__pathprepend_chaff<data_t>(nb,d,&pp,1)); }
 piw::data_t piw::pathtwo_ex(unsigned nb,unsigned v1,unsigned v2,unsigned long long t) { return pathprepend_ex(nb,pathone_ex(nb,v2,t),v1); }
 piw::data_t piw::pathprepend_grist_ex(unsigned nb,const data_t &d, unsigned p) { return (__pathprepend_grist<data_t>(nb,d,p)); }
 piw::data_t piw::pathappend_chaff_ex(unsigned nb,const data_t &d, unsigned p) { return (__pathappend_chaff<data_t>(nb,d,p)); }
@@ -780,7 +780,8 @@ piw::data_nb_t piw::makelong_bounded_units_nb_ex(unsigned nb,unsigned u,float ub
 piw::data_nb_t piw::makewire_nb_ex(unsigned nb,unsigned dl, const unsigned char *dp) { return (__makewire<data_nb_t>(nb,dl,dp)); }
 piw::data_nb_t piw::pathnull_nb_ex(unsigned nb,unsigned long long t) { return (__makepath<data_nb_t>(nb,t,0,0,0)); }
 piw::data_nb_t piw::pathone_nb_ex(unsigned nb,unsigned v,unsigned long long t) { unsigned char vv=v; return (__makepath<data_nb_t>(nb,t,&vv,1,0)); }
-piw::data_nb_t piw::pathprepend_nb_ex(unsigned nb,const data_nb_t &d, unsigned p) { return (__pathprepend_chaff<data_nb_t>(nb,d,p)); }
+piw::data_nb_t piw::pathprepend_nb_ex(unsigned nb,const data_nb_t &d, unsigned p) { unsigned char pp=p; return (__pathprepend_chaff<data_nb_t>(nb,d,&pp,1)); }
+piw::data_nb_t piw::pathprepend_nb_ex(unsigned nb,const data_nb_t &d, const unsigned char *p, unsigned l) { return (__pathprepend_chaff<data_nb_t>(nb,d,p,l)); }
 piw::data_nb_t piw::pathtwo_nb_ex(unsigned nb,unsigned v1,unsigned v2,unsigned long long t) { return pathprepend_nb_ex(nb,pathone_nb_ex(nb,v2,t),v1); }
 piw::data_nb_t piw::pathprepend_grist_nb_ex(unsigned nb,const data_nb_t &d, unsigned p) { return (__pathprepend_grist<data_nb_t>(nb,d,p)); }
 piw::data_nb_t piw::pathappend_chaff_nb_ex(unsigned nb,const data_nb_t &d, unsigned p) { return (__pathappend_chaff<data_nb_t>(nb,d,p)); }
@@ -890,10 +891,148 @@ int piw::data_base_t::compare(const data_base_t &other, bool ts) const
     return memcmp(bct_data_data(a), bct_data_data(b), al);
 }
 
+/*
+ * Path interning.  Each distinct path gets a small id, which is cached in
+ * the data header, so equality of interned paths is an integer compare.
+ *
+ * The table is fixed size and entries are never removed, so ids are stable
+ * for the life of the process; it only ever fills up, and is never
+ * reclaimed.  Slots are claimed with a compare and swap and published once
+ * the key is written, so any thread, including the fast thread, can intern
+ * without locking or allocating.  Paths too long for a slot, or arriving
+ * once the table is full, aren't interned and their id is 0; the header
+ * remembers this as INTERN_NONE so they aren't looked up again.
+ *
+ * A lookup that meets a slot still being written waits a bounded time for
+ * it, since the writer may be a thread preempted by the one waiting.  If it
+ * gives up the id is 0 for that call only, and isn't cached.
+ */
+
+#define INTERN_SLOTS 16384
+#define INTERN_KEYLEN 23
+#define INTERN_PROBES 64
+#define INTERN_SPINS 1000
+#define INTERN_NONE (~0U)
+
+#define INTERN_EMPTY 0
+#define INTERN_WRITING 1
+#define INTERN_READY 2
+
+namespace
+{
+    struct internslot_t
+    {
+        pic_atomic_t state;
+        unsigned hash;
+        unsigned char len;
+        unsigned char key[INTERN_KEYLEN];
+    };
+
+    internslot_t intern__[INTERN_SLOTS];
+}
+
+// the id of a path, INTERN_NONE if it can't be interned, or 0 if it wasn't
+// possible to tell.
+
+static unsigned __intern_lookup(const unsigned char *p, unsigned l)
+{
+    if(l>INTERN_KEYLEN)
+    {
+        return INTERN_NONE;
+    }
+
+    unsigned h = 2166136261U;
+
+    for(unsigned i=0; i<l; ++i)
+    {
+        h = (h^p[i])*16777619U;
+    }
+
+    for(unsigned n=0; n<INTERN_PROBES; ++n)
+    {
+        unsigned i = (h+n)&(INTERN_SLOTS-1);
+        internslot_t *s = &intern__[i];
+
+        if(s->state==INTERN_EMPTY)
+        {
+            if(pic_atomiccas(&s->state,INTERN_EMPTY,INTERN_WRITING))
+            {
+                s->hash=h;
+                s->len=l;
+                memcpy(s->key,p,l);
+                pic_atomiccas(&s->state,INTERN_WRITING,INTERN_READY);
+                return i+1;
+            }
+        }
+
+        // another thread is writing this slot, and may be writing this path.
+
+        for(unsigned spins=0; s->state==INTERN_WRITING; ++spins)
+        {
+            if(spins==INTERN_SPINS)
+            {
+                return 0;
+            }
+        }
+
+        pic_atomicbarrier();
+
+        if(s->hash==h && s->len==l && memcmp(s->key,p,l)==0)
+        {
+            return i+1;
+        }
+    }
+
+    return INTERN_NONE;
+}
+
+unsigned piw::intern_path(const unsigned char *p, unsigned l)
+{
+    unsigned id = __intern_lookup(p,l);
+    return id==INTERN_NONE ? 0 : id;
+}
+
+unsigned piw::data_base_t::as_pathid() const
+{
+    if(!is_path())
+    {
+        return 0;
+    }
+
+    // racing threads can only store the same id here
+
+    unsigned id = _rep->host_hdr.intern;
+
+    if(!id)
+    {
+        id = __intern_lookup(as_path(),as_pathlen());
+        _rep->host_hdr.intern = id;
+    }
+
+    return id==INTERN_NONE ? 0 : id;
+}
+
+bool piw::data_base_t::same_path(const data_base_t &other) const
+{
+    unsigned a = as_pathid();
+    unsigned b = other.as_pathid();
+
+    if(a && b)
+    {
+        return a==b;
+    }
+
+    return compare_path(other)==0;
+}
+
 int piw::data_base_t::compare_path(const data_base_t &other) const
 {
     if(!is_path() || !other.is_path()) return -1;
 
+    unsigned ai=_rep->host_hdr.intern;
+
+    if(ai && ai!=INTERN_NONE && ai==other._rep->host_hdr.intern) return 0;
+
     unsigned al=as_pathlen();
     unsigned bl=other.as_pathlen();
 
@@ -0,0 +1,216 @@
+
+/*
+ Copyright 2009 Eigenlabs Ltd.  http://www.eigenlabs.com
+
+ This file is part of EigenD.
+
+ EigenD is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ EigenD is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with EigenD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <piw/piw_offline.h>
+#include <piw/piw_wavrecorder.h>
+#include <piw/piw_thing.h>
+#include <piw/piw_tsd.h>
+#include <piw/piw_clock.h>
+#include <picross/pic_time.h>
+
+/*
+ * Buffers ticked per visit to the fast thread.  Between slices the fast
+ * thread services anything else queued to it, such as data arriving from
+ * other agents.
+ */
+
+#define SLICE 32
+
+/*
+ * Tick n is at start+n buffers.  start is the time the render begins, or
+ * the end of the previous render if that is later, so that the render
+ * timeline only moves forwards.  The recorder is started at tick 2, by
+ * which time the source has primed its tick interval however it was left
+ * by any previous render, so recording always begins on the buffer
+ * following tick 2.  It is stopped at tick 2+buffers and closes its file
+ * on the tick after.
+ *
+ * A render runs ahead of real time.  The domain's sinks keep the render
+ * timeline apart from the live one (see sink_t::advance in pia_clock.cpp),
+ * so when the live source is restored they carry on from where they left
+ * it.
+ */
+
+#define RECORD_TICK 2
+
+struct piw::offline_t::impl_t: piw::clocksource_t, piw::thing_t, virtual public pic::lckobject_t
+{
+    impl_t(piw::clockdomain_ctl_t *d, const std::string &name): domain_(d), name_(piw::makestring(name.c_str())), recorder_(d), record_(recorder_.record()),
+        bs_(PLG_CLOCK_BUFFER_SIZE_DEFAULT), sr_(48000), rendering_(false), running_(false), tick_(0), buffers_(0), start_(0), end_(0), wall_(0), factor_(0)
+    {
+        piw::tsd_thing(this);
+        piw::tsd_clocksource(name_,bs_,sr_,this);
+    }
+
+    ~impl_t()
+    {
+        tracked_invalidate();
+        close_thing();
+        close_source();
+    }
+
+    unsigned long long when(unsigned long long n)
+    {
+        return start_+(n*bs_*1000000ULL)/sr_;
+    }
+
+    void render(unsigned bs, unsigned long sr, float seconds, const piw::change_t &done)
+    {
+        if(rendering_)
+        {
+            pic::logmsg() << "offline render already running";
+            return;
+        }
+
+        bs_ = std::max(1U,std::min(bs,(unsigned)PLG_CLOCK_BUFFER_SIZE));
+        sr_ = sr?sr:48000;
+
+        unsigned long long buffers = (unsigned long long)(seconds*sr_+bs_-1)/bs_;
+
+        set_details(bs_,sr_);
+        previous_ = domain_->get_source();
+        domain_->set_source(name_);
+        done_ = done;
+        rendering_ = true;
+
+        pic::logmsg() << "offline render of " << buffers << " buffers, bs=" << bs_ << " sr=" << sr_;
+        enqueue_fast(piw::makelong_nb(std::max(1ULL,buffers),piw::tsd_time()));
+    }
+
+    void thing_dequeue_fast(const piw::data_nb_t &d)
+    {
+        if(d.is_long())
+        {
+            if(running_)
+            {
+                return;
+            }
+
+            tick_ = 0;
+            buffers_ = d.as_long();
+            start_ = std::max(d.time(),end_);
+            wall_ = pic_microtime();
+            running_ = true;
+            record_(piw::makebool_nb(true,when(RECORD_TICK)));
+            slice();
+            return;
+        }
+
+        // stop early, finishing the buffer in progress
+
+        if(running_)
+        {
+            buffers_ = std::max(tick_,(unsigned long long)RECORD_TICK+1)-RECORD_TICK;
+        }
+    }
+
+    void thing_trigger_fast()
+    {
+        if(running_)
+        {
+            slice();
+        }
+    }
+
+    void slice()
+    {
+        for(unsigned i=0; i<SLICE; ++i)
+        {
+            unsigned long long n = tick_++;
+
+            clocksource_t::tick(when(n));
+
+            if(n==RECORD_TICK+buffers_)
+            {
+                record_(piw::makebool_nb(false,when(n)));
+            }
+
+            if(n>RECORD_TICK+buffers_)
+            {
+                finish();
+                return;
+            }
+        }
+
+        trigger_fast();
+    }
+
+    void finish()
+    {
+        unsigned long long wall = pic_microtime()-wall_;
+        float rendered = (float)(buffers_*bs_)/(float)sr_;
+
+        factor_ = wall?(1000000.0*rendered/(float)wall):0.0;
+        end_ = when(tick_-1);
+        running_ = false;
+        trigger_slow();
+    }
+
+    void thing_trigger_slow()
+    {
+        if(!rendering_ || running_)
+        {
+            return;
+        }
+
+        domain_->set_source(previous_.is_string()?previous_:piw::makestring("*"));
+        rendering_ = false;
+
+        pic::logmsg() << "offline render done: " << (buffers_*bs_) << " frames at " << factor_ << "x realtime";
+
+        piw::change_t done = done_;
+        done_.clear();
+        done(piw::makefloat(factor_));
+    }
+
+    void stop()
+    {
+        if(rendering_)
+        {
+            enqueue_fast(piw::makenull_nb());
+        }
+    }
+
+    piw::clockdomain_ctl_t *domain_;
+    piw::data_t name_;
+    piw::data_t previous_;
+    piw::wavrecorder_t recorder_;
+    piw::change_nb_t record_;
+    piw::change_t done_;
+    unsigned bs_;
+    unsigned long sr_;
+    bool rendering_;
+    bool running_;
+    unsigned long long tick_;
+    unsigned long long buffers_;
+    unsigned long long start_;
+    unsigned long long end_;
+    unsigned long long wall_;
+    float factor_;
+};
+
+piw::offline_t::offline_t(piw::clockdomain_ctl_t *d, const std::string &name): impl_(new impl_t(d,name)) {}
+piw::offline_t::~offline_t() { delete impl_; }
+void piw::offline_t::setfile(const char *filename) { impl_->recorder_.setfile(filename); }
+piw::cookie_t piw::offline_t::cookie() { return impl_->recorder_.cookie(); }
+void piw::offline_t::render(unsigned bs, unsigned long sr, float seconds, const piw::change_t &done) { impl_->render(bs,sr,seconds,done); }
+void piw::offline_t::stop() { impl_->stop(); }
+bool piw::offline_t::rendering() { return impl_->rendering_; }
+float piw::offline_t::realtime_factor() { return impl_->factor_; }
@@ -231,53 +231,45 @@ namespace
         }
     };
 
-    struct aggregation_filter3_t: virtual public pic::lckobject_t
-    {
-        unsigned s1_,s2_,s3_;
+    /*
+     * A filter that puts fixed components on the front of a path and
+     * passes anything else through.  Being a sink of its own rather than
+     * a callable lets prefix_filter() find out what it does.
+     */
 
-        aggregation_filter3_t(unsigned s1,unsigned s2,unsigned s3): s1_(s1), s2_(s2), s3_(s3) {}
+    struct prefix_filter_t: pic::sink_t<piw::data_nb_t(const piw::data_nb_t &)>
+    {
+        prefix_filter_t(): len_(0) {}
 
-        aggregation_filter3_t(const aggregation_filter3_t &o): s1_(o.s1_), s2_(o.s2_), s3_(o.s3_) {}
-        bool operator==(const aggregation_filter3_t &o) const { return s1_==o.s1_ && s2_==o.s2_ && s3_==o.s3_; }
-        aggregation_filter3_t &operator=(const aggregation_filter3_t &o) { s1_=o.s1_; s2_=o.s2_; s3_=o.s3_; return *this; }
+        void add(unsigned p)
+        {
+            PIC_ASSERT(len_<PIW_FILTER_MAXPREFIX);
+            prefix_[len_++] = p;
+        }
 
-        piw::data_nb_t operator()(const piw::data_nb_t &x) const
+        piw::data_nb_t invoke(const piw::data_nb_t &x) const
         {
-            if(!x.is_path())
+            if(!len_ || !x.is_path())
             {
                 return x;
             }
 
-            piw::data_nb_t d(x);
-            
-            if(s3_) d=pathprepend_nb(d,s3_);
-            if(s2_) d=pathprepend_nb(d,s2_);
-            if(s1_) d=pathprepend_nb(d,s1_);
-
-            return d;
+            return piw::pathprepend_nb(x,prefix_,len_);
         }
-    };
-
-    struct aggregation_filter_t: virtual public pic::lckobject_t
-    {
-        unsigned s_;
-
-        aggregation_filter_t(unsigned s): s_(s) {}
-
-        aggregation_filter_t(const aggregation_filter_t &o): s_(o.s_) {}
-        bool operator==(const aggregation_filter_t &o) const { return s_==o.s_; }
-        aggregation_filter_t &operator=(const aggregation_filter_t &o) { s_=o.s_; return *this; }
 
-        piw::data_nb_t operator()(const piw::data_nb_t &x) const
+        bool iscallable() const
         {
-            if(!x.is_path())
-            {
-                return x;
-            }
+            return true;
+        }
 
-            piw::data_nb_t d = pathprepend_nb(x,s_);
-            return d;
+        bool compare(const pic::sink_t<piw::data_nb_t(const piw::data_nb_t &)> *s_) const
+        {
+            const prefix_filter_t *s = dynamic_cast<const prefix_filter_t *>(s_);
+            return s && s->len_==len_ && memcmp(s->prefix_,prefix_,len_)==0;
         }
+
+        unsigned char prefix_[PIW_FILTER_MAXPREFIX];
+        unsigned len_;
     };
 
     struct signal_cnc_filter_t: virtual public pic::lckobject_t
@@ -394,12 +386,18 @@ piw::d2d_nb_t piw::grist_aggregation_filter(unsigned s)
 
 piw::d2d_nb_t piw::aggregation_filter(unsigned s)
 {
-    return piw::d2d_nb_t::callable(aggregation_filter_t(s));
+    prefix_filter_t *f = new prefix_filter_t;
+    f->add(s);
+    return piw::d2d_nb_t(pic::ref(f));
 }
 
 piw::d2d_nb_t piw::aggregation_filter3(unsigned s1, unsigned s2, unsigned s3)
 {
-    return piw::d2d_nb_t::callable(aggregation_filter3_t(s1,s2,s3));
+    prefix_filter_t *f = new prefix_filter_t;
+    if(s1) f->add(s1);
+    if(s2) f->add(s2);
+    if(s3) f->add(s3);
+    return piw::d2d_nb_t(pic::ref(f));
 }
 
 piw::d2d_nb_t piw::deaggregation_filter(unsigned s)
@@ -432,14 +430,22 @@ static piw::data_nb_t root_filter__(const piw::data_nb_t &d)
     return piw::pathnull_nb(d.time());
 }
 
-static piw::data_nb_t null_filter__(const piw::data_nb_t &d)
+piw::d2d_nb_t piw::null_filter()
 {
-    return d;
+    return piw::d2d_nb_t(pic::ref(new prefix_filter_t));
 }
 
-piw::d2d_nb_t piw::null_filter()
+int piw::prefix_filter(const d2d_nb_t &f, unsigned char *p)
 {
-    return piw::d2d_nb_t::callable(null_filter__);
+    const prefix_filter_t *pf = dynamic_cast<const prefix_filter_t *>(f.get_sink().ptr());
+
+    if(!pf)
+    {
+        return -1;
+    }
+
+    memcpy(p,pf->prefix_,pf->len_);
+    return pf->len_;
 }
 
 piw::d2d_nb_t piw::root_filter()
@@ -21,23 +21,42 @@
 #include <piw/piw_sample.h>
 #include <piw/piw_tsd.h>
 #include <picross/pic_error.h>
-#include <picross/pic_safeq.h>
+#include <picross/pic_ring.h>
+#include <picross/pic_thread.h>
+#include <picross/pic_time.h>
 #include <picross/pic_power.h>
 #include <errno.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+// samples are used straight from a mapping of the file where they can be,
+// which needs mmap and a file in the machine's byte order.
+#if !defined(PI_WINDOWS) && !defined(PI_BIGENDIAN)
+#define SAMPLE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #define BUFFERSIZE_CHARS  PIC_ALLOC_SLABSIZE
 #define BUFFERSIZE_SAMPLES (BUFFERSIZE_CHARS/2)
 #define BLOCKSIZE_SAMPLES 2048
 #define BUFFER_BLOCKS     14
 #define BUFFER_HEADROOM   (BUFFERSIZE_CHARS-BLOCKSIZE_SAMPLES*2*BUFFER_BLOCKS)
+#define MMAP_LIMIT        512 // Mb, arrays bigger than this are read
+#define READERS           4
+#define READ_RING         1024
+#define READ_PING         1000000ULL
 
 namespace
 {
     struct sample_buffer_t: virtual pic::atomic_counted_t, virtual pic::lckobject_t
     {
         sample_buffer_t(unsigned block, unsigned size,unsigned long long t);
+        sample_buffer_t(unsigned block, const short *data,unsigned long long t);
         ~sample_buffer_t();
 
         unsigned long long qtime() { return time_; }
@@ -52,24 +71,117 @@ namespace
     };
 
     typedef pic::ref_t<sample_buffer_t> sample_bufref_t;
+
+    /*
+     * The threads that do the reading for every sample array.  Audio
+     * threads put requests on a ring; whichever reader runs next moves
+     * them onto a heap ordered by when each buffer is due to be played, and
+     * takes the earliest.  A block needed in a couple of milliseconds
+     * doesn't wait behind lookahead that isn't needed for a while.  A
+     * request whose buffer nobody else holds any more, because the voice
+     * was released or moved on, is dropped without reading.
+     *
+     * An array's last outstanding request opens the array's drained_ gate
+     * under lock_, for an array being unloaded to wait on.  The array
+     * checks its count under lock_ too, so it can't be freed between the
+     * count reaching 0 and the gate opening.
+     */
+
+    struct readpool_t: pic::nocopy_t
+    {
+        struct request_t
+        {
+            bool operator>(const request_t &o) const
+            {
+                if(deadline!=o.deadline) return deadline>o.deadline;
+                return seq>o.seq;
+            }
+
+            unsigned long long deadline;
+            unsigned long seq;
+            piw::samplearray_t::impl_t *array;
+            sample_buffer_t *buffer;
+        };
+
+        struct reader_t: pic::thread_t
+        {
+            reader_t(readpool_t *p): pic::thread_t(PIC_THREAD_PRIORITY_HIGH), pool_(p) {}
+            void thread_main() { pool_->serve(); }
+            readpool_t *pool_;
+        };
+
+        readpool_t(unsigned n);
+        ~readpool_t();
+
+        bool add(piw::samplearray_t::impl_t *a, sample_buffer_t *b, unsigned long long deadline);
+        bool next(request_t &r);
+        void serve();
+        void done(piw::samplearray_t::impl_t *a);
+        void ping();
+
+        static readpool_t *attach(piw::samplearray_t::impl_t *a);
+        static void detach(piw::samplearray_t::impl_t *a);
+
+        pic::mpscring_t<request_t,READ_RING> ring_;
+        pic::semaphore_t pending_;
+        pic::mutex_t lock_;
+        std::vector<request_t> heap_;
+        std::vector<piw::samplearray_t::impl_t *> arrays_;
+        std::vector<reader_t *> readers_;
+        unsigned long seq_;
+        unsigned long long lastping_;
+        bool quit_;
+    };
+
+    unsigned mmap_limit__ = MMAP_LIMIT;
+    unsigned readers__ = READERS;
+    pic::mutex_t pool_lock__;
+    readpool_t *pool__ = 0;
+
+    // stats are updated by any reader
+    void atomic_max(pic_atomic_t *p, unsigned long long v)
+    {
+        pic_atomic_t n = (pic_atomic_t)std::min(v,0xffffffffULL);
+
+        for(;;)
+        {
+            pic_atomic_t o = *p;
+
+            if(n<=o || pic_atomiccas(p,o,n))
+            {
+                return;
+            }
+        }
+    }
 };
 
-struct piw::samplearray_t::impl_t: virtual pic::lckobject_t, pic::safe_worker_t
+struct piw::samplearray_t::impl_t: virtual pic::lckobject_t
 {
     impl_t(const char *filename, unsigned p, unsigned l);
-    bool ping();
+    void ping();
     sample_bufref_t allocate_buffer(unsigned o,unsigned long long t) const;
     sample_bufref_t get_block(unsigned o) const;
     void __get_block(unsigned o, short *dst) const;
-    static void __reader(void *i_, void *dst_, void *, void *);
-    sample_bufref_t queue_read(unsigned o);
+    void read(sample_buffer_t *b, unsigned long long deadline);
+    sample_bufref_t queue_read(unsigned o, unsigned long long deadline);
     ~impl_t();
 
+#ifdef SAMPLE_MMAP
+    bool map_file();
+    void __prefetch(unsigned o) const;
+#endif
+
     std::string name;
     FILE *fd;
     unsigned size;
     unsigned offset;
-    unsigned long long max_total,max_sched,max_read,count,ocount;
+    pic_atomic_t max_total,max_sched,max_read;
+    pic_atomic_t count,ocount,late,cancelled,pending;
+    readpool_t *pool_;
+    pic::gate_t drained_;
+    char *map_;
+    size_t maplen_;
+    const short *base_;
 };
 
 struct piw::sample_t::impl_t: public pic::lckobject_t
@@ -88,6 +200,7 @@ struct piw::sample_t::impl_t: public pic::lckobject_t
 struct piw::samplereader_t::rimpl_t: virtual public pic::lckobject_t
 {
     rimpl_t(const sampleref_t &sample);
+    unsigned long long deadline(unsigned nblk) const;
     void queue(sample_bufref_t &next, unsigned nblk);
     const short *bufptr0(unsigned blk, const sample_bufref_t &current, sample_bufref_t &next, sample_bufref_t &next2, sample_bufref_t &next3);
     const short *bufptr(unsigned offset);
@@ -100,6 +213,9 @@ struct piw::samplereader_t::rimpl_t: virtual public pic::lckobject_t
     bool looped_;
     unsigned last_block_;
     bool error_;
+    unsigned offset_;
+    unsigned long long now_;
+    double rate_;
 };
 
 piw::samplearray_t::samplearray_t(const char *filename, unsigned p, unsigned l): impl_(new impl_t(filename,p,l))
@@ -111,6 +227,16 @@ piw::samplearray_t::~samplearray_t()
     delete impl_;
 }
 
+unsigned long piw::samplearray_t::late_reads()
+{
+    return impl_->late;
+}
+
+unsigned long piw::samplearray_t::cancelled_reads()
+{
+    return impl_->cancelled;
+}
+
 piw::samplereader_t::samplereader_t(const sampleref_t &sample): impl_(new piw::samplereader_t::rimpl_t(sample))
 {
 }
@@ -199,9 +325,17 @@ sample_buffer_t::sample_buffer_t(unsigned block, unsigned size,unsigned long lon
     data_=(short *)piw::tsd_alloc(PIC_ALLOC_NB,PIC_ALLOC_SLABSIZE,&dealloc_,&deallocarg_);
 }
 
+// a buffer onto a mapped array.  valid_ is only set once its pages are in.
+sample_buffer_t::sample_buffer_t(unsigned block, const short *data,unsigned long long t): size_(BUFFERSIZE_CHARS), data_((short *)data), valid_(false), block_(block), time_(t), dealloc_(0), deallocarg_(0)
+{
+}
+
 sample_buffer_t::~sample_buffer_t()
 {
-    dealloc_(data_,deallocarg_);
+    if(dealloc_)
+    {
+        dealloc_(data_,deallocarg_);
+    }
 }
 
 piw::samplearrayref_t piw::sample_t::data() { return impl_->data_; }
@@ -213,41 +347,323 @@ float piw::sample_t::samplerate() const { return impl_->samplerate_; }
 float piw::sample_t::rootfreq() const { return impl_->rootfreq_; }
 float piw::sample_t::attenuation() const { return impl_->attenuation_; }
 
-piw::samplearray_t::impl_t::impl_t(const char *filename, unsigned p, unsigned l): pic::safe_worker_t(1000,PIC_THREAD_PRIORITY_HIGH), name(filename), size(l/2), offset(p)
+void piw::set_sample_mmap_limit(unsigned mb)
+{
+    mmap_limit__ = mb;
+}
+
+void piw::set_sample_readers(unsigned n)
+{
+    readers__ = std::max(n,1U);
+}
+
+readpool_t::readpool_t(unsigned n): seq_(0), lastping_(0), quit_(false)
+{
+    heap_.reserve(READ_RING);
+
+    for(unsigned i=0; i<n; ++i)
+    {
+        reader_t *r = new reader_t(this);
+        readers_.push_back(r);
+        r->run();
+    }
+}
+
+readpool_t::~readpool_t()
+{
+    {
+        pic::mutex_t::guard_t g(lock_);
+        quit_ = true;
+    }
+
+    for(unsigned i=0; i<readers_.size(); ++i)
+    {
+        pending_.up();
+    }
+
+    for(unsigned i=0; i<readers_.size(); ++i)
+    {
+        readers_[i]->wait();
+        delete readers_[i];
+    }
+}
+
+readpool_t *readpool_t::attach(piw::samplearray_t::impl_t *a)
+{
+    pic::mutex_t::guard_t g(pool_lock__);
+
+    if(!pool__)
+    {
+        pool__ = new readpool_t(readers__);
+    }
+
+    pic::mutex_t::guard_t g2(pool__->lock_);
+    pool__->arrays_.push_back(a);
+    return pool__;
+}
+
+void readpool_t::detach(piw::samplearray_t::impl_t *a)
+{
+    pic::mutex_t::guard_t g(pool_lock__);
+
+    {
+        pic::mutex_t::guard_t g2(pool__->lock_);
+        pool__->arrays_.erase(std::find(pool__->arrays_.begin(),pool__->arrays_.end(),a));
+
+        if(!pool__->arrays_.empty())
+        {
+            return;
+        }
+    }
+
+    delete pool__;
+    pool__ = 0;
+}
+
+// fast thread.  the buffer reference is given.
+bool readpool_t::add(piw::samplearray_t::impl_t *a, sample_buffer_t *b, unsigned long long deadline)
+{
+    request_t r;
+    r.deadline = deadline;
+    r.seq = 0;
+    r.array = a;
+    r.buffer = b;
+
+    if(!ring_.push(r))
+    {
+        return false;
+    }
+
+    pending_.up();
+    return true;
+}
+
+bool readpool_t::next(request_t &r)
+{
+    pic::mutex_t::guard_t g(lock_);
+    request_t in[16];
+    unsigned n;
+
+    for(;;)
+    {
+        if(quit_)
+        {
+            return false;
+        }
+
+        while((n=ring_.pop_n(in,16))>0)
+        {
+            for(unsigned i=0; i<n; ++i)
+            {
+                in[i].seq = seq_++;
+                heap_.push_back(in[i]);
+                std::push_heap(heap_.begin(),heap_.end(),std::greater<request_t>());
+            }
+        }
+
+        if(!heap_.empty())
+        {
+            break;
+        }
+
+        // woken by a request whose producer hasn't quite finished putting
+        // it on the ring
+        g.unlock();
+        pic_thread_yield();
+        g.lock(lock_);
+    }
+
+    std::pop_heap(heap_.begin(),heap_.end(),std::greater<request_t>());
+    r = heap_.back();
+    heap_.pop_back();
+    return true;
+}
+
+void readpool_t::serve()
+{
+    request_t r;
+
+    for(;;)
+    {
+        if(pending_.timeddown(READ_PING))
+        {
+            if(!next(r))
+            {
+                return;
+            }
+
+            r.array->read(r.buffer,r.deadline);
+            done(r.array);
+        }
+        else if(quit_)
+        {
+            return;
+        }
+
+        ping();
+    }
+}
+
+void readpool_t::done(piw::samplearray_t::impl_t *a)
+{
+    pic::mutex_t::guard_t g(lock_);
+
+    if(pic_atomicdec(&a->pending)==0)
+    {
+        a->drained_.open();
+    }
+}
+
+void readpool_t::ping()
+{
+    if(pic_microtime()<lastping_+READ_PING)
+    {
+        return;
+    }
+
+    pic::mutex_t::guard_t g(lock_);
+    unsigned long long now = pic_microtime();
+
+    if(now<lastping_+READ_PING)
+    {
+        return;
+    }
+
+    lastping_ = now;
+
+    for(unsigned i=0; i<arrays_.size(); ++i)
+    {
+        arrays_[i]->ping();
+    }
+}
+
+piw::samplearray_t::impl_t::impl_t(const char *filename, unsigned p, unsigned l): name(filename), size(l/2), offset(p), map_(0), maplen_(0), base_(0)
 {
     fd = fopen(filename,"rb");
 
-    if(fd<0)
+    if(!fd)
     {
         pic::msg() << "Can't open " << filename << pic::hurl;
     }
 
-    max_total=0; max_sched=0; max_read=0; count=0; ocount=0;
-    run();
+#ifdef SAMPLE_MMAP
+    if(l/(1024*1024) < mmap_limit__ && (p&1)==0)
+    {
+        map_file();
+    }
+#endif
+
+    max_total=0; max_sched=0; max_read=0; count=0; ocount=0; late=0; cancelled=0; pending=0;
+    pool_ = readpool_t::attach(this);
+}
+
+#ifdef SAMPLE_MMAP
+
+/*
+ * Map the array, with a buffer's worth of space after it so that a buffer
+ * starting at any block can be used whole, as a read one can.  The space is
+ * reserved with an anonymous mapping and as much of it as the file covers
+ * is then mapped over from the file, so the tail past the end of the file
+ * reads as zeros rather than faulting.
+ */
+
+bool piw::samplearray_t::impl_t::map_file()
+{
+    struct stat st;
+    size_t page = sysconf(_SC_PAGESIZE);
+    off_t start = offset-(offset%page);
+    size_t len = (offset-start)+2*size+BUFFERSIZE_CHARS;
+
+    len = (len+page-1)-((len+page-1)%page);
+
+    if(fstat(fileno(fd),&st)<0 || st.st_size<=start)
+    {
+        return false;
+    }
+
+    void *m = mmap(0,len,PROT_READ,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+
+    if(m==MAP_FAILED)
+    {
+        pic::logmsg() << "can't map " << name << " " << errno << ", reading instead";
+        return false;
+    }
+
+    size_t flen = std::min((size_t)(st.st_size-start),len);
+
+    if(mmap(m,flen,PROT_READ,MAP_SHARED|MAP_FIXED,fileno(fd),start)==MAP_FAILED)
+    {
+        pic::logmsg() << "can't map " << name << " " << errno << ", reading instead";
+        munmap(m,len);
+        return false;
+    }
+
+    map_ = (char *)m;
+    maplen_ = len;
+    base_ = (const short *)(map_+(offset-start));
+    return true;
+}
+
+// the mapped version of a read: ask for the buffer's pages and then touch
+// each one so that it's in before the buffer is marked valid and the audio
+// thread gets to it.
+void piw::samplearray_t::impl_t::__prefetch(unsigned o) const
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    const char *b = (const char *)(base_+o*BLOCKSIZE_SAMPLES);
+    size_t a = (b-map_)%page;
+
+    madvise((void *)(b-a),BUFFERSIZE_CHARS+a,MADV_WILLNEED);
+
+    volatile char t = 0;
+
+    for(size_t i=0; i<BUFFERSIZE_CHARS+a; i+=page)
+    {
+        t += b[i-a];
+    }
+
+    t += b[BUFFERSIZE_CHARS-1];
 }
 
-bool piw::samplearray_t::impl_t::ping()
+#endif
+
+void piw::samplearray_t::impl_t::ping()
 {
     pic::disk_active();
 
     if(count!=ocount)
     {
         ocount=count;
-        pic::logmsg() << "buffer stats: max delay=" << max_total << " sched=" << max_sched << " read=" << max_read << " count=" << count;
+        pic::logmsg() << "buffer stats (" << (map_?"mapped":"read") << "): max delay=" << max_total << " sched=" << max_sched << " read=" << max_read << " count=" << count << " late=" << late << " cancelled=" << cancelled;
     }
-
-    return true;
 }
 
 sample_bufref_t piw::samplearray_t::impl_t::allocate_buffer(unsigned o,unsigned long long t) const
 {
+    if(map_)
+    {
+        return pic::ref(new sample_buffer_t(o,base_+o*BLOCKSIZE_SAMPLES,t));
+    }
+
     return pic::ref(new sample_buffer_t(o,BUFFERSIZE_CHARS,t));
 }
 
-// read c floats from disk
+// read c floats from disk.  this is a sample's start buffer, held for as
+// long as the sample is, so it's always a copy in slab memory: pages of a
+// mapping could be dropped long before the note that needs them.
 sample_bufref_t piw::samplearray_t::impl_t::get_block(unsigned o) const
 {
-    sample_bufref_t b = allocate_buffer(o,0);
+    sample_bufref_t b = pic::ref(new sample_buffer_t(o,BUFFERSIZE_CHARS,0));
+
+#ifdef SAMPLE_MMAP
+    if(map_)
+    {
+        memcpy(b->data_,base_+o*BLOCKSIZE_SAMPLES,BUFFERSIZE_CHARS);
+        b->valid_=true;
+        return b;
+    }
+#endif
+
     __get_block(o,b->data_);
     b->valid_=true;
     return b;
@@ -255,6 +671,14 @@ sample_bufref_t piw::samplearray_t::impl_t::get_block(unsigned o) const
 
 void piw::samplearray_t::impl_t::__get_block(unsigned o, short *dst) const
 {
+#ifdef SAMPLE_MMAP
+    if(map_)
+    {
+        __prefetch(o);
+        return;
+    }
+#endif
+
     if(fseek(fd,offset+o*BLOCKSIZE_SAMPLES*2,SEEK_SET)<0)
     {
         pic::logmsg() << "seek error " << name << " " << errno;
@@ -289,41 +713,83 @@ void piw::samplearray_t::impl_t::__get_block(unsigned o, short *dst) const
 #endif
 }
 
-void piw::samplearray_t::impl_t::__reader(void *i_, void *dst_, void *, void *)
+// reader thread.  the buffer reference is given.
+void piw::samplearray_t::impl_t::read(sample_buffer_t *b, unsigned long long deadline)
 {
-    unsigned long long t2=piw::tsd_time();
-    sample_bufref_t buf = sample_bufref_t::from_given((sample_buffer_t *)dst_);
-    impl_t *impl = (impl_t *)i_;
+    unsigned long long t2=pic_microtime();
+    sample_bufref_t buf = sample_bufref_t::from_given(b);
 
-    if(buf->count()==0)
+    if(buf->count()==1)
     {
-        //pic::logmsg() << "read aborted " << buf->block_;
+        //pic::logmsg() << "read cancelled " << buf->block_;
+        buf.clear();
+        pic_atomicinc(&cancelled);
         return;
     }
 
-    impl->__get_block(buf->block_,buf->data_);
-    unsigned long long t3=piw::tsd_time();
+    __get_block(buf->block_,buf->data_);
+    unsigned long long t3=pic_microtime();
     unsigned long long tb = buf->qtime();
     buf->valid_=true;
+    buf.clear();
     //pic::logmsg() << "read completed " << buf->block_;
-    impl->count++;
-    if(t2-tb>impl->max_sched) impl->max_sched=t2-tb;
-    if(t3-t2>impl->max_read) impl->max_read=t3-t2;
-    if(t3-tb>impl->max_total) impl->max_total=t3-tb;
+    pic_atomicinc(&count);
+    if(t3>deadline) pic_atomicinc(&late);
+    atomic_max(&max_sched,t2-tb);
+    atomic_max(&max_read,t3-t2);
+    atomic_max(&max_total,t3-tb);
 }
 
-sample_bufref_t piw::samplearray_t::impl_t::queue_read(unsigned o)
+// fast thread.  an invalid buffer if the request can't be queued; the
+// reader asks again next time round.
+sample_bufref_t piw::samplearray_t::impl_t::queue_read(unsigned o, unsigned long long deadline)
 {
     //pic::logmsg() << "queue read " << o;
     sample_bufref_t b = allocate_buffer(o,piw::tsd_time());
-    add(__reader,this, b.give(), 0, 0);
+    pic_atomicinc(&pending);
+
+    if(!pool_->add(this,b.give(),deadline))
+    {
+        pic_atomicdec(&pending);
+        b->decref();
+        return sample_bufref_t();
+    }
+
     return b;
 }
 
 piw::samplearray_t::impl_t::~impl_t()
 {
     pic::logmsg() << "unloading sampler";
-    quit();
+
+    // nothing queues reads on an array being unloaded, so the count only
+    // goes down from here.
+
+    for(;;)
+    {
+        {
+            pic::mutex_t::guard_t g(pool_->lock_);
+
+            if(!pending)
+            {
+                break;
+            }
+
+            drained_.shut();
+        }
+
+        drained_.untimedpass();
+    }
+
+    readpool_t::detach(this);
+
+#ifdef SAMPLE_MMAP
+    if(map_)
+    {
+        munmap(map_,maplen_);
+    }
+#endif
+
     fclose(fd);
 }
 
@@ -332,8 +798,10 @@ piw::sample_t::impl_t::impl_t(const samplearrayref_t &d,unsigned s, unsigned e,
     start_buffer_ = data_->impl()->get_block(start_/BLOCKSIZE_SAMPLES);
 }
 
-piw::samplereader_t::rimpl_t::rimpl_t(const sampleref_t &sample): sample_(sample), error_(true)
+piw::samplereader_t::rimpl_t::rimpl_t(const sampleref_t &sample): sample_(sample), error_(true), offset_(0), now_(0)
 {
+    rate_ = ((sample_->samplerate()>0.f) ? sample_->samplerate() : 48000.f)/1000000.0;
+
     array_ = sample_->data()->impl();
     start_buffer_ = sample_->impl()->start_buffer_;
     looped_ = (sample_->loopend()!=0);
@@ -353,6 +821,30 @@ piw::samplereader_t::rimpl_t::rimpl_t(const sampleref_t &sample): sample_(sample
     }
 }
 
+/*
+ * When block nblk will be wanted, going by where the reader is and how fast
+ * it has been moving through the sample.  A block behind the reader in a
+ * looped sample is wanted after the loop goes round.
+ */
+
+unsigned long long piw::samplereader_t::rimpl_t::deadline(unsigned nblk) const
+{
+    unsigned at = nblk*BLOCKSIZE_SAMPLES;
+    double ahead = 0;
+
+    if(at>=offset_)
+    {
+        ahead = at-offset_;
+    }
+    else if(looped_)
+    {
+        if(sample_->loopend()>offset_) ahead += sample_->loopend()-offset_;
+        if(at>sample_->loopstart()) ahead += at-sample_->loopstart();
+    }
+
+    return now_+(unsigned long long)(ahead/rate_);
+}
+
 void piw::samplereader_t::rimpl_t::queue(sample_bufref_t &next, unsigned nblk)
 {
     if(nblk>end_block_)
@@ -372,7 +864,7 @@ void piw::samplereader_t::rimpl_t::queue(sample_bufref_t &next, unsigned nblk)
             }
             else
             {
-                next=array_->queue_read(nblk);
+                next=array_->queue_read(nblk,deadline(nblk));
                 loop_buffer1_=next;
             }
             return;
@@ -387,7 +879,7 @@ void piw::samplereader_t::rimpl_t::queue(sample_bufref_t &next, unsigned nblk)
             }
             else
             {
-                next=array_->queue_read(nblk);
+                next=array_->queue_read(nblk,deadline(nblk));
                 loop_buffer2_=next;
             }
             return;
@@ -396,7 +888,7 @@ void piw::samplereader_t::rimpl_t::queue(sample_bufref_t &next, unsigned nblk)
 
     if(!next.isvalid() || next->block_!=nblk)
     {
-        next=array_->queue_read(nblk);
+        next=array_->queue_read(nblk,deadline(nblk));
     }
     else
     {
@@ -464,6 +956,16 @@ const short *piw::samplereader_t::rimpl_t::bufptr(unsigned offset)
     unsigned blk = offset/BLOCKSIZE_SAMPLES;
     unsigned ind = offset%BLOCKSIZE_SAMPLES;
     const short *ptr;
+    unsigned long long now = piw::tsd_time();
+
+    // samples per microsecond, smoothed.  loops going round are ignored.
+    if(now_ && now>now_ && offset>offset_)
+    {
+        rate_ += 0.25*((double)(offset-offset_)/(double)(now-now_)-rate_);
+    }
+
+    offset_ = offset;
+    now_ = now;
 
     if((ptr=bufptr0(blk,buffer1_,buffer2_,buffer3_,buffer4_))!=0)
     {
@@ -35,6 +35,7 @@
 #include <vector>
 #include <set>
 #include <cmath>
+#include <algorithm>
 
 #define ET_NULL 0
 #define ET_EDGEGOOD 1
@@ -69,6 +70,7 @@ namespace
     };
 
     struct clkevent_t;
+    struct eventq_t;
 
     struct edge_constraint_t
     {
@@ -84,7 +86,7 @@ namespace
         void edge_bad(unsigned long long t);
         void edge_good(unsigned long long t);
 
-        void event(std::multimap<std::pair<unsigned char,unsigned long long>, clkevent_t> &q, unsigned long long event_time, float event_value);
+        void event(eventq_t &q, unsigned long long event_time, float event_value);
 
         void update_edge(float v)
         {
@@ -112,7 +114,7 @@ namespace
         mod_constraint_t(): armed_(false) {}
         virtual ~mod_constraint_t() {}
 
-        virtual void event(std::multimap<std::pair<unsigned char,unsigned long long>, clkevent_t> &q, unsigned long long event_time, float event_value) = 0;
+        virtual void event(eventq_t &q, unsigned long long event_time, float event_value) = 0;
 
         bool armed_;
     };
@@ -123,7 +125,7 @@ namespace
         {
         }
 
-        void event(std::multimap<std::pair<unsigned char,unsigned long long>, clkevent_t> &q, unsigned long long event_time, float event_value);
+        void event(eventq_t &q, unsigned long long event_time, float event_value);
         void mod(unsigned long long t);
 
         eventimpl_t *event_;
@@ -138,7 +140,7 @@ namespace
         {
         }
 
-        void event(std::multimap<std::pair<unsigned char,unsigned long long>, clkevent_t> &q, unsigned long long event_time, float event_value);
+        void event(eventq_t &q, unsigned long long event_time, float event_value);
 
         void zone_good(unsigned long long t);
         void zone_bad(unsigned long long t);
@@ -189,9 +191,83 @@ namespace
         unsigned long long time;
     };
 
+    /*
+     * Events found by a sweep, taken out in order of priority, then time,
+     * then the order they were found in.  A binary heap whose storage is
+     * kept from sweep to sweep, so it only allocates when a sweep finds
+     * more events than any before it.
+     */
+
+    struct eventq_t
+    {
+        struct entry_t
+        {
+            entry_t(unsigned char p, unsigned long long t, unsigned s, const clkevent_t &e): pri(p), time(t), seq(s), event(e) {}
+
+            bool operator>(const entry_t &o) const
+            {
+                if(pri!=o.pri) return pri>o.pri;
+                if(time!=o.time) return time>o.time;
+                return seq>o.seq;
+            }
+
+            unsigned char pri;
+            unsigned long long time;
+            unsigned seq;
+            clkevent_t event;
+        };
+
+        eventq_t(): seq_(0)
+        {
+            heap_.reserve(256);
+        }
+
+        bool empty() const
+        {
+            return heap_.empty();
+        }
+
+        void push(unsigned char pri, unsigned long long time, const clkevent_t &e)
+        {
+            heap_.push_back(entry_t(pri,time,seq_++,e));
+            std::push_heap(heap_.begin(),heap_.end(),std::greater<entry_t>());
+        }
+
+        clkevent_t pop()
+        {
+            std::pop_heap(heap_.begin(),heap_.end(),std::greater<entry_t>());
+            clkevent_t e = heap_.back().event;
+            heap_.pop_back();
+
+            if(heap_.empty())
+            {
+                seq_ = 0;
+            }
+
+            return e;
+        }
+
+        std::vector<entry_t> heap_;
+        unsigned seq_;
+    };
+
+    /*
+     * Edge values in a sorted array.  cursor_ is the first entry at or
+     * above current_clock_, so a sweep carries on from where the last one
+     * stopped; it is found again by binary search only after a reset, a
+     * change to the table, or the clock moving backwards.
+     */
+
     struct edge_table_t
     {
-        edge_table_t()
+        typedef std::pair<float, edge_constraint_t *> entry_t;
+
+        static bool entry_less(const entry_t &a, const entry_t &b)
+        {
+            return a.first<b.first;
+        }
+
+        edge_table_t(): cursor_(0), cursor_valid_(false), current_timestamp_(0), current_clock_(0)
         {
         }
 
@@ -207,18 +283,29 @@ namespace
         {
             current_timestamp_ = next_stamp;
             current_clock_ = next_clock;
+            cursor_valid_ = false;
         }
 
-        void sweep(std::multimap<std::pair<unsigned char,unsigned long long>, clkevent_t> &q, unsigned long long ubound_time, float ubound_clock)
+        void sweep(eventq_t &q, unsigned long long ubound_time, float ubound_clock)
         {
             //pic::logmsg() << "table sweep time " << current_timestamp_ << "-" << ubound_time << " clk " << current_clock_ << "-" << ubound_clock;
-            std::multimap<float, edge_constraint_t *>::iterator ei=table_.lower_bound(current_clock_);
+            if(!cursor_valid_)
+            {
+                cursor_ = std::lower_bound(table_.begin(),table_.end(),entry_t(current_clock_,0),entry_less)-table_.begin();
+                cursor_valid_ = true;
+            }
+
+            while(cursor_<table_.size() && table_[cursor_].first<ubound_clock)
+            {
+                const entry_t &e(table_[cursor_]);
+                unsigned long long event_time = (unsigned long long)interp(e.first,ubound_time,ubound_clock);
+                e.second->event(q,event_time,e.first);
+                cursor_++;
+            }
 
-            while(ei!=table_.end() && ei->first<ubound_clock)
+            if(ubound_clock<current_clock_)
             {
-                unsigned long long event_time = (unsigned long long)interp(ei->first,ubound_time,ubound_clock);
-                ei->second->event(q,event_time,ei->first);
-                ei++;
+                cursor_valid_ = false;
             }
 
             current_clock_ = ubound_clock;
@@ -227,21 +314,21 @@ namespace
 
         void insert_edge(float v, edge_constraint_t *x)
         {
-            table_.insert(std::make_pair(v,x));
+            entry_t e(v,x);
+            table_.insert(std::upper_bound(table_.begin(),table_.end(),e,entry_less),e);
+            cursor_valid_ = false;
         }
 
         void remove_edge(float v, edge_constraint_t *x)
         {
-            std::multimap<float, edge_constraint_t *>::iterator i,e;
-
-            e=table_.end();
-            i=table_.lower_bound(v);
+            std::vector<entry_t>::iterator i = std::lower_bound(table_.begin(),table_.end(),entry_t(v,0),entry_less);
 
-            while(i!=e && i->first == v)
+            while(i!=table_.end() && i->first == v)
             {
                 if(i->second==x)
                 {
                     table_.erase(i);
+                    cursor_valid_ = false;
                     break;
                 }
 
@@ -249,16 +336,38 @@ namespace
             }
         }
 
-        std::multimap<float, edge_constraint_t *> table_;
+        std::vector<entry_t> table_;
+        unsigned cursor_;
+        bool cursor_valid_;
         unsigned long long current_timestamp_;
         float current_clock_;
     };
 
+    /*
+     * The points in one cycle of a modulo clock, sorted, ending with a
+     * sentinel at tablesize_ where the sweep wraps to the next cycle.  As
+     * with the edge table, the sweep keeps its place in cursor_ between
+     * calls.
+     */
+
     struct mod_table_t
     {
-        mod_table_t(unsigned size, unsigned long long t, float c): tablesize_(size)
+        struct entry_t
         {
-            table_.insert(std::make_pair(tablesize_,std::make_pair(tablesize_,(mod_constraint_t *)0)));
+            entry_t(float p, float r, mod_constraint_t *c): point(p), remainder(r), constraint(c) {}
+            float point;
+            float remainder;
+            mod_constraint_t *constraint;
+        };
+
+        static bool entry_less(const entry_t &a, const entry_t &b)
+        {
+            return a.point<b.point;
+        }
+
+        mod_table_t(unsigned size, unsigned long long t, float c): tablesize_(size), cursor_(0), cursor_valid_(false)
+        {
+            table_.push_back(entry_t(tablesize_,tablesize_,0));
             reset(t,c);
         }
 
@@ -268,23 +377,26 @@ namespace
             for(float i=remainder; i<tablesize_; i+=divisor)
             {
                 //pic::msg() << "table size=" << tablesize_ << " i=" << i << " cf=" << current_frame_ << " cr=" << current_remainder_ << " lr=" << last_remainder_ << pic::log;
-                table_.insert(std::make_pair(i,std::make_pair(remainder,mc)));
+                entry_t e(i,remainder,mc);
+                table_.insert(std::upper_bound(table_.begin(),table_.end(),e,entry_less),e);
                 if(i<=last_remainder_ && i>=current_remainder_)
                 {
                     mc->armed_ = false;
                 }
             }
+
+            cursor_valid_ = false;
         }
 
         void remove_constraint(mod_constraint_t *mc, float divisor, float remainder)
         {
             for(float i=remainder; i<tablesize_; i+=divisor)
             {
-                std::multimap<float,std::pair<float,mod_constraint_t *> >::iterator mi = table_.lower_bound(i);
+                std::vector<entry_t>::iterator mi = std::lower_bound(table_.begin(),table_.end(),entry_t(i,0,0),entry_less);
 
-                while(mi != table_.end() && mi->first==i)
+                while(mi != table_.end() && mi->point==i)
                 {
-                    if(mi->second.second==mc)
+                    if(mi->constraint==mc)
                     {
                         table_.erase(mi);
                         break;
@@ -293,6 +405,8 @@ namespace
                     mi++;
                 }
             }
+
+            cursor_valid_ = false;
         }
 
         float interp(float value, unsigned long long ubound_time, float ubound_clock)
@@ -303,41 +417,47 @@ namespace
             return ((double)usdist)*ratio+current_timestamp_;
         }
 
-        void sweep(std::multimap<std::pair<unsigned char,unsigned long long>, clkevent_t> &q, unsigned long long ubound_time, float ubound_clock)
+        void sweep(eventq_t &q, unsigned long long ubound_time, float ubound_clock)
         {
-            std::multimap<float,std::pair<float,mod_constraint_t *> >::iterator mi=table_.lower_bound(current_remainder_);
+            if(!cursor_valid_)
+            {
+                cursor_ = std::lower_bound(table_.begin(),table_.end(),entry_t(current_remainder_,0,0),entry_less)-table_.begin();
+                cursor_valid_ = true;
+            }
+
             //pic::logmsg() << "sweep utime: " << ubound_time << " uclk: " << ubound_clock;
 
             float c = current_clock_;
             while(c < ubound_clock)
             {
-                double event_clock = current_frame_*tablesize_+mi->first;
+                const entry_t &e(table_[cursor_]);
+                double event_clock = current_frame_*tablesize_+e.point;
                 if(event_clock >= ubound_clock)
                 {
                     break;
                 }
 
-                if(!mi->second.second)
+                if(!e.constraint)
                 {
-                    mi=table_.begin();
+                    cursor_=0;
                     current_frame_+=1;
                     current_remainder_=0;
                     continue;
                 }
 
-                if(mi->second.second->armed_)
+                if(e.constraint->armed_)
                 {
                     unsigned long long event_time = (unsigned long long)interp(event_clock,ubound_time,ubound_clock);
-                    mi->second.second->event(q,event_time,mi->second.first);
+                    e.constraint->event(q,event_time,e.remainder);
                 }
                 else
                 {
-                    mi->second.second->armed_ = true;
+                    e.constraint->armed_ = true;
                 }
 
-                mi++;
+                cursor_++;
 
-                current_remainder_=mi->first;
+                current_remainder_=table_[cursor_].point;
                 c = current_frame_*tablesize_+current_remainder_;
             }
 
@@ -353,11 +473,14 @@ namespace
             current_remainder_ = next_clock-current_frame_*tablesize_;
             current_clock_ = current_frame_*tablesize_+current_remainder_;
             last_remainder_=-1;
+            cursor_valid_=false;
             //pic::msg() << "table reset size=" << tablesize_ << " frame=" << current_frame_ << " clk=" << next_clock << " cc=" << current_clock_ << " cr=" << current_remainder_ << pic::log;
         }
 
-        std::multimap<float,std::pair<float,mod_constraint_t *> > table_;
+        std::vector<entry_t> table_;
         unsigned tablesize_;
+        unsigned cursor_;
+        bool cursor_valid_;
         unsigned long long current_timestamp_;
         unsigned long current_frame_;
         float current_clock_;
@@ -399,12 +522,15 @@ struct piw::event_t::impl_t: piw::thing_t
     static int __disable(void *e_, void *a_) { ((eventimpl_t *)e_)->disable(); return 0; }
     static int __enable(void *e_, void *a_) { ((eventimpl_t *)e_)->enable(); return 0; }
 
-    void call_clear() { piw::tsd_fastcall(__clear, this, 0); }
-    void call_lower(unsigned signal, float value) { fastarg_t a(signal,0,value,0); piw::tsd_fastcall(__lower, this, &a); }
-    void call_upper(unsigned signal, float value) { fastarg_t a(signal,0,value,0); piw::tsd_fastcall(__upper, this, &a); }
-    void call_zone(unsigned signal, unsigned divisor, float r1, float r2) { fastarg_t a(signal,divisor,r1,r2); piw::tsd_fastcall(__zone, this, &a); }
-    void call_modulo(unsigned signal, unsigned divisor, float remainder) { fastarg_t a(signal,divisor,remainder,0); piw::tsd_fastcall(__modulo, this, &a); }
-    void call_enable() { piw::tsd_fastcall(__enable, this, 0); enqueue_slow(piw::makebool(true,0)); }
+    // constraint changes don't wait for the fast thread.  disable waits,
+    // so that nothing queued is left behind when the event is destroyed.
+
+    void call_clear() { piw::tsd_fastcall_async(__clear, this, 0); }
+    void call_lower(unsigned signal, float value) { piw::tsd_fastcall_async_copy(__lower, this, fastarg_t(signal,0,value,0)); }
+    void call_upper(unsigned signal, float value) { piw::tsd_fastcall_async_copy(__upper, this, fastarg_t(signal,0,value,0)); }
+    void call_zone(unsigned signal, unsigned divisor, float r1, float r2) { piw::tsd_fastcall_async_copy(__zone, this, fastarg_t(signal,divisor,r1,r2)); }
+    void call_modulo(unsigned signal, unsigned divisor, float remainder) { piw::tsd_fastcall_async_copy(__modulo, this, fastarg_t(signal,divisor,remainder,0)); }
+    void call_enable() { piw::tsd_fastcall_async(__enable, this, 0); enqueue_slow(piw::makebool(true,0)); }
     void call_disable() { piw::tsd_fastcall(__disable, this, 0); enqueue_slow(piw::makebool(false,0)); }
 
     void mod(unsigned long long t, unsigned s);
@@ -532,7 +658,7 @@ namespace
             current_clock_ = c;
         }
 
-        void segment_next(std::multimap<std::pair<unsigned char,unsigned long long>, clkevent_t> &q, unsigned long long ubound_time, float ubound_clock)
+        void segment_next(eventq_t &q, unsigned long long ubound_time, float ubound_clock)
         {
             edge_table_.sweep(q,ubound_time,ubound_clock);
 
@@ -543,7 +669,7 @@ namespace
             }
         }
 
-        void clock_next(std::multimap<std::pair<unsigned char,unsigned long long>, clkevent_t> &q, unsigned long long ubound_time)
+        void clock_next(eventq_t &q, unsigned long long ubound_time)
         {
             while(current_stamp_<ubound_time)
             {
@@ -647,19 +773,16 @@ struct piw::scheduler_t::impl_t: piw::wire_t, piw::clockdomain_t, piw::clocksink
 
     void run_segment(unsigned long long now)
     {
-        std::multimap<std::pair<unsigned char,unsigned long long>, clkevent_t> q;
+        eventq_t &q(queue_);
 
         for(unsigned i=0;i<clkcount_;i++)
         {
             signals_[i]->clock_next(q,now);
         }
 
-        std::multimap<std::pair<unsigned char,unsigned long long>, clkevent_t>::iterator qi;
-
-        while((qi=q.begin())!= q.end())
+        while(!q.empty())
         {
-            clkevent_t e = qi->second;
-            q.erase(qi);
+            clkevent_t e = q.pop();
 
             switch(e.type)
             {
@@ -808,6 +931,7 @@ struct piw::scheduler_t::impl_t: piw::wire_t, piw::clockdomain_t, piw::clocksink
     piw::decoder_t decoder_;
     unsigned long sigmask_;
     piw::xevent_data_buffer_t::iter_t iterator_;
+    eventq_t queue_;
 };
 
 void piw::event_t::impl_t::clear()
@@ -1039,32 +1163,32 @@ void point_constraint_t::mod(unsigned long long t)
     event_->mod(t,signal_);
 }
 
-void zone_constraint_t::event(std::multimap<std::pair<unsigned char,unsigned long long>, clkevent_t> &q, unsigned long long event_time, float event_value)
+void zone_constraint_t::event(eventq_t &q, unsigned long long event_time, float event_value)
 {
     if(event_value==mod_remainder1)
     {
-        q.insert(std::make_pair(std::make_pair(5,event_time),clkevent_t(ET_ZONEGOOD,signal_,this,event_time)));
+        q.push(5,event_time,clkevent_t(ET_ZONEGOOD,signal_,this,event_time));
     }
     else
     {
-        q.insert(std::make_pair(std::make_pair(3,event_time),clkevent_t(ET_ZONEBAD,signal_,this,event_time)));
+        q.push(3,event_time,clkevent_t(ET_ZONEBAD,signal_,this,event_time));
     }
 }
 
-void point_constraint_t::event(std::multimap<std::pair<unsigned char,unsigned long long>, clkevent_t> &q, unsigned long long event_time, float event_value)
+void point_constraint_t::event(eventq_t &q, unsigned long long event_time, float event_value)
 {
-    q.insert(std::make_pair(std::make_pair(10,event_time),clkevent_t(ET_MOD,signal_,this,event_time)));
+    q.push(10,event_time,clkevent_t(ET_MOD,signal_,this,event_time));
 }
 
-void edge_constraint_t::event(std::multimap<std::pair<unsigned char,unsigned long long>, clkevent_t> &q, unsigned long long event_time, float event_value)
+void edge_constraint_t::event(eventq_t &q, unsigned long long event_time, float event_value)
 {
     if(edge_lower_)
     {
-        q.insert(std::make_pair(std::make_pair(5,event_time),clkevent_t(ET_EDGEGOOD,signal_,this,event_value,event_time)));
+        q.push(5,event_time,clkevent_t(ET_EDGEGOOD,signal_,this,event_value,event_time));
     }
     else
     {
-        q.insert(std::make_pair(std::make_pair(3,event_time),clkevent_t(ET_EDGEBAD,signal_,this,event_value,event_time)));
+        q.push(3,event_time,clkevent_t(ET_EDGEBAD,signal_,this,event_value,event_time));
     }
 }
 
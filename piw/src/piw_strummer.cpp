@@ -97,7 +97,7 @@ namespace
             void add_consumer(consumer_t *c);
             void del_consumer(consumer_t *c);
 
-            pic::lckmultimap_t<piw::data_nb_t, producer_t *,piw::path_less>::nbtype producers_;
+            pic::lckmultimap_t<piw::data_nb_t, producer_t *,piw::pathid_less>::nbtype producers_;
             pic::lckmultimap_t<piw::data_nb_t, consumer_t *>::nbtype consumers_;
     };
 
@@ -943,8 +943,8 @@ void correlator_t::add_consumer(consumer_t *c)
     for(int l=cidlen;l>=0;l--)
     {
         std::pair<
-            pic::lckmultimap_t<piw::data_nb_t,producer_t *,piw::path_less>::nbtype::const_iterator,
-            pic::lckmultimap_t<piw::data_nb_t,producer_t *,piw::path_less>::nbtype::const_iterator> range =
+            pic::lckmultimap_t<piw::data_nb_t,producer_t *,piw::pathid_less>::nbtype::const_iterator,
+            pic::lckmultimap_t<piw::data_nb_t,producer_t *,piw::pathid_less>::nbtype::const_iterator> range =
                 producers_.equal_range(piw::makepath_nb(cidpath,l));
 
         for(; range.first != range.second; range.first++)
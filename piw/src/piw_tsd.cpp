@@ -22,6 +22,8 @@
 #include <piw/piw_data.h>
 #include <picross/pic_log.h>
 #include <picross/pic_fastalloc.h>
+#include <picross/pic_thread.h>
+#include <picross/pic_atomic.h>
 #include <pibelcanto/plugin.h>
 
 namespace piw
@@ -235,6 +237,21 @@ void piw::tsd_dump()
     bct_entity_dump(e);
 }
 
+bool piw::tsd_clockstats_enable(bool f)
+{
+    bct_entity_t e = tsd_getcontext();
+    PIC_ASSERT(e);
+    return bct_entity_clockstats_enable(e,f?1:0)>0;
+}
+
+std::string piw::tsd_clockstats(bool reset)
+{
+    bct_entity_t e = tsd_getcontext();
+    PIC_ASSERT(e);
+    piw::data_t d = piw::data_t::from_given(bct_entity_clockstats(e,reset?1:0));
+    return d.is_string() ? d.as_stdstr() : std::string();
+}
+
 void piw::tsd_exit()
 {
     bct_entity_t e = tsd_getcontext();
@@ -359,6 +376,198 @@ int piw::tsd_fastcall4(int (*cb)(void *arg1, void *arg2, void *arg3, void *arg4)
     return bct_entity_fastcall(e,fastcaller4__,(void *)cb,&call);
 }
 
+/*
+ * A call queued with tsd_fastcall_async() or a fastbatch_t, and its
+ * result.  One reference belongs to the queued call and one to each
+ * fastfuture_t.  Copied arguments up to COPY_INLINE bytes are kept in the
+ * record itself, so a typical call costs a single allocation.  Batched
+ * calls are chained through next_ and go to the fast thread as one.
+ */
+
+#define COPY_INLINE 32
+
+struct piw::fastfuture_t::impl_t: virtual public pic::lckobject_t
+{
+    impl_t(int (*cb)(void *, void *), void *arg1, void *arg2): count_(1), done_(false), waited_(false), result_(-1), cb_(cb), arg1_(arg1), arg2_(arg2), copy_(0), next_(0) {}
+    ~impl_t() { if(copy_ && copy_!=inline_.c) pic::nb_free(copy_); }
+
+    void incref() { pic_atomicinc(&count_); }
+    void decref() { if(pic_atomicdec(&count_)==0) delete this; }
+    void complete(int r) { result_=r; done_=true; gate_.up(); }
+
+    void copy(const void *arg2, unsigned len)
+    {
+        copy_ = (len<=COPY_INLINE) ? inline_.c : pic::nb_malloc(PIC_ALLOC_NB,len);
+        memcpy(copy_,arg2,len);
+        arg2_ = copy_;
+    }
+
+    pic_atomic_t count_;
+    volatile bool done_;
+    bool waited_;
+    int result_;
+    pic::semaphore_t gate_;
+
+    int (*cb_)(void *, void *);
+    void *arg1_;
+    void *arg2_;
+    void *copy_;
+    union { char c[COPY_INLINE]; double d; void *p; } inline_;
+    impl_t *next_;
+};
+
+piw::fastfuture_t::fastfuture_t(impl_t *i): impl_(i)
+{
+    if(impl_) impl_->incref();
+}
+
+piw::fastfuture_t::fastfuture_t(const fastfuture_t &f): impl_(f.impl_)
+{
+    if(impl_) impl_->incref();
+}
+
+piw::fastfuture_t &piw::fastfuture_t::operator=(const fastfuture_t &f)
+{
+    if(f.impl_) f.impl_->incref();
+    if(impl_) impl_->decref();
+    impl_=f.impl_;
+    return *this;
+}
+
+piw::fastfuture_t::~fastfuture_t()
+{
+    if(impl_) impl_->decref();
+}
+
+bool piw::fastfuture_t::done() const
+{
+    return !impl_ || impl_->done_;
+}
+
+int piw::fastfuture_t::wait()
+{
+    if(!impl_)
+    {
+        return -1;
+    }
+
+    if(!impl_->waited_)
+    {
+        impl_->gate_.untimeddown();
+        impl_->waited_=true;
+    }
+
+    return impl_->result_;
+}
+
+// runs a chain of calls on the fast thread, and owns their references
+
+static int asynccaller__(bct_entity_t e, void *call_, void *)
+{
+    piw::tsd_setcontext(e);
+    piw::fastfuture_t::impl_t *call = (piw::fastfuture_t::impl_t *)call_;
+
+    while(call)
+    {
+        piw::fastfuture_t::impl_t *next = call->next_;
+        int r = -1;
+
+        try
+        {
+            r = (call->cb_)(call->arg1_,call->arg2_);
+        }
+        CATCHLOG()
+
+        call->complete(r);
+        call->decref();
+        call = next;
+    }
+
+    return 0;
+}
+
+static void post__(piw::fastfuture_t::impl_t *call)
+{
+    bct_entity_t e = piw::tsd_getcontext();
+    PIC_ASSERT(e);
+
+    if(bct_entity_fastcall_async(e,asynccaller__,call,0)<0)
+    {
+        while(call)
+        {
+            piw::fastfuture_t::impl_t *next = call->next_;
+            call->complete(-1);
+            call->decref();
+            call = next;
+        }
+    }
+}
+
+piw::fastfuture_t piw::tsd_fastcall_async(int (*cb)(void *arg1, void *arg2), void *arg1, void *arg2)
+{
+    fastfuture_t::impl_t *call = new fastfuture_t::impl_t(cb,arg1,arg2);
+    fastfuture_t f(call);
+    post__(call);
+    return f;
+}
+
+piw::fastfuture_t piw::tsd_fastcall_async_copy(int (*cb)(void *arg1, void *arg2), void *arg1, const void *arg2, unsigned len)
+{
+    fastfuture_t::impl_t *call = new fastfuture_t::impl_t(cb,arg1,0);
+    call->copy(arg2,len);
+    fastfuture_t f(call);
+    post__(call);
+    return f;
+}
+
+piw::fastbatch_t::~fastbatch_t()
+{
+    post();
+}
+
+piw::fastfuture_t piw::fastbatch_t::append(fastfuture_t::impl_t *call)
+{
+    if(tail_)
+    {
+        tail_->next_ = call;
+    }
+    else
+    {
+        head_ = call;
+    }
+
+    tail_ = call;
+    size_++;
+    return fastfuture_t(call);
+}
+
+piw::fastfuture_t piw::fastbatch_t::add(int (*cb)(void *arg1, void *arg2), void *arg1, void *arg2)
+{
+    return append(new fastfuture_t::impl_t(cb,arg1,arg2));
+}
+
+piw::fastfuture_t piw::fastbatch_t::add_copy(int (*cb)(void *arg1, void *arg2), void *arg1, const void *arg2, unsigned len)
+{
+    fastfuture_t::impl_t *call = new fastfuture_t::impl_t(cb,arg1,0);
+    call->copy(arg2,len);
+    return append(call);
+}
+
+piw::fastfuture_t piw::fastbatch_t::post()
+{
+    if(!head_)
+    {
+        return fastfuture_t();
+    }
+
+    fastfuture_t f(tail_);
+    fastfuture_t::impl_t *call = head_;
+    head_ = tail_ = 0;
+    size_ = 0;
+    post__(call);
+    return f;
+}
+
 void piw::tsd_alert(const char *k, const char *l, const char *m)
 {
     bct_entity_t e = tsd_getcontext();
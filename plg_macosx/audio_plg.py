@@ -18,7 +18,7 @@
 # along with EigenD.  If not, see <http://www.gnu.org/licenses/>.
 #
 
-from pi import agent,atom,domain,utils,paths,bundles,action,logic,node,upgrade,resource,files,policy,errors,const
+from pi import agent,atom,domain,utils,paths,bundles,action,logic,node,upgrade,resource,files,policy,errors,const,async
 from plg_macosx import audio_version as version
 
 import piw
@@ -158,8 +158,10 @@ class Agent(agent.Agent):
         self.clone = piw.clone(True)
         self.audio = AudioDelegate(self,self.domain)
         self.recorder = piw.wavrecorder(self.domain)
+        self.offline = piw.offline(self.domain,'offline')
         self.clone.set_output(1,self.audio.cookie())
         self.clone.set_output(2,self.recorder.cookie())
+        self.clone.set_output(3,self.offline.cookie())
         self.input = bundles.ScalarInput(self.clone.cookie(), self.domain,signals=(1,2),threshold=0)
         self.__loading = False
 
@@ -182,6 +184,9 @@ class Agent(agent.Agent):
         self.__filename = resource.new_resource_file('audio','audio.wav')
         self.recorder.setfile(self.__filename)
 
+        self.__render_filename = resource.new_resource_file('audio','render.wav')
+        self.offline.setfile(self.__render_filename)
+
         self[10]=atom.Atom(domain=domain.Bool(),init=False,transient=True,policy=policy.FastPolicy(self.recorder.record(),policy.TriggerStreamPolicy()),protocols='nostage',names='recorder running input')
 
     def load_state(self,state,delegate,phase):
@@ -223,10 +228,30 @@ class Agent(agent.Agent):
             pass
         self.audio.reset_dropout_count()
 
+    def rpc_render(self,arg):
+        (seconds,sr,bs) = logic.parse_term(arg)
+
+        if self.offline.rendering():
+            return async.failure('already rendering')
+
+        r = async.Deferred()
+
+        def rendered(factor):
+            f = files.get_ideal(self.id(),'render',files.FileSystemFile(self.__render_filename,'render'),0)
+            r.succeeded(logic.render_term((f,factor.as_float())))
+
+        self.offline.render(int(bs or 0),int(sr or 0),float(seconds),utils.changify(rendered))
+        return r
+
+    def rpc_stop_render(self,arg):
+        self.offline.stop()
+
     def resolve_file_cookie(self,cookie):
         print 'resolve_file_cookie',cookie
         if cookie=='audio':
             return files.FileSystemFile(self.__filename,'audio')
+        if cookie=='render':
+            return files.FileSystemFile(self.__render_filename,'render')
         return agent.Agent.resolve_file_cookie(self,cookie)
 
     def rpc_resolve_ideal(self,arg):
@@ -94,7 +94,7 @@ namespace
         unsigned long long cfilterctl_inputs() { return 7; }
         unsigned long long cfilterctl_outputs() { return 3; }
 
-        pic::lckmap_t<piw::data_nb_t,piw::voiceref_t,piw::path_less>::nbtype id2voice_;
+        pic::lckmap_t<piw::data_nb_t,piw::voiceref_t,piw::pathid_less>::nbtype id2voice_;
         bool fade_;
         unsigned long long playercount_;
     };
@@ -114,7 +114,7 @@ struct sampler2::player_t::impl_t
 
 piw::voiceref_t playerctl_t::find_voice(const piw::data_nb_t &id)
 {
-    pic::lckmap_t<piw::data_nb_t,piw::voiceref_t,piw::path_less>::nbtype::iterator i;
+    pic::lckmap_t<piw::data_nb_t,piw::voiceref_t,piw::pathid_less>::nbtype::iterator i;
     piw::voiceref_t v;
 
     if((i=id2voice_.find(id))!=id2voice_.end())
@@ -0,0 +1,604 @@
+/*
+ Copyright 2009 Eigenlabs Ltd.  http://www.eigenlabs.com
+
+ This file is part of EigenD.
+
+ EigenD is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ EigenD is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with EigenD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <piagent/pia_scaffold.h>
+#include <piw/piw_tsd.h>
+#include <piw/piw_clock.h>
+#include <piw/piw_correlator.h>
+#include <piw/piw_fastdata.h>
+#include <piw/piw_velocitydetect.h>
+#include <piw/piw_aggregator.h>
+#include <piw/piw_mixer.h>
+#include <piw/piw_policy.h>
+#include <piw/piw_table.h>
+#include <picross/pic_time.h>
+
+#include "synth.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+/*
+ * Measures how many voices the synth graph can sustain, with no devices.
+ *
+ * A fake keyboard plays N keys at once, each with pressure, roll, yaw and
+ * key frequency streams updated every millisecond.  They feed the same
+ * graph a typical setup has: an envelope agent, an oscillator agent, a
+ * ladder filter agent and a console mixer, each behind its own
+ * correlator.  The connections between agents are made in process by
+ * link_t, which hands each wire's data queues to the next correlator as
+ * an agent connection would.
+ *
+ * A private clock source is ticked back to back with synthetic times, and
+ * each tick, which runs every clock sink in the domain, is timed on its
+ * own.  Percentiles are reported for each voice count, with the time to
+ * start all N notes.
+ *
+ * synthbench [max voices] [buffers per step] [buffer size] [sample rate]
+ */
+
+#define KEY_PRESSURE 1
+#define KEY_ROLL 2
+#define KEY_YAW 3
+#define KEY_FREQ 4
+#define KEY_SIGNALS 4
+
+// keys are laid out in courses of 100, as path course.key
+
+#define COURSE(k) (1+(k)/100)
+#define KEY(k) (1+(k)%100)
+
+#define WARMUP 64
+#define DRAIN_MS 2000
+
+namespace
+{
+    struct plumb_t
+    {
+        unsigned from;
+        unsigned to;
+        bool iso;
+    };
+
+    piw::converter_ref_t converter(bool iso)
+    {
+        return iso?piw::resampling_converter():piw::null_converter();
+    }
+
+    /*
+     * One signal of a key or of a linked wire.  It is the upstream of a
+     * correlator input, exactly as the fastdata of a remote output is.
+     */
+
+    struct sender_t: piw::fastdata_t
+    {
+        sender_t(): piw::fastdata_t(PLG_FASTDATA_SENDER)
+        {
+            piw::tsd_fastdata(this);
+            enable(true,false,false);
+        }
+    };
+
+    struct link_t;
+
+    struct link_wire_t: piw::wire_t, piw::event_data_sink_t, virtual public pic::lckobject_t
+    {
+        link_wire_t(link_t *l, const piw::event_data_source_t &es);
+        ~link_wire_t() { invalidate(); }
+        void wire_closed() { delete this; }
+        void invalidate();
+
+        void event_start(unsigned seq,const piw::data_nb_t &id, const piw::xevent_data_buffer_t &b);
+        bool event_end(unsigned long long t);
+        void event_buffer_reset(unsigned sig, unsigned long long t, const piw::dataqueue_t &o, const piw::dataqueue_t &n);
+
+        link_t *link_;
+        piw::data_t path_;
+        std::vector<sender_t *> senders_;
+    };
+
+    /*
+     * Connects the output of one agent to the correlator of the next,
+     * renumbering signals on the way.
+     */
+
+    struct link_t: piw::decode_ctl_t
+    {
+        link_t(piw::correlator_t *c, const plumb_t *p, unsigned n): decoder_(this), correlator_(c), plumbs_(p,p+n), clock_(0)
+        {
+        }
+
+        ~link_t()
+        {
+            decoder_.shutdown();
+        }
+
+        piw::cookie_t cookie() { return decoder_.cookie(); }
+
+        piw::wire_t *wire_create(const piw::event_data_source_t &es)
+        {
+            return new link_wire_t(this,es);
+        }
+
+        void set_clock(bct_clocksink_t *c)
+        {
+            if(clock_)
+            {
+                correlator_->clocksink()->remove_upstream(clock_);
+            }
+
+            clock_=c;
+
+            if(clock_)
+            {
+                correlator_->clocksink()->add_upstream(clock_);
+            }
+        }
+
+        void set_latency(unsigned) {}
+
+        piw::decoder_t decoder_;
+        piw::correlator_t *correlator_;
+        std::vector<plumb_t> plumbs_;
+        bct_clocksink_t *clock_;
+    };
+
+    link_wire_t::link_wire_t(link_t *l, const piw::event_data_source_t &es): link_(l), path_(es.path())
+    {
+        for(unsigned i=0; i<link_->plumbs_.size(); ++i)
+        {
+            const plumb_t &p(link_->plumbs_[i]);
+            sender_t *s = new sender_t;
+            senders_.push_back(s);
+            link_->correlator_->plumb_input(p.to,1,path_,-1,INPUT_INPUT,s,converter(p.iso),piw::null_filter());
+        }
+
+        subscribe(es);
+    }
+
+    void link_wire_t::invalidate()
+    {
+        unsubscribe();
+
+        if(link_)
+        {
+            for(unsigned i=0; i<senders_.size(); ++i)
+            {
+                link_->correlator_->unplumb_input(link_->plumbs_[i].to,1,path_,-1);
+                delete senders_[i];
+            }
+
+            senders_.clear();
+            link_=0;
+        }
+    }
+
+    void link_wire_t::event_start(unsigned seq,const piw::data_nb_t &id, const piw::xevent_data_buffer_t &b)
+    {
+        for(unsigned i=0; i<senders_.size(); ++i)
+        {
+            senders_[i]->send_fast(id,b.signal(link_->plumbs_[i].from));
+        }
+    }
+
+    void link_wire_t::event_buffer_reset(unsigned sig, unsigned long long t, const piw::dataqueue_t &o, const piw::dataqueue_t &n)
+    {
+        for(unsigned i=0; i<senders_.size(); ++i)
+        {
+            if(link_->plumbs_[i].from==sig)
+            {
+                senders_[i]->send_fast(current_id(),n);
+            }
+        }
+    }
+
+    bool link_wire_t::event_end(unsigned long long t)
+    {
+        for(unsigned i=0; i<senders_.size(); ++i)
+        {
+            senders_[i]->send_fast(piw::makenull_nb(t),piw::dataqueue_t());
+        }
+
+        return true;
+    }
+
+    /*
+     * A keyboard with one wire per key and a sender per signal per key.
+     */
+
+    struct key_t
+    {
+        sender_t senders_[KEY_SIGNALS];
+        piw::dataqueue_t queues_[KEY_SIGNALS];
+        float freq_;
+        float phase_;
+    };
+
+    struct keyboard_t
+    {
+        keyboard_t(unsigned n)
+        {
+            for(unsigned k=0; k<n; ++k)
+            {
+                key_t *key = new key_t;
+                key->freq_ = 110.0*pow(2.0,(double)(k%48)/12.0);
+                key->phase_ = (float)k*0.37f;
+                keys_.push_back(key);
+            }
+        }
+
+        ~keyboard_t()
+        {
+            for(unsigned k=0; k<keys_.size(); ++k)
+            {
+                delete keys_[k];
+            }
+        }
+
+        void plumb(piw::correlator_t *c, unsigned from, unsigned to, bool iso)
+        {
+            for(unsigned k=0; k<keys_.size(); ++k)
+            {
+                c->plumb_input(to,1,piw::pathtwo(COURSE(k),KEY(k),0),-1,INPUT_INPUT,&keys_[k]->senders_[from-1],iso?piw::interpolating_converter(1,0,0):piw::null_converter(),piw::null_filter());
+            }
+        }
+
+        piw::data_nb_t value(key_t *key, unsigned s, unsigned long long t)
+        {
+            float x = key->phase_+(float)(t%10000000ULL)/1000000.0f;
+
+            switch(s)
+            {
+                case KEY_PRESSURE: return piw::makefloat_bounded_nb(1,0,0,0.5f+0.3f*sinf(x*3.1f),t);
+                case KEY_ROLL: return piw::makefloat_bounded_nb(1,-1,0,0.2f*sinf(x*1.7f),t);
+                case KEY_YAW: return piw::makefloat_bounded_nb(1,-1,0,-0.8f+0.1f*sinf(x*0.9f),t);
+            }
+
+            return piw::makefloat_bounded_units_nb(BCTUNIT_HZ,96000,0,440,key->freq_,t);
+        }
+
+        void start(unsigned n, unsigned long long t)
+        {
+            for(unsigned k=0; k<n; ++k)
+            {
+                key_t *key = keys_[k];
+
+                for(unsigned s=1; s<=KEY_SIGNALS; ++s)
+                {
+                    key->queues_[s-1] = piw::tsd_dataqueue(PIW_DATAQUEUE_SIZE_NORM);
+                    key->queues_[s-1].write_fast(value(key,s,t));
+                    key->senders_[s-1].send_fast(piw::pathtwo_nb(COURSE(k),KEY(k),t),key->queues_[s-1]);
+                }
+            }
+        }
+
+        void play(unsigned n, unsigned long long f, unsigned long long t)
+        {
+            for(unsigned long long u=f+1000; u<=t; u+=1000)
+            {
+                for(unsigned k=0; k<n; ++k)
+                {
+                    key_t *key = keys_[k];
+                    key->queues_[KEY_PRESSURE-1].write_fast(value(key,KEY_PRESSURE,u));
+                    key->queues_[KEY_ROLL-1].write_fast(value(key,KEY_ROLL,u));
+                    key->queues_[KEY_YAW-1].write_fast(value(key,KEY_YAW,u));
+                }
+            }
+        }
+
+        void stop(unsigned n, unsigned long long t)
+        {
+            for(unsigned k=0; k<n; ++k)
+            {
+                key_t *key = keys_[k];
+
+                for(unsigned s=1; s<=KEY_SIGNALS; ++s)
+                {
+                    key->senders_[s-1].send_fast(piw::makenull_nb(t),piw::dataqueue_t());
+                    key->queues_[s-1].clear();
+                }
+            }
+        }
+
+        std::vector<key_t *> keys_;
+    };
+
+    struct source_t: piw::clocksource_t
+    {
+        source_t(unsigned bs, unsigned long sr)
+        {
+            piw::tsd_clocksource(piw::makestring("synthbench"),bs,sr,this);
+            set_details(bs,sr);
+        }
+
+        ~source_t()
+        {
+            close_source();
+        }
+    };
+
+    struct bench_t
+    {
+        bench_t(unsigned voices, unsigned bs, unsigned long sr);
+        ~bench_t();
+
+        unsigned long long period() { return (bs_*1000000ULL)/sr_; }
+        unsigned long long step(unsigned n, unsigned buffers, std::vector<unsigned long long> &times);
+
+        static int start__(void *, void *);
+        static int tick__(void *, void *);
+        static int stop__(void *, void *);
+
+        unsigned bs_;
+        unsigned long sr_;
+        unsigned voices_;
+        unsigned long long now_;
+        unsigned long long elapsed_;
+
+        piw::clockdomain_ctl_t domain_;
+        source_t *source_;
+        keyboard_t keyboard_;
+
+        piw::consolemixer_t *mixer_;
+        piw::aggregator_t *channel_;
+        piw::correlator_t *mixer_input_;
+        link_t *mixer_link_;
+
+        synth::synthfilter2_t *filter_;
+        piw::correlator_t *filter_input_;
+        link_t *filter_link_;
+
+        synth::sine_t *osc_;
+        piw::correlator_t *osc_input_;
+        link_t *osc_link_;
+
+        synth::adsr2_t *adsr_;
+        piw::velocitydetect_t *vdetect_;
+        piw::correlator_t *adsr_input_;
+    };
+
+    // the console mixer's curves, without the tables the agent builds
+
+    float volume_curve(float v) { return v/120.0f; }
+    float pan_curve(float p) { return 0.5f+0.5f*p; }
+
+    const plumb_t mixer_plumbs__[] = { { 1, 1, true }, { 1, 2, true } };
+    const plumb_t filter_plumbs__[] = { { 1, 5, true } };
+    const plumb_t osc_plumbs__[] = { { 1, 1, true } };
+
+    std::string sigmap(const unsigned char *s, unsigned n)
+    {
+        return std::string((const char *)s,n);
+    }
+
+    const unsigned char mixer_sigs__[] = { 1, 2 };
+    const unsigned char filter_sigs__[] = { 1, 5 };
+    const unsigned char osc_sigs__[] = { 1, 2, 4 };
+    const unsigned char adsr_sigs__[] = { 8, 9 };
+}
+
+bench_t::bench_t(unsigned voices, unsigned bs, unsigned long sr): bs_(bs), sr_(sr), voices_(voices), now_(pic_microtime()), elapsed_(0), keyboard_(voices)
+{
+    source_ = new source_t(bs,sr);
+    domain_.set_source(piw::makestring("synthbench"));
+
+    // built from the mixer back to the keyboard, as each stage needs the
+    // cookie of the one after it.
+
+    mixer_ = new piw::consolemixer_t(pic::f2f_t::callable(volume_curve),pic::f2f_t::callable(pan_curve),&domain_,piw::cookie_t());
+    channel_ = new piw::aggregator_t(mixer_->create_channel(1),&domain_);
+    mixer_input_ = new piw::correlator_t(&domain_,sigmap(mixer_sigs__,sizeof(mixer_sigs__)),piw::null_filter(),channel_->get_output(2),0,0);
+    mixer_link_ = new link_t(mixer_input_,mixer_plumbs__,sizeof(mixer_plumbs__)/sizeof(plumb_t));
+
+    filter_ = new synth::synthfilter2_t(mixer_link_->cookie(),&domain_);
+    filter_input_ = new piw::correlator_t(&domain_,sigmap(filter_sigs__,sizeof(filter_sigs__)),piw::null_filter(),filter_->cookie(),0,0);
+    filter_link_ = new link_t(filter_input_,filter_plumbs__,sizeof(filter_plumbs__)/sizeof(plumb_t));
+
+    osc_ = new synth::sine_t(filter_link_->cookie(),&domain_);
+    osc_input_ = new piw::correlator_t(&domain_,sigmap(osc_sigs__,sizeof(osc_sigs__)),piw::null_filter(),osc_->cookie(),0,0);
+    osc_link_ = new link_t(osc_input_,osc_plumbs__,sizeof(osc_plumbs__)/sizeof(plumb_t));
+
+    adsr_ = new synth::adsr2_t(osc_link_->cookie(),&domain_);
+    vdetect_ = new piw::velocitydetect_t(adsr_->cookie(),8,1);
+    adsr_input_ = new piw::correlator_t(&domain_,sigmap(adsr_sigs__,sizeof(adsr_sigs__)),piw::null_filter(),vdetect_->cookie(),0,0);
+
+    // the keyboard's pressure drives the envelope, its frequency and roll
+    // the oscillator and its yaw the filter cutoff.
+
+    keyboard_.plumb(adsr_input_,KEY_PRESSURE,8,false);
+    keyboard_.plumb(adsr_input_,KEY_PRESSURE,9,true);
+    keyboard_.plumb(osc_input_,KEY_FREQ,2,false);
+    keyboard_.plumb(osc_input_,KEY_ROLL,4,false);
+    keyboard_.plumb(filter_input_,KEY_YAW,1,false);
+}
+
+bench_t::~bench_t()
+{
+    delete adsr_input_;
+    delete vdetect_;
+    delete adsr_;
+    delete osc_link_;
+    delete osc_input_;
+    delete osc_;
+    delete filter_link_;
+    delete filter_input_;
+    delete filter_;
+    delete mixer_link_;
+    delete mixer_input_;
+    delete channel_;
+    delete mixer_;
+    delete source_;
+}
+
+int bench_t::start__(void *self_, void *n_)
+{
+    bench_t *self = (bench_t *)self_;
+    unsigned long long t0 = pic_microtime();
+    self->keyboard_.start(*(unsigned *)n_,self->now_);
+    self->elapsed_ = pic_microtime()-t0;
+    return 0;
+}
+
+int bench_t::tick__(void *self_, void *n_)
+{
+    bench_t *self = (bench_t *)self_;
+    unsigned long long t = self->now_+self->period();
+
+    self->keyboard_.play(*(unsigned *)n_,self->now_,t);
+    self->now_ = t;
+
+    unsigned long long t0 = pic_microtime();
+    self->source_->tick(t);
+    self->elapsed_ = pic_microtime()-t0;
+
+    return 0;
+}
+
+int bench_t::stop__(void *self_, void *n_)
+{
+    bench_t *self = (bench_t *)self_;
+    self->keyboard_.stop(*(unsigned *)n_,self->now_);
+    return 0;
+}
+
+/*
+ * Plays n keys for a number of buffers, filling times with the tick times
+ * after warm up.  Returns the note on time: delivering the key downs to
+ * the first correlator, and the first tick, which starts the voices
+ * through the rest of the graph.
+ */
+
+unsigned long long bench_t::step(unsigned n, unsigned buffers, std::vector<unsigned long long> &times)
+{
+    unsigned none = 0;
+    unsigned long long onset = 0;
+
+    times.clear();
+
+    piw::tsd_fastcall(start__,this,&n);
+    onset = elapsed_;
+
+    for(unsigned i=0; i<WARMUP+buffers; ++i)
+    {
+        piw::tsd_fastcall(tick__,this,&n);
+
+        if(i==0)
+        {
+            onset += elapsed_;
+        }
+
+        if(i>=WARMUP)
+        {
+            times.push_back(elapsed_);
+        }
+    }
+
+    piw::tsd_fastcall(stop__,this,&n);
+
+    // let the envelopes release and the voices free before the next step
+
+    for(unsigned long long t=0; t<DRAIN_MS*1000ULL; t+=period())
+    {
+        piw::tsd_fastcall(tick__,this,&none);
+    }
+
+    return onset;
+}
+
+static unsigned long long percentile(const std::vector<unsigned long long> &v, double p)
+{
+    unsigned i = (unsigned)(p*(double)(v.size()-1)+0.5);
+    return v[std::min(i,(unsigned)v.size()-1)];
+}
+
+static void logger(const char *msg)
+{
+    fprintf(stderr,"%s\n",msg);
+}
+
+int main0(int ac, char **av)
+{
+    unsigned voices = (ac>1) ? atoi(av[1]) : 500;
+    unsigned buffers = (ac>2) ? atoi(av[2]) : 2000;
+    unsigned bs = (ac>3) ? atoi(av[3]) : 256;
+    unsigned long sr = (ac>4) ? atol(av[4]) : 48000;
+
+    static const unsigned steps__[] = { 1, 2, 5, 10, 20, 50, 100, 150, 200, 300, 400, 500 };
+
+    voices = std::max(1U,std::min(voices,500U));
+    buffers = std::max(1U,buffers);
+    bs = std::max(1U,std::min(bs,(unsigned)PLG_CLOCK_BUFFER_SIZE));
+
+    pia::scaffold_mt_t scaffold("synthbench",1,pic::f_string_t::callable(logger),pic::f_string_t(),false,false);
+    pia::context_t entity = scaffold.context(pic::status_t(),pic::f_string_t::callable(logger),"synthbench");
+    piw::tsd_setcontext(entity.entity());
+
+    bench_t *bench;
+
+    piw::tsd_lock();
+    bench = new bench_t(voices,bs,sr);
+    piw::tsd_unlock();
+
+    std::vector<unsigned long long> times;
+    unsigned long long period = bench->period();
+
+    printf("buffer %u samples at %lu Hz, %llu us\n",bs,sr,period);
+    printf("%6s %8s %8s %8s %8s %8s %7s %9s\n","voices","p50 us","p90 us","p99 us","p99.9 us","max us","p99 %","note on us");
+
+    for(unsigned i=0; i<sizeof(steps__)/sizeof(steps__[0]) && steps__[i]<=voices; ++i)
+    {
+        unsigned n = steps__[i];
+
+        unsigned long long onset = bench->step(n,buffers,times);
+        std::sort(times.begin(),times.end());
+
+        unsigned long long p99 = percentile(times,0.99);
+
+        printf("%6u %8llu %8llu %8llu %8llu %8llu %6.1f%% %9llu\n",n,percentile(times,0.5),percentile(times,0.9),p99,percentile(times,0.999),times.back(),100.0*(double)p99/(double)period,onset);
+        fflush(stdout);
+    }
+
+    piw::tsd_lock();
+    delete bench;
+    piw::tsd_unlock();
+
+    entity.release();
+    return 0;
+}
+
+int main(int ac, char **av)
+{
+    try
+    {
+        return main0(ac,av);
+    }
+    catch(const std::exception &e)
+    {
+        fprintf(stderr,"%s\n",e.what());
+        return -1;
+    }
+    catch(...)
+    {
+        fprintf(stderr,"unknown exception\n");
+        return -1;
+    }
+}
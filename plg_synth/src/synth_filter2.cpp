@@ -26,6 +26,7 @@
 
 #include "synth.h"
 #include "synth_limiter.h"
+#include "synth_lanes.h"
 
 #define IN_FC 1
 #define IN_RESONANCE 2
@@ -42,13 +43,17 @@
 #define DEFAULT_RESONANCE 0.5
 #define MAX_RESONANCE 0.995
 
+// noise for lanes: bit l of the row index gives lane l -1e-9 or 0
+#define NOISE1(r,l) ((((r)>>(l))&1)?-1e-9f:0.f)
+#define NOISE4(r) { NOISE1(r,0),NOISE1(r,1),NOISE1(r,2),NOISE1(r,3) }
 
 namespace
 {
     struct synthfunc_t: piw::cfilterfunc_t
     {
-        synthfunc_t(): current_freq_(DEFAULT_FREQ),current_resonance_(DEFAULT_RESONANCE),timer_(0)
+        synthfunc_t(): current_freq_(DEFAULT_FREQ),current_resonance_(DEFAULT_RESONANCE),timer_(0),out_(0),outs_(0),audio_in_(0),sr_(48000)
         {
+            noise_=0x9e3779b9u^(unsigned)(size_t)this;
             tv2_=40000.f;
             ya_=0.f;yb_=0.f;yc_=0.f;yd_=0.f;ye_=0.f;
             wa_=0.f;wb_=0.f;wc_=0.f;
@@ -102,6 +107,12 @@ namespace
         bool cfilterfunc_process(piw::cfilterenv_t *e, unsigned long long f, unsigned long long t,unsigned long sr, unsigned bs);
         bool cfilterfunc_end(piw::cfilterenv_t *, unsigned long long time);
 
+        bool lanes_begin(piw::cfilterenv_t *e, unsigned long long f, unsigned long long t,unsigned long sr, unsigned bs);
+        void lanes_apply(unsigned sig, const piw::data_nb_t &d);
+        void lanes_end(piw::cfilterenv_t *e, unsigned bs);
+        void lanes_idle(unsigned bs);
+        static void lanes_run(synthfunc_t **lanes, unsigned samp_from, unsigned samp_to);
+
         void synth_setup(float freq, float res);
         void synth_process(const float *input, float *lp, unsigned samp_from, unsigned samp_to);
         void synth_process1(float input, float *lp);
@@ -117,6 +128,90 @@ namespace
         float current_freq_, current_resonance_;
         unsigned timer_;
         synth::limiter_t limiter_;
+
+        float *out_, *outs_;
+        piw::data_nb_t dout_;
+        const float *audio_in_;
+        piw::data_nb_t din_;
+        float sr_;
+        unsigned noise_;
+        synth::laneevents_t events_;
+    };
+
+    /*
+     * The ladders of SYNTH_LANES voices.  This is synth_process1() a lane
+     * per voice, with the rand() noise replaced by a per-voice xorshift.
+     */
+
+    struct ladderlanes_t
+    {
+        ladderlanes_t(synthfunc_t **v): v_(v), noise_(v[0]->noise_)
+        {
+            synth::limiter_t *l[SYNTH_LANES];
+            for(unsigned i=0; i<SYNTH_LANES; ++i) l[i]=&v[i]->limiter_;
+            limiter_.load(l);
+
+            ya_=synth::gather(v,&synthfunc_t::ya_); yb_=synth::gather(v,&synthfunc_t::yb_); yc_=synth::gather(v,&synthfunc_t::yc_);
+            yd_=synth::gather(v,&synthfunc_t::yd_); ye_=synth::gather(v,&synthfunc_t::ye_);
+            wa_=synth::gather(v,&synthfunc_t::wa_); wb_=synth::gather(v,&synthfunc_t::wb_); wc_=synth::gather(v,&synthfunc_t::wc_);
+            last_=synth::gather(v,&synthfunc_t::last_);
+            tv2_=synth::gather(v,&synthfunc_t::tv2_);
+            ft_=synth::gather(v,&synthfunc_t::ft_);
+            x_=synth::lanes_t(4.f)*synth::gather(v,&synthfunc_t::q_)*synth::gather(v,&synthfunc_t::gc_);
+        }
+
+        ~ladderlanes_t()
+        {
+            synth::limiter_t *l[SYNTH_LANES];
+            for(unsigned i=0; i<SYNTH_LANES; ++i) l[i]=&v_[i]->limiter_;
+            limiter_.save(l);
+
+            synth::scatter(ya_,v_,&synthfunc_t::ya_); synth::scatter(yb_,v_,&synthfunc_t::yb_); synth::scatter(yc_,v_,&synthfunc_t::yc_);
+            synth::scatter(yd_,v_,&synthfunc_t::yd_); synth::scatter(ye_,v_,&synthfunc_t::ye_);
+            synth::scatter(wa_,v_,&synthfunc_t::wa_); synth::scatter(wb_,v_,&synthfunc_t::wb_); synth::scatter(wc_,v_,&synthfunc_t::wc_);
+            synth::scatter(last_,v_,&synthfunc_t::last_);
+            v_[0]->noise_=noise_;
+        }
+
+        synth::lanes_t half(const synth::lanes_t &in)
+        {
+            using synth::approx::tanh;
+
+            ya_ = ya_ + ft_*(tanh((in-x_*last_)/tv2_)-wa_);
+            wa_ = tanh(ya_/tv2_);
+            yb_ = yb_ + ft_*(wa_-wb_);
+            wb_ = tanh(yb_/tv2_);
+            yc_ = yc_ + ft_*(wb_-wc_);
+            wc_ = tanh(yc_/tv2_);
+            yd_ = limiter_.process(yd_ + ft_*(wc_-tanh(yd_/tv2_)));
+
+            last_ = (yd_+ye_)*synth::lanes_t(0.5f);
+            ye_ = yd_;
+
+            return last_;
+        }
+
+        synth::lanes_t process1(const synth::lanes_t &in)
+        {
+            static const float noise[16][SYNTH_LANES] =
+            {
+                NOISE4(0), NOISE4(1), NOISE4(2), NOISE4(3), NOISE4(4), NOISE4(5), NOISE4(6), NOISE4(7),
+                NOISE4(8), NOISE4(9), NOISE4(10), NOISE4(11), NOISE4(12), NOISE4(13), NOISE4(14), NOISE4(15)
+            };
+
+            noise_^=noise_<<13; noise_^=noise_>>17; noise_^=noise_<<5;
+
+            half(in+synth::lanes_t::load(noise[noise_&15]));
+            return half(in);
+        }
+
+        synthfunc_t **v_;
+        unsigned noise_;
+        synth::limiterlanes_t limiter_;
+        synth::lanes_t ya_,yb_,yc_,yd_,ye_;
+        synth::lanes_t wa_,wb_,wc_;
+        synth::lanes_t last_;
+        synth::lanes_t tv2_,ft_,x_;
     };
 };
 
@@ -154,7 +249,7 @@ void synthfunc_t::synth_process1(float in,float *lp)
 	*lp = last_;
 }
 
-bool synthfunc_t::cfilterfunc_process(piw::cfilterenv_t *e, unsigned long long f, unsigned long long t,unsigned long sr, unsigned bs)
+bool synthfunc_t::lanes_begin(piw::cfilterenv_t *e, unsigned long long f, unsigned long long t,unsigned long sr, unsigned bs)
 {
     if(timer_ == 0)
     {
@@ -173,65 +268,126 @@ bool synthfunc_t::cfilterfunc_process(piw::cfilterenv_t *e, unsigned long long f
     --timer_;
 
     //float sr=e->cfilterenv_clock()->get_sample_rate();
-    float fc=current_freq_/sr;
-    synth_setup(fc,current_resonance_);
-
-    float *lp;
-    float *lps;
+    sr_=sr;
+    synth_setup(current_freq_/sr_,current_resonance_);
 
-    piw::data_nb_t dlp=piw::makenorm_nb(t,bs,&lp,&lps);
-
-    piw::data_nb_t d;
+    dout_=piw::makenorm_nb(t,bs,&out_,&outs_);
 
-    const float *audio_in=0;
-    if(e->cfilterenv_nextsig(IN_AUDIO,d,t))
+    audio_in_=0;
+    if(e->cfilterenv_nextsig(IN_AUDIO,din_,t))
     {
-        audio_in = d.as_array();
+        audio_in_ = din_.as_array();
         timer_ = TIMER_TICKS;
     }
     //else
         //pic::logmsg() << "(no audio)";
 
+    return true;
+}
+
+void synthfunc_t::lanes_apply(unsigned sig, const piw::data_nb_t &d)
+{
+    switch(sig)
+    {
+        case IN_FC:
+            setfreq(d);
+            synth_setup(current_freq_/sr_,current_resonance_);
+            break;
+
+        case IN_RESONANCE:
+            setq(d);
+            synth_setup(current_freq_/sr_,current_resonance_);
+            break;
+
+        case IN_NONLINEARITY:
+            setnl(d);
+            synth_setup(current_freq_/sr_,current_resonance_);
+            break;
+    }
+}
+
+void synthfunc_t::lanes_end(piw::cfilterenv_t *e, unsigned bs)
+{
+    *outs_=out_[bs-1];
+
+    e->cfilterenv_output(OUT_LP,dout_);
+
+    dout_.clear();
+    din_.clear();
+    audio_in_=0;
+}
+
+void synthfunc_t::lanes_idle(unsigned bs)
+{
+    ya_=0.f;yb_=0.f;yc_=0.f;yd_=0.f;ye_=0.f;
+    wa_=0.f;wb_=0.f;wc_=0.f;
+    last_=0.f;
+    synth_setup(current_freq_/sr_,current_resonance_);
+    dout_=piw::makenorm_nb(0,bs,&out_,&outs_);
+    audio_in_=0;
+}
+
+void synthfunc_t::lanes_run(synthfunc_t **lanes, unsigned samp_from, unsigned samp_to)
+{
+    static const float silence[PLG_CLOCK_BUFFER_SIZE] = { 0.f };
+
+    const float *in[SYNTH_LANES];
+    float *lp[SYNTH_LANES];
+
+    for(unsigned l=0; l<SYNTH_LANES; ++l)
+    {
+        in[l] = lanes[l]->audio_in_ ? lanes[l]->audio_in_ : silence;
+        lp[l] = lanes[l]->out_;
+    }
+
+    ladderlanes_t ladder(lanes);
+    unsigned i = samp_from;
+
+    for(; i+4<=samp_to; i+=4)
+    {
+        synth::lanes_t x[4];
+        synth::gather4(in,i,x);
+        x[0]=ladder.process1(x[0]);
+        x[1]=ladder.process1(x[1]);
+        x[2]=ladder.process1(x[2]);
+        x[3]=ladder.process1(x[3]);
+        synth::scatter4(x,lp,i);
+    }
+
+    for(; i<samp_to; ++i)
+    {
+        synth::scatter(ladder.process1(synth::gather(in,i)),lp,i);
+    }
+}
+
+bool synthfunc_t::cfilterfunc_process(piw::cfilterenv_t *e, unsigned long long f, unsigned long long t,unsigned long sr, unsigned bs)
+{
+    if(!lanes_begin(e,f,t,sr,bs))
+    {
+        return false;
+    }
+
+    piw::data_nb_t d;
     unsigned sig;
     unsigned samp_from = 0;
     unsigned samp_to = 0;
 
     while(e->cfilterenv_next(sig,d,t))
     {
-        switch(sig)
-        {
-            case IN_FC:
-                setfreq(d);
-                fc=current_freq_/sr;
-                synth_setup(fc,current_resonance_);
-                break;
-
-            case IN_RESONANCE:
-                setq(d);
-                synth_setup(fc,current_resonance_);
-                break;
-
-            case IN_NONLINEARITY:
-                setnl(d);
-                synth_setup(fc,current_resonance_);
-                break;
-
-        }
+        lanes_apply(sig,d);
 
         samp_to = sample_offset(bs,d.time(),f,t);
 
         if(samp_to>samp_from)
         {
-            synth_process(audio_in,lp,samp_from,samp_to);
+            synth_process(audio_in_,out_,samp_from,samp_to);
             samp_from = samp_to;
         }
     }
 
-    synth_process(audio_in,lp,samp_from,bs);
-
-    *lps=lp[bs-1];
+    synth_process(audio_in_,out_,samp_from,bs);
 
-    e->cfilterenv_output(OUT_LP,dlp);
+    lanes_end(e,bs);
 
     return true;
 }
@@ -265,11 +421,16 @@ namespace synth
 {
     struct synthfilter2_t::impl_t : piw::cfilterctl_t, piw::cfilter_t
     {
-        impl_t(const piw::cookie_t &o, piw::clockdomain_ctl_t *d) : cfilter_t(this,o,d) {}
+        impl_t(const piw::cookie_t &o, piw::clockdomain_ctl_t *d) : cfilter_t(this,o,d), batch_(new synthfunc_t()) {}
         piw::cfilterfunc_t *cfilterctl_create(const piw::data_t &) { return new synthfunc_t(); }
         unsigned long long cfilterctl_thru() { return 0; }
         unsigned long long cfilterctl_inputs() { return IN_MASK; }
         unsigned long long cfilterctl_outputs() { return OUT_MASK; }
+
+        bool cfilterctl_batch() { return true; }
+        void cfilterctl_process(piw::cfiltervoice_t *v, unsigned n, unsigned long long f, unsigned long long t, unsigned long sr, unsigned bs) { batch_.process(v,n,f,t,sr,bs); }
+
+        synth::lanebatch_t<synthfunc_t> batch_;
     };
 }
 
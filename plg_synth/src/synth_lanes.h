@@ -0,0 +1,377 @@
+/*
+ Copyright 2009 Eigenlabs Ltd.  http://www.eigenlabs.com
+
+ This file is part of EigenD.
+
+ EigenD is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ EigenD is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with EigenD.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SYNTH_LANES__
+#define __SYNTH_LANES__
+
+#include <piw/piw_cfilter.h>
+#include <piw/piw_data.h>
+#include <picross/pic_stl.h>
+#include <picross/pic_nocopy.h>
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+ * Voice lanes for batched cfilters.
+ *
+ * A lanes_t holds one float for each of SYNTH_LANES voices, so a filter can
+ * run the same per-sample recurrence for several voices at once.  With SSE2
+ * the lanes are a vector register, otherwise they are a plain array.
+ *
+ * lanebatch_t drives a cfilterctl_t's batched process: it starts each voice
+ * as its cfilterfunc_process() would, groups the running voices SYNTH_LANES
+ * at a time and splits the tick where any voice in the group has a control
+ * change, so each run of samples has constant controls in every lane.
+ */
+
+#define SYNTH_LANES 4
+
+namespace synth
+{
+#if defined(__SSE2__)
+
+    struct lanemask_t
+    {
+        lanemask_t() {}
+        lanemask_t(__m128 v): v_(v) {}
+
+        lanemask_t operator&(const lanemask_t &o) const { return _mm_and_ps(v_,o.v_); }
+        lanemask_t operator|(const lanemask_t &o) const { return _mm_or_ps(v_,o.v_); }
+        lanemask_t andnot(const lanemask_t &o) const { return _mm_andnot_ps(o.v_,v_); }
+
+        unsigned bits() const { return _mm_movemask_ps(v_); }
+
+        __m128 v_;
+    };
+
+    struct lanes_t
+    {
+        lanes_t() {}
+        lanes_t(float f): v_(_mm_set1_ps(f)) {}
+        lanes_t(__m128 v): v_(v) {}
+        lanes_t(float a, float b, float c, float d): v_(_mm_setr_ps(a,b,c,d)) {}
+
+        static lanes_t load(const float *p) { return _mm_loadu_ps(p); }
+        void store(float *p) const { _mm_storeu_ps(p,v_); }
+
+        lanes_t operator+(const lanes_t &o) const { return _mm_add_ps(v_,o.v_); }
+        lanes_t operator-(const lanes_t &o) const { return _mm_sub_ps(v_,o.v_); }
+        lanes_t operator*(const lanes_t &o) const { return _mm_mul_ps(v_,o.v_); }
+        lanes_t operator/(const lanes_t &o) const { return _mm_div_ps(v_,o.v_); }
+
+        lanemask_t operator>=(const lanes_t &o) const { return _mm_cmpge_ps(v_,o.v_); }
+        lanemask_t operator>(const lanes_t &o) const { return _mm_cmpgt_ps(v_,o.v_); }
+
+        __m128 v_;
+    };
+
+    inline lanes_t max(const lanes_t &a, const lanes_t &b) { return _mm_max_ps(a.v_,b.v_); }
+    inline lanes_t sqrt(const lanes_t &a) { return _mm_sqrt_ps(a.v_); }
+    inline lanes_t select(const lanemask_t &m, const lanes_t &a, const lanes_t &b) { return _mm_or_ps(_mm_and_ps(m.v_,a.v_),_mm_andnot_ps(m.v_,b.v_)); }
+
+    // truncate each lane towards zero, as a float and into i
+    inline lanes_t truncate(const lanes_t &x, int *i)
+    {
+        __m128i t = _mm_cvttps_epi32(x.v_);
+        _mm_storeu_si128((__m128i *)i,t);
+        return _mm_cvtepi32_ps(t);
+    }
+
+    // sample i of each lane's buffer
+    inline lanes_t gather(const float *const *p, unsigned i)
+    {
+        return _mm_setr_ps(p[0][i],p[1][i],p[2][i],p[3][i]);
+    }
+
+    inline void scatter(const lanes_t &v, float *const *p, unsigned i)
+    {
+        float t[SYNTH_LANES];
+        v.store(t);
+        p[0][i]=t[0]; p[1][i]=t[1]; p[2][i]=t[2]; p[3][i]=t[3];
+    }
+
+    // samples i..i+3 of each lane's buffer, as one lanes_t per sample
+    inline void gather4(const float *const *p, unsigned i, lanes_t *r)
+    {
+        __m128 a=_mm_loadu_ps(p[0]+i), b=_mm_loadu_ps(p[1]+i), c=_mm_loadu_ps(p[2]+i), d=_mm_loadu_ps(p[3]+i);
+        _MM_TRANSPOSE4_PS(a,b,c,d);
+        r[0].v_=a; r[1].v_=b; r[2].v_=c; r[3].v_=d;
+    }
+
+    inline void scatter4(const lanes_t *r, float *const *p, unsigned i)
+    {
+        __m128 a=r[0].v_, b=r[1].v_, c=r[2].v_, d=r[3].v_;
+        _MM_TRANSPOSE4_PS(a,b,c,d);
+        _mm_storeu_ps(p[0]+i,a); _mm_storeu_ps(p[1]+i,b); _mm_storeu_ps(p[2]+i,c); _mm_storeu_ps(p[3]+i,d);
+    }
+
+#else
+
+    struct lanemask_t
+    {
+        lanemask_t() {}
+        lanemask_t(bool a, bool b, bool c, bool d) { m_[0]=a; m_[1]=b; m_[2]=c; m_[3]=d; }
+
+        lanemask_t operator&(const lanemask_t &o) const { return lanemask_t(m_[0]&&o.m_[0],m_[1]&&o.m_[1],m_[2]&&o.m_[2],m_[3]&&o.m_[3]); }
+        lanemask_t operator|(const lanemask_t &o) const { return lanemask_t(m_[0]||o.m_[0],m_[1]||o.m_[1],m_[2]||o.m_[2],m_[3]||o.m_[3]); }
+        lanemask_t andnot(const lanemask_t &o) const { return lanemask_t(m_[0]&&!o.m_[0],m_[1]&&!o.m_[1],m_[2]&&!o.m_[2],m_[3]&&!o.m_[3]); }
+
+        unsigned bits() const { return (m_[0]?1:0)|(m_[1]?2:0)|(m_[2]?4:0)|(m_[3]?8:0); }
+
+        bool m_[SYNTH_LANES];
+    };
+
+    struct lanes_t
+    {
+        lanes_t() {}
+        lanes_t(float f) { v_[0]=v_[1]=v_[2]=v_[3]=f; }
+        lanes_t(float a, float b, float c, float d) { v_[0]=a; v_[1]=b; v_[2]=c; v_[3]=d; }
+
+        static lanes_t load(const float *p) { return lanes_t(p[0],p[1],p[2],p[3]); }
+        void store(float *p) const { p[0]=v_[0]; p[1]=v_[1]; p[2]=v_[2]; p[3]=v_[3]; }
+
+        lanes_t operator+(const lanes_t &o) const { return lanes_t(v_[0]+o.v_[0],v_[1]+o.v_[1],v_[2]+o.v_[2],v_[3]+o.v_[3]); }
+        lanes_t operator-(const lanes_t &o) const { return lanes_t(v_[0]-o.v_[0],v_[1]-o.v_[1],v_[2]-o.v_[2],v_[3]-o.v_[3]); }
+        lanes_t operator*(const lanes_t &o) const { return lanes_t(v_[0]*o.v_[0],v_[1]*o.v_[1],v_[2]*o.v_[2],v_[3]*o.v_[3]); }
+        lanes_t operator/(const lanes_t &o) const { return lanes_t(v_[0]/o.v_[0],v_[1]/o.v_[1],v_[2]/o.v_[2],v_[3]/o.v_[3]); }
+
+        lanemask_t operator>=(const lanes_t &o) const { return lanemask_t(v_[0]>=o.v_[0],v_[1]>=o.v_[1],v_[2]>=o.v_[2],v_[3]>=o.v_[3]); }
+        lanemask_t operator>(const lanes_t &o) const { return lanemask_t(v_[0]>o.v_[0],v_[1]>o.v_[1],v_[2]>o.v_[2],v_[3]>o.v_[3]); }
+
+        float v_[SYNTH_LANES];
+    };
+
+    inline lanes_t max(const lanes_t &a, const lanes_t &b) { return lanes_t(std::max(a.v_[0],b.v_[0]),std::max(a.v_[1],b.v_[1]),std::max(a.v_[2],b.v_[2]),std::max(a.v_[3],b.v_[3])); }
+    inline lanes_t sqrt(const lanes_t &a) { return lanes_t(sqrtf(a.v_[0]),sqrtf(a.v_[1]),sqrtf(a.v_[2]),sqrtf(a.v_[3])); }
+
+    inline lanes_t select(const lanemask_t &m, const lanes_t &a, const lanes_t &b)
+    {
+        return lanes_t(m.m_[0]?a.v_[0]:b.v_[0],m.m_[1]?a.v_[1]:b.v_[1],m.m_[2]?a.v_[2]:b.v_[2],m.m_[3]?a.v_[3]:b.v_[3]);
+    }
+
+    inline lanes_t truncate(const lanes_t &x, int *i)
+    {
+        for(unsigned k=0; k<4; ++k) i[k]=(int)x.v_[k];
+        return lanes_t((float)i[0],(float)i[1],(float)i[2],(float)i[3]);
+    }
+
+    inline lanes_t gather(const float *const *p, unsigned i)
+    {
+        return lanes_t(p[0][i],p[1][i],p[2][i],p[3][i]);
+    }
+
+    inline void scatter(const lanes_t &v, float *const *p, unsigned i)
+    {
+        p[0][i]=v.v_[0]; p[1][i]=v.v_[1]; p[2][i]=v.v_[2]; p[3][i]=v.v_[3];
+    }
+
+    inline void gather4(const float *const *p, unsigned i, lanes_t *r)
+    {
+        for(unsigned k=0; k<4; ++k) r[k]=gather(p,i+k);
+    }
+
+    inline void scatter4(const lanes_t *r, float *const *p, unsigned i)
+    {
+        for(unsigned k=0; k<4; ++k) scatter(r[k],p,i+k);
+    }
+
+#endif
+
+    // a float member of each lane's object
+    template <class F> inline lanes_t gather(F *const *v, float F::*m)
+    {
+        return lanes_t(v[0]->*m,v[1]->*m,v[2]->*m,v[3]->*m);
+    }
+
+    template <class F> inline void scatter(const lanes_t &x, F *const *v, float F::*m)
+    {
+        float t[SYNTH_LANES];
+        x.store(t);
+        v[0]->*m=t[0]; v[1]->*m=t[1]; v[2]->*m=t[2]; v[3]->*m=t[3];
+    }
+
+    namespace approx
+    {
+        // lane versions of pic::approx, with the same ranges
+
+        inline lanes_t exp(const lanes_t &x)
+        {
+            return (lanes_t(6.f)+x*(lanes_t(6.f)+x*(lanes_t(3.f)+x)))*lanes_t(0.16666666f);
+        }
+
+        inline lanes_t tanh(const lanes_t &x)
+        {
+            lanes_t x2=x*x;
+            return x*(lanes_t(27.f)+x2)/(lanes_t(27.f)+lanes_t(9.f)*x2);
+        }
+
+        inline lanes_t ln(const lanes_t &x)
+        {
+            lanes_t y=(x-lanes_t(1.f))/(x+lanes_t(1.f));
+            lanes_t y2=y*y;
+            return lanes_t(2.f)*y*(lanes_t(15.f)-lanes_t(4.f)*y2)/(lanes_t(15.f)-lanes_t(9.f)*y2);
+        }
+    }
+
+    /*
+     * The control changes of one voice for one tick.  Each change is kept
+     * with the sample from which cfilterfunc_process() would have used it:
+     * a change is applied before the run of samples that ends at its own
+     * time, so it takes effect from the end of the previous run.
+     */
+
+    class laneevents_t: public pic::nocopy_t
+    {
+        public:
+            struct event_t
+            {
+                unsigned from;
+                unsigned sig;
+                piw::data_nb_t value;
+            };
+
+            laneevents_t(): next_(0) {}
+
+            void load(piw::cfilterfunc_t *func, piw::cfilterenv_t *env, unsigned long long f, unsigned long long t, unsigned bs)
+            {
+                unsigned sig;
+                unsigned from = 0;
+                piw::data_nb_t d;
+
+                events_.clear();
+                next_=0;
+
+                while(env->cfilterenv_next(sig,d,t))
+                {
+                    events_.push_back(event_t());
+                    event_t &e(events_.back());
+                    e.from=from;
+                    e.sig=sig;
+                    e.value=d;
+
+                    unsigned to = func->sample_offset(bs,d.time(),f,t);
+                    if(to>from) from=to;
+                }
+            }
+
+            bool due(unsigned i) const { return next_<events_.size() && events_[next_].from<=i; }
+            const event_t &pop() { return events_[next_++]; }
+            unsigned until(unsigned bs) const { return (next_<events_.size()) ? events_[next_].from : bs; }
+            void clear() { events_.clear(); next_=0; }
+
+        private:
+            pic::lckvector_t<event_t>::nbtype events_;
+            unsigned next_;
+    };
+
+    /*
+     * Batched process for a cfilterctl_t whose functions are all of type F.
+     * F provides:
+     *
+     *   bool lanes_begin(env,f,t,sr,bs)   set up the tick, false if finished
+     *   void lanes_apply(sig,value)       apply one control change
+     *   void lanes_end(env,bs)            output the tick
+     *   void lanes_idle(bs)               make a silent filler voice
+     *   static void lanes_run(F **lanes, from, to)
+     *                                     process samples from..to of each lane
+     *   laneevents_t events_
+     */
+
+    template <class F> class lanebatch_t: public pic::nocopy_t
+    {
+        public:
+            lanebatch_t(F *idle): idle_(idle) {}
+            ~lanebatch_t() { delete idle_; }
+
+            void process(piw::cfiltervoice_t *voices, unsigned count, unsigned long long f, unsigned long long t, unsigned long sr, unsigned bs)
+            {
+                running_.clear();
+
+                for(unsigned i=0; i<count; ++i)
+                {
+                    F *func = static_cast<F *>(voices[i].func);
+
+                    if(!func->lanes_begin(voices[i].env,f,t,sr,bs))
+                    {
+                        voices[i].running=false;
+                        continue;
+                    }
+
+                    func->events_.load(func,voices[i].env,f,t,bs);
+                    running_.push_back(i);
+                }
+
+                for(unsigned g=0; g<running_.size(); g+=SYNTH_LANES)
+                {
+                    F *lanes[SYNTH_LANES];
+                    unsigned n = std::min((unsigned)(running_.size()-g),(unsigned)SYNTH_LANES);
+
+                    for(unsigned l=0; l<SYNTH_LANES; ++l)
+                    {
+                        lanes[l] = (l<n) ? static_cast<F *>(voices[running_[g+l]].func) : idle_;
+                    }
+
+                    if(n<SYNTH_LANES)
+                    {
+                        idle_->lanes_idle(bs);
+                    }
+
+                    unsigned from = 0;
+
+                    while(from<bs)
+                    {
+                        unsigned to = bs;
+
+                        for(unsigned l=0; l<n; ++l)
+                        {
+                            laneevents_t &e(lanes[l]->events_);
+
+                            while(e.due(from))
+                            {
+                                const laneevents_t::event_t &ev(e.pop());
+                                lanes[l]->lanes_apply(ev.sig,ev.value);
+                            }
+
+                            to = std::min(to,e.until(bs));
+                        }
+
+                        F::lanes_run(lanes,from,to);
+                        from = to;
+                    }
+                }
+
+                for(unsigned i=0; i<running_.size(); ++i)
+                {
+                    piw::cfiltervoice_t &v(voices[running_[i]]);
+                    F *func = static_cast<F *>(v.func);
+                    func->events_.clear();
+                    func->lanes_end(v.env,bs);
+                }
+            }
+
+        private:
+            F *idle_;
+            pic::lckvector_t<unsigned>::nbtype running_;
+    };
+}
+
+#endif
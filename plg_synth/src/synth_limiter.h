@@ -35,6 +35,7 @@
 #define ANTI_DENORMAL 1.0e-20
 
 #include <plg_synth/src/synth_exports.h>
+#include "synth_lanes.h"
 
 namespace synth
 {
@@ -87,8 +88,12 @@ namespace synth
         float state_;
     };
 
+    class limiterlanes_t;
+
     class PISYNTH_DECLSPEC_CLASS limiter_t : public pic::nocopy_t
     {
+        friend class limiterlanes_t;
+
         public:
             limiter_t(): release_(false),average_(0),gain_(1)
             {
@@ -128,6 +133,66 @@ namespace synth
             float average_;
             float gain_;
     };
+
+    /*
+     * The limiters of SYNTH_LANES voices, processed together.  load() takes
+     * the state of each voice's limiter and save() puts it back.
+     */
+
+    class limiterlanes_t
+    {
+        public:
+            void load(limiter_t *const *l)
+            {
+                follower_ = lanes_t(l[0]->follower_.state_,l[1]->follower_.state_,l[2]->follower_.state_,l[3]->follower_.state_);
+                averager_ = lanes_t(l[0]->averager_.state_,l[1]->averager_.state_,l[2]->averager_.state_,l[3]->averager_.state_);
+                release_ = lanes_t(l[0]->release_?RELEASE:0.f,l[1]->release_?RELEASE:0.f,l[2]->release_?RELEASE:0.f,l[3]->release_?RELEASE:0.f);
+                average_ = lanes_t(l[0]->average_,l[1]->average_,l[2]->average_,l[3]->average_);
+                gain_ = lanes_t(l[0]->gain_,l[1]->gain_,l[2]->gain_,l[3]->gain_);
+            }
+
+            void save(limiter_t *const *l)
+            {
+                float f[SYNTH_LANES],s[SYNTH_LANES],a[SYNTH_LANES],g[SYNTH_LANES];
+                follower_.store(f);
+                averager_.store(s);
+                average_.store(a);
+                gain_.store(g);
+
+                for(unsigned i=0; i<SYNTH_LANES; ++i)
+                {
+                    l[i]->follower_.state_=f[i];
+                    l[i]->averager_.state_=s[i];
+                    l[i]->average_=a[i];
+                    l[i]->gain_=g[i];
+                }
+            }
+
+            lanes_t process(const lanes_t &in)
+            {
+                lanes_t x = in+lanes_t(ANTI_DENORMAL);
+                lanes_t squared = x*x;
+                averager_ = squared+lanes_t(AVERAGE_COEFF)*(averager_-squared);
+                average_ = sqrt(averager_);
+
+                lanes_t avdb = approx::ln(average_)*lanes_t(20.f/PIC_LN10);
+                lanes_t headrm = max(lanes_t(0.f),avdb-lanes_t(THRESHOLD))+release_;
+
+                lanes_t h = headrm+lanes_t(ANTI_DENORMAL);
+                follower_ = select(h>follower_,h+lanes_t(ATTACK_COEFF)*(follower_-h),h+lanes_t(RELEASE_COEFF)*(follower_-h));
+
+                lanes_t gaindb = (follower_-lanes_t(ANTI_DENORMAL))*lanes_t(1.f-RATIO);
+                gain_ = max(lanes_t(0.f),approx::exp(gaindb*lanes_t(PIC_LN10/20.f)));
+                return gain_*in;
+            }
+
+        private:
+            lanes_t follower_;
+            lanes_t averager_;
+            lanes_t release_;
+            lanes_t average_;
+            lanes_t gain_;
+    };
 }
 
 #endif
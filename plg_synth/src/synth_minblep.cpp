@@ -23,6 +23,7 @@
 
 #include "synth.h"
 #include "synth_blepdata.h"
+#include "synth_lanes.h"
 #include <piw/piw_cfilter.h>
 #include <piw/piw_clock.h>
 #include <piw/piw_address.h>
@@ -51,7 +52,7 @@ namespace
 {
     struct minblep_buffer_t: piw::cfilterfunc_t
     {
-        minblep_buffer_t(float p) : index_(0),phase_(p),current_volume_(DEFAULT_VOLUME),current_freq_(DEFAULT_FREQ),current_param_(DEFAULT_PARAM),current_detune_(powf(2.0,DEFAULT_DETUNE/1200.0)), on_(false)
+        minblep_buffer_t(float p) : index_(0),phase_(p),current_volume_(DEFAULT_VOLUME),current_freq_(DEFAULT_FREQ),current_param_(DEFAULT_PARAM),current_detune_(powf(2.0,DEFAULT_DETUNE/1200.0)), on_(false), out_(0), outs_(0), audio_in_(0), inc_(0), sr_(48000), base_(0)
         {
             memset(buffer_,0,BUFFER_LEN*sizeof(float));
         }
@@ -141,67 +142,125 @@ namespace
             return true;
         }
 
-        bool cfilterfunc_process(piw::cfilterenv_t *env, unsigned long long from, unsigned long long t,unsigned long sr, unsigned bs)
+        bool lanes_begin(piw::cfilterenv_t *env, unsigned long long from, unsigned long long t,unsigned long sr, unsigned bs)
         {
             if(!on_)
             {
                 return false;
             }
 
-            float *out, *fs;
-            
-            piw::data_nb_t o = piw::makenorm_nb(t,bs,&out,&fs);
+            o_ = piw::makenorm_nb(t,bs,&out_,&outs_);
             reserve(bs);
+            base_ = index_;
 
             //float sr = (float)env->cfilterenv_clock()->get_sample_rate();
-            float inc = current_freq_*current_detune_/sr;
+            sr_ = sr;
+            inc_ = current_freq_*current_detune_/sr_;
 
-            piw::data_nb_t d;
+            audio_in_=0;
+            if(env->cfilterenv_nextsig(IN_VOL,vol_,t))
+            {
+                audio_in_ = vol_.as_array();
+                current_volume_ = vol_.as_renorm(0,1,0);
+            }
+
+            return true;
+        }
+
+        void lanes_apply(unsigned sig, const piw::data_nb_t &d)
+        {
+            switch(sig)
+            {
+                case IN_FREQ:
+                    setfreq(d);
+                    inc_ = current_freq_*current_detune_/sr_;
+                    break;
+
+                case IN_DETUNE:
+                    setdetune(d);
+                    inc_ = current_freq_*current_detune_/sr_;
+                    break;
+
+                case IN_PARAM:
+                    setparam(d);
+                    break;
+            }
+        }
+
+        // the lanes only accumulate into buffer_, the output is read from
+        // it here: nothing is added to a sample of buffer_ once it is due.
+
+        void lanes_end(piw::cfilterenv_t *env, unsigned bs)
+        {
+            const float *b = buffer_+base_;
 
-            const float *audio_in=0;
-            if(env->cfilterenv_nextsig(IN_VOL,d,t))
+            if(audio_in_)
             {
-                audio_in = d.as_array();
-                current_volume_ = d.as_renorm(0,1,0);
+                for(unsigned i=0; i<bs; ++i)
+                {
+                    out_[i] = b[i]*piw::denormalise(1.f,0.f,0.f,audio_in_[i]);
+                }
+            }
+            else
+            {
+                for(unsigned i=0; i<bs; ++i)
+                {
+                    out_[i] = current_volume_*b[i];
+                }
             }
 
+            //pic::logmsg() << "sawtooth output " << o_;
+            *outs_=out_[bs-1];
+            env->cfilterenv_output(OUT_AUDIO,o_);
+
+            o_.clear();
+            vol_.clear();
+            audio_in_=0;
+        }
+
+        void lanes_idle(unsigned bs)
+        {
+            memset(buffer_,0,(bs+TABLE_SAMPLES)*sizeof(float));
+            index_=0;
+            base_=0;
+            phase_=0;
+            inc_=0;
+            audio_in_=0;
+        }
+
+        bool cfilterfunc_process(piw::cfilterenv_t *env, unsigned long long from, unsigned long long t,unsigned long sr, unsigned bs)
+        {
+            if(!lanes_begin(env,from,t,sr,bs))
+            {
+                return false;
+            }
+
+            piw::data_nb_t d;
             unsigned sig;
             unsigned samp_from = 0;
             unsigned samp_to = 0;
 
             while(env->cfilterenv_next(sig,d,t))
             {
-                switch(sig)
-                {
-                    case IN_FREQ:
-                        setfreq(d);
-                        inc = current_freq_*current_detune_/sr;
-                        break;
-
-                    case IN_DETUNE:
-                        setdetune(d);
-                        inc = current_freq_*current_detune_/sr;
-                        break;
-
-                    case IN_PARAM:
-                        setparam(d);
-                        break;
-                }
+                lanes_apply(sig,d);
 
                 samp_to = sample_offset(bs,d.time(),from,t);
 
                 if(samp_to>samp_from)
                 {
-                    process(audio_in,out,inc,samp_from,samp_to);
+                    process(audio_in_,out_,inc_,samp_from,samp_to);
                     samp_from = samp_to;
                 }
             }
 
-            process(audio_in,out,inc,samp_from,bs);
+            process(audio_in_,out_,inc_,samp_from,bs);
+
+            *outs_=out_[bs-1];
+            env->cfilterenv_output(OUT_AUDIO,o_);
 
-            //pic::logmsg() << "sawtooth output " << o;
-            *fs=out[bs-1];
-            env->cfilterenv_output(OUT_AUDIO,o);
+            o_.clear();
+            vol_.clear();
+            audio_in_=0;
 
             return true;
         }
@@ -213,12 +272,99 @@ namespace
         float phase_;
         float current_volume_, current_freq_, current_param_, current_detune_;
         bool on_;
+
+        float *out_, *outs_;
+        piw::data_nb_t o_;
+        const float *audio_in_;
+        piw::data_nb_t vol_;
+        float inc_;
+        float sr_;
+        unsigned base_;
+        synth::laneevents_t events_;
+    };
+
+    /*
+     * The phases of SYNTH_LANES oscillators, for a run of samples.  Steps
+     * are put into each lane's buffer as they happen, as process() does,
+     * and the naive waveform is added a sample at a time.
+     */
+
+    struct minbleplanes_t
+    {
+        template <class F> minbleplanes_t(F **lanes, unsigned from, unsigned to): from_(from), to_(to)
+        {
+            for(unsigned l=0; l<SYNTH_LANES; ++l)
+            {
+                v_[l] = lanes[l];
+                naive_[l] = v_[l]->buffer_+v_[l]->base_+TABLE_DELAY;
+            }
+
+            phase_ = synth::gather(v_,&minblep_buffer_t::phase_);
+            inc_ = synth::gather(v_,&minblep_buffer_t::inc_);
+        }
+
+        ~minbleplanes_t()
+        {
+            synth::scatter(phase_,v_,&minblep_buffer_t::phase_);
+
+            for(unsigned l=0; l<SYNTH_LANES; ++l)
+            {
+                v_[l]->index_ = v_[l]->base_+to_;
+            }
+        }
+
+        // the lane's phase and position, for a step() or cusp() at sample i
+        minblep_buffer_t *at(unsigned l, unsigned i)
+        {
+            float p[SYNTH_LANES];
+            phase_.store(p);
+            v_[l]->phase_ = p[l];
+            v_[l]->index_ = v_[l]->base_+i;
+            return v_[l];
+        }
+
+        void add(const synth::lanes_t &naive, unsigned i)
+        {
+            float n[SYNTH_LANES];
+            naive.store(n);
+            naive_[0][i]+=n[0]; naive_[1][i]+=n[1]; naive_[2][i]+=n[2]; naive_[3][i]+=n[3];
+        }
+
+        minblep_buffer_t *v_[SYNTH_LANES];
+        float *naive_[SYNTH_LANES];
+        unsigned from_, to_;
+        synth::lanes_t phase_;
+        synth::lanes_t inc_;
     };
 
     struct sawfunc_t : minblep_buffer_t
     {
         sawfunc_t(): minblep_buffer_t(0.5) {}
 
+        static void lanes_run(sawfunc_t **lanes, unsigned from, unsigned to)
+        {
+            minbleplanes_t m(lanes,from,to);
+            synth::lanes_t one(1.f), half(0.5f);
+
+            for(unsigned i=from; i<to; ++i)
+            {
+                synth::lanemask_t wrap = m.phase_>=one;
+
+                if(unsigned b = wrap.bits())
+                {
+                    m.phase_ = synth::select(wrap,m.phase_-one,m.phase_);
+
+                    for(unsigned l=0; l<SYNTH_LANES; ++l)
+                    {
+                        if(b&(1<<l)) m.at(l,i)->step(lanes[l]->inc_, 0.0, 1.0);
+                    }
+                }
+
+                m.add(half-m.phase_,i);
+                m.phase_ = m.phase_+m.inc_;
+            }
+        }
+
         void process(const float *audio_in,float *out,float inc,unsigned from,unsigned to)
         {
             if(audio_in)
@@ -258,6 +404,51 @@ namespace
     {
         rectfunc_t(): minblep_buffer_t(0.0) { state_ = 0; }
 
+        float threshold() const
+        {
+            return audio_in_ ? piw::denormalise(0.9f,0.1f,0.5f,current_param_) : (current_param_*0.5+1)/4;
+        }
+
+        static void lanes_run(rectfunc_t **lanes, unsigned from, unsigned to)
+        {
+            minbleplanes_t m(lanes,from,to);
+            synth::lanes_t one(1.f), half(0.5f), mhalf(-0.5f);
+            synth::lanes_t p(lanes[0]->threshold(),lanes[1]->threshold(),lanes[2]->threshold(),lanes[3]->threshold());
+            synth::lanemask_t high = synth::lanes_t(lanes[0]->state_,lanes[1]->state_,lanes[2]->state_,lanes[3]->state_)>half;
+            float pl[SYNTH_LANES];
+            p.store(pl);
+
+            for(unsigned i=from; i<to; ++i)
+            {
+                synth::lanemask_t fall = (m.phase_>=p).andnot(high);
+                synth::lanemask_t rise = (m.phase_>=one)&high;
+
+                if(unsigned b = (fall|rise).bits())
+                {
+                    unsigned r = rise.bits();
+                    m.phase_ = synth::select(rise,m.phase_-one,m.phase_);
+
+                    for(unsigned l=0; l<SYNTH_LANES; ++l)
+                    {
+                        if(r&(1<<l)) m.at(l,i)->step(lanes[l]->inc_, 0.0, 1.0);
+                        else if(b&(1<<l)) m.at(l,i)->step(lanes[l]->inc_, pl[l], -1.0);
+                    }
+
+                    high = fall|high.andnot(rise);
+                }
+
+                m.add(synth::select(high,mhalf,half),i);
+                m.phase_ = m.phase_+m.inc_;
+            }
+
+            unsigned h = high.bits();
+
+            for(unsigned l=0; l<SYNTH_LANES; ++l)
+            {
+                lanes[l]->state_ = (h&(1<<l)) ? 1 : 0;
+            }
+        }
+
         void process(const float *audio_in,float *out, float inc, unsigned from, unsigned to)
         {
             if(audio_in)
@@ -330,6 +521,44 @@ namespace
     {
         trifunc_t(): minblep_buffer_t(0.0) { state_ = 0; }
 
+        static void lanes_run(trifunc_t **lanes, unsigned from, unsigned to)
+        {
+            minbleplanes_t m(lanes,from,to);
+            synth::lanes_t one(1.f), two(2.f), half(0.5f), three(1.5f);
+            synth::lanemask_t high = synth::lanes_t(lanes[0]->state_,lanes[1]->state_,lanes[2]->state_,lanes[3]->state_)>half;
+
+            for(unsigned i=from; i<to; ++i)
+            {
+                synth::lanemask_t fall = (m.phase_>=half).andnot(high);
+                synth::lanemask_t rise = (m.phase_>=one)&high;
+
+                if(unsigned b = (fall|rise).bits())
+                {
+                    unsigned r = rise.bits();
+                    m.phase_ = synth::select(rise,m.phase_-one,m.phase_);
+
+                    for(unsigned l=0; l<SYNTH_LANES; ++l)
+                    {
+                        if(r&(1<<l)) m.at(l,i)->cusp(lanes[l]->inc_, 0, 4.0);
+                        else if(b&(1<<l)) m.at(l,i)->cusp(lanes[l]->inc_, 0.5, -4.0);
+                    }
+
+                    high = fall|high.andnot(rise);
+                }
+
+                synth::lanes_t p2 = m.phase_*two;
+                m.add(synth::select(high,three-p2,p2-half),i);
+                m.phase_ = m.phase_+m.inc_;
+            }
+
+            unsigned h = high.bits();
+
+            for(unsigned l=0; l<SYNTH_LANES; ++l)
+            {
+                lanes[l]->state_ = (h&(1<<l)) ? 1 : 0;
+            }
+        }
+
         void process(const float *audio_in,float *out, float inc,unsigned from, unsigned to)
         {
             if(audio_in)
@@ -409,12 +638,17 @@ namespace synth
 {
     struct sawtooth_t::impl_t: piw::cfilterctl_t, piw::cfilter_t
     {
-        impl_t(const piw::cookie_t &o, piw::clockdomain_ctl_t *d) : cfilter_t(this,o,d) {}
+        impl_t(const piw::cookie_t &o, piw::clockdomain_ctl_t *d) : cfilter_t(this,o,d), batch_(new sawfunc_t) {}
         piw::cfilterfunc_t *cfilterctl_create(const piw::data_t &) { return new sawfunc_t; }
 
         unsigned long long cfilterctl_thru() { return 0; }
         unsigned long long cfilterctl_inputs() { return IN_MASK; }
         unsigned long long cfilterctl_outputs() { return OUT_MASK; }
+
+        bool cfilterctl_batch() { return true; }
+        void cfilterctl_process(piw::cfiltervoice_t *v, unsigned n, unsigned long long f, unsigned long long t, unsigned long sr, unsigned bs) { batch_.process(v,n,f,t,sr,bs); }
+
+        synth::lanebatch_t<sawfunc_t> batch_;
     };
 
     sawtooth_t::sawtooth_t(const piw::cookie_t &o, piw::clockdomain_ctl_t *d) : impl_(new impl_t(o,d)) {}
@@ -423,12 +657,17 @@ namespace synth
 
     struct rect_t::impl_t: piw::cfilterctl_t, piw::cfilter_t
     {
-        impl_t(const piw::cookie_t &o, piw::clockdomain_ctl_t *d) : cfilter_t(this,o,d) {}
+        impl_t(const piw::cookie_t &o, piw::clockdomain_ctl_t *d) : cfilter_t(this,o,d), batch_(new rectfunc_t) {}
         piw::cfilterfunc_t *cfilterctl_create(const piw::data_t &) { return new rectfunc_t; }
 
         unsigned long long cfilterctl_thru() { return 0; }
         unsigned long long cfilterctl_inputs() { return IN_MASK; }
         unsigned long long cfilterctl_outputs() { return OUT_MASK; }
+
+        bool cfilterctl_batch() { return true; }
+        void cfilterctl_process(piw::cfiltervoice_t *v, unsigned n, unsigned long long f, unsigned long long t, unsigned long sr, unsigned bs) { batch_.process(v,n,f,t,sr,bs); }
+
+        synth::lanebatch_t<rectfunc_t> batch_;
     };
 
     rect_t::rect_t(const piw::cookie_t &o, piw::clockdomain_ctl_t *d) : impl_(new impl_t(o,d)) {}
@@ -437,12 +676,17 @@ namespace synth
 
     struct triangle_t::impl_t: piw::cfilterctl_t, piw::cfilter_t
     {
-        impl_t(const piw::cookie_t &o, piw::clockdomain_ctl_t *d) : cfilter_t(this,o,d) {}
+        impl_t(const piw::cookie_t &o, piw::clockdomain_ctl_t *d) : cfilter_t(this,o,d), batch_(new trifunc_t) {}
         piw::cfilterfunc_t *cfilterctl_create(const piw::data_t &) { return new trifunc_t; }
 
         unsigned long long cfilterctl_thru() { return 0; }
         unsigned long long cfilterctl_inputs() { return IN_MASK; }
         unsigned long long cfilterctl_outputs() { return OUT_MASK; }
+
+        bool cfilterctl_batch() { return true; }
+        void cfilterctl_process(piw::cfiltervoice_t *v, unsigned n, unsigned long long f, unsigned long long t, unsigned long sr, unsigned bs) { batch_.process(v,n,f,t,sr,bs); }
+
+        synth::lanebatch_t<trifunc_t> batch_;
     };
 
     triangle_t::triangle_t(const piw::cookie_t &o, piw::clockdomain_ctl_t *d) : impl_(new impl_t(o,d)) {}
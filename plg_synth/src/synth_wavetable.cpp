@@ -24,6 +24,7 @@
 
 #include "synth.h"
 #include "synth_sinetable.h"
+#include "synth_lanes.h"
 
 #include <math.h>
 
@@ -42,7 +43,7 @@ namespace
 {
     struct wavetable_t: piw::cfilterfunc_t
     {
-        wavetable_t(const float *samples, unsigned size): samples_(samples), size_(size), count_(0.0),current_volume_(DEFAULT_VOLUME),current_freq_(DEFAULT_FREQ),current_detune_(powf(2.0,DEFAULT_DETUNE/1200.0)), on_(false)
+        wavetable_t(const float *samples, unsigned size): samples_(samples), size_(size), count_(0.0),current_volume_(DEFAULT_VOLUME),current_freq_(DEFAULT_FREQ),current_detune_(powf(2.0,DEFAULT_DETUNE/1200.0)), on_(false), out_(0), outs_(0), audio_in_(0), inc_(0), sr_(48000)
         {
         }
 
@@ -55,62 +56,154 @@ namespace
             return false;
         }
 
-        bool cfilterfunc_process(piw::cfilterenv_t *env, unsigned long long from, unsigned long long t,unsigned long sr, unsigned bs)
+        bool lanes_begin(piw::cfilterenv_t *env, unsigned long long from, unsigned long long t,unsigned long sr, unsigned bs)
         {
             if(!on_)
             {
                 return false;
             }
 
-            float *out, *fs;
-
-            piw::data_nb_t o = piw::makenorm_nb(t,bs,&out,&fs);
+            o_ = piw::makenorm_nb(t,bs,&out_,&outs_);
 
             //float sr = (float)env->cfilterenv_clock()->get_sample_rate();
-            float inc = size_*current_freq_*current_detune_/sr;
+            sr_ = sr;
+            inc_ = size_*current_freq_*current_detune_/sr_;
 
-            piw::data_nb_t d;
+            audio_in_=0;
+            if(env->cfilterenv_nextsig(IN_VOL,vol_,t))
+            {
+                audio_in_ = vol_.as_array();
+                current_volume_ = vol_.as_renorm(0,1,0);
+            }
+
+            return true;
+        }
+
+        void lanes_apply(unsigned sig, const piw::data_nb_t &d)
+        {
+            switch(sig)
+            {
+                case IN_FREQ:
+                    setfreq(d);
+                    inc_ = size_*current_freq_*current_detune_/sr_;
+                    break;
+
+                case IN_DETUNE:
+                    setdetune(d);
+                    inc_ = size_*current_freq_*current_detune_/sr_;
+                    break;
+            }
+        }
 
-            const float *audio_in=0;
-            if(env->cfilterenv_nextsig(IN_VOL,d,t))
+        void lanes_end(piw::cfilterenv_t *env, unsigned bs)
+        {
+            *outs_=out_[bs-1];
+            //pic::logmsg() << "sine output " << o_ << ' ' << *outs_ << ' ' << current_freq_ << ' ' << inc_ << ' ' << sr_ << ' ' << current_detune_ << ' ' << current_volume_;
+            env->cfilterenv_output(OUT_AUDIO,o_);
+
+            o_.clear();
+            vol_.clear();
+            audio_in_=0;
+        }
+
+        void lanes_idle(unsigned bs)
+        {
+            o_ = piw::makenorm_nb(0,bs,&out_,&outs_);
+            audio_in_=0;
+            current_volume_=0;
+            count_=0;
+            inc_=0;
+        }
+
+        // the oscillator of each lane, with the table lookups done lane by lane
+        static void lanes_run(wavetable_t **lanes, unsigned from, unsigned to)
+        {
+            const float *samples = lanes[0]->samples_;
+            unsigned size = lanes[0]->size_;
+            const float *vol[SYNTH_LANES];
+            float *out[SYNTH_LANES];
+            float volume[SYNTH_LANES];
+            float usevol[SYNTH_LANES];
+
+            for(unsigned l=0; l<SYNTH_LANES; ++l)
             {
-                audio_in = d.as_array();
-                current_volume_ = d.as_renorm(0,1,0);
+                out[l] = lanes[l]->out_;
+                vol[l] = lanes[l]->audio_in_ ? lanes[l]->audio_in_ : lanes[l]->out_;
+                volume[l] = lanes[l]->current_volume_;
+                usevol[l] = lanes[l]->audio_in_ ? 1.f : 0.f;
             }
 
+            synth::lanemask_t varying = synth::lanes_t::load(usevol)>synth::lanes_t(0.5f);
+            synth::lanes_t constant = synth::lanes_t::load(volume);
+            synth::lanes_t count = synth::gather(lanes,&wavetable_t::count_);
+            synth::lanes_t inc = synth::gather(lanes,&wavetable_t::inc_);
+            synth::lanes_t fsize((float)size);
+            unsigned i = from;
+
+            for(; i+4<=to; i+=4)
+            {
+                synth::lanes_t v[4];
+                synth::gather4(vol,i,v);
+
+                for(unsigned k=0; k<4; ++k)
+                {
+                    v[k] = lanes_sample(samples,size,count,fsize)*synth::select(varying,v[k],constant);
+                    count = count+inc;
+                }
+
+                synth::scatter4(v,out,i);
+            }
+
+            for(; i<to; ++i)
+            {
+                synth::lanes_t v = lanes_sample(samples,size,count,fsize)*synth::select(varying,synth::gather(vol,i),constant);
+                synth::scatter(v,out,i);
+                count = count+inc;
+            }
+
+            synth::scatter(count,lanes,&wavetable_t::count_);
+        }
+
+        static synth::lanes_t lanes_sample(const float *samples, unsigned size, synth::lanes_t &count, const synth::lanes_t &fsize)
+        {
+            count = synth::select(count>=fsize,count-fsize,count);
+
+            int ix[SYNTH_LANES];
+            synth::lanes_t frac = count-synth::truncate(count,ix);
+            synth::lanes_t y0(samples[ix[0]],samples[ix[1]],samples[ix[2]],samples[ix[3]]);
+            synth::lanes_t y1(samples[(ix[0]+1)%size],samples[(ix[1]+1)%size],samples[(ix[2]+1)%size],samples[(ix[3]+1)%size]);
+
+            return y0+(frac*(y1-y0));
+        }
+
+        bool cfilterfunc_process(piw::cfilterenv_t *env, unsigned long long from, unsigned long long t,unsigned long sr, unsigned bs)
+        {
+            if(!lanes_begin(env,from,t,sr,bs))
+            {
+                return false;
+            }
+
+            piw::data_nb_t d;
             unsigned sig;
             unsigned samp_from = 0;
             unsigned samp_to = 0;
 
             while(env->cfilterenv_next(sig,d,t))
             {
-                switch(sig)
-                {
-                    case IN_FREQ:
-                        setfreq(d);
-                        inc = size_*current_freq_*current_detune_/sr;
-                        break;
-
-                    case IN_DETUNE:
-                        setdetune(d);
-                        inc = size_*current_freq_*current_detune_/sr;
-                        break;
-                }
+                lanes_apply(sig,d);
 
                 samp_to = sample_offset(bs,d.time(),from,t);
 
                 if(samp_to>samp_from)
                 {
-                    process(audio_in,out,inc,samp_from,samp_to);
+                    process(audio_in_,out_,inc_,samp_from,samp_to);
                     samp_from = samp_to;
                 }
             }
 
-            process(audio_in,out,inc,samp_from,bs);
+            process(audio_in_,out_,inc_,samp_from,bs);
 
-            *fs=out[bs-1];
-            //pic::logmsg() << "sine output " << o << ' ' << *fs << ' ' << current_freq_ << ' ' << inc << ' ' << sr << ' ' << current_detune_ << ' ' << current_volume_;
-            env->cfilterenv_output(OUT_AUDIO,o);
+            lanes_end(env,bs);
 
             return true;
         }
@@ -175,6 +268,14 @@ namespace
         float current_volume_, current_freq_, current_detune_;
         piw::data_nb_t last_volume_;
         bool on_;
+
+        float *out_, *outs_;
+        piw::data_nb_t o_;
+        const float *audio_in_;
+        piw::data_nb_t vol_;
+        float inc_;
+        float sr_;
+        synth::laneevents_t events_;
     };
 }
 
@@ -183,12 +284,17 @@ namespace synth
 {
     struct sine_t::impl_t : piw::cfilterctl_t, piw::cfilter_t
     {
-        impl_t(const piw::cookie_t &o, piw::clockdomain_ctl_t *d) : cfilter_t(this,o,d) {}
+        impl_t(const piw::cookie_t &o, piw::clockdomain_ctl_t *d) : cfilter_t(this,o,d), batch_(new wavetable_t(sine_table, sine_table_size)) {}
         piw::cfilterfunc_t *cfilterctl_create(const piw::data_t &) { return new wavetable_t(sine_table, sine_table_size); }
 
         unsigned long long cfilterctl_thru() { return 0; }
         unsigned long long cfilterctl_inputs() { return IN_MASK; }
         unsigned long long cfilterctl_outputs() { return OUT_MASK; }
+
+        bool cfilterctl_batch() { return true; }
+        void cfilterctl_process(piw::cfiltervoice_t *v, unsigned n, unsigned long long f, unsigned long long t, unsigned long sr, unsigned bs) { batch_.process(v,n,f,t,sr,bs); }
+
+        synth::lanebatch_t<wavetable_t> batch_;
     };
 
     sine_t::sine_t(const piw::cookie_t &o, piw::clockdomain_ctl_t *d) : impl_(new impl_t(o,d)) {}